@@ -247,6 +247,22 @@ protected:
 	*/
 	void CommandError(const PString & msg);
 
+	/** Keeps a listing that is sent in several parts together: while it exists,
+		status events for this client from other threads are held back
+		and sent when the listing is complete.
+	*/
+	class Listing {
+	public:
+		Listing(StatusClient * client) : m_client(client) { m_client->BeginListing(); }
+		~Listing() { m_client->EndListing(); }
+
+	private:
+		StatusClient * m_client;
+	};
+
+	void BeginListing();
+	void EndListing();
+
 	// Adds regular expression filter
 	void AddFilter(
 	// filter vector
@@ -319,6 +335,17 @@ protected:
 	// this flag indicates whether filtering is active or not
 	bool m_isFilteringActive;
 	bool m_handlePasswordRule;	// password rule is handled differently in SSHStatusClient subclass
+
+	/// held by the thread that sends a listing, one listing at a time
+	PMutex m_listingMutex;
+	/// for atomic access to m_listing, m_listingThread and m_heldMessages
+	PMutex m_heldMutex;
+	/// true while a listing is being sent
+	bool m_listing;
+	/// thread that sends the listing
+	PThreadIdentifier m_listingThread;
+	/// status events held back until the listing is complete
+	std::list<PString> m_heldMessages;
 };
 
 #ifdef HAS_LIBSSH
@@ -1182,6 +1209,8 @@ void GkStatus::OnStart()
 	m_commands["printcallinfo"] = e_PrintCallInfo;
 	m_commands["pci"] = e_PrintCallInfo;
 	m_commands["maintenancemode"] = e_MaintenanceMode;
+	m_commands["printcachestatistics"] = e_PrintCacheStatistics;
+	m_commands["pcs"] = e_PrintCacheStatistics;
 }
 
 void GkStatus::ReadSocket(IPSocket * clientSocket)
@@ -1223,7 +1252,8 @@ StatusClient::StatusClient(
 	m_traceLevel(MAX_STATUS_TRACE_LEVEL),
 	m_done(false), m_deleted(false),
 	m_isFilteringActive(false),
-	m_handlePasswordRule(true)
+	m_handlePasswordRule(true),
+	m_listing(false)
 {
 	PStringToString filters = GkConfig()->GetAllKeyValues(filteringsec);
 	SetWriteTimeout(10);
@@ -1336,6 +1366,14 @@ bool StatusClient::WriteString(
 	if (m_isFilteringActive && (IsExcludeMessage(msg) || !IsIncludeMessage(msg)))
 	    return false;
 
+	{
+		PWaitAndSignal lock(m_heldMutex);
+		if (m_listing && PThread::GetCurrentThreadId() != m_listingThread) {
+			m_heldMessages.push_back(msg);
+			return true;
+		}
+	}
+
 	if (!WriteData(msg, msg.GetLength()))
 	    while (CanFlush())
 			Flush();
@@ -1473,6 +1511,7 @@ void StatusClient::DoDebug(
 				WriteString("Remove section " + args[2] + "\r\n");
 			}
 		} else if ((args[1] *= "printrm")) {
+			Listing listing(this);
 			SoftPBX::PrintRemoved(this, (args.GetSize() >= 3));
 		} else {
 			WriteString("Unknown debug command!\r\n");
@@ -1625,6 +1664,35 @@ PString StatusClient::GetPassword(const PString & userName) const
 	return userName.IsEmpty() ? "" : Toolkit::Instance()->ReadPassword(authsec, userName, true);
 }
 
+void StatusClient::BeginListing()
+{
+	m_listingMutex.Wait();
+	PWaitAndSignal lock(m_heldMutex);
+	m_listing = true;
+	m_listingThread = PThread::GetCurrentThreadId();
+}
+
+void StatusClient::EndListing()
+{
+	// events arriving meanwhile are held until all have been sent
+	while (true) {
+		std::list<PString> held;
+		{
+			PWaitAndSignal lock(m_heldMutex);
+			if (m_heldMessages.empty()) {
+				m_listing = false;
+				break;
+			}
+			held.swap(m_heldMessages);
+		}
+		for (std::list<PString>::const_iterator i = held.begin(); i != held.end(); ++i)
+			if (!WriteData(*i, i->GetLength()))
+				while (CanFlush())
+					Flush();
+	}
+	m_listingMutex.Signal();
+}
+
 void StatusClient::CommandError(const PString & msg)
 {
 	WriteString(msg + "\r\n");
@@ -1646,7 +1714,8 @@ void StatusClient::ExecCommand(
 	PTRACE(5, "STATUS\tGot command " << cmd << " from client " << Name());
 
 	PStringArray args;
-	switch (m_gkStatus->ParseCommand(cmd, args))
+	const int command = m_gkStatus->ParseCommand(cmd, args);
+	switch (command)
 	{
 	case GkStatus::e_DisconnectIp:
 		// disconnect call on this IP number
@@ -1698,29 +1767,57 @@ void StatusClient::ExecCommand(
 		SoftPBX::DisconnectAll();
 		break;
 	case GkStatus::e_PrintAllRegistrations:
-		// print list of all registered endpoints
-		SoftPBX::PrintAllRegistrations(this);
-		break;
-	case GkStatus::e_PrintAllRegistrationsVerbose:
-		// print list of all registered endpoints verbose
-		SoftPBX::PrintAllRegistrations(this, TRUE);
+	case GkStatus::e_PrintAllRegistrationsVerbose: {
+		// print list of all registered endpoints, optionally filtered
+		Listing listing(this);
+		if (args.GetSize() == 1)
+			SoftPBX::PrintAllRegistrations(this, command == GkStatus::e_PrintAllRegistrationsVerbose);
+		else {
+			StatusListFilter filter;
+			if (filter.Parse(args, 1))
+				SoftPBX::PrintAllRegistrations(this, command == GkStatus::e_PrintAllRegistrationsVerbose, &filter);
+			else
+				CommandError("Syntax Error: " + args[0] + " [alias=PREFIX] [ip=NETWORK] [type=TYPE] [offset=N] [limit=N]");
+		}
 		break;
-	case GkStatus::e_PrintAllCached:
+	}
+	case GkStatus::e_PrintAllCached: {
 		// print list of all cached out-of-zone endpoints
-		SoftPBX::PrintAllCached(this, (args.GetSize() > 1));
+		// any argument that is not a filter turns on verbose output
+		Listing listing(this);
+		if (args.GetSize() == 1 || (args.GetSize() == 2 && args[1].Find('=') == P_MAX_INDEX))
+			SoftPBX::PrintAllCached(this, (args.GetSize() > 1));
+		else {
+			const bool verbose = (args[1].Find('=') == P_MAX_INDEX);
+			StatusListFilter filter;
+			if (filter.Parse(args, verbose ? 2 : 1))
+				SoftPBX::PrintAllCached(this, verbose, &filter);
+			else
+				CommandError("Syntax Error: PrintAllCached [verbose] [alias=PREFIX] [ip=NETWORK] [type=TYPE] [offset=N] [limit=N]");
+		}
 		break;
+	}
 	case GkStatus::e_PrintCurrentCalls:
-		// print list of currently ongoing calls
-		SoftPBX::PrintCurrentCalls(this, FALSE);
-		break;
-	case GkStatus::e_PrintCurrentCallsVerbose:
-		// print list of currently ongoing calls
-		SoftPBX::PrintCurrentCalls(this, TRUE);
+	case GkStatus::e_PrintCurrentCallsVerbose: {
+		// print list of currently ongoing calls, optionally filtered
+		Listing listing(this);
+		if (args.GetSize() == 1)
+			SoftPBX::PrintCurrentCalls(this, command == GkStatus::e_PrintCurrentCallsVerbose);
+		else {
+			StatusListFilter filter;
+			if (filter.Parse(args, 1))
+				SoftPBX::PrintCurrentCalls(this, command == GkStatus::e_PrintCurrentCallsVerbose, &filter);
+			else
+				CommandError("Syntax Error: " + args[0] + " [alias=PREFIX] [ip=NETWORK] [type=TYPE] [state=STATE] [offset=N] [limit=N]");
+		}
 		break;
-	case GkStatus::e_PrintCurrentCallsPorts:
+	}
+	case GkStatus::e_PrintCurrentCallsPorts: {
 		// print list of currently ongoing calls with their dynamic ports
+		Listing listing(this);
 		SoftPBX::PrintCurrentCallsPorts(this);
 		break;
+	}
 	case GkStatus::e_Statistics:
 		SoftPBX::PrintStatistics(this, TRUE);
 		break;
@@ -2176,6 +2273,9 @@ void StatusClient::ExecCommand(
 	case GkStatus::e_PrintCapacityControlRules:
 		SoftPBX::PrintCapacityControlRules(this);
 		break;
+	case GkStatus::e_PrintCacheStatistics:
+		SoftPBX::PrintCacheStatistics(this);
+		break;
 	case GkStatus::e_GetAuthInfo:
 		if (args.GetSize() == 2)
 			WriteString(RasServer::Instance()->GetAuthInfo(args[1]));
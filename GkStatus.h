@@ -169,6 +169,7 @@ public:
 		e_PrintNeighbors,              /// print list of neighbors
 		e_PrintCallInfo,               /// print detailed infor for a call
 		e_MaintenanceMode,             /// switch in or out of maitenance mode
+		e_PrintCacheStatistics,        /// print hit/miss counters of the lookup caches
 		e_numCommands
 		/// Number of different strings
 	};
@@ -297,6 +297,7 @@ void NeighborPingThread::Main()
             if (!m_nb->IsDisabled()) {
                 PTRACE(3, "NB\tPing timeout: Disabling neighbor " << m_nb->GetId());
                 m_nb->SetDisabled(true);
+                SNMP_CACHE(OnNeighborStatus(m_nb));
             }
         }
 
@@ -318,6 +319,7 @@ void NeighborPingThread::Process(RasMsg * ras)
                 if (m_nb->IsDisabled()) {
                     PTRACE(3, "NB\tPing successful: Activating neighbor " << m_nb->GetId());
                     m_nb->SetDisabled(false);
+                    SNMP_CACHE(OnNeighborStatus(m_nb));
                 }
                 m_sync.Signal();
             break;
@@ -1658,6 +1660,7 @@ void NeighborList::OnReload()
 				m_neighbors.erase(iter);
 		}
 	}
+	SNMP_CACHE(OnNeighborsLoaded(m_neighbors));
 }
 
 bool NeighborList::CheckLRQ(RasMsg *ras) const
@@ -33,6 +33,7 @@
 #include "sigmsg.h"
 #include "ProxyChannel.h"
 #include "GkStatus.h"
+#include "metrics.h"
 #include <queue>
 
 #ifdef H323_H450
@@ -119,6 +120,17 @@ const int DEFAULT_NUM_SEQ_PORTS = 500;
 
 // maximum number of handlder threads GnuGk will start (call signaling or RTP)
 const unsigned MAX_HANDLER_NUMBER = 200;
+// interval (ms) to update the load statistics of the proxy handlers
+const long HANDLER_LOAD_UPDATE_INTERVAL = 5000;
+// start another handler when all active handlers are busier than this (percent)
+const unsigned HANDLER_GROW_BUSY = 70;
+// stop assigning sockets to the last handler when the average is below this (percent)
+const unsigned HANDLER_SHRINK_BUSY = 20;
+
+inline PInt64 GetMicroSeconds(const PTime & t)
+{
+	return (PInt64)t.GetTimeInSeconds() * 1000000 + t.GetMicrosecond();
+}
 
 enum RTPSessionTypes { Unknown = 0, Audio, Video, Presentation, Data };
 
@@ -1141,6 +1153,9 @@ private:
 #ifdef HAS_H235_MEDIA
 	PMutex m_cryptoEngineMutex;
 	H235CryptoEngine * m_H235CryptoEngine;
+#ifdef HAS_H235_MEDIA_INPLACE
+	PBYTEArray m_cryptoBuffer;	// output buffer of the crypto engine, reused for every packet
+#endif
 	H235Authenticators * m_auth;
 	bool m_encrypting;
 	BYTE m_plainPayloadType;			// remember in OLC to use in OLCA
@@ -1336,19 +1351,32 @@ protected:
 };
 
 
+// the proxy buffers keep PACKET_BUFFER_HEADROOM bytes in front of the data,
+// so RTP can be sent on multiplexed without copying the packet
+static BYTE * NewPacketBuffer(WORD size)
+{
+	return new BYTE[size + PACKET_BUFFER_HEADROOM] + PACKET_BUFFER_HEADROOM;
+}
+
+static void DeletePacketBuffer(BYTE * buffer)
+{
+	if (buffer)
+		delete [] (buffer - PACKET_BUFFER_HEADROOM);
+}
+
 // class ProxySocket
 ProxySocket::ProxySocket(
 	IPSocket *s,
 	const char *t,
 	WORD buffSize
-	) : USocket(s, t), wbuffer(new BYTE[buffSize]), wbufsize(buffSize), buflen(0),
+	) : USocket(s, t), wbuffer(NewPacketBuffer(buffSize)), wbufsize(buffSize), buflen(0),
 	connected(false), deletable(false), handler(NULL)
 {
 }
 
 ProxySocket::~ProxySocket()
 {
-	delete [] wbuffer;
+	DeletePacketBuffer(wbuffer);
 }
 
 ProxySocket::Result ProxySocket::ReceiveData()
@@ -1717,8 +1745,8 @@ void TCPProxySocket::UnregisterKeepAlive()
 bool TCPProxySocket::SetMinBufSize(WORD len)
 {
 	if (wbufsize < len) {
-		delete [] wbuffer;
-		wbuffer = new BYTE[wbufsize = len];
+		DeletePacketBuffer(wbuffer);
+		wbuffer = NewPacketBuffer(wbufsize = len);
 	}
 	return (wbuffer != NULL);
 }
@@ -2162,6 +2190,7 @@ ProxySocket::Result CallSignalSocket::ReceiveData()
 
 	PTRACE(3, Type() << "\tReceived: " << q931pdu->GetMessageTypeName()
 		<< " CRV=" << q931pdu->GetCallReference() << " from " << GetName());
+	Metrics::Instance()->OnQ931Message(q931pdu->GetMessageType());
 
 	if (q931pdu->HasIE(Q931::UserUserIE)) {
 		uuie = new H225_H323_UserInformation();
@@ -5398,6 +5427,8 @@ void CallSignalSocket::OnSetup(SignalingMsg * msg)
 		PTRACE(3, "GK\tCall " << m_call->GetCallNumber() << " proxy enabled (H.460.17)");
 	}
 #endif
+	SelectHandlerByCall();
+
 #ifdef HAS_H46018
 	// proxy if calling or called use H.460.18
 	if ((m_call->H46019Required() && ((m_call->GetCallingParty() && m_call->GetCallingParty()->GetTraversalRole() != None)
@@ -5640,6 +5671,20 @@ void CallSignalSocket::OnSetup(SignalingMsg * msg)
 }
 
 // used for regular calls
+void CallSignalSocket::SelectHandlerByCall()
+{
+	// only for sockets no handler is reading, yet
+	// moving a socket between running handlers is racy
+	ProxyHandler * handler = GetHandler();
+	if (!m_call || m_isnatsocket || m_maintainConnection || (handler && handler->HasSocket(this)))
+		return;
+	ProxyHandler * callHandler = RasServer::Instance()->GetSigProxyHandler(m_call->GetCallIdentifier());
+	if (callHandler && callHandler != handler) {
+		PTRACE(5, Type() << "\tCall " << m_call->GetCallNumber() << " uses handler " << callHandler->GetName());
+		SetHandler(callHandler);
+	}
+}
+
 bool CallSignalSocket::CreateRemote(H225_Setup_UUIE & setupBody)
 {
 	if (!m_call->GetDestSignalAddr(peerAddr, peerPort)) {
@@ -10306,12 +10351,16 @@ void H46019Session::Send(DWORD sendMultiplexID, const IPAndPortAddress & toAddre
 	if (sendMultiplexID != INVALID_MULTIPLEX_ID) {
 		lenToSend += 4;
 		BYTE * multiplexMsg = NULL;
+		BYTE stackBuffer[DEFAULT_PACKET_BUFFER_SIZE + 4];
 		// prepend multiplexID
 		if (bufferHasRoomForID) {
-			// this data came multiplexed, and we can write the ID in place of the old ID (_in front of_ the buffer)
+			// this data came multiplexed or from a proxy buffer, and we can write the ID _in front of_ the buffer
 			multiplexMsg = (BYTE*)data - 4;
+		} else if (lenToSend <= sizeof(stackBuffer)) {
+			// eg. RTP from a H.460.26 frame, copy the data behind the ID
+			multiplexMsg = stackBuffer;
+			memcpy(multiplexMsg+4, data, len);
 		} else {
-			// this data came non multiplexed, we must allocate a buffer and copy the data
 			multiplexMsg = (BYTE*)malloc(len+4);
 			memcpy(multiplexMsg+4, data, len);
 		}
@@ -10319,7 +10368,7 @@ void H46019Session::Send(DWORD sendMultiplexID, const IPAndPortAddress & toAddre
 		*((PUInt32b*)multiplexMsg) = networkID;	// set multiplexID
 
 		sent = UDPSendWithSourceIP(osSocket, multiplexMsg, lenToSend, toAddress);
-		if (!bufferHasRoomForID)
+		if (multiplexMsg != stackBuffer && !bufferHasRoomForID)
 			free(multiplexMsg);
 	} else {
 		sent = UDPSendWithSourceIP(osSocket, data, lenToSend, toAddress);
@@ -10386,6 +10435,8 @@ void MultiplexedRTPReader::ReadSocket(IPSocket * socket)
 MultiplexedRTPHandler::MultiplexedRTPHandler() : Singleton<MultiplexedRTPHandler>("MultiplexedRTPHandler")
 {
 	m_idCounter = 0;
+	for (unsigned i = 0; i < MULTIPLEX_ID_TABLE_SIZE; ++i)
+		m_multiplexIDTable[i] = NULL;
     m_deleteDelay = WAIT_DELETE_AFTER_DISCONNECT; // wait 30 sec. before really deleting a deleted session
     m_inactivityCheck = GkConfig()->GetBoolean(ProxySection, "RTPInactivityCheck", false);
     m_inactivityTimeout = GkConfig()->GetInteger(ProxySection, "RTPInactivityTimeout", 300);    // 300 sec = 5 min
@@ -10415,27 +10466,99 @@ MultiplexedRTPHandler::~MultiplexedRTPHandler()
     // TODO: delete remaining sessions in list ?
 }
 
+// make the channel data visible to other CPUs before the lock free lookup can find it
+static inline void MultiplexPublishBarrier()
+{
+#if defined(__GNUC__)
+	__sync_synchronize();
+#elif defined(_WIN32)
+	MemoryBarrier();
+#endif
+}
+
+void MultiplexedRTPHandler::PublishMultiplexID(DWORD id, H46019Session * session)
+{
+	if (id == INVALID_MULTIPLEX_ID)
+		return;
+	H46019Session * volatile & slot = m_multiplexIDTable[id & (MULTIPLEX_ID_TABLE_SIZE - 1)];
+	// on a collision the ID is only found through m_multiplexIDIndex
+	if (slot == NULL) {
+		MultiplexPublishBarrier();
+		slot = session;
+	}
+}
+
+void MultiplexedRTPHandler::RetractMultiplexID(DWORD id, H46019Session * session)
+{
+	if (id == INVALID_MULTIPLEX_ID)
+		return;
+	H46019Session * volatile & slot = m_multiplexIDTable[id & (MULTIPLEX_ID_TABLE_SIZE - 1)];
+	if (slot == session)
+		slot = NULL;
+}
+
+void MultiplexedRTPHandler::IndexChannel(ChannelIterator iter)
+{
+	if (iter->m_multiplexID_fromA != INVALID_MULTIPLEX_ID)
+		m_multiplexIDIndex[iter->m_multiplexID_fromA] = iter;
+	if (iter->m_multiplexID_fromB != INVALID_MULTIPLEX_ID)
+		m_multiplexIDIndex[iter->m_multiplexID_fromB] = iter;
+	if (!iter->m_deleted) {
+		m_sessionIndex.insert(SessionIndex::value_type(std::make_pair(iter->m_callno, iter->m_session), iter));
+		PublishMultiplexID(iter->m_multiplexID_fromA, &*iter);
+		PublishMultiplexID(iter->m_multiplexID_fromB, &*iter);
+	}
+}
+
+void MultiplexedRTPHandler::UnindexChannel(ChannelIterator iter, bool keepMultiplexIDs)
+{
+	RetractMultiplexID(iter->m_multiplexID_fromA, &*iter);
+	RetractMultiplexID(iter->m_multiplexID_fromB, &*iter);
+	std::pair<SessionIndex::iterator, SessionIndex::iterator> range = m_sessionIndex.equal_range(std::make_pair(iter->m_callno, iter->m_session));
+	for (SessionIndex::iterator i = range.first; i != range.second; ++i) {
+		if (i->second == iter) {
+			m_sessionIndex.erase(i);
+			break;
+		}
+	}
+	if (keepMultiplexIDs)
+		return;
+	const DWORD ids[2] = { iter->m_multiplexID_fromA, iter->m_multiplexID_fromB };
+	for (int i = 0; i < 2; ++i) {
+		std::map<DWORD, ChannelIterator>::iterator idIter = m_multiplexIDIndex.find(ids[i]);
+		if (idIter != m_multiplexIDIndex.end() && idIter->second == iter)
+			m_multiplexIDIndex.erase(idIter);
+	}
+}
+
+MultiplexedRTPHandler::SessionIndex::const_iterator MultiplexedRTPHandler::FindSession(PINDEX callno, WORD session) const
+{
+	return m_sessionIndex.find(std::make_pair(callno, session));
+}
+
 void MultiplexedRTPHandler::AddChannel(const H46019Session & chan)
 {
 	WriteLock lock(m_listLock);
 	if (chan.IsValid()) {
-		bool found = false;
 		// update if we have a channel for this session
-		for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-				iter != m_h46019channels.end() ; ++iter) {
-			if (   (iter->m_callno == chan.m_callno)
-				&& (iter->m_session == chan.m_session)) {
-				if (iter->m_openedBy == chan.m_openedBy) {
-					*iter = chan;
+		std::pair<SessionIndex::iterator, SessionIndex::iterator> range = m_sessionIndex.equal_range(std::make_pair(chan.m_callno, chan.m_session));
+		if (range.first != range.second) {
+			std::vector<ChannelIterator> matches;
+			for (SessionIndex::iterator i = range.first; i != range.second; ++i)
+				matches.push_back(i->second);
+			for (std::vector<ChannelIterator>::iterator iter = matches.begin(); iter != matches.end(); ++iter) {
+				UnindexChannel(*iter);
+				if ((*iter)->m_openedBy == chan.m_openedBy) {
+					**iter = chan;
 				} else {
-					*iter = chan.SwapSides();
+					**iter = chan.SwapSides();
 				}
-				found = true;
+				IndexChannel(*iter);
 			}
+		} else {
+			// else add
+			IndexChannel(m_h46019channels.insert(m_h46019channels.end(), chan));
 		}
-		// else add
-		if (!found)
-			m_h46019channels.push_back(chan);
 	} else {
 		PTRACE(1, "H46019\tError: Adding invalid H460.19 channel");
 	}
@@ -10445,21 +10568,19 @@ void MultiplexedRTPHandler::AddChannel(const H46019Session & chan)
 void MultiplexedRTPHandler::UpdateChannelSession(PINDEX callno, WORD flcn, void * openedBy, WORD session)
 {
 	WriteLock lock(m_listLock);
-	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-        if (!iter->m_deleted) {
-            if (   (iter->m_callno == callno)
-                && (iter->m_session == session) ) {
-                return;	// session already in list - all is well
-            }
-            if (   (iter->m_callno == callno)
-                && (iter->m_flcn == flcn)
-                && (iter->m_openedBy == openedBy) ) {
-                    iter->m_session = session;
-                    iter->m_flcn = 0;	// reset
-                DumpChannels(" UpdateChannelSession() done ");
-                return;
-            }
+	if (FindSession(callno, session) != m_sessionIndex.end())
+		return;	// session already in list - all is well
+	for (ChannelIterator iter = m_h46019channels.begin(); iter != m_h46019channels.end() ; ++iter) {
+		if (!iter->m_deleted
+			&& (iter->m_callno == callno)
+			&& (iter->m_flcn == flcn)
+			&& (iter->m_openedBy == openedBy) ) {
+			UnindexChannel(iter);
+			iter->m_session = session;
+			iter->m_flcn = 0;	// reset
+			IndexChannel(iter);
+			DumpChannels(" UpdateChannelSession() done ");
+			return;
 		}
 	}
 	PTRACE(1, "H46019\tError: Updating master assigned RTP session failed: flcn=" << flcn << " openedBy=" << openedBy);
@@ -10468,37 +10589,30 @@ void MultiplexedRTPHandler::UpdateChannelSession(PINDEX callno, WORD flcn, void
 void MultiplexedRTPHandler::UpdateChannel(const H46019Session & chan)
 {
 	WriteLock lock(m_listLock);
-	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-        if (!iter->m_deleted) {
-            if (   (iter->m_callno == chan.m_callno)
-                && (iter->m_session == chan.m_session)) {
-                if (iter->m_openedBy == chan.m_openedBy) {
-                    *iter = chan;
-                } else {
-                    *iter = chan.SwapSides();
-                }
-                DumpChannels(" UpdateChannel() done ");
-                return;
-            }
-        }
+	SessionIndex::iterator i = m_sessionIndex.find(std::make_pair(chan.m_callno, chan.m_session));
+	if (i != m_sessionIndex.end()) {
+		ChannelIterator iter = i->second;
+		UnindexChannel(iter);
+		if (iter->m_openedBy == chan.m_openedBy) {
+			*iter = chan;
+		} else {
+			*iter = chan.SwapSides();
+		}
+		IndexChannel(iter);
+		DumpChannels(" UpdateChannel() done ");
 	}
 }
 
 H46019Session MultiplexedRTPHandler::GetChannelSwapped(PINDEX callno, WORD session, void * openedBy) const
 {
 	ReadLock lock(m_listLock);
-	for (list<H46019Session>::const_iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-        if (!iter->m_deleted) {
-            if (iter->m_callno == callno && iter->m_session == session) {
-                if (iter->m_openedBy == openedBy) {
-                    return *iter;
-                } else {
-                    return iter->SwapSides();
-                }
-            }
-        }
+	SessionIndex::const_iterator i = FindSession(callno, session);
+	if (i != m_sessionIndex.end()) {
+		if (i->second->m_openedBy == openedBy) {
+			return *i->second;
+		} else {
+			return i->second->SwapSides();
+		}
 	}
 	return H46019Session(0, 0, NULL);	// not found
 }
@@ -10506,11 +10620,9 @@ H46019Session MultiplexedRTPHandler::GetChannelSwapped(PINDEX callno, WORD sessi
 H46019Session MultiplexedRTPHandler::GetChannel(PINDEX callno, WORD session) const
 {
 	ReadLock lock(m_listLock);
-	for (list<H46019Session>::const_iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-		if (!iter->m_deleted && iter->m_callno == callno && iter->m_session == session) {
-			return *iter;
-		}
+	SessionIndex::const_iterator i = FindSession(callno, session);
+	if (i != m_sessionIndex.end()) {
+		return *i->second;
 	}
 	return H46019Session(0, 0, NULL);	// not found
 }
@@ -10518,15 +10630,12 @@ H46019Session MultiplexedRTPHandler::GetChannel(PINDEX callno, WORD session) con
 void MultiplexedRTPHandler::RemoveChannels(PINDEX callno)
 {
 	WriteLock lock(m_listLock);
-	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; /* nothing */ ) {
-		if (!iter->m_deleted && iter->m_callno == callno) {
-            iter->m_deleted = true; // mark as logically deleted
-            iter->m_deleteTime = time(NULL);
-			//m_h46019channels.erase(iter++);
-		} else {
-			++iter;
-		}
+	SessionIndex::iterator i = m_sessionIndex.lower_bound(std::make_pair(callno, (WORD)0));
+	while (i != m_sessionIndex.end() && i->first.first == callno) {
+		ChannelIterator iter = (i++)->second;
+		UnindexChannel(iter, true);	// keep the multiplex IDs to silently drop late packets
+		iter->m_deleted = true; // mark as logically deleted
+		iter->m_deleteTime = time(NULL);
 	}
 	DumpChannels(" RemoveChannels() done ");
 }
@@ -10535,15 +10644,12 @@ void MultiplexedRTPHandler::RemoveChannels(PINDEX callno)
 void MultiplexedRTPHandler::RemoveChannel(PINDEX callno, RTPLogicalChannel * rtplc)
 {
 	WriteLock lock(m_listLock);
-	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; /* nothing */ ) {
-		if (!iter->m_deleted && iter->m_callno == callno) {
-			if (iter->m_encryptingLC == rtplc)
-				iter->m_encryptingLC = NULL;
-			if (iter->m_decryptingLC == rtplc)
-				iter->m_decryptingLC = NULL;
-		}
-		++iter;
+	for (SessionIndex::iterator i = m_sessionIndex.lower_bound(std::make_pair(callno, (WORD)0));
+			i != m_sessionIndex.end() && i->first.first == callno; ++i) {
+		if (i->second->m_encryptingLC == rtplc)
+			i->second->m_encryptingLC = NULL;
+		if (i->second->m_decryptingLC == rtplc)
+			i->second->m_decryptingLC = NULL;
 	}
 	DumpChannels(" RemoveChannel() done ");
 }
@@ -10563,19 +10669,24 @@ void MultiplexedRTPHandler::DumpChannels(const PString & msg) const
 
 bool MultiplexedRTPHandler::HandlePacket(DWORD receivedMultiplexID, const IPAndPortAddress & fromAddress, void * data, unsigned len, bool isRTCP)
 {
+	// lock free lookup of the channel for the multiplex ID
+	H46019Session * session = m_multiplexIDTable[receivedMultiplexID & (MULTIPLEX_ID_TABLE_SIZE - 1)];
+	if (session && !session->m_deleted
+		&& (session->m_multiplexID_fromA == receivedMultiplexID || session->m_multiplexID_fromB == receivedMultiplexID)) {
+		session->HandlePacket(receivedMultiplexID, fromAddress, data, len, isRTCP);
+		return true;
+	}
+
 	ReadLock lock(m_listLock);
 	// find the matching channel for the multiplex ID and let it handle the packet
-	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-		if ((iter->m_multiplexID_fromA == receivedMultiplexID)
-			|| (iter->m_multiplexID_fromB == receivedMultiplexID)) {
-			if (!iter->m_deleted) {
-                ReadUnlock unlock(m_listLock); // release read lock to avoid possible dead lock
-                //PTRACE(0, "JW " << PThread::Current()->GetThreadId() << " HandlePacket ended READ lock");
-                iter->HandlePacket(receivedMultiplexID, fromAddress, data, len, isRTCP);
-            }
-            return true;
+	std::map<DWORD, ChannelIterator>::const_iterator i = m_multiplexIDIndex.find(receivedMultiplexID);
+	if (i != m_multiplexIDIndex.end()) {
+		ChannelIterator iter = i->second;
+		if (!iter->m_deleted) {
+			ReadUnlock unlock(m_listLock); // release read lock to avoid possible dead lock
+			iter->HandlePacket(receivedMultiplexID, fromAddress, data, len, isRTCP);
 		}
+		return true;
 	}
 	if (!isRTCP) {
         // no warning for RTCP, probably a Polycom RTCP packet with missing multiplex ID
@@ -10589,41 +10700,40 @@ bool MultiplexedRTPHandler::HandlePacket(PINDEX callno, const H46026_UDPFrame &
 {
 	ReadLock lock(m_listLock);
 	// find the matching channel by callID and sessionID
-	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-		if (!iter->m_deleted && (iter->m_callno == callno) && (iter->m_session == data.m_sessionId)) {
-			// found session, now send all RTP packets
-			for (PINDEX i = 0; i < data.m_frame.GetSize(); i++) {
-				PASN_OctetString & bytes = data.m_frame[i];
-				PTRACE(7, "JW found .19 session, send packet, size=" << bytes.GetSize() << " rtp=" << data.m_dataFrame);
-				if (iter->m_multiplexID_toA != INVALID_MULTIPLEX_ID) {
-					if (!data.m_dataFrame) {
-						if (IsSet(iter->m_addrA_RTCP) && (iter->m_osSocketToA_RTCP != INVALID_OSSOCKET)) {
-							PTRACE(7, "JW send mux packet to " << iter->m_addrA_RTCP << " osSocket=" << iter->m_osSocketToA_RTCP);
-							iter->Send(iter->m_multiplexID_toA, iter->m_addrA_RTCP, iter->m_osSocketToA_RTCP, bytes.GetPointer(), bytes.GetSize(), false);
-						}
-					} else {
-						if (IsSet(iter->m_addrA) && (iter->m_osSocketToA != INVALID_OSSOCKET)) {
-							PTRACE(7, "JW send mux packet to " << iter->m_addrA << " osSocket=" << iter->m_osSocketToA);
-							iter->Send(iter->m_multiplexID_toA, iter->m_addrA, iter->m_osSocketToA, bytes.GetPointer(), bytes.GetSize(), false);
-						}
+	SessionIndex::const_iterator found = FindSession(callno, data.m_sessionId);
+	if (found != m_sessionIndex.end()) {
+		ChannelIterator iter = found->second;
+		// found session, now send all RTP packets
+		for (PINDEX i = 0; i < data.m_frame.GetSize(); i++) {
+			PASN_OctetString & bytes = data.m_frame[i];
+			PTRACE(7, "JW found .19 session, send packet, size=" << bytes.GetSize() << " rtp=" << data.m_dataFrame);
+			if (iter->m_multiplexID_toA != INVALID_MULTIPLEX_ID) {
+				if (!data.m_dataFrame) {
+					if (IsSet(iter->m_addrA_RTCP) && (iter->m_osSocketToA_RTCP != INVALID_OSSOCKET)) {
+						PTRACE(7, "JW send mux packet to " << iter->m_addrA_RTCP << " osSocket=" << iter->m_osSocketToA_RTCP);
+						iter->Send(iter->m_multiplexID_toA, iter->m_addrA_RTCP, iter->m_osSocketToA_RTCP, bytes.GetPointer(), bytes.GetSize(), false);
 					}
-				} else if (iter->m_multiplexID_toB != INVALID_MULTIPLEX_ID) {
-					if (!data.m_dataFrame) {
-						if (IsSet(iter->m_addrB_RTCP) && (iter->m_osSocketToB_RTCP != INVALID_OSSOCKET)) {
-							PTRACE(7, "JW send mux packet to " << iter->m_addrB_RTCP << " osSocket=" << iter->m_osSocketToB_RTCP);
-							iter->Send(iter->m_multiplexID_toB, iter->m_addrB_RTCP, iter->m_osSocketToB_RTCP, bytes.GetPointer(), bytes.GetSize(), false);
-						}
-					} else {
-						if (IsSet(iter->m_addrB) && (iter->m_osSocketToB != INVALID_OSSOCKET)) {
-							PTRACE(7, "JW send mux packet to " << iter->m_addrB << " osSocket=" << iter->m_osSocketToB);
-							iter->Send(iter->m_multiplexID_toB, iter->m_addrB, iter->m_osSocketToB, bytes.GetPointer(), bytes.GetSize(), false);
-						}
+				} else {
+					if (IsSet(iter->m_addrA) && (iter->m_osSocketToA != INVALID_OSSOCKET)) {
+						PTRACE(7, "JW send mux packet to " << iter->m_addrA << " osSocket=" << iter->m_osSocketToA);
+						iter->Send(iter->m_multiplexID_toA, iter->m_addrA, iter->m_osSocketToA, bytes.GetPointer(), bytes.GetSize(), false);
+					}
+				}
+			} else if (iter->m_multiplexID_toB != INVALID_MULTIPLEX_ID) {
+				if (!data.m_dataFrame) {
+					if (IsSet(iter->m_addrB_RTCP) && (iter->m_osSocketToB_RTCP != INVALID_OSSOCKET)) {
+						PTRACE(7, "JW send mux packet to " << iter->m_addrB_RTCP << " osSocket=" << iter->m_osSocketToB_RTCP);
+						iter->Send(iter->m_multiplexID_toB, iter->m_addrB_RTCP, iter->m_osSocketToB_RTCP, bytes.GetPointer(), bytes.GetSize(), false);
+					}
+				} else {
+					if (IsSet(iter->m_addrB) && (iter->m_osSocketToB != INVALID_OSSOCKET)) {
+						PTRACE(7, "JW send mux packet to " << iter->m_addrB << " osSocket=" << iter->m_osSocketToB);
+						iter->Send(iter->m_multiplexID_toB, iter->m_addrB, iter->m_osSocketToB, bytes.GetPointer(), bytes.GetSize(), false);
 					}
 				}
 			}
-			return true;
 		}
+		return true;
 	}
 	return false;
 }
@@ -10632,15 +10742,12 @@ bool MultiplexedRTPHandler::HandlePacket(PINDEX callno, const H46026_UDPFrame &
 DWORD MultiplexedRTPHandler::GetMultiplexID(PINDEX callno, WORD session, void * to)
 {
 	ReadLock lock(m_listLock);
-	for (list<H46019Session>::const_iterator iter = m_h46019channels.begin();
-			iter != m_h46019channels.end() ; ++iter) {
-		if (!iter->m_deleted && iter->m_callno == callno && iter->m_session == session) {
-			if (iter->m_openedBy == to && iter->m_multiplexID_fromA != INVALID_MULTIPLEX_ID) {
-				return iter->m_multiplexID_fromA;
-			}
-			if (iter->m_openedBy != to && iter->m_multiplexID_fromB != INVALID_MULTIPLEX_ID) {
-				return iter->m_multiplexID_fromB;
-			}
+	SessionIndex::const_iterator i = FindSession(callno, session);
+	if (i != m_sessionIndex.end()) {
+		if (i->second->m_openedBy == to) {
+			return i->second->m_multiplexID_fromA;
+		} else {
+			return i->second->m_multiplexID_fromB;
 		}
 	}
 	return INVALID_MULTIPLEX_ID;	// not found
@@ -10683,6 +10790,7 @@ void MultiplexedRTPHandler::SessionCleanup(GkTimer* /* timer */)
 	for (list<H46019Session>::iterator iter = m_h46019channels.begin();
 			iter != m_h46019channels.end() ; /* nothing */ ) {
 		if (iter->m_deleted && (now - iter->m_deleteTime > m_deleteDelay)) {
+			UnindexChannel(iter);
 			m_h46019channels.erase(iter++);
 		} else {
             // inactivity check
@@ -11380,6 +11488,7 @@ ProxySocket::Result UDPProxySocket::ReceiveData()
             //PTRACE(7, "JW RTP IN on " << localport << " meets IP restrictions - accepting");
         } else {
             PTRACE(5, "JW RTP IN on " << localport << " violates IP restrictions: not in " << AsString(m_restrictRTPNetwork_A) << " or " << AsString(m_restrictRTPNetwork_B) << " - ignoring");
+            Metrics::Instance()->OnRTPDropped();
             return NoData;
         }
     }
@@ -11615,6 +11724,7 @@ ProxySocket::Result UDPProxySocket::ReceiveData()
     if (isRTP && (!m_call || (m_call && !(*m_call)))) {
 		if (m_encryptingLC || m_decryptingLC) {
             PTRACE(7, "JW RTP dropping crypto RTP packet (call object already gone)");
+            Metrics::Instance()->OnRTPDropped();
             return NoData;
         }
     }
@@ -11661,8 +11771,10 @@ ProxySocket::Result UDPProxySocket::ReceiveData()
 			PTRACE(3, "H235\tCrypto channel not ready");
 		}
 
-		if (!succesful)
+		if (!succesful) {
+			Metrics::Instance()->OnRTPDropped();
 			return NoData;
+		}
 
 		// update RTP padding bit
 		if (rtpPadding)
@@ -11693,13 +11805,13 @@ ProxySocket::Result UDPProxySocket::ReceiveData()
 	if (IsSet(m_multiplexDestination_A) && (m_multiplexDestination_A != fromAddr)) {
 		if (isRTCP && m_EnableRTCPStats && m_call && (*m_call))
 			ParseRTCP(*m_call, m_sessionID, fromIP, wbuffer, buflen);
-		H46019Session::Send(m_multiplexID_A, m_multiplexDestination_A, m_multiplexSocket_A, wbuffer, buflen);
+		H46019Session::Send(m_multiplexID_A, m_multiplexDestination_A, m_multiplexSocket_A, wbuffer, buflen, true);	// wbuffer has headroom for the ID
 		return NoData;	// already forwarded through multiplex socket
 	}
 	if (IsSet(m_multiplexDestination_B) && (m_multiplexDestination_B != fromAddr)) {
 		if (isRTCP && m_EnableRTCPStats && m_call && (*m_call))
 			ParseRTCP(*m_call, m_sessionID, fromIP, wbuffer, buflen);
-		H46019Session::Send(m_multiplexID_B, m_multiplexDestination_B, m_multiplexSocket_B, wbuffer, buflen);
+		H46019Session::Send(m_multiplexID_B, m_multiplexDestination_B, m_multiplexSocket_B, wbuffer, buflen, true);	// wbuffer has headroom for the ID
 		return NoData;	// already forwarded through multiplex socket
 	}
 
@@ -11742,8 +11854,10 @@ ProxySocket::Result UDPProxySocket::ReceiveData()
 			PTRACE(6, Type() << "\tForward from " << AsString(fromIP, fromPort)
 				<< " blocked, remote socket (" << AsString(fDestIP, fDestPort)
 				<< ") not yet known or ready");
-			if (m_dontQueueRTP)
+			if (m_dontQueueRTP) {
+				Metrics::Instance()->OnRTPDropped();
 				return NoData;
+			}
 		}
         if (rnat && (!m_portDetectionDone || m_legacyPortDetection)) {
             // RTP bleed
@@ -11764,8 +11878,10 @@ ProxySocket::Result UDPProxySocket::ReceiveData()
 			PTRACE(6, Type() << "\tForward from " << AsString(fromIP, fromPort)
 				<< " blocked, remote socket (" << AsString(rDestIP, rDestPort)
 				<< ") not yet known or ready");
-			if (m_dontQueueRTP)
+			if (m_dontQueueRTP) {
+				Metrics::Instance()->OnRTPDropped();
 				return NoData;
+			}
         }
         if (fnat && (!m_portDetectionDone || m_legacyPortDetection)) {
             // RTP bleed
@@ -12522,40 +12638,60 @@ bool RTPLogicalChannel::GenerateNewMediaKey(BYTE newPayloadType, H245_Encryption
 
 bool RTPLogicalChannel::ProcessH235Media(BYTE * buffer, WORD & len, bool encrypt, unsigned char * ivsequence, bool & rtpPadding, BYTE & payloadType)
 {
-	PWaitAndSignal lock(m_cryptoEngineMutex);
-	if (!m_H235CryptoEngine)
+	const unsigned rtpHeaderLen = GetRTPHeaderLength(buffer, len);
+	if (rtpHeaderLen == 0 || rtpHeaderLen >= len) {
+		PTRACE(5, "H235\tRTP packet without payload");
 		return false;
-
-	unsigned rtpHeaderLen = 12;	// TODO: skip more if header has CSRC or extensions
-	PBYTEArray data(buffer+rtpHeaderLen, len-rtpHeaderLen);	// skip RTP header
-	PBYTEArray processed;
+	}
 
 	if (encrypt) {
-		if (payloadType == m_plainPayloadType) {
-			processed = m_H235CryptoEngine->Encrypt(data, ivsequence, rtpPadding);
-		} else {
+		if (payloadType != m_plainPayloadType) {
 			PTRACE(1, "H235\tUnexpected plaintext payload type " << (int)payloadType << " expecting " << (int)m_plainPayloadType);
 			SNMP_TRAP(10, SNMPWarning, Authentication, "H.235.6 payload type mismatch");
+			return false;
 		}
 		payloadType = m_cipherPayloadType;
 	} else {
-		if (payloadType == m_cipherPayloadType) {
-			processed = m_H235CryptoEngine->Decrypt(data, ivsequence, rtpPadding);
-		} else {
+		if (payloadType != m_cipherPayloadType) {
 			PTRACE(1, "H235\tUnexpected chipher payload type " << (int)payloadType << " expecting " << (int)m_cipherPayloadType);
 			SNMP_TRAP(10, SNMPWarning, Authentication, "H.235.6 payload type mismatch");
+			return false;
 		}
 		payloadType = m_plainPayloadType;
 	}
 
+	PWaitAndSignal lock(m_cryptoEngineMutex);
+	if (!m_H235CryptoEngine)
+		return false;
+
+	const BYTE * payload = buffer + rtpHeaderLen;
+	const PINDEX payloadLen = len - rtpHeaderLen;
+#ifdef HAS_H235_MEDIA_INPLACE
+	// leave room for the cipher padding
+	if (m_cryptoBuffer.GetSize() < payloadLen + 64)
+		m_cryptoBuffer.SetSize(payloadLen + 64);
+	PINDEX processedLen = 0;
+	if (encrypt) {
+		processedLen = m_H235CryptoEngine->EncryptInPlace(payload, payloadLen, m_cryptoBuffer.GetPointer(), ivsequence, rtpPadding);
+	} else {
+		processedLen = m_H235CryptoEngine->DecryptInPlace(payload, payloadLen, m_cryptoBuffer.GetPointer(), ivsequence, rtpPadding);
+	}
+	const BYTE * processed = m_cryptoBuffer;
+#else
+	const PBYTEArray data(payload, payloadLen, false);	// refers to the packet buffer, no copy
+	const PBYTEArray processedData = encrypt ? m_H235CryptoEngine->Encrypt(data, ivsequence, rtpPadding)
+		: m_H235CryptoEngine->Decrypt(data, ivsequence, rtpPadding);
+	PINDEX processedLen = processedData.GetSize();
+	const BYTE * processed = processedData;
+#endif
+
 	// check max buffer size
-	len = processed.GetSize() + rtpHeaderLen;
-	if (len > DEFAULT_PACKET_BUFFER_SIZE) {
+	if (processedLen + rtpHeaderLen > DEFAULT_PACKET_BUFFER_SIZE) {
 		PTRACE(1, "H235\tRTP packet too large, truncating");
-		len = DEFAULT_PACKET_BUFFER_SIZE;
-		processed.SetSize(DEFAULT_PACKET_BUFFER_SIZE - rtpHeaderLen);
+		processedLen = DEFAULT_PACKET_BUFFER_SIZE - rtpHeaderLen;
 	}
-	memcpy(buffer + rtpHeaderLen, processed.GetPointer(), processed.GetSize());
+	len = (WORD)(processedLen + rtpHeaderLen);
+	memcpy(buffer + rtpHeaderLen, processed, processedLen);
 #if (H323PLUS_VER > 1252)
 	if (Toolkit::Instance()->IsH235HalfCallMediaKeyUpdatesEnabled()) {
 		// major endpoints seem to ignore the key updates, thus the switch
@@ -12580,7 +12716,7 @@ bool RTPLogicalChannel::ProcessH235Media(BYTE * buffer, WORD & len, bool encrypt
 		}
 	}
 #endif
-	return (processed.GetSize() > 0);
+	return (processedLen > 0);
 }
 #endif // HAS_H235_MEDIA
 
@@ -15045,7 +15181,10 @@ void TLSCallSignalSocket::Dispatch()
 
 // class ProxyHandler
 ProxyHandler::ProxyHandler(const PString & name)
-	: SocketsReader(100), m_socketCleanupTimeout(DEFAULT_SOCKET_CLEANUP_TIMEOUT)
+	: SocketsReader(100), m_socketCleanupTimeout(DEFAULT_SOCKET_CLEANUP_TIMEOUT),
+	m_busyTime(0), m_readCount(0), m_lastBusyTime(0), m_lastReadCount(0),
+	m_busyPercent(0), m_packetsPerSecond(0), m_assigned(0),
+	m_packetsReceived(0), m_bytesReceived(0)
 {
 	SetName(name);
 #ifdef HAS_H46017
@@ -15170,8 +15309,44 @@ bool ProxyHandler::BuildSelectList(SocketSelectList & slist)
 	return slist.GetSize() > 0;
 }
 
-// handle a new message on an existing connection
+void ProxyHandler::UpdateLoad(const PTime & now)
+{
+	const PInt64 elapsed = (now - m_lastLoadUpdate).GetMilliSeconds();
+	if (elapsed <= 0)
+		return;
+	// unsigned arithmetic handles the wrap around of the counters
+	const unsigned busyTime = m_busyTime;
+	const unsigned readCount = m_readCount;
+	m_busyPercent = (unsigned)PMIN((PInt64)(busyTime - m_lastBusyTime) / (elapsed * 10), (PInt64)100);
+	m_packetsPerSecond = (unsigned)((PInt64)(readCount - m_lastReadCount) * 1000 / elapsed);
+	m_lastBusyTime = busyTime;
+	m_lastReadCount = readCount;
+	m_lastLoadUpdate = now;
+	m_assigned = 0;
+}
+
+unsigned ProxyHandler::GetLoad() const
+{
+	// 1% of busy time weighs like 10 sockets, sockets assigned since the last
+	// update count twice, because their traffic isn't in the statistics, yet
+	return m_busyPercent * 10 + m_socksize + 2 * m_assigned;
+}
+
 void ProxyHandler::ReadSocket(IPSocket * socket)
+{
+	const PTime start;
+	ProcessSocket(socket);
+	m_busyTime += (unsigned)(GetMicroSeconds(PTime()) - GetMicroSeconds(start));
+	++m_readCount;
+	const PINDEX len = socket->GetLastReadCount();
+	if (len > 0) {
+		++m_packetsReceived;
+		m_bytesReceived += len;
+	}
+}
+
+// handle a new message on an existing connection
+void ProxyHandler::ProcessSocket(IPSocket * socket)
 {
 	ProxySocket * psocket = dynamic_cast<ProxySocket *>(socket);
 	if (psocket == NULL) {
@@ -15506,6 +15681,12 @@ bool ProxyHandler::Detach(TCPProxySocket *socket)
 	return detached;
 }
 
+bool ProxyHandler::HasSocket(IPSocket * socket) const
+{
+	ReadLock lock(m_listmutex);
+	return find(m_sockets.begin(), m_sockets.end(), socket) != m_sockets.end();
+}
+
 void ProxyHandler::DetachSocket(IPSocket *socket)
 {
 	m_listmutex.StartWrite();
@@ -15525,7 +15706,7 @@ void ProxyHandler::DetachSocket(IPSocket *socket)
 
 // class HandlerList
 HandlerList::HandlerList() : m_numSigHandlers(0), m_numRtpHandlers(0),
-	m_currentSigHandler(0), m_currentRtpHandler(0)
+	m_minSigHandlers(0), m_maxSigHandlers(0), m_minRtpHandlers(0), m_maxRtpHandlers(0)
 {
 	LoadConfig();
 }
@@ -15540,23 +15721,104 @@ HandlerList::~HandlerList()
 ProxyHandler * HandlerList::GetSigHandler()
 {
 	PWaitAndSignal lock(m_handlerMutex);
-	// round-robin
-	ProxyHandler* const result = m_sigHandlers[m_currentSigHandler];
-	if (++m_currentSigHandler >= m_numSigHandlers)
-		m_currentSigHandler = 0;
+	UpdateLoad();
+	return SelectHandler(m_sigHandlers, m_numSigHandlers);
+}
+
+ProxyHandler * HandlerList::GetSigHandler(const H225_CallIdentifier & callId)
+{
+	// hash the call identifier, so both call legs, H.245 and T.120 share one thread
+	const PASN_OctetString & guid = callId.m_guid;
+	unsigned hash = 2166136261u;	// FNV-1a
+	for (PINDEX i = 0; i < guid.GetSize(); ++i)
+		hash = (hash ^ guid[i]) * 16777619u;
+	PWaitAndSignal lock(m_handlerMutex);
+	UpdateLoad();
+	// take the less loaded of 2 handlers chosen by the hash
+	ProxyHandler * first = m_sigHandlers[hash % m_numSigHandlers];
+	ProxyHandler * second = m_sigHandlers[(hash / m_numSigHandlers) % m_numSigHandlers];
+	ProxyHandler * result = (second->GetLoad() < first->GetLoad()) ? second : first;
+	result->OnAssigned();
 	return result;
 }
 
 ProxyHandler * HandlerList::GetRtpHandler()
 {
 	PWaitAndSignal lock(m_handlerMutex);
-	// round-robin
-	ProxyHandler* const result = m_rtpHandlers[m_currentRtpHandler];
-	if (++m_currentRtpHandler >= m_numRtpHandlers)
-		m_currentRtpHandler = 0;
+	UpdateLoad();
+	return SelectHandler(m_rtpHandlers, m_numRtpHandlers);
+}
+
+void HandlerList::GetRtpStatistics(PUInt64 & packets, PUInt64 & bytes)
+{
+	packets = bytes = 0;
+	// handlers taken out of service stay in the list, their counters don't get lost
+	PWaitAndSignal lock(m_handlerMutex);
+	for (std::vector<ProxyHandler *>::const_iterator i = m_rtpHandlers.begin(); i != m_rtpHandlers.end(); ++i) {
+		packets += (*i)->GetPacketsReceived();
+		bytes += (*i)->GetBytesReceived();
+	}
+}
+
+ProxyHandler * HandlerList::SelectHandler(const std::vector<ProxyHandler *> & handlers, unsigned num)
+{
+	// assume the handler list is locked
+	ProxyHandler * result = handlers[0];
+	unsigned minLoad = result->GetLoad();
+	for (unsigned i = 1; i < num; ++i) {
+		const unsigned load = handlers[i]->GetLoad();
+		if (load < minLoad) {
+			result = handlers[i];
+			minLoad = load;
+		}
+	}
+	result->OnAssigned();
 	return result;
 }
 
+void HandlerList::UpdateLoad()
+{
+	// assume the handler list is locked
+	const PTime now;
+	if ((now - m_lastLoadUpdate).GetMilliSeconds() < HANDLER_LOAD_UPDATE_INTERVAL)
+		return;
+	m_lastLoadUpdate = now;
+
+	std::vector<ProxyHandler *>::const_iterator i = m_sigHandlers.begin();
+	while (i != m_sigHandlers.end())
+		(*i++)->UpdateLoad(now);
+	i = m_rtpHandlers.begin();
+	while (i != m_rtpHandlers.end())
+		(*i++)->UpdateLoad(now);
+
+	ResizePool(m_sigHandlers, m_numSigHandlers, m_minSigHandlers, m_maxSigHandlers, "ProxyH(%d)");
+	ResizePool(m_rtpHandlers, m_numRtpHandlers, m_minRtpHandlers, m_maxRtpHandlers, "ProxyRTP(%d)");
+}
+
+void HandlerList::ResizePool(std::vector<ProxyHandler *> & handlers, unsigned & num, unsigned minNum, unsigned maxNum, const char * nameFormat)
+{
+	// assume the handler list is locked
+	unsigned minBusy = 100, totalBusy = 0;
+	for (unsigned i = 0; i < num; ++i) {
+		const unsigned busy = handlers[i]->GetBusyPercent();
+		minBusy = PMIN(minBusy, busy);
+		totalBusy += busy;
+	}
+	if (minBusy >= HANDLER_GROW_BUSY && num < maxNum) {
+		// re-use a handler that was taken out of service before
+		if (num == handlers.size()) {
+			handlers.push_back(new ProxyHandler(psprintf(PString(nameFormat), num)));
+			handlers.back()->LoadConfig();
+		}
+		++num;
+		PTRACE(2, "Proxy\tAll handlers at least " << minBusy << "% busy, using " << num << " handlers now");
+	} else if (num > minNum && totalBusy / num < HANDLER_SHRINK_BUSY) {
+		// the last handler gets no new sockets, its calls continue until they end
+		--num;
+		PTRACE(2, "Proxy\tHandlers only " << (totalBusy / (num + 1)) << "% busy, using " << num << " handlers now");
+	}
+}
+
 void HandlerList::LoadConfig()
 {
 	PWaitAndSignal lock(m_handlerMutex);
@@ -15566,31 +15828,34 @@ void HandlerList::LoadConfig()
 	T120PortRange.LoadConfig(ProxySection, "T120PortRange");
 	RTPPortRange.LoadConfig(ProxySection, "RTPPortRange", "1024-65535");
 
-	m_numSigHandlers = GkConfig()->GetInteger(RoutedSec, "CallSignalHandlerNumber", 5); // update gk.cxx when changing default
-	if (m_numSigHandlers < 1)
-		m_numSigHandlers = 1;
-	if (m_numSigHandlers > MAX_HANDLER_NUMBER)
-		m_numSigHandlers = MAX_HANDLER_NUMBER;
-	unsigned hs = m_sigHandlers.size();
-	if (hs <= m_numSigHandlers) {
-		for (unsigned i = hs; i < m_numSigHandlers; ++i)
-			m_sigHandlers.push_back(new ProxyHandler(psprintf(PString("ProxyH(%d)"), i)));
-	} else {
-		m_currentSigHandler = 0;
-	}
-
-	m_numRtpHandlers = GkConfig()->GetInteger(RoutedSec, "RtpHandlerNumber", 1);    // update gk.cxx when changing default
-	if (m_numRtpHandlers < 1)
-		m_numRtpHandlers = 1;
-	if (m_numRtpHandlers > MAX_HANDLER_NUMBER)
-		m_numRtpHandlers = MAX_HANDLER_NUMBER;
-	hs = m_rtpHandlers.size();
-	if (hs <= m_numRtpHandlers) {
-		for (unsigned i = hs; i < m_numRtpHandlers; ++i)
-			m_rtpHandlers.push_back(new ProxyHandler(psprintf(PString("ProxyRTP(%d)"), i)));
-	} else {
-		m_currentRtpHandler = 0;
-	}
+	m_minSigHandlers = GkConfig()->GetInteger(RoutedSec, "CallSignalHandlerNumber", 5); // update gk.cxx when changing default
+	if (m_minSigHandlers < 1)
+		m_minSigHandlers = 1;
+	if (m_minSigHandlers > MAX_HANDLER_NUMBER)
+		m_minSigHandlers = MAX_HANDLER_NUMBER;
+	m_maxSigHandlers = GkConfig()->GetInteger(RoutedSec, "CallSignalHandlerMaxNumber", m_minSigHandlers);
+	if (m_maxSigHandlers < m_minSigHandlers)
+		m_maxSigHandlers = m_minSigHandlers;
+	if (m_maxSigHandlers > MAX_HANDLER_NUMBER)
+		m_maxSigHandlers = MAX_HANDLER_NUMBER;
+	// keep the current pool size if it is still within the limits
+	m_numSigHandlers = PMAX(m_minSigHandlers, PMIN(m_numSigHandlers, m_maxSigHandlers));
+	for (unsigned h = m_sigHandlers.size(); h < m_numSigHandlers; ++h)
+		m_sigHandlers.push_back(new ProxyHandler(psprintf(PString("ProxyH(%d)"), h)));
+
+	m_minRtpHandlers = GkConfig()->GetInteger(RoutedSec, "RtpHandlerNumber", 1);    // update gk.cxx when changing default
+	if (m_minRtpHandlers < 1)
+		m_minRtpHandlers = 1;
+	if (m_minRtpHandlers > MAX_HANDLER_NUMBER)
+		m_minRtpHandlers = MAX_HANDLER_NUMBER;
+	m_maxRtpHandlers = GkConfig()->GetInteger(RoutedSec, "RtpHandlerMaxNumber", m_minRtpHandlers);
+	if (m_maxRtpHandlers < m_minRtpHandlers)
+		m_maxRtpHandlers = m_minRtpHandlers;
+	if (m_maxRtpHandlers > MAX_HANDLER_NUMBER)
+		m_maxRtpHandlers = MAX_HANDLER_NUMBER;
+	m_numRtpHandlers = PMAX(m_minRtpHandlers, PMIN(m_numRtpHandlers, m_maxRtpHandlers));
+	for (unsigned h = m_rtpHandlers.size(); h < m_numRtpHandlers; ++h)
+		m_rtpHandlers.push_back(new ProxyHandler(psprintf(PString("ProxyRTP(%d)"), h)));
 
 	std::vector<ProxyHandler *>::const_iterator i = m_sigHandlers.begin();
 	while (i != m_sigHandlers.end())
@@ -68,6 +68,8 @@ extern const char *TLSSec;
 extern const char *ProxySection;
 
 const WORD DEFAULT_PACKET_BUFFER_SIZE = 2048;
+const WORD PACKET_BUFFER_HEADROOM = 4;	// room in front of a proxy receive buffer to prepend a multiplex ID
+const unsigned MULTIPLEX_ID_TABLE_SIZE = 16384;	// must be a power of 2
 
 void PrintQ931(int, const char *, const char *, const Q931 *, const H225_H323_UserInformation *);
 
@@ -498,6 +500,8 @@ private:
 
 	bool InternalConnectTo();
 	bool ForwardCallConnectTo();
+	// move a new socket to the signaling handler of its call
+	void SelectHandlerByCall();
 
 	/** @return
 	    A string that can be used to identify a calling number.
@@ -753,9 +757,26 @@ public:
 	void SessionCleanup(GkTimer* timer);
 
 protected:
+	typedef list<H46019Session>::iterator ChannelIterator;
+	typedef std::multimap<std::pair<PINDEX, WORD>, ChannelIterator> SessionIndex;
+
+	// maintain the lookup indexes, the caller must hold the write lock
+	void IndexChannel(ChannelIterator iter);
+	void UnindexChannel(ChannelIterator iter, bool keepMultiplexIDs = false);
+	void PublishMultiplexID(DWORD id, H46019Session * session);
+	void RetractMultiplexID(DWORD id, H46019Session * session);
+	SessionIndex::const_iterator FindSession(PINDEX callno, WORD session) const;
+
 	MultiplexedRTPReader * m_reader;
 	mutable PReadWriteMutex m_listLock;
 	list<H46019Session> m_h46019channels;
+	// channels not marked as deleted by call number and session
+	SessionIndex m_sessionIndex;
+	// all channels in the list by the multiplex IDs they receive
+	std::map<DWORD, ChannelIterator> m_multiplexIDIndex;
+	// direct mapped multiplex IDs for the packet path, read without lock;
+	// a channel is retracted when it gets marked as deleted and stays in the list for m_deleteDelay
+	H46019Session * volatile m_multiplexIDTable[MULTIPLEX_ID_TABLE_SIZE];
 	DWORD m_idCounter; // we should make sure this counter is _not_ reset on reload
 	GkTimerManager::GkTimerHandle m_cleanupTimer;
 	int m_deleteDelay;    // how long to wait before deleting a session marked for delete in sec.
@@ -837,6 +858,22 @@ public:
 	void LoadConfig();
 	bool Detach(TCPProxySocket *);
 	void Remove(TCPProxySocket *);
+	bool HasSocket(IPSocket *) const;
+
+	/// update the load statistics, called periodically by the HandlerList
+	void UpdateLoad(const PTime & now);
+	/** @return
+	    Load score to select the handler for new sockets, based on busy time
+	    and number of sockets.
+	*/
+	unsigned GetLoad() const;
+	unsigned GetBusyPercent() const { return m_busyPercent; }
+	unsigned GetPacketsPerSecond() const { return m_packetsPerSecond; }
+	/// a new socket was assigned to this handler
+	void OnAssigned() { ++m_assigned; }
+	/// traffic totals for the metrics
+	PUInt64 GetPacketsReceived() const { return m_packetsReceived; }
+	PUInt64 GetBytesReceived() const { return m_bytesReceived; }
 
 private:
 	// override from class RegularJob
@@ -847,6 +884,7 @@ private:
 	virtual void ReadSocket(IPSocket *);
 	virtual void CleanUp();
 
+	void ProcessSocket(IPSocket *);
 	void AddPairSockets(IPSocket *, IPSocket *);
 	void FlushSockets();
 	void Remove(iterator);
@@ -864,6 +902,18 @@ private:
 	bool m_h46017Enabled;
 #endif
 	bool m_proxyHandlerHighPrio;
+	/// load statistics, the counters are only written by the handler thread
+	volatile unsigned m_busyTime;	// microseconds spent processing sockets
+	volatile unsigned m_readCount;
+	unsigned m_lastBusyTime;
+	unsigned m_lastReadCount;
+	PTime m_lastLoadUpdate;
+	unsigned m_busyPercent;
+	unsigned m_packetsPerSecond;
+	unsigned m_assigned;
+	/// only written by the handler thread, a scrape may see a slightly old value
+	volatile PUInt64 m_packetsReceived;
+	volatile PUInt64 m_bytesReceived;
 };
 
 class HandlerList {
@@ -876,30 +926,45 @@ public:
 	*/
 	ProxyHandler* GetSigHandler();
 
+	/** @return
+	    Signaling proxy thread for all sockets of the given call.
+	*/
+	ProxyHandler* GetSigHandler(const H225_CallIdentifier & callId);
+
 	/** @return
 	    RTP proxy thread to handle a pair of new RTP sockets.
 	*/
 	ProxyHandler* GetRtpHandler();
 
+	/// sum the packets and bytes received by the RTP handlers
+	void GetRtpStatistics(PUInt64 & packets, PUInt64 & bytes);
+
 	void LoadConfig();
 
 private:
 	HandlerList(const HandlerList &);
 	HandlerList& operator=(const HandlerList &);
 
+	/// the least loaded of the first num handlers
+	ProxyHandler* SelectHandler(const std::vector<ProxyHandler *> & handlers, unsigned num);
+	/// update the load statistics and pool sizes if it is time to
+	void UpdateLoad();
+	void ResizePool(std::vector<ProxyHandler *> & handlers, unsigned & num, unsigned minNum, unsigned maxNum, const char * nameFormat);
+
 private:
 	/// signaling/H.245/T.120 proxy handling threads
 	std::vector<ProxyHandler *> m_sigHandlers;
 	/// RTP proxy handling threads
 	std::vector<ProxyHandler *> m_rtpHandlers;
-	/// number of signaling handlers
+	/// number of signaling handlers that get new sockets
 	unsigned m_numSigHandlers;
-	/// number of RTP handlers
+	/// number of RTP handlers that get new sockets
 	unsigned m_numRtpHandlers;
-	/// next available signaling handler
-	unsigned m_currentSigHandler;
-	/// next available RTP handler
-	unsigned m_currentRtpHandler;
+	/// limits for the pool sizes
+	unsigned m_minSigHandlers, m_maxSigHandlers;
+	unsigned m_minRtpHandlers, m_maxRtpHandlers;
+	/// last update of the load statistics
+	PTime m_lastLoadUpdate;
 	/// atomic access to the handler lists
 	PMutex m_handlerMutex;
 };
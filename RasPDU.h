@@ -19,6 +19,7 @@
 #define RASPDU_H "@(#) $Id$"
 
 #include <list>
+#include <vector>
 #include "yasocket.h"
 #include "factory.h"
 #include "rasinfo.h"
@@ -38,6 +39,8 @@ class RasServer;
 class CallSignalSocket;
 
 const unsigned MaxRasTag = H225_RasMessage::e_serviceControlResponse;
+// RAS message abbreviations, indexed by tag, MaxRasTag+1 is for unknown messages
+extern const char *RasName[];
 
 class GatekeeperMessage {
 public:
@@ -68,11 +71,13 @@ public:
 
 class RasListener : public UDPSocket {
 public:
-	RasListener(const Address &, WORD);
+	RasListener(const Address &, WORD, bool reusePort = false);
 	virtual ~RasListener();
 
 	GatekeeperMessage *ReadRas();
 	bool SendRas(H225_RasMessage &, const Address &, WORD, GkH235Authenticators * auth);
+	// send an already encoded RAS message
+	bool WriteRas(const PBYTEArray &, const Address &, WORD);
 
 	WORD GetSignalPort() const { return m_signalPort; }
 	void SetSignalPort(WORD pt) { m_signalPort = pt; }
@@ -100,6 +105,11 @@ protected:
 	bool m_virtualInterface;
 };
 
+// encode a RAS message and find the position of its request sequence number
+bool EncodeRasTemplate(H225_RasMessage & ras, H225_RequestSeqNum & seqNum, PBYTEArray & encoded, PINDEX & seqNumPos);
+// set the request sequence number of a message encoded with EncodeRasTemplate()
+void SetRasTemplateSeqNum(PBYTEArray & encoded, PINDEX seqNumPos, unsigned seqNum);
+
 class RasMsg : public Task {
 public:
 	virtual ~RasMsg() { delete m_msg; }
@@ -244,6 +254,8 @@ public:
 
 protected:
 	bool ValidateSocket(IPSocket *, WORD &);
+	// open the additional RAS listeners for the RAS reader threads
+	void CreateRasShards();
 
 	template <class Listener> bool SetListener(WORD nport, WORD & oport, Listener *& listener, Listener *(GkInterface::*creator)())
 	{
@@ -262,6 +274,7 @@ protected:
 
 	Address m_address;
 	RasListener *m_rasListener;
+	std::vector<RasListener *> m_rasShards;	// more listeners on the RAS port, one per RAS reader thread
 	MulticastListener *m_multicastListener;
 	CallSignalListener *m_callSignalListener;
 	StatusListener *m_statusListener;
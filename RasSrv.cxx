@@ -33,6 +33,8 @@
 #include "gkauth.h"
 #include "gkacct.h"
 #include "gktimer.h"
+#include "metrics.h"
+#include "regsync.h"
 #include "RasSrv.h"
 
 #ifdef HAS_H460
@@ -209,8 +211,11 @@ bool GatekeeperMessage::Reply(GkH235Authenticators * authenticators)
 
 
 // class RasListener
-RasListener::RasListener(const Address & addr, WORD pt) : UDPSocket(0, addr.GetVersion() == 6 ? AF_INET6 : AF_INET), m_ip(addr)
+RasListener::RasListener(const Address & addr, WORD pt, bool reusePort) : UDPSocket(0, addr.GetVersion() == 6 ? AF_INET6 : AF_INET), m_ip(addr)
 {
+#if defined(LARGE_FDSET) && defined(SO_REUSEPORT)
+	SetReusePort(reusePort);
+#endif
 	if (!Listen(addr, 0, pt, PSocket::CanReuseAddress)) {
 		PTRACE(1, "RAS\tCould not open listening socket at " << AsString(addr, pt)
 			<< " - error " << GetErrorCode(PSocket::LastGeneralError) << '/'
@@ -247,6 +252,7 @@ GatekeeperMessage *RasListener::ReadRas()
 	PTRACE(4, "RAS\tReceiving on " << GetName());
 	GatekeeperMessage *msg = new GatekeeperMessage();
 	if (!(msg->Read(this) && Filter(msg))) {
+		Metrics::Instance()->OnRasDropped();
 		delete msg;
 		return NULL;
 	}
@@ -279,10 +285,15 @@ bool RasListener::SendRas(H225_RasMessage & rasobj, const Address & addr, WORD p
 	if (auth != NULL)
 		auth->Finalise(rasobj, wtbuf);
 
-	m_wmutex.Wait();
 	//bool result = WriteTo(wtstrm.GetPointer(), wtstrm.GetSize(), addr, pt);
     // must send PByteArray, with the updated H.235 hash; PPER_Stream doesn't seem to change
-	bool result = WriteTo(wtbuf.GetPointer(), wtbuf.GetSize(), addr, pt);
+	return WriteRas(wtbuf, addr, pt);
+}
+
+bool RasListener::WriteRas(const PBYTEArray & wtbuf, const Address & addr, WORD pt)
+{
+	m_wmutex.Wait();
+	bool result = WriteTo((const BYTE *)wtbuf, wtbuf.GetSize(), addr, pt);
 	m_wmutex.Signal();
 	if (result)
 		PTRACE(5, "RAS\tSent Successful");
@@ -393,9 +404,11 @@ bool MulticastListener::Filter(GatekeeperMessage * msg) const
 void RasMsg::Exec()
 {
 	PTRACE(1, "RAS\t" << m_msg->GetTagName() << " Received from " << AsString(m_msg->m_peerAddr, m_msg->m_peerPort));
+	const PTime start;
 	if (Process()) {
 		Reply(m_authenticators);
 	}
+	Metrics::Instance()->OnRasProcessed(m_msg->GetTag(), (PTime() - start).GetMilliSeconds());
 }
 
 bool RasMsg::IsFrom(const PIPSocket::Address & addr, WORD pt) const
@@ -524,6 +537,8 @@ GkInterface::~GkInterface()
 	// TODO/BUG: without LARGE_FDSET, closing RAS sockets may hang on ConfigReloadMutex
 	if (m_rasListener)
 		m_rasListener->Close();
+	// the RAS reader threads delete their closed sockets
+	ForEachInContainer(m_rasShards, mem_fun(&IPSocket::Close));
 	if (m_multicastListener)
 		m_multicastListener->Close();
 	if (m_callSignalListener)
@@ -549,8 +564,10 @@ bool GkInterface::CreateListeners(RasServer *RasSrv)
 #endif
 	WORD statusPort = (WORD)GkConfig()->GetInteger("StatusPort", GK_DEF_STATUS_PORT);
 
-	if (SetListener(rasPort, m_rasPort, m_rasListener, &GkInterface::CreateRasListener))
+	if (SetListener(rasPort, m_rasPort, m_rasListener, &GkInterface::CreateRasListener)) {
 		m_rasSrv->AddListener(m_rasListener);
+		CreateRasShards();
+	}
 	if (SetListener(multicastPort, m_multicastPort, m_multicastListener, &GkInterface::CreateMulticastListener))
 		m_rasSrv->AddListener(m_multicastListener);
 	if (SetListener(signalPort, m_signalPort, m_callSignalListener, &GkInterface::CreateCallSignalListener))
@@ -572,6 +589,13 @@ bool GkInterface::CreateListeners(RasServer *RasSrv)
 			if (m_tlsCallSignalListener)
 				m_rasListener->SetTLSSignalPort(m_tlsSignalPort);
 #endif
+			for (std::vector<RasListener *>::iterator shard = m_rasShards.begin(); shard != m_rasShards.end(); ++shard) {
+				(*shard)->SetSignalPort(m_signalPort);
+#ifdef HAS_TLS
+				if (m_tlsCallSignalListener)
+					(*shard)->SetTLSSignalPort(m_tlsSignalPort);
+#endif
+			}
 			if (m_multicastListener) {
 				m_multicastListener->SetSignalPort(m_signalPort);
 			}
@@ -614,9 +638,23 @@ bool GkInterface::ValidateSocket(IPSocket *socket, WORD & port)
 	return false;
 }
 
+void GkInterface::CreateRasShards()
+{
+	ForEachInContainer(m_rasShards, mem_fun(&IPSocket::Close));
+	m_rasShards.clear();
+	for (unsigned i = 1; i < m_rasSrv->GetRasReaderCount(); ++i) {
+		WORD port = m_rasPort;
+		RasListener * listener = new RasListener(m_address, m_rasPort, true);
+		if (!ValidateSocket(listener, port))
+			break;
+		m_rasShards.push_back(listener);
+		m_rasSrv->AddListener(listener, i);
+	}
+}
+
 RasListener *GkInterface::CreateRasListener()
 {
-	return new RasListener(m_address, m_rasPort);
+	return new RasListener(m_address, m_rasPort, m_rasSrv->GetRasReaderCount() > 1);
 }
 
 MulticastListener *GkInterface::CreateMulticastListener()
@@ -762,6 +800,148 @@ void RasRequester::AddReply(RasMsg *ras)
 }
 
 
+namespace { // anonymous namespace
+
+// check if a lightweight RRQ was sent from the endpoint that is registered with this endpoint ID
+bool IsLightweightRRQFromEndpoint(const H225_RegistrationRequest & rrq, const endptr & ep, const PIPSocket::Address & rx_addr)
+{
+	if (ep->IsNATed() || ep->IsTraversalClient() || ep->UsesH46017()) {
+		// for nated endpoint, only check rx_addr
+		if (ep->GetNATIP() != rx_addr) {
+			PTRACE(3, "RAS\tLightweight registration rejected, because IP doesn't match");
+			return false;
+		}
+		return true;
+	}
+
+	PIPSocket::Address oaddr, raddr;
+	WORD oport = 0, rport = 0;
+	if (rrq.m_callSignalAddress.GetSize() >= 1) {
+		GetIPAndPortFromTransportAddr(ep->GetCallSignalAddress(), oaddr, oport);
+		for (int s = 0; s < rrq.m_callSignalAddress.GetSize(); ++s) {
+			GetIPAndPortFromTransportAddr(rrq.m_callSignalAddress[s], raddr, rport);
+			if (oaddr == raddr && oport == rport)
+				break;
+		}
+	} else if (rrq.m_rasAddress.GetSize() >= 1) {
+		GetIPAndPortFromTransportAddr(ep->GetRasAddress(), oaddr, oport),
+		GetIPAndPortFromTransportAddr(rrq.m_rasAddress[0], raddr, rport);
+	} else {
+		GetIPAndPortFromTransportAddr(ep->GetCallSignalAddress(), oaddr, oport),
+		raddr = oaddr, rport = oport;
+	}
+	if ((oaddr != raddr) || (oport != rport) || (IsLoopback(rx_addr) ? false : (raddr != rx_addr))) {
+		PTRACE(3, "RAS\tLightweight registration rejected, because IP or ports don't match: old addr=" << AsString(oaddr, oport) << " receive addr=" << AsString(raddr, rport) << " rx_addr=" << rx_addr);
+		return false;
+	}
+	return true;
+}
+
+// the registration data that SNMP and RegistrationSync mirror,
+// to tell them about changes made while processing a RAS message
+class RegistrationSnapshot {
+public:
+	RegistrationSnapshot(const endptr & ep)
+		: m_rasAddress(ep->GetRasAddress()), m_signalAddress(ep->GetCallSignalAddress()),
+		  m_aliasCount(ep->GetAliases().GetSize()) { }
+
+	void NotifyIfChanged(const endptr & ep) const
+	{
+		if (ep->GetRasAddress() != m_rasAddress || ep->GetCallSignalAddress() != m_signalAddress
+			|| ep->GetAliases().GetSize() != m_aliasCount)
+			RegistrationTable::Instance()->OnEndpointChanged(ep.operator->());
+	}
+
+private:
+	H225_TransportAddress m_rasAddress;
+	H225_TransportAddress m_signalAddress;
+	PINDEX m_aliasCount; // aliases are only added or removed without a full RRQ
+};
+
+} // end of anonymous namespace
+
+// Encode a RAS reply and find the position of its request sequence number,
+// so the encoded message can be re-sent later with only the sequence number changed.
+// The sequence number is a constrained INTEGER (1..65535) which PER encodes as
+// 2 aligned octets, we locate them by encoding 2 different values.
+bool EncodeRasTemplate(H225_RasMessage & ras, H225_RequestSeqNum & seqNum, PBYTEArray & encoded, PINDEX & seqNumPos)
+{
+	const unsigned origSeqNum = seqNum;
+	PPER_Stream strm1, strm2;
+	seqNum = 0x1235;
+	ras.Encode(strm1);
+	strm1.CompleteEncoding();
+	seqNum = 0x4322;
+	ras.Encode(strm2);
+	strm2.CompleteEncoding();
+	seqNum = origSeqNum;
+
+	const PINDEX size = strm1.GetSize();
+	if (size < 2 || size != strm2.GetSize())
+		return false;
+	const BYTE * buf1 = strm1;
+	const BYTE * buf2 = strm2;
+	seqNumPos = P_MAX_INDEX;
+	for (PINDEX i = 0; i < size; ++i) {
+		if (buf1[i] != buf2[i]) {
+			if (seqNumPos == P_MAX_INDEX)
+				seqNumPos = i;
+			else if (i > seqNumPos + 1)
+				return false;	// differs in more than the sequence number
+		}
+	}
+	// the encoded value is seqNum - 1
+	if (seqNumPos >= size - 1 || buf1[seqNumPos] != 0x12 || buf1[seqNumPos + 1] != 0x34
+		|| buf2[seqNumPos] != 0x43 || buf2[seqNumPos + 1] != 0x21)
+		return false;
+
+	encoded = PBYTEArray(buf1, size);
+	return true;
+}
+
+void SetRasTemplateSeqNum(PBYTEArray & encoded, PINDEX seqNumPos, unsigned seqNum)
+{
+	BYTE * buf = encoded.GetPointer();
+	buf[seqNumPos] = (BYTE)(((seqNum - 1) >> 8) & 0xff);
+	buf[seqNumPos + 1] = (BYTE)((seqNum - 1) & 0xff);
+}
+
+
+// class RasReader
+// additional reader thread for the RAS listeners sharing the RAS port (SO_REUSEPORT)
+class RasReader : public SocketsReader {
+public:
+	RasReader(RasServer * rasSrv, unsigned id);
+
+	void AddListener(RasListener * socket) { AddSocket(socket); }
+
+private:
+	// override from class SocketsReader
+	virtual bool BuildSelectList(SocketSelectList &);
+	virtual void ReadSocket(IPSocket *);
+
+	RasServer * m_rasSrv;
+};
+
+RasReader::RasReader(RasServer * rasSrv, unsigned id) : m_rasSrv(rasSrv)
+{
+	SetName(PString(PString::Printf, "RasSrv%u", id));
+	Execute();
+}
+
+bool RasReader::BuildSelectList(SocketSelectList & slist)
+{
+	// the listeners are closed by their GkInterface on reload or shutdown
+	RemoveClosed(false);
+	return SocketsReader::BuildSelectList(slist);
+}
+
+void RasReader::ReadSocket(IPSocket * socket)
+{
+	m_rasSrv->ReadRas(static_cast<RasListener *>(socket));
+}
+
+
 // class RasServer
 RasServer::RasServer() : Singleton<RasServer>("RasSrv")
 {
@@ -782,6 +962,9 @@ RasServer::RasServer() : Singleton<RasServer>("RasSrv")
 	altGKsSize = 0;
 	epLimit = callLimit = P_MAX_INDEX;
 	redirectGK = e_noRedirect;
+	m_lightweightRRQFastPath = false;
+	m_configGeneration = 0;
+	m_rasReaderCount = 1;
 }
 
 RasServer::~RasServer()
@@ -1040,6 +1223,8 @@ void RasServer::LoadConfig()
 
 	if (listeners)
 		listeners->LoadConfig();
+	Metrics::Instance()->LoadConfig();
+	RegistrationSync::Instance()->LoadConfig();
 	if (gkClient)
 		gkClient->OnReload();
 	if (neighbors)
@@ -1054,34 +1239,27 @@ void RasServer::LoadConfig()
 	Routing::ExplicitPolicy::OnReload();
 
 	bRemoveCallOnDRQ = Toolkit::AsBool(GkConfig()->GetString(RoutedSec, "RemoveCallOnDRQ", "1"));
+	m_lightweightRRQFastPath = GkConfig()->GetBoolean(RRQFeatureSection, "LightweightRRQFastPath", false);
 
 	// read [ReplyToRasAddress] section
-	m_replyras.clear();
+	m_replyras.Clear();
 	PStringToString ras_rules(GkConfig()->GetAllKeyValues("ReplyToRasAddress"));
 	for (PINDEX i = 0; i < ras_rules.GetSize(); ++i) {
 		PString network = ras_rules.GetKeyAt(i);
 		bool setting = Toolkit::AsBool(ras_rules.GetDataAt(i));
 		if (!network.IsEmpty()) {
 			NetworkAddress addr = NetworkAddress(network);
-			m_replyras[addr] = setting;
+			m_replyras.Insert(addr, setting);
 		}
 	}
+
+	// invalidate all cached RCFs
+	++m_configGeneration;
 }
-bool RasServer::ReplyToRasAddress(const NetworkAddress & ip) const
+bool RasServer::ReplyToRasAddress(const PIPSocket::Address & ip) const
 {
-	NetworkAddress bestmatch;
-	bool result = false;
-
-	std::map<NetworkAddress, bool>::const_iterator iter = m_replyras.begin();
-	while (iter != m_replyras.end()) {
-		if ((ip << iter->first) && (iter->first.GetNetmaskLen() >= bestmatch.GetNetmaskLen())) {
-			bestmatch = iter->first;
-			result = iter->second;
-		}
-		++iter;
-	}
-
-	return result;
+	const bool * result = m_replyras.FindBestMatch(ip);
+	return result ? *result : false;
 }
 
 void RasServer::AddListener(RasListener * socket)
@@ -1089,6 +1267,14 @@ void RasServer::AddListener(RasListener * socket)
 	AddSocket(socket);
 }
 
+void RasServer::AddListener(RasListener * socket, unsigned reader)
+{
+	if (reader > 0 && reader <= m_rasReaders.size())
+		m_rasReaders[reader - 1]->AddListener(socket);
+	else
+		AddSocket(socket);
+}
+
 void RasServer::AddListener(TCPListenSocket * socket)
 {
 	if (socket->IsOpen())
@@ -1357,11 +1543,30 @@ ProxyHandler * RasServer::GetSigProxyHandler()
 	return sigHandler ? sigHandler->GetSigHandler() : NULL;
 }
 
+ProxyHandler * RasServer::GetSigProxyHandler(const H225_CallIdentifier & callId)
+{
+	return sigHandler ? sigHandler->GetSigHandler(callId) : NULL;
+}
+
 ProxyHandler * RasServer::GetRtpProxyHandler()
 {
 	return sigHandler ? sigHandler->GetRtpHandler() : NULL;
 }
 
+bool RasServer::GetRtpStatistics(PUInt64 & packets, PUInt64 & bytes)
+{
+	if (!sigHandler)
+		return false;
+	sigHandler->GetRtpStatistics(packets, bytes);
+	return true;
+}
+
+unsigned RasServer::GetPendingRequests()
+{
+	PWaitAndSignal lock(requests_mutex);
+	return (unsigned)count_if(requests.begin(), requests.end(), not1(mem_fun(&RasMsg::IsDone)));
+}
+
 void RasServer::SelectH235Capability(const H225_GatekeeperRequest & grq, H225_GatekeeperConfirm & gcf) const
 {
 	authList->SelectH235Capability(grq, gcf);
@@ -1436,7 +1641,20 @@ void RasServer::Run()
 	acctList = new GkAcctLoggerList();
 	vqueue = new VirtualQueue();
 
+	// the number of RAS reader threads can't be changed by a reload
+	int rasReaders = GkConfig()->GetInteger("RasListenerThreads", 1);
+#if !defined(LARGE_FDSET) || !defined(SO_REUSEPORT)
+	if (rasReaders > 1) {
+		PTRACE(1, "RAS\tRasListenerThreads needs SO_REUSEPORT and LARGE_FDSET, using 1 thread");
+		rasReaders = 1;
+	}
+#endif
+	m_rasReaderCount = (rasReaders > 1) ? rasReaders : 1;
+	for (unsigned i = 1; i < m_rasReaderCount; ++i)
+		m_rasReaders.push_back(new RasReader(this, i));
+
 	LoadConfig();
+	RegistrationTable::Instance()->LoadSnapshot();
 
 	if ((m_socksize > 0) && (!interfaces.empty())) {
 		acctList->LogAcctEvent(GkAcctLogger::AcctOn, callptr(NULL));
@@ -1464,6 +1682,15 @@ void RasServer::OnStop()
 	if (gkClient->IsRegistered())
 		gkClient->SendURQ();
 
+	// peers remove our endpoints when the connection is closed
+	RegistrationSync::Instance()->Stop();
+
+	// keep the registrations for a warm restart, if the endpoints aren't unregistered
+	if (Toolkit::AsBool(GkConfig()->GetString("Gatekeeper::Main", "DisconnectCallsOnShutdown", "1")))
+		RegistrationTable::Instance()->RemoveSnapshot();
+	else
+		RegistrationTable::Instance()->SaveSnapshot();
+
 	// clear all calls and unregister all endpoints
 	SoftPBX::UnregisterAllEndpoints();
 
@@ -1473,6 +1700,10 @@ void RasServer::OnStop()
 	DeleteObjectsInContainer(interfaces);
 	interfaces.clear();
 
+	// the reader jobs delete themselves when stopped
+	ForEachInContainer(m_rasReaders, mem_vfun(&RasReader::Stop));
+	m_rasReaders.clear();
+
 	listeners->Stop();
 
 	delete sigHandler;
@@ -1523,14 +1754,14 @@ void RasServer::GetAlternateGK()
 
 
 	// read [RasSrv::AlternateGatekeeper] section
-	m_altGkRules.clear();
+	m_altGkRules.Clear();
 	PStringToString altgk_rules(GkConfig()->GetAllKeyValues("RasSrv::AlternateGatekeeper"));
 	for (PINDEX i = 0; i < altgk_rules.GetSize(); ++i) {
 		PString network = altgk_rules.GetKeyAt(i);
 		PString setting = altgk_rules.GetDataAt(i);
 		if (!network.IsEmpty()) {
 			NetworkAddress addr = NetworkAddress(network);
-			m_altGkRules[addr] = ParseAltGKConfig(setting);
+			m_altGkRules.Insert(addr, ParseAltGKConfig(setting));
 		}
 	}
 
@@ -1579,17 +1810,8 @@ H225_ArrayOf_AlternateGK RasServer::ParseAltGKConfig(const PString & altGkSettin
 H225_ArrayOf_AlternateGK RasServer::GetAltGKForIP(const NetworkAddress & ip) const
 {
 	// find alternate gatekeeper rule by IP address
-	H225_ArrayOf_AlternateGK result;
-	NetworkAddress bestmatch;
-	std::map<NetworkAddress, H225_ArrayOf_AlternateGK>::const_iterator iter = m_altGkRules.begin();
-	while (iter != m_altGkRules.end()) {
-		if ((ip << iter->first) && (iter->first.GetNetmaskLen() >= bestmatch.GetNetmaskLen())) {
-			bestmatch = iter->first;
-			result = iter->second;
-		}
-		++iter;
-	}
-	return result;
+	const H225_ArrayOf_AlternateGK * result = m_altGkRules.FindBestMatch(ip.m_address);
+	return result ? *result : H225_ArrayOf_AlternateGK();
 }
 
 void RasServer::ClearAltGKsTable()
@@ -1617,6 +1839,10 @@ void RasServer::HouseKeeping()
                 CallTable::Instance()->CheckRTPInactive();
 			}
 
+			const int snapshotInterval = RegistrationTable::Instance()->GetSnapshotInterval();
+			if (snapshotInterval > 0 && !(count % snapshotInterval))
+				RegistrationTable::Instance()->StartSnapshot();
+
 			CallTable::Instance()->CheckCalls(this);
 
 			gkClient->CheckRegistration();
@@ -1627,12 +1853,70 @@ void RasServer::HouseKeeping()
 
 void RasServer::ReadSocket(IPSocket *socket)
 {
-	RasListener *listener = static_cast<RasListener *>(socket);
+	ReadRas(static_cast<RasListener *>(socket));
+}
+
+void RasServer::ReadRas(RasListener * listener)
+{
 	if (GatekeeperMessage *msg = listener->ReadRas()) {
+		Metrics::Instance()->OnRasMessage(msg->GetTag());
+		if (m_lightweightRRQFastPath && ProcessLightweightRRQ(msg)) {
+			delete msg;
+			return;
+		}
 		CreateRasJob(msg);
 	}
 }
 
+// Answer a lightweight RRQ (keep-alive) directly in the reader thread with the
+// cached RCF of the endpoint. Anything that can't be handled here returns false
+// and takes the normal path through RegistrationRequestPDU.
+bool RasServer::ProcessLightweightRRQ(GatekeeperMessage * msg)
+{
+	if (msg->GetTag() != H225_RasMessage::e_registrationRequest || !msg->m_socket)
+		return false;
+
+	const H225_RegistrationRequest & rrq = msg->m_recvRAS;
+	if (!(rrq.HasOptionalField(H225_RegistrationRequest::e_keepAlive) && rrq.m_keepAlive)
+		|| !rrq.HasOptionalField(H225_RegistrationRequest::e_endpointIdentifier)
+		|| rrq.HasOptionalField(H225_RegistrationRequest::e_additiveRegistration)
+		|| rrq.HasOptionalField(H225_RegistrationRequest::e_featureSet)
+		|| rrq.HasOptionalField(H225_RegistrationRequest::e_genericData)
+		|| rrq.HasOptionalField(H225_RegistrationRequest::e_tokens)
+		|| rrq.HasOptionalField(H225_RegistrationRequest::e_cryptoTokens))
+		return false;
+
+	if (Toolkit::Instance()->IsMaintenanceMode()
+		|| IsForwardedRas(rrq, msg->m_peerAddr)
+		|| ReplyToRasAddress(msg->m_peerAddr))
+		return false;
+
+	// no need to check the RasHandlers here, they never wait for RRQs
+
+	endptr ep = RegistrationTable::Instance()->FindByEndpointId(rrq.m_endpointIdentifier);
+	if (!ep || ep->GetH235Authenticators() != NULL || !IsLightweightRRQFromEndpoint(rrq, ep, msg->m_peerAddr))
+		return false;
+	// a changed rasAddress has to be announced, leave that to the normal path
+	if (!ep->IsNATed() && rrq.m_rasAddress.GetSize() >= 1 && rrq.m_rasAddress[0] != ep->GetRasAddress())
+		return false;
+
+	ep->Update(msg->m_recvRAS);
+
+	PBYTEArray rcf;
+	PINDEX seqNumPos = 0;
+	if (!ep->GetRasTemplate(H225_RasMessage::e_registrationConfirm, rcf, seqNumPos, msg->m_localAddr, m_configGeneration)) {
+		// no RCF cached yet, the normal processing will create one
+		return false;
+	}
+	SetRasTemplateSeqNum(rcf, seqNumPos, rrq.m_requestSeqNum);
+
+	ForwardRasMsg(msg->m_recvRAS);
+
+	PTRACE(2, "RAS\tSend cached RCF to " << AsString(msg->m_peerAddr, msg->m_peerPort));
+	msg->m_socket->WriteRas(rcf, msg->m_peerAddr, msg->m_peerPort);
+	return true;
+}
+
 #ifdef HAS_H46017
 void RasServer::ReadH46017Message(const PBYTEArray & ras, const PIPSocket::Address & fromIP, WORD fromPort, const PIPSocket::Address & localAddr, CallSignalSocket * s)
 {
@@ -1661,6 +1945,7 @@ void RasServer::CreateRasJob(GatekeeperMessage * msg, bool syncronous)
 			std::list<RasMsg *>::iterator i = find_if(requests.begin(), requests.end(), bind2nd(mem_fun(&RasMsg::EqualTo), ras));
 			if (i != requests.end() && !(*i)->IsDone()) {
 				PTRACE(2, "RAS\tDuplicate " << msg->GetTagName() << ", deleted");
+				Metrics::Instance()->OnRasDropped();
 				delete ras;
 				ras = NULL;
 			} else {
@@ -1683,6 +1968,7 @@ void RasServer::CreateRasJob(GatekeeperMessage * msg, bool syncronous)
 		}
 	} else {
 		PTRACE(1, "RAS\tUnknown RAS message " << msg->GetTagName());
+		Metrics::Instance()->OnRasDropped();
 		delete msg;
 	}
 }
@@ -2174,34 +2460,7 @@ bool RegistrationRequestPDU::Process()
 		}
 		// check if the RRQ was sent from the registered endpoint
 		if (ep && bSendReply) { // not forwarded RRQ
-			if (ep->IsNATed() || ep->IsTraversalClient() || ep->UsesH46017()) {
-				// for nated endpoint, only check rx_addr
-			    bReject = (ep->GetNATIP() != rx_addr);
-			    if (bReject) {
-					PTRACE(3, "RAS\tLightweight registration rejected, because IP doesn't match");
-				}
-			} else {
-				PIPSocket::Address oaddr, raddr;
-				WORD oport = 0, rport = 0;
-				if (request.m_callSignalAddress.GetSize() >= 1) {
-					GetIPAndPortFromTransportAddr(ep->GetCallSignalAddress(), oaddr, oport);
-					for (int s = 0; s < request.m_callSignalAddress.GetSize(); ++s) {
-						GetIPAndPortFromTransportAddr(request.m_callSignalAddress[s], raddr, rport);
-						if (oaddr == raddr && oport == rport)
-							break;
-					}
-				} else if (request.m_rasAddress.GetSize() >= 1) {
-					GetIPAndPortFromTransportAddr(ep->GetRasAddress(), oaddr, oport),
-					GetIPAndPortFromTransportAddr(request.m_rasAddress[0], raddr, rport);
-				} else {
-					GetIPAndPortFromTransportAddr(ep->GetCallSignalAddress(), oaddr, oport),
-					raddr = oaddr, rport = oport;
-				}
-				bReject = (oaddr != raddr) || (oport != rport) || (IsLoopback(rx_addr) ? false : (raddr != rx_addr));
-			    if (bReject) {
-					PTRACE(3, "RAS\tLightweight registration rejected, because IP or ports don't match: old addr=" << AsString(oaddr, oport) << " receive addr=" << AsString(raddr, rport) << " rx_addr=" << rx_addr);
-				}
-			}
+			bReject = !IsLightweightRRQFromEndpoint(request, ep, rx_addr);
 		}
 		if (bReject) {
 			if (ep && bSendReply) {
@@ -2218,6 +2477,7 @@ bool RegistrationRequestPDU::Process()
 			// endpoint was NOT registered and force Full Registration
 			return BuildRRJ(H225_RegistrationRejectReason::e_fullRegistrationRequired);
 		} else {
+			const RegistrationSnapshot snapshot(ep);
 			 if (ntype < 8) {
 #ifdef HAS_H46023
 				if (ntype > 1) {
@@ -2274,6 +2534,7 @@ bool RegistrationRequestPDU::Process()
 
 			// endpoint was already registered
 			ep->Update(m_msg->m_recvRAS);
+			snapshot.NotifyIfChanged(ep);
 			if (bSendReply) {
 				BuildRCF(ep);
 				H225_RegistrationConfirm & rcf = m_msg->m_replyRAS;
@@ -2372,6 +2633,25 @@ bool RegistrationRequestPDU::Process()
             // (Innovaphone accepts without, SmartNode can be configured, H323Plus currently needs it)
             SetupResponseTokens(m_msg->m_replyRAS, ep);
 
+			// cache the encoded RCF for the lightweight RRQ fast path, if it only depends on the endpoint record
+			if (bSendReply && m_msg->m_socket
+#ifdef HAS_H46017
+				&& !m_msg->m_h46017Socket
+#endif
+				) {
+				PBYTEArray rcfTemplate;
+				PINDEX seqNumPos = 0;
+				if (m_authenticators == NULL
+					&& !request.HasOptionalField(H225_RegistrationRequest::e_featureSet)
+					&& !request.HasOptionalField(H225_RegistrationRequest::e_additiveRegistration)
+					&& m_msg->m_replyRAS.GetTag() == H225_RasMessage::e_registrationConfirm) {
+					H225_RegistrationConfirm & rcf = m_msg->m_replyRAS;
+					if (!EncodeRasTemplate(m_msg->m_replyRAS, rcf.m_requestSeqNum, rcfTemplate, seqNumPos))
+						rcfTemplate.SetSize(0);
+				}
+				ep->SetRasTemplate(H225_RasMessage::e_registrationConfirm, rcfTemplate, seqNumPos, m_msg->m_localAddr, RasSrv->GetConfigGeneration());
+			}
+
 			return bSendReply;
 		}
 	} // end lightweight
@@ -2599,6 +2879,8 @@ bool RegistrationRequestPDU::Process()
 		PTRACE(3, "RAS\tRRQ rejected by unknown reason from " << rx_addr);
 		return BuildRRJ(H225_RegistrationRejectReason::e_undefinedReason);
 	}
+	// InsertRec announced the registration, the NAT handling below may still change its addresses
+	const RegistrationSnapshot snapshot(ep);
 
 #ifdef HAS_H46017
 	if (usesH46017) {
@@ -2852,6 +3134,7 @@ bool RegistrationRequestPDU::Process()
 			// this is an nated endpoint
 			ep->SetNATAddress(rasip);
 	}
+	snapshot.NotifyIfChanged(ep);
 	// forward heavyweight
 	if (bForwardRequest) {
 		request.IncludeOptionalField(H225_RegistrationRequest::e_endpointIdentifier);
@@ -2950,6 +3233,8 @@ template<> bool RasPDU<H225_UnregistrationRequest>::Process()
 		if (ep->IsAdditiveRegistrant()
 			&& request.HasOptionalField(H225_UnregistrationRequest::e_endpointAlias)
 			&& !ep->RemoveAliases(request.m_endpointAlias)) {
+				// the endpoint stays registered with its remaining aliases
+				EndpointTbl->OnEndpointChanged(ep.operator->());
 
 				EndpointRec logRec(m_msg->m_recvRAS);
 				RasServer::Instance()->LogAcctEvent(GkAcctLogger::AcctUnregister, endptr(&logRec));
@@ -32,12 +32,14 @@ class H225_NonStandardParameter;
 class H225_TransportAddress;
 class H225_ArrayOf_AlternateGK;
 class H225_Setup_UUIE;
+class H225_CallIdentifier;
 class Q931;
 class SignalingMsg;
 template <class> class H225SignalingMsg;
 typedef H225SignalingMsg<H225_Setup_UUIE> SetupMsg;
 
 class RasListener;
+class RasReader;
 class GkInterface;
 class GkAcctLoggerList;
 class GkClient;
@@ -90,6 +92,8 @@ public:
 
 	void LoadConfig();
 	void AddListener(RasListener *);
+	// add a listener to one of the additional RAS reader threads
+	void AddListener(RasListener *, unsigned reader);
 	void AddListener(TCPListenSocket *);
 	bool CloseListener(TCPListenSocket *);
 
@@ -112,7 +116,16 @@ public:
 	bool IsRedirected(unsigned = 0) const;
 	bool IsForwardedMessage(const H225_NonStandardParameter *, const Address &) const;
 	void ForwardRasMsg(H225_RasMessage &);
-	bool ReplyToRasAddress(const NetworkAddress & ip) const;
+	bool ReplyToRasAddress(const PIPSocket::Address & ip) const;
+
+	// number of threads reading the RAS port, including this one
+	unsigned GetRasReaderCount() const { return m_rasReaderCount; }
+
+	// read and dispatch a message from a RAS listener, may run in any RAS reader thread
+	void ReadRas(RasListener *);
+
+	// incremented on each config reload, used to invalidate cached RAS replies
+	unsigned GetConfigGeneration() const { return m_configGeneration; }
 
 	bool RemoveCallOnDRQ() const { return bRemoveCallOnDRQ; }
 
@@ -129,7 +142,15 @@ public:
 
 	// get signaling handler
 	ProxyHandler *GetSigProxyHandler();
+	ProxyHandler *GetSigProxyHandler(const H225_CallIdentifier &);
 	ProxyHandler *GetRtpProxyHandler();
+	/** Sum the packets and bytes received by the RTP proxy.
+
+	    @return	false if calls aren't routed
+	*/
+	bool GetRtpStatistics(PUInt64 & packets, PUInt64 & bytes);
+	/// @return	RAS requests waiting for or being processed by a job
+	unsigned GetPendingRequests();
 
 	void SelectH235Capability(const H225_GatekeeperRequest &, H225_GatekeeperConfirm &) const;
 
@@ -267,6 +288,9 @@ private:
 	virtual void ReadSocket(IPSocket *);
 	virtual void CleanUp();
 
+	// answer lightweight RRQs from the cache, returns false if the message needs the full processing
+	bool ProcessLightweightRRQ(GatekeeperMessage * msg);
+
 	// new virtual function
 	virtual void CreateRasJob(GatekeeperMessage * msg, bool syncronous = false);
 	virtual GkInterface *CreateInterface(const Address &);
@@ -307,11 +331,17 @@ private:
 	std::vector<WORD> altGKsPort;
 	H225_ArrayOf_AlternateGK altGKs;
 	PINDEX altGKsSize;
-	std::map<NetworkAddress, H225_ArrayOf_AlternateGK> m_altGkRules;	// alternate GK rules by IP
+	NetworkAddressTree<H225_ArrayOf_AlternateGK> m_altGkRules;	// alternate GK rules by IP
 	PINDEX epLimit, callLimit;
 	int redirectGK;
 
-	std::map<NetworkAddress, bool> m_replyras; // on which network should we use the rasAddress included in GRQ/RRQ/IRQ
+	NetworkAddressTree<bool> m_replyras; // on which network should we use the rasAddress included in GRQ/RRQ/IRQ
+
+	bool m_lightweightRRQFastPath;
+	unsigned m_configGeneration;
+
+	unsigned m_rasReaderCount;
+	std::vector<RasReader *> m_rasReaders;	// the additional RAS reader threads
 };
 
 #endif // RASSRV_H
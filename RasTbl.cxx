@@ -12,6 +12,7 @@
 //////////////////////////////////////////////////////////////////
 
 #include <time.h>
+#include <set>
 #include <ptlib.h>
 #include <h323.h>
 #include <h323pdu.h>
@@ -26,8 +27,10 @@
 #include "Neighbor.h"
 #include "gkacct.h"
 #include "RasTbl.h"
+#include "regsync.h"
 #include "gk.h"
 #include "gk_const.h"
+#include "job.h"
 #include "config.h"
 
 #ifdef H323_H350
@@ -64,6 +67,8 @@ namespace {
 const long DEFAULT_SIGNAL_TIMEOUT = 30000;
 const long DEFAULT_ALERTING_TIMEOUT = 180000;
 const int DEFAULT_IRQ_POLL_COUNT = 1;
+// status port listings are sent in chunks of about this size
+const PINDEX STATUS_LIST_CHUNK_SIZE = 64 * 1024;
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -87,6 +92,123 @@ PString EPQoS::AsString() const
 
 /////////////////////////////////////////////////////////////////////////////////
 
+StatusListFilter::StatusListFilter()
+	: m_hasNetwork(false), m_offset(0), m_limit(0)
+{
+}
+
+bool StatusListFilter::Parse(const PStringArray & args, PINDEX first)
+{
+	for (PINDEX i = first; i < args.GetSize(); ++i) {
+		const PINDEX eq = args[i].Find('=');
+		if (eq == P_MAX_INDEX || eq == 0)
+			return false;
+		const PCaselessString name = args[i].Left(eq);
+		const PString value = args[i].Mid(eq + 1);
+		if (name == "alias") {
+			m_aliasPrefix = value;
+		} else if (name == "ip") {
+			Toolkit::GetNetworkFromString(value, m_network, m_netmask);
+			if (!m_network.IsValid() || m_network.GetSize() != m_netmask.GetSize())
+				return false;
+			// ip=0.0.0.0/0 matches everything, don't bother filtering
+			m_hasNetwork = !NetworkAddress(m_network, m_netmask).IsAny();
+		} else if (name == "type") {
+			m_type = value.ToLower();
+			if (m_type != "terminal" && m_type != "gateway" && m_type != "mcu" && m_type != "gatekeeper")
+				return false;
+		} else if (name == "state") {
+			m_state = value.ToLower();
+			if (m_state != "connected" && m_state != "alerting" && m_state != "setup")
+				return false;
+		} else if (name == "offset" || name == "limit") {
+			// AsUnsigned() would silently turn garbage into 0
+			if (value.IsEmpty() || value.FindSpan("0123456789") != P_MAX_INDEX)
+				return false;
+			(name == "offset" ? m_offset : m_limit) = value.AsUnsigned();
+		} else
+			return false;
+	}
+	return true;
+}
+
+bool StatusListFilter::MatchAlias(const PString & alias) const
+{
+	return alias.Left(m_aliasPrefix.GetLength()) == m_aliasPrefix;
+}
+
+bool StatusListFilter::MatchIP(const PIPSocket::Address & ip) const
+{
+	return ip << NetworkAddress(m_network, m_netmask);
+}
+
+bool StatusListFilter::MatchType(const EndpointRec & ep) const
+{
+	const PStringArray types = AsString(ep.GetEndpointType()).Tokenise(",", FALSE);
+	for (PINDEX i = 0; i < types.GetSize(); ++i)
+		if (types[i] == m_type)
+			return true;
+	return false;
+}
+
+bool StatusListFilter::Match(const EndpointRec & ep) const
+{
+	if (m_hasNetwork) {
+		PIPSocket::Address ip;
+		if (!GetIPFromTransportAddr(ep.GetCallSignalAddress(), ip) || !MatchIP(ip))
+			return false;
+	}
+	if (!m_type && !MatchType(ep))
+		return false;
+	if (!m_aliasPrefix) {
+		const H225_ArrayOf_AliasAddress aliases = ep.GetAliases();
+		for (PINDEX i = 0; i < aliases.GetSize(); ++i)
+			if (MatchAlias(AsString(aliases[i], FALSE)))
+				return true;
+		return false;
+	}
+	return true;
+}
+
+bool StatusListFilter::Match(const CallRec & call) const
+{
+	if (!m_state) {
+		const char * state = "setup";
+		if (call.IsConnected())
+			state = "connected";
+		else if (call.GetAlertingTime() != 0)
+			state = "alerting";
+		if (m_state != state)
+			return false;
+	}
+	if (m_hasNetwork) {
+		PIPSocket::Address ip;
+		WORD port = 0;
+		if (!(call.GetSrcSignalAddr(ip, port) && MatchIP(ip))
+				&& !(call.GetDestSignalAddr(ip, port) && MatchIP(ip)))
+			return false;
+	}
+	if (!m_type) {
+		const endptr calling = call.GetCallingParty();
+		const endptr called = call.GetCalledParty();
+		if (!(calling && MatchType(*calling)) && !(called && MatchType(*called)))
+			return false;
+	}
+	if (!m_aliasPrefix) {
+		if (MatchAlias(call.GetCallingStationId()) || MatchAlias(call.GetCalledStationId())
+				|| MatchAlias(StripAliasType(call.GetDestInfo())))
+			return true;
+		const H225_ArrayOf_AliasAddress aliases = call.GetSourceAddress();
+		for (PINDEX i = 0; i < aliases.GetSize(); ++i)
+			if (MatchAlias(AsString(aliases[i], FALSE)))
+				return true;
+		return false;
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
 EndpointRec::EndpointRec(
 	/// RRQ, ARQ, ACF or LCF that contains a description of the endpoint
 	const H225_RasMessage & ras,
@@ -882,6 +1004,42 @@ void EndpointRec::SetH235Authenticators(GkH235Authenticators * auth)
     };
 }
 
+void EndpointRec::SetRasTemplate(unsigned tag, const PBYTEArray & encoded, PINDEX seqNumPos, const PIPSocket::Address & localAddr, unsigned generation)
+{
+	PWaitAndSignal lock(m_usedLock);
+	if (encoded.GetSize() == 0) {
+		m_rasTemplates.erase(tag);
+		return;
+	}
+	RasTemplate & t = m_rasTemplates[tag];
+	// make a real copy, the cached buffer gets patched by the caller
+	t.m_encoded = PBYTEArray((const BYTE *)encoded, encoded.GetSize());
+	t.m_seqNumPos = seqNumPos;
+	t.m_localAddr = localAddr;
+	t.m_timeToLive = m_timeToLive;
+	t.m_generation = generation;
+}
+
+bool EndpointRec::GetRasTemplate(unsigned tag, PBYTEArray & encoded, PINDEX & seqNumPos, const PIPSocket::Address & localAddr, unsigned generation) const
+{
+	PWaitAndSignal lock(m_usedLock);
+	std::map<unsigned, RasTemplate>::const_iterator i = m_rasTemplates.find(tag);
+	if (i == m_rasTemplates.end()
+		|| i->second.m_generation != generation
+		|| i->second.m_timeToLive != m_timeToLive
+		|| i->second.m_localAddr != localAddr)
+		return false;
+	encoded = PBYTEArray((const BYTE *)i->second.m_encoded, i->second.m_encoded.GetSize());
+	seqNumPos = i->second.m_seqNumPos;
+	return true;
+}
+
+void EndpointRec::ClearRasTemplates()
+{
+	PWaitAndSignal lock(m_usedLock);
+	m_rasTemplates.clear();
+}
+
 void EndpointRec::Update(const H225_RasMessage & ras_msg)
 {
 	if (ras_msg.GetTag() == H225_RasMessage::e_registrationRequest) {
@@ -913,6 +1071,8 @@ void EndpointRec::Update(const H225_RasMessage & ras_msg)
 			// H.225.0v4: ignore fields other than rasAddress, endpointIdentifier,
 			// timeToLive for a lightweightRRQ
 			if (!(rrq.HasOptionalField(H225_RegistrationRequest::e_keepAlive) && rrq.m_keepAlive)) {
+				// full registration, the endpoint may have changed its features
+				ClearRasTemplates();
 				if (rrq.HasOptionalField(H225_RegistrationRequest::e_terminalAlias)
 					&& (rrq.m_terminalAlias.GetSize() >= 1)) {
 					LoadAliases(rrq.m_terminalAlias, rrq.m_terminalType);
@@ -1126,16 +1286,36 @@ bool EndpointRec::SendIRQ()
 	--m_pollCount;
 
 	RasServer *RasSrv = RasServer::Instance();
-	H225_RasMessage ras_msg;
-	ras_msg.SetTag(H225_RasMessage::e_infoRequest);
-	H225_InfoRequest & irq = ras_msg;
-	irq.m_requestSeqNum.SetValue(RasSrv->GetRequestSeqNum());
-	irq.m_callReferenceValue.SetValue(0); // ask for each call
+	const unsigned seqNum = RasSrv->GetRequestSeqNum();
 
 	PString msg(PString::Printf, "IRQ|%s|%s;\r\n",
 			(const unsigned char *) AsDotString(GetRasAddress()),
 			(const unsigned char *) GetEndpointIdentifier().GetValue());
         GkStatus::Instance()->SignalStatus(msg, STATUS_TRACE_LEVEL_RAS);
+
+	// the poll IRQ only differs in the sequence number, re-use the encoded one if we can
+	PIPSocket::Address addr;
+	WORD port = 0;
+	RasListener * listener = NULL;
+	if (!UsesH46017() && GetH235Authenticators() == NULL
+		&& GetIPAndPortFromTransportAddr(GetRasAddress(), addr, port)
+		&& (listener = RasSrv->GetRasListener(addr)) != NULL) {
+		PBYTEArray irqTemplate;
+		PINDEX seqNumPos = 0;
+		if (GetRasTemplate(H225_RasMessage::e_infoRequest, irqTemplate, seqNumPos, GNUGK_INADDR_ANY, RasSrv->GetConfigGeneration())) {
+			SetRasTemplateSeqNum(irqTemplate, seqNumPos, seqNum);
+			PTRACE(2, "RAS\tSend cached IRQ to " << AsString(addr, port));
+			listener->WriteRas(irqTemplate, addr, port);
+			return true;
+		}
+	}
+
+	H225_RasMessage ras_msg;
+	ras_msg.SetTag(H225_RasMessage::e_infoRequest);
+	H225_InfoRequest & irq = ras_msg;
+	irq.m_requestSeqNum.SetValue(seqNum);
+	irq.m_callReferenceValue.SetValue(0); // ask for each call
+
 #ifdef HAS_H46017
 	if (UsesH46017()) {
 		CallSignalSocket * s = GetSocket();
@@ -1143,6 +1323,13 @@ bool EndpointRec::SendIRQ()
 			s->SendH46017Message(ras_msg, GetH235Authenticators());
 	} else
 #endif
+	if (listener) {
+		PBYTEArray irqTemplate;
+		PINDEX seqNumPos = 0;
+		if (EncodeRasTemplate(ras_msg, irq.m_requestSeqNum, irqTemplate, seqNumPos))
+			SetRasTemplate(H225_RasMessage::e_infoRequest, irqTemplate, seqNumPos, GNUGK_INADDR_ANY, RasSrv->GetConfigGeneration());
+		listener->SendRas(ras_msg, addr, port, NULL);
+	} else
 		RasSrv->SendRas(ras_msg, GetRasAddress(), NULL, GetH235Authenticators());
 
 	return true;
@@ -1645,13 +1832,28 @@ OutOfZoneGWRec::OutOfZoneGWRec(const H225_RasMessage & completeLCF, const H225_E
 RegistrationTable::RegistrationTable() : Singleton<RegistrationTable>("RegistrationTable")
 {
 	regSize = 0;
+	m_snapshotInterval = 0;
+	m_snapshotRunning = false;
+	m_snapshotsStopped = false;
 
 	LoadConfig();
 }
 
 RegistrationTable::~RegistrationTable()
 {
+	// wait for a snapshot job that has been started just before shutdown
+	while (true) {
+		{
+			PWaitAndSignal snapshotLock(m_snapshotMutex);
+			m_snapshotsStopped = true;
+			if (!m_snapshotRunning)
+				break;
+		}
+		PThread::Sleep(100);
+	}
+
 	ClearTable();
+	DeleteObjectsInContainer(RemoteList);
 	// since the socket has been deleted, just remove it
 	ForEachInContainer(RemovedList, mem_fun(&EndpointRec::GetAndRemoveSocket));
 	DeleteObjectsInContainer(RemovedList);
@@ -1664,9 +1866,10 @@ endptr RegistrationTable::InsertRec(H225_RasMessage & ras_msg, PIPSocket::Addres
 	{
 		case H225_RasMessage::e_registrationRequest: {
 			H225_RegistrationRequest & rrq = ras_msg;
-			if ((ep = FindBySignalAdr(rrq.m_callSignalAddress[0], ip)))
+			if ((ep = FindBySignalAdr(rrq.m_callSignalAddress[0], ip))) {
 				ep->Update(ras_msg);
-			else
+				OnEndpointChanged(ep.operator->());
+			} else
 				ep = InternalInsertEP(ras_msg);
 			break;
 		}
@@ -1739,8 +1942,7 @@ endptr RegistrationTable::InternalInsertEP(H225_RasMessage & ras_msg)
 	}
 	EndpointRec * ep = isGW ? new GatewayRec(ras_msg) : new EndpointRec(ras_msg);
 	WriteLock lock(listLock);
-	EndpointList.push_back(ep);
-	++regSize;
+	InternalAppend(ep);
 	return endptr(ep);
 }
 
@@ -1850,18 +2052,97 @@ void RegistrationTable::InternalRemove(iterator Iter)
 		return;
 	}
 	RemovedList.push_back(*Iter);
-	EndpointList.erase(Iter);
+	InternalErase(Iter);
+}
+
+void RegistrationTable::InternalAppend(EndpointRec * ep)
+{
+	EndpointList.push_back(ep);
+	EndpointIdIndex.insert(std::make_pair(ep->GetEndpointIdentifier().GetValue(), ep));
+	++regSize;
+	SNMP_CACHE(OnEndpointAdded(ep));
+	if (RegistrationSync::InstanceExists())
+		RegistrationSync::Instance()->OnEndpointUpdated(ep);
+}
+
+void RegistrationTable::OnEndpointChanged(EndpointRec * ep)
+{
+	SNMP_CACHE(OnEndpointUpdated(ep));
+	if (RegistrationSync::InstanceExists())
+		RegistrationSync::Instance()->OnEndpointUpdated(ep);
+}
+
+RegistrationTable::iterator RegistrationTable::InternalErase(iterator Iter)
+{
+	EndpointRec * ep = *Iter;
+	const PString epId = ep->GetEndpointIdentifier().GetValue();
+	std::multimap<PString, EndpointRec *>::iterator i = EndpointIdIndex.lower_bound(epId);
+	while (i != EndpointIdIndex.end() && i->first == epId) {
+		if (i->second == ep) {
+			EndpointIdIndex.erase(i);
+			break;
+		}
+		++i;
+	}
 	--regSize;
+	SNMP_CACHE(OnEndpointRemoved(ep));
+	if (RegistrationSync::InstanceExists())
+		RegistrationSync::Instance()->OnEndpointRemoved(ep);
+	return EndpointList.erase(Iter);
 }
 
-endptr RegistrationTable::FindByEndpointId(const H225_EndpointIdentifier & epId) const
+void RegistrationTable::UpdateRemote(const PString & peer, EndpointRec * ep)
+{
+	const PString key = peer + '\t' + ep->GetEndpointIdentifier().GetValue();
+	WriteLock lock(listLock);
+	std::map<PString, EndpointRec *>::iterator i = RemoteIndex.find(key);
+	if (i != RemoteIndex.end()) {
+		RemoteList.remove(i->second);
+		RemovedList.push_back(i->second);
+		i->second = ep;
+	} else
+		RemoteIndex.insert(std::make_pair(key, ep));
+	RemoteList.push_back(ep);
+}
+
+void RegistrationTable::RemoveRemote(const PString & peer, const PString & endpointId)
+{
+	WriteLock lock(listLock);
+	std::map<PString, EndpointRec *>::iterator i = RemoteIndex.find(peer + '\t' + endpointId);
+	if (i != RemoteIndex.end()) {
+		RemoteList.remove(i->second);
+		RemovedList.push_back(i->second);
+		RemoteIndex.erase(i);
+	}
+}
+
+void RegistrationTable::ClearRemote(const PString & peer)
 {
-	PWaitAndSignal m(findmutex);
+	const PString prefix = peer + '\t';
+	std::set<EndpointRec *> removed;
+	WriteLock lock(listLock);
+	std::map<PString, EndpointRec *>::iterator i = RemoteIndex.lower_bound(prefix);
+	while (i != RemoteIndex.end() && i->first.Left(prefix.GetLength()) == prefix) {
+		removed.insert(i->second);
+		RemovedList.push_back(i->second);
+		RemoteIndex.erase(i++);
+	}
+	if (removed.empty())
+		return;
+	iterator Iter = RemoteList.begin();
+	while (Iter != RemoteList.end())
+		if (removed.find(*Iter) != removed.end())
+			Iter = RemoteList.erase(Iter);
+		else
+			++Iter;
+	PTRACE(3, "RegSync\t" << removed.size() << " endpoints of " << peer << " removed");
+}
 
-	PString epIdStr;
-	epIdStr = epId;
-	return InternalFind(compose1(bind2nd(equal_to<PString>(), epIdStr),
-			mem_fun(&EndpointRec::GetEndpointIdentifier)));
+endptr RegistrationTable::FindByEndpointId(const H225_EndpointIdentifier & epId) const
+{
+	ReadLock lock(listLock);
+	std::multimap<PString, EndpointRec *>::const_iterator i = EndpointIdIndex.find(epId.GetValue());
+	return endptr((i != EndpointIdIndex.end()) ? i->second : NULL);
 }
 
 namespace { // anonymous namespace
@@ -1943,6 +2224,8 @@ endptr RegistrationTable::FindByAliases(const H225_ArrayOf_AliasAddress & alias)
 endptr RegistrationTable::FindFirstEndpoint(const H225_ArrayOf_AliasAddress & alias)
 {
 	endptr ep = InternalFindFirstEP(alias, &EndpointList);
+	if (!ep)
+		ep = InternalFindFirstEP(alias, &RemoteList);
 	return (ep) ? ep : InternalFindFirstEP(alias, &OutOfZoneList);
 }
 
@@ -1954,6 +2237,9 @@ bool RegistrationTable::FindEndpoint(
 	list<Route> & routes)
 {
 	bool found = InternalFindEP(aliases, &EndpointList, roundRobin, leastUsedRouting, routes);
+	// endpoints registered on peer gatekeepers, local registrations take precedence
+	if (!found && InternalFindEP(aliases, &RemoteList, roundRobin, leastUsedRouting, routes))
+		found = true;
 	if (searchOutOfZone && InternalFindEP(aliases, &OutOfZoneList, roundRobin, leastUsedRouting, routes))
 		found = true;
 	return found;
@@ -2123,10 +2409,10 @@ void RegistrationTable::GenerateAlias(H225_ArrayOf_AliasAddress & AliasList, con
 	H323SetAliasAddress(endpointId, AliasList[0]);
 }
 
-void RegistrationTable::PrintAllRegistrations(USocket *client, bool verbose)
+void RegistrationTable::PrintAllRegistrations(USocket *client, bool verbose, const StatusListFilter * filter)
 {
 	PString msg("AllRegistrations\r\n");
-	InternalPrint(client, verbose, &EndpointList, msg);
+	InternalPrint(client, verbose, &EndpointList, msg, filter);
 }
 
 void RegistrationTable::PrintEndpointQoS(USocket *client) //const
@@ -2150,16 +2436,16 @@ void RegistrationTable::PrintEndpointQoS(USocket *client) //const
 	client->TransmitData(msg);
 }
 
-void RegistrationTable::PrintAllCached(USocket *client, bool verbose)
+void RegistrationTable::PrintAllCached(USocket *client, bool verbose, const StatusListFilter * filter)
 {
 	PString msg("AllCached\r\n");
-	InternalPrint(client, verbose, &OutOfZoneList, msg);
+	InternalPrint(client, verbose, &OutOfZoneList, msg, filter);
 }
 
 void RegistrationTable::PrintRemoved(USocket *client, bool verbose)
 {
 	PString msg("AllRemoved\r\n");
-	InternalPrint(client, verbose, &RemovedList, msg);
+	InternalPrint(client, verbose, &RemovedList, msg, NULL);
 }
 
 void RegistrationTable::PrintPrefixCapacities(USocket *client, PString alias) const
@@ -2177,7 +2463,7 @@ void RegistrationTable::PrintPrefixCapacities(USocket *client, PString alias) co
 	client->TransmitData(msg);
 }
 
-void RegistrationTable::InternalPrint(USocket *client, bool verbose, std::list<EndpointRec *> * List, PString & msg)
+void RegistrationTable::InternalPrint(USocket *client, bool verbose, std::list<EndpointRec *> * List, PString & msg, const StatusListFilter * filter)
 {
 	// copy the pointers into a temporary array to avoid large lock
 	listLock.StartRead();
@@ -2189,14 +2475,32 @@ void RegistrationTable::InternalPrint(USocket *client, bool verbose, std::list<E
 	listLock.EndRead();
 	// end of lock
 
-	if (s > 1000) // set buffer to avoid reallocate
-		msg.SetSize(s * (verbose ? 200 : 100));
-	for (k = 0; k < s; k++)
-		msg += "RCF|" + eptr[k]->PrintOn(verbose);
+	// send the list in chunks to keep the buffer small
+	PINDEX chunkSize = msg.GetLength();
+	unsigned matches = 0, listed = 0;
+	for (k = 0; k < s; k++) {
+		if (filter && !filter->Match(*eptr[k]))
+			continue;
+		if (!filter || filter->OnPage(matches)) {
+			const PString line = "RCF|" + eptr[k]->PrintOn(verbose);
+			msg += line;
+			chunkSize += line.GetLength();
+			++listed;
+			if (chunkSize >= STATUS_LIST_CHUNK_SIZE) {
+				client->TransmitData(msg);
+				msg = PString::Empty();
+				chunkSize = 0;
+			}
+		}
+		++matches;
+	}
 	delete [] eptr;
 	eptr = NULL;
 
-	msg += PString(PString::Printf, "Number of Endpoints: %u\r\n;\r\n", s);
+	if (filter && filter->IsPaged())
+		msg += PString(PString::Printf, "Number of Endpoints: %u Listed: %u\r\n;\r\n", matches, listed);
+	else
+		msg += PString(PString::Printf, "Number of Endpoints: %u\r\n;\r\n", matches);
 	client->TransmitData(msg);
 }
 
@@ -2220,15 +2524,22 @@ PString RegistrationTable::PrintStatistics() const
 	unsigned cs, ct, cg, cn; // cn is useless
 	InternalStatistics(&OutOfZoneList, cs, ct, cg, cn);
 
-	return PString(PString::Printf, "-- Endpoint Statistics --\r\n"
+	PString result(PString::Printf, "-- Endpoint Statistics --\r\n"
 		"Total Endpoints: %u  Terminals: %u  Gateways: %u  NATed: %u\r\n"
 		"Cached Endpoints: %u  Terminals: %u  Gateways: %u\r\n",
 		es, et, eg, en, cs, ct, cg);
+	unsigned rs, rt, rg, rn; // rn is useless, NATed endpoints aren't replicated
+	InternalStatistics(&RemoteList, rs, rt, rg, rn);
+	if (rs > 0)
+		result += PString(PString::Printf, "Remote Endpoints: %u  Terminals: %u  Gateways: %u\r\n", rs, rt, rg);
+	return result;
 }
 
 void RegistrationTable::LoadConfig()
 {
 	endpointIdSuffix = GkConfig()->GetString("EndpointIDSuffix", "_endp");
+	m_snapshotFile = GkConfig()->GetString(RRQFeaturesSection, "SnapshotFile", "");
+	m_snapshotInterval = GkConfig()->GetInteger(RRQFeaturesSection, "SnapshotInterval", 60);
 
 	// Load config for each endpoint
 	if (regSize > 0) {
@@ -2263,8 +2574,7 @@ void RegistrationTable::LoadConfig()
 				SoftPBX::DisconnectEndpoint(endptr(ep));
 				ep->Unregister();
 				RemovedList.push_back(ep);
-				epIter = EndpointList.erase(epIter);
-				--regSize;
+				epIter = InternalErase(epIter);
 				PTRACE(2, "Permanent endpoint " << ep->GetEndpointIdentifier().GetValue() << " removed");
 			}
 			else ++epIter;
@@ -2357,9 +2667,9 @@ void RegistrationTable::LoadConfig()
 		if (!eptr) {
 			PTRACE(2, "Add permanent endpoint " << AsDotString(rrq.m_callSignalAddress[0]));
 			WriteLock lock(listLock);
-			EndpointList.push_back(ep);
-			++regSize;
-		}
+			InternalAppend(ep);
+		} else
+			OnEndpointChanged(eptr.operator->()); // the config may have changed its aliases or prefixes
 	}
 }
 
@@ -2372,7 +2682,9 @@ void RegistrationTable::ClearTable()
 			back_inserter(RemovedList), mem_fun(&EndpointRec::Unregister));
 	}
 	EndpointList.clear();
+	EndpointIdIndex.clear();
 	regSize = 0;
+	SNMP_CACHE(OnEndpointsCleared());
 	copy(OutOfZoneList.begin(), OutOfZoneList.end(), back_inserter(RemovedList));
 	OutOfZoneList.clear();
 }
@@ -2383,6 +2695,301 @@ void RegistrationTable::UpdateTable()
 
 	ForEachInContainer(EndpointList, mem_fun(&EndpointRec::Reregister));
 	EndpointList.clear();
+	EndpointIdIndex.clear();
+	regSize = 0;
+	SNMP_CACHE(OnEndpointsCleared());
+}
+
+namespace { // anonymous namespace
+
+// Warm restart snapshot: magic, version and time of the snapshot, then for each
+// endpoint the length and the PER encoded RRQ with its current aliases, addresses
+// and TTL, followed by the flags, the NAT type and the NAT IP that are not part of the RRQ.
+const BYTE SnapshotMagic[4] = { 'G', 'K', 'R', 'S' };
+const DWORD SnapshotVersion = 1;
+
+enum SnapshotFlags {
+	SnapshotGateway = 0x01,
+	SnapshotNAT = 0x02,
+	SnapshotTraversalClient = 0x04,
+	SnapshotH46023 = 0x08
+};
+
+class SnapshotWriter {
+public:
+	SnapshotWriter() : m_pos(0) { }
+
+	void Put(DWORD value, PINDEX len)
+	{
+		Reserve(len);
+		for (PINDEX i = len; i-- > 0; )
+			m_buf[m_pos++] = (BYTE)(value >> (8 * i));
+	}
+
+	void Put(const BYTE * data, PINDEX len)
+	{
+		Reserve(len);
+		memcpy(m_buf.GetPointer() + m_pos, data, len);
+		m_pos += len;
+	}
+
+	const PBYTEArray & GetData()
+	{
+		m_buf.SetSize(m_pos);
+		return m_buf;
+	}
+
+private:
+	void Reserve(PINDEX len)
+	{
+		if (m_pos + len > m_buf.GetSize())
+			m_buf.SetSize(2 * (m_pos + len));
+	}
+
+	PBYTEArray m_buf;
+	PINDEX m_pos;
+};
+
+class SnapshotReader {
+public:
+	SnapshotReader(const PBYTEArray & buf) : m_buf(buf), m_pos(0) { }
+
+	bool Get(DWORD & value, PINDEX len)
+	{
+		if (m_pos + len > m_buf.GetSize())
+			return false;
+		value = 0;
+		while (len-- > 0)
+			value = (value << 8) | m_buf[m_pos++];
+		return true;
+	}
+
+	bool Get(PBYTEArray & data, PINDEX len)
+	{
+		if (m_pos + len > m_buf.GetSize())
+			return false;
+		data = PBYTEArray((const BYTE *)m_buf + m_pos, len);
+		m_pos += len;
+		return true;
+	}
+
+private:
+	const PBYTEArray & m_buf;
+	PINDEX m_pos;
+};
+
+} // end of anonymous namespace
+
+void RegistrationTable::GetEndpoints(std::vector<endptr> & endpoints) const
+{
+	ReadLock lock(listLock);
+	endpoints.reserve(EndpointList.size());
+	for (const_iterator i = EndpointList.begin(); i != EndpointList.end(); ++i)
+		endpoints.push_back(endptr(*i));
+}
+
+bool RegistrationTable::BuildRegistrationRequest(const endptr & ep, H225_RasMessage & ras)
+{
+	ras = ep->GetCompleteRegistrationRequest();
+	if (ras.GetTag() != H225_RasMessage::e_registrationRequest)
+		return false;
+	H225_RegistrationRequest & rrq = ras;
+	rrq.IncludeOptionalField(H225_RegistrationRequest::e_endpointIdentifier);
+	rrq.m_endpointIdentifier = ep->GetEndpointIdentifier();
+	rrq.IncludeOptionalField(H225_RegistrationRequest::e_terminalAlias);
+	rrq.m_terminalAlias = ep->GetAliases();
+	rrq.m_callSignalAddress.SetSize(1);
+	rrq.m_callSignalAddress[0] = ep->GetCallSignalAddress();
+	rrq.m_rasAddress.SetSize(1);
+	rrq.m_rasAddress[0] = ep->GetRasAddress();
+	if (ep->GetTimeToLive() > 0) {
+		rrq.IncludeOptionalField(H225_RegistrationRequest::e_timeToLive);
+		rrq.m_timeToLive = ep->GetTimeToLive();
+	} else
+		rrq.RemoveOptionalField(H225_RegistrationRequest::e_timeToLive);
+	rrq.RemoveOptionalField(H225_RegistrationRequest::e_tokens);
+	rrq.RemoveOptionalField(H225_RegistrationRequest::e_cryptoTokens);
+	rrq.m_keepAlive = FALSE;
+	return true;
+}
+
+void RegistrationTable::SaveSnapshot()
+{
+	PWaitAndSignal snapshotLock(m_snapshotMutex);
+	m_snapshotsStopped = true;
+	WriteSnapshot();
+}
+
+void RegistrationTable::StartSnapshot()
+{
+	{
+		PWaitAndSignal snapshotLock(m_snapshotMutex);
+		// the last snapshot is still being written, try again next time
+		if (m_snapshotRunning || m_snapshotsStopped)
+			return;
+		m_snapshotRunning = true;
+	}
+	CreateJob(this, &RegistrationTable::SnapshotJob, "RegSnapshot");
+}
+
+void RegistrationTable::SnapshotJob()
+{
+	PWaitAndSignal snapshotLock(m_snapshotMutex);
+	// the final snapshot has been written or removed at shutdown
+	if (!m_snapshotsStopped)
+		WriteSnapshot();
+	m_snapshotRunning = false;
+}
+
+void RegistrationTable::WriteSnapshot()
+{
+	if (m_snapshotFile.IsEmpty())
+		return;
+
+	// hold references, so the endpoints can be encoded without the table lock
+	std::vector<endptr> endpoints;
+	GetEndpoints(endpoints);
+
+	SnapshotWriter writer;
+	writer.Put(SnapshotMagic, sizeof(SnapshotMagic));
+	writer.Put(SnapshotVersion, 1);
+	writer.Put((DWORD)time(NULL), 4);
+
+	unsigned saved = 0;
+	for (std::vector<endptr>::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+		endptr & ep = *i;
+		// permanent endpoints are loaded from the config, H.460.17 endpoints need
+		// their TCP connection and H.235 endpoints have to authenticate again
+		if (ep->IsPermanent() || ep->UsesH46017() || ep->GetH235Authenticators())
+			continue;
+
+		H225_RasMessage ras;
+		if (!BuildRegistrationRequest(ep, ras))
+			continue;
+
+		PPER_Stream strm;
+		ras.Encode(strm);
+		strm.CompleteEncoding();
+		if (strm.GetSize() > 0xffff)
+			continue;
+
+		DWORD flags = 0;
+		if (ep->IsGateway())
+			flags |= SnapshotGateway;
+		if (ep->IsNATed())
+			flags |= SnapshotNAT;
+		if (ep->IsTraversalClient())
+			flags |= SnapshotTraversalClient;
+		if (ep->UsesH46023())
+			flags |= SnapshotH46023;
+		const PIPSocket::Address natIP = ep->IsNATed() ? ep->GetNATIP() : PIPSocket::Address();
+		const PINDEX natIPLen = ep->IsNATed() ? natIP.GetSize() : 0;
+
+		writer.Put(strm.GetSize(), 2);
+		writer.Put(strm.GetPointer(), strm.GetSize());
+		writer.Put(flags, 1);
+		writer.Put(ep->GetEPNATType(), 1);
+		writer.Put(natIPLen, 1);
+		for (PINDEX b = 0; b < natIPLen; ++b)
+			writer.Put(natIP[b], 1);
+		++saved;
+	}
+	endpoints.clear();
+
+	// write a new file and replace the old snapshot, so there is always a complete snapshot
+	const PBYTEArray & data = writer.GetData();
+	const PString tmpFile = m_snapshotFile + ".tmp";
+	PFile file(tmpFile, PFile::WriteOnly, PFile::Create | PFile::Truncate);
+	if (!file.IsOpen() || !file.Write(data, data.GetSize()) || !file.Close()
+		|| !PFile::Move(tmpFile, m_snapshotFile, true)) {
+		PTRACE(1, "RAS\tCan't write registration snapshot " << m_snapshotFile);
+		SNMP_TRAP(6, SNMPError, General, "Can't write registration snapshot " + m_snapshotFile);
+		return;
+	}
+	PTRACE(4, "RAS\tSaved " << saved << " endpoints to registration snapshot " << m_snapshotFile);
+}
+
+void RegistrationTable::LoadSnapshot()
+{
+	if (m_snapshotFile.IsEmpty() || !PFile::Exists(m_snapshotFile))
+		return;
+
+	PBYTEArray data;
+	{
+		PFile file(m_snapshotFile, PFile::ReadOnly);
+		const PINDEX size = file.IsOpen() ? (PINDEX)file.GetLength() : 0;
+		if (size <= 0 || !file.Read(data.GetPointer(size), size)) {
+			PTRACE(1, "RAS\tCan't read registration snapshot " << m_snapshotFile);
+			return;
+		}
+	}
+
+	SnapshotReader reader(data);
+	PBYTEArray magic;
+	DWORD version = 0, savedTime = 0;
+	if (!reader.Get(magic, sizeof(SnapshotMagic)) || memcmp(magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0
+		|| !reader.Get(version, 1) || version != SnapshotVersion || !reader.Get(savedTime, 4)) {
+		PTRACE(1, "RAS\tInvalid registration snapshot " << m_snapshotFile);
+		return;
+	}
+	const long age = (long)time(NULL) - (long)savedTime;
+
+	unsigned restored = 0, skipped = 0;
+	DWORD len;
+	while (reader.Get(len, 2)) {
+		PBYTEArray encoded, natIPBytes;
+		DWORD flags, natType, natIPLen;
+		if (!reader.Get(encoded, len) || !reader.Get(flags, 1) || !reader.Get(natType, 1)
+			|| !reader.Get(natIPLen, 1) || !reader.Get(natIPBytes, natIPLen)) {
+			PTRACE(1, "RAS\tTruncated registration snapshot " << m_snapshotFile);
+			break;
+		}
+
+		H225_RasMessage ras;
+		PPER_Stream strm(encoded);
+		if (!ras.Decode(strm) || ras.GetTag() != H225_RasMessage::e_registrationRequest) {
+			++skipped;
+			continue;
+		}
+		H225_RegistrationRequest & rrq = ras;
+		// skip registrations that expired while the gatekeeper was down
+		// and endpoints that are in the table already
+		if ((rrq.HasOptionalField(H225_RegistrationRequest::e_timeToLive)
+				&& age > (long)rrq.m_timeToLive.GetValue())
+			|| rrq.m_callSignalAddress.GetSize() < 1
+			|| FindByEndpointId(rrq.m_endpointIdentifier)
+			|| FindBySignalAdr(rrq.m_callSignalAddress[0])) {
+			++skipped;
+			continue;
+		}
+
+		EndpointRec * ep = (flags & SnapshotGateway) ? new GatewayRec(ras) : new EndpointRec(ras);
+		if (flags & SnapshotTraversalClient)
+			ep->SetTraversalRole(TraversalClient);
+		if ((flags & SnapshotNAT) && natIPLen > 0) {
+			PIPSocket::Address rasIP;
+			WORD rasPort = 0;
+			GetIPAndPortFromTransportAddr(ep->GetRasAddress(), rasIP, rasPort);
+			ep->SetNATAddress(PIPSocket::Address(natIPBytes.GetSize(), natIPBytes), rasPort);
+		}
+		if (flags & SnapshotH46023)
+			ep->SetUsesH46023(true);
+		ep->SetEPNATType(natType);
+
+		WriteLock lock(listLock);
+		InternalAppend(ep);
+		++restored;
+	}
+	PTRACE(1, "RAS\tRestored " << restored << " endpoints from registration snapshot "
+		<< m_snapshotFile << " (" << age << " sec. old), " << skipped << " skipped");
+}
+
+void RegistrationTable::RemoveSnapshot()
+{
+	PWaitAndSignal snapshotLock(m_snapshotMutex);
+	m_snapshotsStopped = true;
+	if (!m_snapshotFile.IsEmpty() && PFile::Exists(m_snapshotFile))
+		PFile::Remove(m_snapshotFile);
 }
 
 void RegistrationTable::CheckEndpoints()
@@ -2405,8 +3012,7 @@ void RegistrationTable::CheckEndpoints()
 			ep->Expired();
 			RasServer::Instance()->LogAcctEvent(GkAcctLogger::AcctUnregister, endptr(ep));
 			RemovedList.push_back(ep);
-			Iter = EndpointList.erase(Iter);
-			--regSize;
+			Iter = InternalErase(Iter);
 			PTRACE(2, "Endpoint " << ep->GetEndpointIdentifier().GetValue() << " expired");
 		}
 		else ++Iter;
@@ -2439,8 +3045,7 @@ void RegistrationTable::OnNATSocketClosed(CallSignalSocket * s)
 			SoftPBX::DisconnectEndpoint(endptr(ep)); // disconnect ongoing calls
 			RasServer::Instance()->LogAcctEvent(GkAcctLogger::AcctUnregister, endptr(ep));
 			RemovedList.push_back(ep);
-			Iter = EndpointList.erase(Iter);
-			--regSize;
+			Iter = InternalErase(Iter);
 			PTRACE(2, "Endpoint " << ep->GetEndpointIdentifier().GetValue() << " removed due to closed NAT socket");
 			PString msg(PString::Printf, "URQ|%s|%s|%s;\r\n",
 				(const unsigned char *) AsDotString(ep->GetRasAddress()),
@@ -2464,8 +3069,7 @@ void RegistrationTable::UnregisterAllEndpointsNotInCall()
 			ep->Unregister();
 			RasServer::Instance()->LogAcctEvent(GkAcctLogger::AcctUnregister, endptr(ep));
 			RemovedList.push_back(ep);
-			Iter = EndpointList.erase(Iter);
-			--regSize;
+			Iter = InternalErase(Iter);
 		}
 		else ++Iter;
 	}
@@ -2485,8 +3089,7 @@ void RegistrationTable::UnregisterAllH46017Endpoints()
 			RasServer::Instance()->LogAcctEvent(GkAcctLogger::AcctUnregister, endptr(ep));
 			ep->RemoveNATSocket();
 			RemovedList.push_back(ep);
-			Iter = EndpointList.erase(Iter);
-			--regSize;
+			Iter = InternalErase(Iter);
 		}
 		else ++Iter;
 	}
@@ -3390,13 +3993,17 @@ void CallRec::SetRTCP_DST_video_jitter(int val)
 void CallRec::InternalSetEP(endptr & ep, const endptr & nep)
 {
 	if (ep != nep) {
-		if (ep)
+		if (ep) {
 			ep->RemoveCall(StripAliasType(GetDestInfo()));
+			SNMP_CACHE(OnCallRemoved(ep.operator->()));
+		}
 		m_usedLock.Wait();
 		ep = nep;
 		m_usedLock.Signal();
-		if (ep)
+		if (ep) {
 			ep->AddCall(StripAliasType(GetDestInfo()));
+			SNMP_CACHE(OnCallAdded(ep.operator->()));
+		}
 	}
 }
 
@@ -3404,10 +4011,14 @@ void CallRec::RemoveAll()
 {
 	if (IsToParent())
 		RasServer::Instance()->GetGkClient()->SendDRQ(callptr(this));
-	if (m_Calling)
+	if (m_Calling) {
 		m_Calling->RemoveCall(StripAliasType(GetDestInfo()));
-	if (m_Called)
+		SNMP_CACHE(OnCallRemoved(m_Calling.operator->()));
+	}
+	if (m_Called) {
 		m_Called->RemoveCall(StripAliasType(GetDestInfo()));
+		SNMP_CACHE(OnCallRemoved(m_Called.operator->()));
+	}
 }
 
 void CallRec::RemoveSocket()
@@ -5821,16 +6432,21 @@ void CallTable::InternalRemoveFailedLeg(iterator Iter)
 		RasServer::Instance()->LogAcctEvent(GkAcctLogger::AcctStop, call);
 	}
 
-	if (call->GetCalledParty())
-		call->GetCalledParty()->RemoveCall(StripAliasType(call->GetDestInfo()));
+	endptr called = call->GetCalledParty();
+	if (called) {
+		called->RemoveCall(StripAliasType(call->GetDestInfo()));
+		SNMP_CACHE(OnCallRemoved(called.operator->()));
+	}
 
 	call->SetSocket(NULL, NULL);
 }
 
-void CallTable::InternalStatistics(unsigned & n, unsigned & act, unsigned & nb, unsigned & np, unsigned & npr, PString & msg, bool verbose) const
+void CallTable::InternalStatistics(unsigned & n, unsigned & act, unsigned & nb, unsigned & np, unsigned & npr, std::vector<callptr> * calls) const
 {
 	ReadLock lock(listLock);
 	n = m_activeCall, act = nb = np = npr = 0;
+	if (calls)
+		calls->reserve(CallList.size());
 	const_iterator eIter = CallList.end();
 	for (const_iterator Iter = CallList.begin(); Iter != eIter; ++Iter) {
 		CallRec *call = *Iter;
@@ -5840,8 +6456,8 @@ void CallTable::InternalStatistics(unsigned & n, unsigned & act, unsigned & nb,
 			++(call->IsToParent() ? np : nb);
 		if (call->GetProxyMode() == CallRec::ProxyEnabled)
 		        ++npr;
-		if (!msg)
-			msg += call->PrintOn(verbose);
+		if (calls)
+			calls->push_back(callptr(call));
 	}
 }
 
@@ -5856,15 +6472,42 @@ void CallTable::UpdatePrefixCapacityCounters()
 	}
 }
 
-void CallTable::PrintCurrentCalls(USocket *client, bool verbose) const
+void CallTable::PrintCurrentCalls(USocket *client, bool verbose, const StatusListFilter * filter) const
 {
 	PString msg = "CurrentCalls\r\n";
 	unsigned n, act, nb, np, npr;
-	InternalStatistics(n, act, nb, np, npr, msg, verbose);
+	// print outside the lock
+	std::vector<callptr> calls;
+	InternalStatistics(n, act, nb, np, npr, &calls);
+
+	// send the list in chunks to keep the buffer small
+	PINDEX chunkSize = msg.GetLength();
+	unsigned matches = 0, listed = 0;
+	for (std::vector<callptr>::iterator Iter = calls.begin(); Iter != calls.end(); ++Iter) {
+		if (filter && !filter->Match(**Iter))
+			continue;
+		if (!filter || filter->OnPage(matches)) {
+			const PString line = (*Iter)->PrintOn(verbose);
+			msg += line;
+			chunkSize += line.GetLength();
+			++listed;
+			if (chunkSize >= STATUS_LIST_CHUNK_SIZE) {
+				client->TransmitData(msg);
+				msg = PString::Empty();
+				chunkSize = 0;
+			}
+		}
+		++matches;
+		*Iter = callptr(); // release the call as soon as possible
+	}
 
 	PString bandstr;
 	if (m_capacity >= 0)
 		bandstr = PString(PString::Printf, "\r\nAvailable Bandwidth: %u", m_capacity);
+	if (filter && filter->IsPaged())
+		bandstr = PString(PString::Printf, "\r\nMatching Calls: %u Listed: %u", matches, listed) + bandstr;
+	else if (filter)
+		bandstr = PString(PString::Printf, "\r\nMatching Calls: %u", matches) + bandstr;
 	msg += PString(PString::Printf, "Number of Calls: %u Active: %u From Neighbor: %u From Parent: %u Proxied: %u%s\r\n;\r\n", n, act, nb, np, npr, (const char *)bandstr);
 	client->TransmitData(msg);
 }
@@ -5873,9 +6516,24 @@ void CallTable::PrintCurrentCallsPorts(USocket *client) const
 {
 	PString msg = "CurrentCallsPorts\r\n";
 	if (Toolkit::Instance()->IsPortNotificationActive()) {
-		ReadLock lock(listLock);
-		for (const_iterator Iter = CallList.begin(); Iter != CallList.end(); ++Iter) {
-			msg += (*Iter)->PrintPorts();
+		// copy the pointers to print outside the lock
+		std::vector<callptr> calls;
+		listLock.StartRead();
+		calls.reserve(CallList.size());
+		for (const_iterator Iter = CallList.begin(); Iter != CallList.end(); ++Iter)
+			calls.push_back(callptr(*Iter));
+		listLock.EndRead();
+
+		PINDEX chunkSize = msg.GetLength();
+		for (std::vector<callptr>::const_iterator Iter = calls.begin(); Iter != calls.end(); ++Iter) {
+			const PString line = (*Iter)->PrintPorts();
+			msg += line;
+			chunkSize += line.GetLength();
+			if (chunkSize >= STATUS_LIST_CHUNK_SIZE) {
+				client->TransmitData(msg);
+				msg = PString::Empty();
+				chunkSize = 0;
+			}
 		}
 	} else {
 		msg += "Port accounting is only active when notifications are configured in [PortNotifications]\r\n";
@@ -5886,9 +6544,8 @@ void CallTable::PrintCurrentCallsPorts(USocket *client) const
 
 PString CallTable::PrintStatistics() const
 {
-	PString dumb;
 	unsigned n, act, nb, np, npr;
-	InternalStatistics(n, act, nb, np, npr, dumb, FALSE);
+	InternalStatistics(n, act, nb, np, npr, NULL);
 
 	return PString(PString::Printf, "-- Call Statistics --\r\n"
 		"Current Calls: %u Active: %u From Neighbor: %u From Parent: %u Proxied: %u\r\n"
@@ -17,6 +17,7 @@
 #include <list>
 #include <map>
 #include <string>
+#include <vector>
 #include "rwlock.h"
 #include "singleton.h"
 #include "h225.h"
@@ -175,6 +176,33 @@ public:
 	GkH235Authenticators * GetH235Authenticators();
 	void SetH235Authenticators(GkH235Authenticators * auth);
 
+	/** Remember an encoded RAS message sent to this endpoint (eg. the RCF for
+	    lightweight RRQs or the IRQ poll), so it can be sent again with only
+	    the request sequence number patched. An empty buffer clears the template.
+	*/
+	void SetRasTemplate(
+		unsigned tag, /// RAS message type
+		const PBYTEArray & encoded, /// encoded message
+		PINDEX seqNumPos, /// position of the 16 bit request sequence number
+		const PIPSocket::Address & localAddr, /// local address the message was built for
+		unsigned generation /// RasServer config generation
+		);
+
+	/** @return
+	    true if a template of the given type built for the local address, config
+	    generation and the current timeToLive exists. It is copied into encoded.
+	*/
+	bool GetRasTemplate(
+		unsigned tag,
+		PBYTEArray & encoded,
+		PINDEX & seqNumPos,
+		const PIPSocket::Address & localAddr,
+		unsigned generation
+		) const;
+
+	/// drop all cached RAS templates
+	void ClearRasTemplates();
+
 	virtual EndpointRec *Unregisterpreempt(int type);
 	virtual EndpointRec *Reregister();
 	virtual EndpointRec *Unregister();
@@ -302,6 +330,7 @@ public:
 	*/
 	bool HasAvailableCapacity(const H225_ArrayOf_AliasAddress & aliases) const;
 	unsigned GetActiveCalls() const { return m_activeCall; }
+	unsigned GetTotalCalls() const { return m_totalCall; }
 	// void DumpPrefixCapacity() const;
 	string LongestPrefixMatch(const PString & alias, int & capacity) const;
 	void UpdatePrefixStats(const PString & dest, int update);
@@ -441,6 +470,15 @@ protected:
 	PString m_disabledcodecs;
 	/// H.235 used to authenticate this endpoint
 	GkH235Authenticators * m_authenticators;
+	/// pre-encoded RAS messages by message type
+	struct RasTemplate {
+		PBYTEArray m_encoded;
+		PINDEX m_seqNumPos;
+		PIPSocket::Address m_localAddr;
+		int m_timeToLive;
+		unsigned m_generation;
+	};
+	std::map<unsigned, RasTemplate> m_rasTemplates;
 };
 
 typedef EndpointRec::Ptr endptr;
@@ -565,6 +603,44 @@ protected:
 	unsigned long m_videoJitter;
 };
 
+/// filter and page for the endpoint and call listings on the status port
+class StatusListFilter {
+public:
+	StatusListFilter();
+
+	/** Parse filter arguments like alias=PREFIX, ip=NETWORK/LEN, type=TYPE,
+	    state=STATE, offset=N and limit=N.
+
+	    @return	false if an argument is invalid, eg. a non-numeric offset or limit
+	    */
+	bool Parse(
+		const PStringArray & args, /// status port command arguments
+		PINDEX first /// index of the first filter argument
+		);
+
+	bool Match(const EndpointRec & ep) const;
+	bool Match(const CallRec & call) const;
+
+	/// @return	true if the n-th matching entry (counted from 0) is on the requested page
+	bool OnPage(unsigned n) const { return n >= m_offset && (m_limit == 0 || n - m_offset < m_limit); }
+
+	bool IsPaged() const { return m_offset > 0 || m_limit > 0; }
+
+protected:
+	bool MatchAlias(const PString & alias) const;
+	bool MatchIP(const PIPSocket::Address & ip) const;
+	bool MatchType(const EndpointRec & ep) const;
+
+	PString m_aliasPrefix;
+	PIPSocket::Address m_network; /// NetworkAddress can't be used here, Toolkit.h includes this file
+	PIPSocket::Address m_netmask;
+	bool m_hasNetwork;
+	PString m_type; /// terminal, gateway, mcu or gatekeeper
+	PString m_state; /// connected, alerting or setup
+	unsigned m_offset;
+	unsigned m_limit; /// 0 = no limit
+};
+
 class RegistrationTable : public Singleton<RegistrationTable> {
 public:
 	typedef std::list<EndpointRec *>::iterator iterator;
@@ -602,8 +678,8 @@ public:
 #endif
     void UnregisterAllEndpointsNotInCall();
 
-	void PrintAllRegistrations(USocket *client, bool verbose=FALSE);
-	void PrintAllCached(USocket *client, bool verbose=FALSE);
+	void PrintAllRegistrations(USocket *client, bool verbose=FALSE, const StatusListFilter * filter = NULL);
+	void PrintAllCached(USocket *client, bool verbose=FALSE, const StatusListFilter * filter = NULL);
 	void PrintRemoved(USocket *client, bool verbose=FALSE);
 	void PrintPrefixCapacities(USocket *client, PString alias) const;
 	void PrintEndpointQoS(USocket *client); //const;
@@ -615,6 +691,40 @@ public:
 	/** Updates Prefix + Flags for all aliases */
 	void LoadConfig();
 
+	/// write the registered endpoints to the snapshot file at shutdown, no snapshots are written after this one
+	void SaveSnapshot();
+	/// write a snapshot in a job of its own, skipped while the last one is still being written
+	void StartSnapshot();
+	/// restore the registered endpoints from the snapshot file, called once at startup
+	void LoadSnapshot();
+	/// delete the snapshot file at shutdown, eg. when all endpoints will be unregistered
+	void RemoveSnapshot();
+	/// @return	seconds between two snapshots, 0 = no snapshots
+	int GetSnapshotInterval() const { return m_snapshotFile.IsEmpty() ? 0 : m_snapshotInterval; }
+
+	/// get references to all registered endpoints
+	void GetEndpoints(std::vector<endptr> & endpoints) const;
+	/** Build a full RRQ with the current aliases, addresses and TTL of an endpoint,
+	    to save or replicate the registration.
+
+	    @return	false if the endpoint hasn't been registered by an RRQ
+	*/
+	static bool BuildRegistrationRequest(const endptr & ep, H225_RasMessage & ras);
+	/** Tell the SNMP cache and RegistrationSync that the aliases, addresses
+	    or gateway prefixes of a registered endpoint have changed.
+	    Must be called after every change that doesn't go through InsertRec.
+	*/
+	void OnEndpointChanged(EndpointRec * ep);
+
+	/** Add or replace an endpoint registered on a peer gatekeeper.
+	    Remote endpoints are only used to find call destinations,
+	    the table takes ownership of the record.
+	*/
+	void UpdateRemote(const PString & peer, EndpointRec * ep);
+	void RemoveRemote(const PString & peer, const PString & endpointId);
+	/// remove all endpoints of a peer gatekeeper, eg. when the connection is lost
+	void ClearRemote(const PString & peer);
+
 	PINDEX Size() const { return regSize; }
 
 private:
@@ -624,10 +734,14 @@ private:
 	endptr InternalInsertOZEP(H225_RasMessage &, H225_AdmissionConfirm &);
 	endptr InternalInsertOZEP(const H225_Setup_UUIE & setupBody, H225_TransportAddress addr);
 
-	void InternalPrint(USocket *, bool, std::list<EndpointRec *> *, PString &);
+	void InternalPrint(USocket *, bool, std::list<EndpointRec *> *, PString &, const StatusListFilter *);
 	void InternalStatistics(const std::list<EndpointRec *> *, unsigned & s, unsigned & t, unsigned & g, unsigned & n) const;
 
 	void InternalRemove(iterator);
+	// add to / erase from EndpointList, keeping the endpoint ID index in sync
+	// listLock must be held for writing
+	void InternalAppend(EndpointRec *);
+	iterator InternalErase(iterator);
 
 	template<class F> endptr InternalFind(const F & FindObject) const
 	{ return InternalFind(FindObject, &EndpointList); }
@@ -643,18 +757,32 @@ private:
 	endptr InternalFindFirstEP(const H225_ArrayOf_AliasAddress & alias, std::list<EndpointRec *> *ListToBeFound);
 	bool InternalFindEP(const H225_ArrayOf_AliasAddress & alias, std::list<EndpointRec *> *ListToBeFound, bool roundrobin, bool leastUsedRouting, std::list<Routing::Route> &routes);
 
+	void SnapshotJob();
+	// m_snapshotMutex must be held
+	void WriteSnapshot();
+
 	void GenerateEndpointId(H225_EndpointIdentifier & NewEndpointId, PString prefix = "");
 	void GenerateAlias(H225_ArrayOf_AliasAddress &, const H225_EndpointIdentifier &) const;
 
 	std::list<EndpointRec *> EndpointList;
 	std::list<EndpointRec *> OutOfZoneList;
 	std::list<EndpointRec *> RemovedList;
+	// endpoints registered on peer gatekeepers and the index by peer and endpoint ID
+	std::list<EndpointRec *> RemoteList;
+	std::map<PString, EndpointRec *> RemoteIndex;
+	// index on EndpointList by endpoint ID, used for lightweight RRQs and all other ID lookups
+	std::multimap<PString, EndpointRec *> EndpointIdIndex;
 	int regSize;
 	mutable PReadWriteMutex listLock;
-	PMutex findmutex;          // Endpoint Find Mutex
 
 	PString endpointIdSuffix; // Suffix of the generated Endpoint IDs
 
+	PString m_snapshotFile; // file for the warm restart snapshot, empty = disabled
+	int m_snapshotInterval; // seconds
+	PMutex m_snapshotMutex; // only one snapshot is written at a time
+	bool m_snapshotRunning; // a snapshot job has been started and not finished yet
+	bool m_snapshotsStopped; // the snapshot has been written or removed at shutdown
+
 	// not assignable
 	RegistrationTable(const RegistrationTable &);
 	RegistrationTable& operator=(const RegistrationTable &);
@@ -1769,7 +1897,7 @@ public:
 	void DropCallingParty();
 	void DropCalledParty();
 
-	void PrintCurrentCalls(USocket *client, bool verbose=FALSE) const;
+	void PrintCurrentCalls(USocket *client, bool verbose=FALSE, const StatusListFilter * filter = NULL) const;
 	void PrintCurrentCallsPorts(USocket *client) const;
 	PString PrintStatistics() const;
 	void PrintCallInfo(USocket *client, const PString & callid) const;
@@ -1821,7 +1949,7 @@ private:
 	void InternalRemove(iterator);
 	void InternalRemoveFailedLeg(iterator);
 
-	void InternalStatistics(unsigned & n, unsigned & act, unsigned & nb, unsigned & np, unsigned & npr, PString & msg, bool verbose) const;
+	void InternalStatistics(unsigned & n, unsigned & act, unsigned & nb, unsigned & np, unsigned & npr, std::vector<callptr> * calls) const;
 
 	std::list<CallRec *> CallList;
 	std::list<CallRec *> RemovedList;
@@ -26,6 +26,7 @@
 #include "sigmsg.h"
 #include "Routing.h"
 #include "gksql.h"
+#include "metrics.h"
 
 #ifdef HAS_H46023
   #include <h460/h4601.h>
@@ -261,6 +262,7 @@ bool Policy::Handle(SetupRequest & request)
 		if (OnRequest(request)) {
 			PTRACE(5, "ROUTING\tPolicy " << m_name
 				<< " applied to the request " << tagname << " CRV=" << crv);
+			CountHit();
 			return true;
 		}
 	}
@@ -278,6 +280,7 @@ bool Policy::Handle(FacilityRequest& request)
 		if (OnRequest(request)) {
 			PTRACE(5, "ROUTING\tPolicy " << m_name
 				<< " applied to the request " << tagname << " CRV=" << crv);
+			CountHit();
 			return true;
 		}
 	}
@@ -293,10 +296,18 @@ void Policy::SetInstance(const PString & instance)
 		m_name = *(PString *)policyName.Clone();
 	}
 	m_iniSection = "Routing::" + policyName;
+	m_hits = Metrics::Instance()->GetCounter("gnugk_routing_policy_hits_total",
+		"Requests routed by each routing policy", "policy=\"" + policyName + "\"");
 
 	LoadConfig(instance);
 }
 
+void Policy::CountHit()
+{
+	if (m_hits)
+		m_hits->Inc();
+}
+
 
 // class Analyzer
 Analyzer::Analyzer() : Singleton<Analyzer>("Routing::Analyzer")
@@ -40,6 +40,7 @@ typedef H225SignalingMsg<H225_Facility_UUIE> FacilityMsg;
 class RasMsg;
 class GkClient;
 class GkSQLConnection;
+class MetricCounter;
 
 namespace Routing {
 
@@ -244,7 +245,7 @@ T *PolicyList<T>::Create(const PStringArray & rules)
 
 class Policy : public PolicyList<Policy> {
 public:
-	Policy() : m_name("Undefined"), m_iniSection("Routing::Undefined") { }
+	Policy() : m_name("Undefined"), m_iniSection("Routing::Undefined"), m_hits(NULL) { }
 	virtual ~Policy() { }
 
 	template <class R> bool HandleRas(Request<R, RasMsg> & request)
@@ -258,6 +259,7 @@ public:
 			if( OnRequest(request) ) {
 				PTRACE(5, "ROUTING\tPolicy " << m_name
 					<< " applied to the request " << tagname << ' ' << seqnum);
+				CountHit();
 				return true;
 			}
 		}
@@ -284,12 +286,17 @@ protected:
 
 	virtual void LoadConfig(const PString & /* instance */) { }	// should be used to load config, always called after the policy object is created
 
+	/// count a request routed by this policy for the metrics
+	void CountHit();
+
 protected:
 	/// human readable name for the policy - it should be set inside constructors
 	/// of derived policies, default value is "undefined"
 	const char* m_name;
 	PString m_iniSection;
 	PString m_instance;
+	/// requests routed by this policy
+	MetricCounter * m_hits;
 };
 
 
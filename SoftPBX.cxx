@@ -21,6 +21,7 @@
 #include "ProxyChannel.h"
 #include "SoftPBX.h"
 #include "capctrl.h"
+#include "gkauth.h"
 #include "h323util.h"
 #include "MakeCall.h"
 #include "Neighbor.h"
@@ -56,16 +57,16 @@ void SoftPBX::PrintEndpoint(const PString & EpStr, USocket *client, bool verbose
 	client->TransmitData(msg);
 }
 
-void SoftPBX::PrintAllRegistrations(USocket *client, bool verbose)
+void SoftPBX::PrintAllRegistrations(USocket *client, bool verbose, const StatusListFilter * filter)
 {
 	PTRACE(3, "GK\tSoftPBX: PrintAllRegistrations");
-	RegistrationTable::Instance()->PrintAllRegistrations(client, verbose);
+	RegistrationTable::Instance()->PrintAllRegistrations(client, verbose, filter);
 }
 
-void SoftPBX::PrintAllCached(USocket *client, bool verbose)
+void SoftPBX::PrintAllCached(USocket *client, bool verbose, const StatusListFilter * filter)
 {
 	PTRACE(3, "GK\tSoftPBX: PrintAllCached");
-	RegistrationTable::Instance()->PrintAllCached(client, verbose);
+	RegistrationTable::Instance()->PrintAllCached(client, verbose, filter);
 }
 
 void SoftPBX::PrintRemoved(USocket *client, bool verbose)
@@ -74,10 +75,10 @@ void SoftPBX::PrintRemoved(USocket *client, bool verbose)
 	RegistrationTable::Instance()->PrintRemoved(client, verbose);
 }
 
-void SoftPBX::PrintCurrentCalls(USocket *client, bool verbose)
+void SoftPBX::PrintCurrentCalls(USocket *client, bool verbose, const StatusListFilter * filter)
 {
 	PTRACE(3, "GK\tSoftPBX: PrintCurrentCalls");
-	CallTable::Instance()->PrintCurrentCalls(client, verbose);
+	CallTable::Instance()->PrintCurrentCalls(client, verbose, filter);
 }
 
 void SoftPBX::PrintCurrentCallsPorts(USocket *client)
@@ -537,6 +538,14 @@ void SoftPBX::PrintCapacityControlRules(USocket *client)
 	client->TransmitData(msg);
 }
 
+void SoftPBX::PrintCacheStatistics(USocket *client)
+{
+	PTRACE(3, "GK\tSoftPBX: PrintCacheStatistics");
+	PString msg(CacheManager::PrintStatistics());
+	msg += ";\r\n";
+	client->TransmitData(msg);
+}
+
 void SoftPBX::PrintEndpointQoS(USocket *client)
 {
 	PTRACE(3, "GK\tSoftPBX: PrintEndpointQoS");
@@ -21,16 +21,17 @@ class PString;
 class USocket;
 class EndpointRec;
 class CallRec;
+class StatusListFilter;
 template<class> class SmartPtr;
 typedef SmartPtr<EndpointRec> endptr;
 
 namespace SoftPBX
 {
 	void PrintEndpoint(const PString & EpStr, USocket *client, bool verbose);
-	void PrintAllRegistrations(USocket *client, bool verbose=false);
-	void PrintAllCached(USocket *client, bool verbose=false);
+	void PrintAllRegistrations(USocket *client, bool verbose=false, const StatusListFilter * filter=NULL);
+	void PrintAllCached(USocket *client, bool verbose=false, const StatusListFilter * filter=NULL);
 	void PrintRemoved(USocket *client, bool verbose=false);
-	void PrintCurrentCalls(USocket *client, bool verbose=false);
+	void PrintCurrentCalls(USocket *client, bool verbose=false, const StatusListFilter * filter=NULL);
 	void PrintCurrentCallsPorts(USocket *client);
 	void PrintStatistics(USocket *client, bool verbose=false);
 	void ResetCallCounters(USocket *client);
@@ -52,6 +53,7 @@ namespace SoftPBX
 	void RerouteCall(const PString & CallId, const PCaselessString & whichLeg, const PString & destination);
 	void PrintPrefixCapacities(USocket *client, const PString & alias);
 	void PrintCapacityControlRules(USocket *client);
+	void PrintCacheStatistics(USocket *client);
 	void PrintEndpointQoS(USocket *client);
 	void PrintNeighbors(USocket *client);
 	void PrintCallInfo(USocket *client, const PString & callid);
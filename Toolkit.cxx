@@ -704,7 +704,8 @@ void Toolkit::ProxyCriterion::LoadConfig(PConfig *config)
 	}
 
 	m_internalnetworks.clear();
-	m_modeselection.clear();
+	m_internalnetworkIndex.Clear();
+	m_modeselection.Clear();
 
 	PStringArray networks(config->GetString(ProxySection, "InternalNetwork", "").Tokenise(" ,;\t", FALSE));
 
@@ -723,7 +724,9 @@ void Toolkit::ProxyCriterion::LoadConfig(PConfig *config)
 	if (networks.GetSize() == 0) {
 		m_internalnetworks = Toolkit::Instance()->GetInternalNetworks();
 		for (unsigned j = 0; j < m_internalnetworks.size(); ++j) {
-			m_modeselection[m_internalnetworks[j]] = internal_netmode;
+			if (!m_internalnetworkIndex.Find(m_internalnetworks[j]))
+				m_internalnetworkIndex.Insert(m_internalnetworks[j], j + 1);
+			m_modeselection.Insert(m_internalnetworks[j], internal_netmode);
 			PTRACE(2, "GK\tInternal Network " << j << " = " << m_internalnetworks[j].AsString()
 					<< " (" << internal_netmode.fromExternal << "," << internal_netmode.insideNetwork << ")");
 		}
@@ -732,8 +735,10 @@ void Toolkit::ProxyCriterion::LoadConfig(PConfig *config)
         Toolkit::Instance()->GetRouteTable()->ClearInternalNetworks();
 		for (PINDEX i = 0; i < networks.GetSize(); ++i) {
 			m_internalnetworks.push_back(networks[i]);
+			if (!m_internalnetworkIndex.Find(m_internalnetworks.back()))
+				m_internalnetworkIndex.Insert(m_internalnetworks.back(), m_internalnetworks.size());
 			Toolkit::Instance()->GetRouteTable()->AddInternalNetwork(networks[i]);
-			m_modeselection[networks[i]] = internal_netmode;
+			m_modeselection.Insert(networks[i], internal_netmode);
 			PTRACE(2, "GK\tINI Internal Network " << i << " = " << m_internalnetworks[i].AsString()
 					<< " (" << internal_netmode.fromExternal << "," << internal_netmode.insideNetwork << ")");
 		}
@@ -743,7 +748,7 @@ void Toolkit::ProxyCriterion::LoadConfig(PConfig *config)
 	PStringToString mode_rules(config->GetAllKeyValues("ModeSelection"));
 	if (mode_rules.GetSize() > 0) {
 		// if we have ModeSelection rules, only use those, don't try to merge them with detected
-		m_modeselection.clear();
+		m_modeselection.Clear();
 	}
 	for (PINDEX i = 0; i < mode_rules.GetSize(); ++i) {
 		PString network = mode_rules.GetKeyAt(i);
@@ -758,12 +763,12 @@ void Toolkit::ProxyCriterion::LoadConfig(PConfig *config)
 					netmode.insideNetwork = ToRoutingMode(modes[1].Trim());
 				// replace 0.0.0.0/0 with 2 rules (0.0.0.0/1 + 128.0.0.0/1), because 0.0.0.0/0 is also treated as invalid network
 				if (network == "0.0.0.0/0" || network == PCaselessString("default")) {
-					m_modeselection[NetworkAddress("0.0.0.0/1")] = netmode;
+					m_modeselection.Insert(NetworkAddress("0.0.0.0/1"), netmode);
 					PTRACE(2, "GK\tModeSelection rule: 0.0.0.0/1=" << netmode.fromExternal << "," << netmode.insideNetwork);
-					m_modeselection[NetworkAddress("128.0.0.0/1")] = netmode;
+					m_modeselection.Insert(NetworkAddress("128.0.0.0/1"), netmode);
 					PTRACE(2, "GK\tModeSelection rule: 128.0.0.0/1=" << netmode.fromExternal << "," << netmode.insideNetwork);
 				} else {
-					m_modeselection[addr] = netmode;
+					m_modeselection.Insert(addr, netmode);
 					PTRACE(2, "GK\tModeSelection rule: " << addr.AsString() << "=" << netmode.fromExternal << "," << netmode.insideNetwork);
 				}
 			} else {
@@ -785,22 +790,6 @@ int Toolkit::ProxyCriterion::ToRoutingMode(const PCaselessString & mode) const
 		return CallRec::Undefined;
 }
 
-// returns network for the rule or IsAny() when no is rule found
-NetworkAddress Toolkit::ProxyCriterion::FindModeRule(const NetworkAddress & ip) const
-{
-	NetworkAddress bestmatch;
-
-	std::map<NetworkAddress, NetworkModes>::const_iterator iter = m_modeselection.begin();
-	while (iter != m_modeselection.end()) {
-		if ((ip << iter->first) && (iter->first.GetNetmaskLen() >= bestmatch.GetNetmaskLen())) {
-			bestmatch = iter->first;
-		}
-		++iter;
-	}
-
-	return bestmatch;
-}
-
 int Toolkit::ProxyCriterion::SelectRoutingMode(const Address & ip1, const Address & ip2) const
 {
 	// default mode
@@ -810,44 +799,32 @@ int Toolkit::ProxyCriterion::SelectRoutingMode(const Address & ip1, const Addres
 	PTRACE(5, "ModeSelection for " << ip1.AsString() << " -> " << ip2.AsString() << " default=" << mode);
 
 	// check if we have a more specific setting
-	NetworkAddress bestMatchIP1 = FindModeRule(ip1);
-	NetworkAddress bestMatchIP2 = FindModeRule(ip2);
+	const NetworkModes * bestMatchIP1 = m_modeselection.FindBestMatch(ip1);
+	const NetworkModes * bestMatchIP2 = m_modeselection.FindBestMatch(ip2);
 
-	std::map<NetworkAddress, NetworkModes>::const_iterator iter;
 	// check for same network
-	if (!bestMatchIP1.IsAny() && !bestMatchIP2.IsAny()) {
+	if (bestMatchIP1 && bestMatchIP2) {
 		// rules for both IPs
-		if (bestMatchIP1.Compare(bestMatchIP2) == 0) {
+		if (bestMatchIP1 == bestMatchIP2) {
 			// both on same network
-			iter = m_modeselection.find(bestMatchIP1);
-			if (iter != m_modeselection.end()) {
-				mode = iter->second.insideNetwork;
-				PTRACE(5, "ModeSelection: Both IPs on same network: mode=" << mode);
-			}
+			mode = bestMatchIP1->insideNetwork;
+			PTRACE(5, "ModeSelection: Both IPs on same network: mode=" << mode);
 		} else {
 			// on different networks, use maximum poxying
-			iter = m_modeselection.find(bestMatchIP1);
-			int mode1 = iter->second.fromExternal;	// no check, must exist
-			iter = m_modeselection.find(bestMatchIP2);
-			int mode2 = iter->second.fromExternal;	// no check, must exist
+			int mode1 = bestMatchIP1->fromExternal;
+			int mode2 = bestMatchIP2->fromExternal;
 			mode = max(mode1, mode2);
 			PTRACE(5, "ModeSelection: Both IPs on different networks: mode1=" << mode1 << " mode2=" << mode2 << " => " << mode);
 		}
 	} else {
 		// only one rule, use that
-		if (!bestMatchIP1.IsAny()) {
-			iter = m_modeselection.find(bestMatchIP1);
-			if (iter != m_modeselection.end()) {
-				mode = iter->second.fromExternal;
-				PTRACE(5, "ModeSelection: Only rule for IP 1 = " << ip1.AsString() << " mode=" << mode);
-			}
+		if (bestMatchIP1) {
+			mode = bestMatchIP1->fromExternal;
+			PTRACE(5, "ModeSelection: Only rule for IP 1 = " << ip1.AsString() << " mode=" << mode);
 		}
-		if (!bestMatchIP2.IsAny()) {
-			iter = m_modeselection.find(bestMatchIP2);
-			if (iter != m_modeselection.end()) {
-				mode = iter->second.fromExternal;
-				PTRACE(5, "ModeSelection: Only rule for IP 2 = " << ip2.AsString() << " mode=" << mode);
-			}
+		if (bestMatchIP2) {
+			mode = bestMatchIP2->fromExternal;
+			PTRACE(5, "ModeSelection: Only rule for IP 2 = " << ip2.AsString() << " mode=" << mode);
 		}
 	}
 
@@ -857,14 +834,8 @@ int Toolkit::ProxyCriterion::SelectRoutingMode(const Address & ip1, const Addres
 int Toolkit::ProxyCriterion::IsInternal(const Address & ip) const
 {
 	// Return the network Id. Addresses may be on different internal networks
-	int retval = 0;
-	std::vector<NetworkAddress>::const_iterator i = m_internalnetworks.begin();
-	while (i != m_internalnetworks.end()) {
-		retval++;
-		if (ip << *i++)
-			return retval;
-	}
-	return 0;
+	const unsigned * id = m_internalnetworkIndex.FindBestMatch(ip);
+	return id ? *id : 0;
 }
 
 // class Toolkit::RewriteTool
@@ -897,7 +868,9 @@ void Toolkit::RewriteData::AddSection(PConfig * config, const PString & section)
 					rules[Key(j)] = Value(j);
 				}
 			}
-			m_size = m_size + n_size;
+			// the old rules have been copied into the map
+			FreeRules();
+			m_size = rules.size();
 			// replace array constructor with explicit memory allocation
 			// and in-place new operators - workaround for VC compiler
 //			m_RewriteKey = new PString[m_size * 2];
@@ -912,9 +885,14 @@ void Toolkit::RewriteData::AddSection(PConfig * config, const PString & section)
 //				m_RewriteValue[i] = iter->second;
 				::new(m_RewriteValue + i) PString(iter->second);
 			}
+
+			m_index.Clear();
+			for (PINDEX i = 0; i < m_size; ++i)
+				m_index.Add(m_RewriteKey[i], i);
 		}
 	}
 }
+
 Toolkit::RewriteData::RewriteData(PConfig *config, const PString & section)
 {
 	m_RewriteKey = NULL;
@@ -924,6 +902,11 @@ Toolkit::RewriteData::RewriteData(PConfig *config, const PString & section)
 }
 
 Toolkit::RewriteData::~RewriteData()
+{
+	FreeRules();
+}
+
+void Toolkit::RewriteData::FreeRules()
 {
 	if (m_RewriteKey) {
 		for (int i = 0; i < m_size * 2; i++) {
@@ -931,6 +914,8 @@ Toolkit::RewriteData::~RewriteData()
 		}
 	}
 	delete[] ((BYTE*)m_RewriteKey);
+	m_RewriteKey = m_RewriteValue = NULL;
+	m_size = 0;
 }
 
 void Toolkit::RewriteTool::LoadConfig(PConfig *config)
@@ -984,38 +969,34 @@ bool Toolkit::RewriteTool::RewritePString(PString & s) const
 	if (strncmp(s, m_RewriteFastmatch, m_RewriteFastmatch.GetLength()) != 0)
 		return changed;
 
-	PString t;
-	for (PINDEX i = 0; i < m_Rewrite->Size(); ++i) {
+	// find the first matching key
+	const int i = m_Rewrite->Find(s);
+	if (i >= 0) {
 		const char *prefix = m_Rewrite->Key(i);
 		if (prefix == s){
 			s = m_Rewrite->Value(i);
 			return true;
 		}
 		const int len = MatchPrefix(s, prefix);
-		// try a prefix match through all keys
-		if (len > 0 || (len == 0 && prefix[0] == '!')) {
-			// Rewrite to #t#. Append the suffix, too.
-			// old:  01901234999
-			//               999 Suffix
-			//       0190        Fastmatch
-			//       01901234    prefix, Config-Rule: 01901234=0521321
-			// new:  0521321999
-
-			const char *newprefix = m_Rewrite->Value(i);
-
-			PString result;
-			if (len > 0) {
-				PString unused;
-				result = RewriteString(s, prefix, newprefix, unused);
-			} else
-				result = newprefix + s;
-
-			PTRACE(2, "\tRewritePString: " << s << " to " << result);
-			s = result;
-			changed = true;
+		// Rewrite to #t#. Append the suffix, too.
+		// old:  01901234999
+		//               999 Suffix
+		//       0190        Fastmatch
+		//       01901234    prefix, Config-Rule: 01901234=0521321
+		// new:  0521321999
+
+		const char *newprefix = m_Rewrite->Value(i);
+
+		PString result;
+		if (len > 0) {
+			PString unused;
+			result = RewriteString(s, prefix, newprefix, unused);
+		} else
+			result = newprefix + s;
 
-			break;
-		}
+		PTRACE(2, "\tRewritePString: " << s << " to " << result);
+		s = result;
+		changed = true;
 	}
 
 	return changed;
@@ -1041,49 +1022,44 @@ bool Toolkit::GWRewriteTool::RewritePString(const PString & gw, bool direction,
 	if (gw_entry == NULL)
 		return false;
 
-	std::vector<pair<PString, PString> >::iterator rule_iterator = direction
-		? gw_entry->m_entry_data.first.begin() : gw_entry->m_entry_data.second.begin();
-	std::vector<pair<PString, PString> >::iterator end_iterator = direction
-		? gw_entry->m_entry_data.first.end() : gw_entry->m_entry_data.second.end();
-
-	PString key, value;
-	for (; rule_iterator != end_iterator; ++rule_iterator) {
-		key = (*rule_iterator).first;
+	const std::vector<pair<PString, PString> > & rules = direction
+		? gw_entry->m_entry_data.first : gw_entry->m_entry_data.second;
+	const int i = direction ? gw_entry->m_inIndex.Find(data) : gw_entry->m_outIndex.Find(data);
+	if (i < 0)
+		return false;
 
-		bool postdialmatch = false;
-		if (key.Find("I") != P_MAX_INDEX) {
-			postdialmatch = true;
-			key.Replace("I", ".", true);
-		}
+	PString key = rules[i].first;
 
-		const int len = MatchPrefix(data, key);
-		if (len > 0 || (len == 0 && key[0] == '!')) {
-			// Start rewrite
-			value = (*rule_iterator).second;
+	bool postdialmatch = false;
+	if (key.Find("I") != P_MAX_INDEX) {
+		postdialmatch = true;
+		key.Replace("I", ".", true);
+	}
 
-			PString postdialdigits;
-			if (postdialmatch) {
-				value.Replace("P", ".", true);
-			}
+	const int len = MatchPrefix(data, key);
 
-			if (len > 0) {
-				value = RewriteString(data, key, value, postdialdigits, postdialmatch);
-				if (call && postdialmatch && !postdialdigits.IsEmpty()) {
-					call->SetPostDialDigits(postdialdigits);
-				}
-			} else
-				value = value + data;
+	// Start rewrite
+	PString value = rules[i].second;
 
-			// Log
-			PTRACE(2, "\tGWRewriteTool::RewritePString: " << data << " to " << value << " post dial digits=" << postdialdigits);
+	PString postdialdigits;
+	if (postdialmatch) {
+		value.Replace("P", ".", true);
+	}
 
-			// Finish rewrite
-			data = value;
-			return true;
+	if (len > 0) {
+		value = RewriteString(data, key, value, postdialdigits, postdialmatch);
+		if (call && postdialmatch && !postdialdigits.IsEmpty()) {
+			call->SetPostDialDigits(postdialdigits);
 		}
-	}
+	} else
+		value = value + data;
 
-	return false;
+	// Log
+	PTRACE(2, "\tGWRewriteTool::RewritePString: " << data << " to " << value << " post dial digits=" << postdialdigits);
+
+	// Finish rewrite
+	data = value;
+	return true;
 }
 
 void Toolkit::GWRewriteTool::PrintData()
@@ -1183,6 +1159,18 @@ void Toolkit::GWRewriteTool::LoadConfig(PConfig * config)
 			gw_entry->m_entry_data.first = sorted_in_strings;
 			gw_entry->m_entry_data.second = sorted_out_strings;
 
+			// 'I' matches any digit and is turned into a post dial digit
+			for (unsigned r = 0; r < sorted_in_strings.size(); ++r) {
+				PString prefix = sorted_in_strings[r].first;
+				prefix.Replace("I", ".", true);
+				gw_entry->m_inIndex.Add(prefix, r);
+			}
+			for (unsigned r = 0; r < sorted_out_strings.size(); ++r) {
+				PString prefix = sorted_out_strings[r].first;
+				prefix.Replace("I", ".", true);
+				gw_entry->m_outIndex.Add(prefix, r);
+			}
+
 			// Add to PDictionary hash table
 			m_GWRewrite.Insert(key, gw_entry);
 		}
@@ -16,6 +16,7 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <ptlib.h>
 #include <ptlib/sockets.h>
 #include "singleton.h"
@@ -106,6 +107,143 @@ bool operator==(const PIPSocket::Address & addr, const NetworkAddress & net);
 /// @return	True if the given address is contained withing this network
 bool operator<<(const PIPSocket::Address & addr, const NetworkAddress & net);
 
+/** Binary radix tree of IPv4 and IPv6 networks with a value for each network.
+    A lookup finds the longest network that contains an address in O(address bits).
+*/
+template <class T>
+class NetworkAddressTree {
+public:
+	NetworkAddressTree() : m_root4(NULL), m_root6(NULL), m_size(0) { }
+	~NetworkAddressTree() { Clear(); }
+
+	/// remove all networks
+	void Clear()
+	{
+		DeleteNode(m_root4);
+		DeleteNode(m_root6);
+		m_root4 = m_root6 = NULL;
+		m_size = 0;
+	}
+
+	/** Set the value for a network, an existing value is replaced.
+	    @return	False if the network was already in the tree
+	*/
+	bool Insert(const NetworkAddress & net, const T & value)
+	{
+		const unsigned len = net.GetNetmaskLen();
+		Node * & root = (net.m_address.GetSize() == 16) ? m_root6 : m_root4;
+		if (root == NULL)
+			root = new Node;
+		Node * node = root;
+		for (unsigned bit = 0; bit < len; ++bit) {
+			Node * & child = node->m_child[GetBit(net.m_address, bit)];
+			if (child == NULL)
+				child = new Node;
+			node = child;
+		}
+		if (node->m_entry) {
+			node->m_entry->second = value;
+			return false;
+		}
+		node->m_entry = new Entry(net, value);
+		++m_size;
+		return true;
+	}
+
+	/// @return	The value for exactly this network or NULL
+	const T * Find(const NetworkAddress & net) const
+	{
+		const unsigned len = net.GetNetmaskLen();
+		const Node * node = (net.m_address.GetSize() == 16) ? m_root6 : m_root4;
+		for (unsigned bit = 0; node && bit < len; ++bit)
+			node = node->m_child[GetBit(net.m_address, bit)];
+		return (node && node->m_entry) ? &node->m_entry->second : NULL;
+	}
+
+	/** Find the longest network that contains the address.
+	    @return	The value for the network or NULL if no network matches
+	*/
+	const T * FindBestMatch(
+		const PIPSocket::Address & addr, /// address to look up
+		NetworkAddress * network = NULL /// set to the matching network
+		) const
+	{
+		const unsigned bits = addr.GetSize() * 8;
+		const Node * node = (bits == 128) ? m_root6 : m_root4;
+		const Entry * best = NULL;
+		for (unsigned bit = 0; node; ++bit) {
+			if (node->m_entry)
+				best = node->m_entry;
+			if (bit >= bits)
+				break;
+			node = node->m_child[GetBit(addr, bit)];
+		}
+		if (best == NULL)
+			return NULL;
+		if (network)
+			*network = best->first;
+		return &best->second;
+	}
+
+	/** Find all networks that contain the address.
+	    @return	The number of values appended to #matches#, the longest network first
+	*/
+	unsigned FindAllMatches(
+		const PIPSocket::Address & addr, /// address to look up
+		std::vector<const T *> & matches /// receives the values
+		) const
+	{
+		const unsigned bits = addr.GetSize() * 8;
+		const Node * node = (bits == 128) ? m_root6 : m_root4;
+		const size_t first = matches.size();
+		for (unsigned bit = 0; node; ++bit) {
+			if (node->m_entry)
+				matches.push_back(&node->m_entry->second);
+			if (bit >= bits)
+				break;
+			node = node->m_child[GetBit(addr, bit)];
+		}
+		std::reverse(matches.begin() + first, matches.end());
+		return matches.size() - first;
+	}
+
+	/// @return	The number of networks in the tree
+	unsigned GetSize() const { return m_size; }
+	bool IsEmpty() const { return m_size == 0; }
+
+private:
+	typedef std::pair<NetworkAddress, T> Entry;
+	struct Node {
+		Node() : m_entry(NULL) { m_child[0] = m_child[1] = NULL; }
+		Node * m_child[2];
+		Entry * m_entry;
+	};
+
+	static unsigned GetBit(const PIPSocket::Address & addr, unsigned bit)
+	{
+		return (addr[bit >> 3] >> (7 - (bit & 7))) & 1;
+	}
+
+	static void DeleteNode(Node * node)
+	{
+		if (node) {
+			DeleteNode(node->m_child[0]);
+			DeleteNode(node->m_child[1]);
+			delete node->m_entry;
+			delete node;
+		}
+	}
+
+	/* No copy constructor allowed */
+	NetworkAddressTree(const NetworkAddressTree &);
+	/* No operator= allowed */
+	NetworkAddressTree & operator=(const NetworkAddressTree &);
+
+	Node * m_root4;
+	Node * m_root6;
+	unsigned m_size;
+};
+
 #ifdef H323_H350
 class H350_Session;
 #endif
@@ -194,12 +332,13 @@ class Toolkit : public Singleton<Toolkit>
 
 	private:
 		int ToRoutingMode(const PCaselessString & mode) const;	// returns a CallRec::RoutingMode
-		NetworkAddress FindModeRule(const NetworkAddress & ip) const;
 
 		bool m_enable;
 		std::vector<NetworkAddress> m_internalnetworks;
+		// position of each internal network in m_internalnetworks, starting with 1
+		NetworkAddressTree<unsigned> m_internalnetworkIndex;
 		// mode selection for networks
-		std::map<NetworkAddress, NetworkModes> m_modeselection;
+		NetworkAddressTree<NetworkModes> m_modeselection;
 	};
 
 	int SelectRoutingMode(const PIPSocket::Address & ip1, const PIPSocket::Address & ip2) const
@@ -218,10 +357,15 @@ class Toolkit : public Singleton<Toolkit>
 		PINDEX Size() const { return m_size; }
 		const PString & Key(PINDEX i) const { return m_RewriteKey[i]; }
 		const PString & Value(PINDEX i) const { return m_RewriteValue[i]; }
+		/// @return	index of the first rule that matches #s# or -1
+		int Find(const PString & s) const { return m_index.Find(s); }
 
 	private:
+		void FreeRules();
+
 		PString *m_RewriteKey, *m_RewriteValue;
 		PINDEX m_size;
+		PrefixIndex m_index;
 	};
 
 	class RewriteTool {
@@ -434,6 +578,7 @@ class Toolkit : public Singleton<Toolkit>
 		PCLASSINFO(GWRewriteEntry, PObject);
 		public:
 			std::pair<std::vector<std::pair<PString,PString> >,std::vector<std::pair<PString,PString> > > m_entry_data;
+			PrefixIndex m_inIndex, m_outIndex; /// prefix indexes for the rules in m_entry_data
 	};
 
 
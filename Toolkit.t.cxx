@@ -43,4 +43,33 @@ TEST_F(ToolkitTest, NetworkAddress) {
 	EXPECT_STREQ("2001:db8:85a3:8d3:1319:8a2e:370:7344/128", na6.AsString());
 }
 
+TEST_F(ToolkitTest, NetworkAddressTree) {
+	NetworkAddressTree<int> tree;
+	EXPECT_TRUE(tree.IsEmpty());
+	EXPECT_TRUE(tree.Insert(NetworkAddress("10.0.0.0/8"), 1));
+	EXPECT_TRUE(tree.Insert(NetworkAddress("10.1.0.0/16"), 2));
+	EXPECT_TRUE(tree.Insert(NetworkAddress("2001:db8::/32"), 3));
+	EXPECT_FALSE(tree.Insert(NetworkAddress("10.0.0.0/8"), 4));
+	EXPECT_EQ(3u, tree.GetSize());
+	EXPECT_EQ(4, *tree.Find(NetworkAddress("10.0.0.0/8")));
+	EXPECT_TRUE(tree.Find(NetworkAddress("10.2.0.0/16")) == NULL);
+
+	NetworkAddress match;
+	EXPECT_EQ(2, *tree.FindBestMatch(PIPSocket::Address("10.1.2.3"), &match));
+	EXPECT_STREQ("10.1.0.0/16", match.AsString());
+	EXPECT_EQ(4, *tree.FindBestMatch(PIPSocket::Address("10.2.2.3")));
+	EXPECT_TRUE(tree.FindBestMatch(PIPSocket::Address("11.1.2.3")) == NULL);
+	EXPECT_EQ(3, *tree.FindBestMatch(PIPSocket::Address("2001:db8::1")));
+	EXPECT_TRUE(tree.FindBestMatch(PIPSocket::Address("2001:db9::1")) == NULL);
+
+	std::vector<const int *> matches;
+	EXPECT_EQ(2u, tree.FindAllMatches(PIPSocket::Address("10.1.2.3"), matches));
+	EXPECT_EQ(2, *matches[0]);
+	EXPECT_EQ(4, *matches[1]);
+	EXPECT_EQ(0u, tree.FindAllMatches(PIPSocket::Address("11.1.2.3"), matches));
+
+	tree.Clear();
+	EXPECT_TRUE(tree.FindBestMatch(PIPSocket::Address("10.1.2.3")) == NULL);
+}
+
 }  // namespace
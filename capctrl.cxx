@@ -15,6 +15,7 @@
  *
  */
 
+#include <set>
 #include "config.h"
 #include <ptlib.h>
 #include <ptlib/ipsock.h>
@@ -65,10 +66,189 @@ struct CLIRule_greater : public std::binary_function<CapacityControl::CLICallVol
 	}
 };
 
+#if !defined(__GNUC__) && !defined(_WIN32)
+PMutex CounterMutex;
+#endif
+
+inline void AtomicIncrement(volatile long * value)
+{
+#if defined(__GNUC__)
+	__sync_add_and_fetch(value, 1);
+#elif defined(_WIN32)
+	InterlockedIncrement(value);
+#else
+	PWaitAndSignal lock(CounterMutex);
+	++*value;
+#endif
+}
+
+inline void AtomicDecrement(volatile long * value)
+{
+#if defined(__GNUC__)
+	__sync_sub_and_fetch(value, 1);
+#elif defined(_WIN32)
+	InterlockedDecrement(value);
+#else
+	PWaitAndSignal lock(CounterMutex);
+	--*value;
+#endif
+}
+
+// the current rule set is published to the lookups without locking
+template <class T>
+inline T * AtomicLoad(T * volatile * ptr)
+{
+#if defined(__GNUC__)
+	return __sync_add_and_fetch(ptr, 0);
+#elif defined(_WIN32)
+	return (T *)InterlockedCompareExchangePointer((PVOID volatile *)ptr, NULL, NULL);
+#else
+	PWaitAndSignal lock(CounterMutex);
+	return *ptr;
+#endif
+}
+
+template <class T>
+inline void AtomicStore(T * volatile * ptr, T * value)
+{
+#if defined(__GNUC__)
+	__sync_synchronize(); // make the new object visible before the pointer
+	__sync_lock_test_and_set(ptr, value);
+#elif defined(_WIN32)
+	InterlockedExchangePointer((PVOID volatile *)ptr, value);
+#else
+	PWaitAndSignal lock(CounterMutex);
+	*ptr = value;
+#endif
+}
+
+template <class Rules>
+void CompilePrefixes(Rules & rules)
+{
+	for (typename Rules::iterator i = rules.begin(); i != rules.end(); ++i)
+		i->second.m_prefixRegex.Compile(i->second.m_prefix);
+}
+
+template <class Rules>
+void GetRuleCounters(const Rules & rules, std::set<CapacityControl::CallCounter *> & counters)
+{
+	for (typename Rules::const_iterator i = rules.begin(); i != rules.end(); ++i)
+		counters.insert(i->second.m_counter);
+}
+
+/// keep the counters of rules that did not change, allocate new ones for the rest
+template <class Rules>
+void AssignCounters(Rules & rules, const Rules * oldRules, std::list<CapacityControl::CallCounter *> & counters)
+{
+	for (typename Rules::iterator i = rules.begin(); i != rules.end(); ++i) {
+		if (oldRules) {
+			typename Rules::const_iterator matchingRule = find(oldRules->begin(), oldRules->end(), *i);
+			if (matchingRule != oldRules->end() && matchingRule->second == i->second) {
+				i->second.m_counter = matchingRule->second.m_counter;
+				continue;
+			}
+		}
+		i->second.m_counter = new CapacityControl::CallCounter;
+		counters.push_back(i->second.m_counter);
+	}
+}
+
+/// @return	position of the rule with the longest prefix match or -1
+template <class Rules>
+int FindBestPrefix(const Rules & rules, const std::vector<unsigned> & positions, const PString & calledStationId)
+{
+	int best = -1;
+	PINDEX matchLen = P_MAX_INDEX;
+	for (unsigned i = 0; i < positions.size(); ++i) {
+		const PINDEX len = rules[positions[i]].second.MatchPrefix(calledStationId);
+		if (len != P_MAX_INDEX && (matchLen == P_MAX_INDEX || len > matchLen)) {
+			best = positions[i];
+			matchLen = len;
+		}
+	}
+	return best;
+}
+
 } // end of anonymous namespace
 
+class CapacityControl::RuleSet {
+public:
+	RuleSet() { }
+
+	/// compile the prefixes and build the lookup indexes
+	void Compile()
+	{
+		CompilePrefixes(m_ipCallVolumes);
+		CompilePrefixes(m_h323IdCallVolumes);
+		CompilePrefixes(m_cliCallVolumes);
+
+		for (unsigned i = 0; i < m_ipCallVolumes.size(); ++i) {
+			const NetworkAddress & net = m_ipCallVolumes[i].first;
+			if (net.IsAny()) {
+				m_anyIpRules.push_back(i);
+				continue;
+			}
+			std::vector<unsigned> positions;
+			const std::vector<unsigned> * existing = m_ipIndex.Find(net);
+			if (existing)
+				positions = *existing;
+			positions.push_back(i);
+			m_ipIndex.Insert(net, positions);
+		}
+		for (unsigned i = 0; i < m_h323IdCallVolumes.size(); ++i)
+			m_h323IdIndex[H323GetAliasAddressString(m_h323IdCallVolumes[i].first)].push_back(i);
+		for (unsigned i = 0; i < m_cliCallVolumes.size(); ++i)
+			m_cliIndex[m_cliCallVolumes[i].first].push_back(i);
+	}
+
+	void GetCounters(std::set<CallCounter *> & counters) const
+	{
+		GetRuleCounters(m_ipCallVolumes, counters);
+		GetRuleCounters(m_h323IdCallVolumes, counters);
+		GetRuleCounters(m_cliCallVolumes, counters);
+	}
+
+	IpCallVolumes m_ipCallVolumes; /// per-IP inbound routes
+	H323IdCallVolumes m_h323IdCallVolumes; /// per-H.323 ID inbound routes
+	CLICallVolumes m_cliCallVolumes; /// per-CLI inbound routes
+	NetworkAddressTree<std::vector<unsigned> > m_ipIndex; /// IP rule positions by source network
+	std::vector<unsigned> m_anyIpRules; /// IP rule positions for any source
+	std::map<PString, std::vector<unsigned> > m_h323IdIndex; /// H.323 ID rule positions by source alias
+	std::map<std::string, std::vector<unsigned> > m_cliIndex; /// CLI rule positions by source CLI
+
+private:
+	RuleSet(const RuleSet &);
+	RuleSet & operator=(const RuleSet &);
+};
+
+CapacityControl::PrefixRegex::PrefixRegex(const PrefixRegex & other) : m_regex(NULL)
+{
+	Compile(other.m_pattern);
+}
+
+CapacityControl::PrefixRegex & CapacityControl::PrefixRegex::operator=(const PrefixRegex & other)
+{
+	if (this != &other)
+		Compile(other.m_pattern);
+	return *this;
+}
+
+void CapacityControl::PrefixRegex::Compile(const std::string & pattern)
+{
+	delete m_regex;
+	m_regex = NULL;
+	m_pattern = pattern;
+	// plain digit strings are matched with a substring search
+	if (pattern.find_first_of(".[]()*+?{}|^$\\") == std::string::npos)
+		return;
+	m_regex = new PRegularExpression(pattern.c_str(), PRegularExpression::Extended);
+	if (m_regex->GetErrorCode() != PRegularExpression::NoError) {
+		PTRACE(1, "CAPCTRL\tInvalid prefix regular expression: " << pattern);
+	}
+}
+
 CapacityControl::InboundCallVolume::InboundCallVolume()
-	: m_maxVolume(0)
+	: m_maxVolume(0), m_counter(NULL)
 {
 }
 
@@ -79,7 +259,19 @@ CapacityControl::InboundCallVolume::~InboundCallVolume()
 PString CapacityControl::InboundCallVolume::AsString() const
 {
 	return PString("pfx: ") + (m_prefix.empty() ? "*" : m_prefix.c_str())
-		+ ", vol (cur/max): " + PString(m_calls.size()) + "/" + PString(m_maxVolume);
+		+ ", vol (cur/max): " + PString(m_counter ? m_counter->m_calls : 0L) + "/" + PString(m_maxVolume);
+}
+
+PINDEX CapacityControl::InboundCallVolume::MatchPrefix(const PString & calledStationId) const
+{
+	if (m_prefix.empty())
+		return 0;
+	if (m_prefixRegex.Get() == NULL)
+		return calledStationId.Find(m_prefix.c_str()) != P_MAX_INDEX ? (PINDEX)m_prefix.length() : P_MAX_INDEX;
+	PINDEX offset, len;
+	if (!calledStationId.FindRegEx(*m_prefixRegex.Get(), offset, len))
+		return P_MAX_INDEX;
+	return len;
 }
 
 bool CapacityControl::InboundCallVolume::operator==(const InboundCallVolume & obj) const
@@ -103,23 +295,41 @@ bool CapacityControl::InboundCLICallVolume::operator==(const InboundCLICallVolum
 }
 
 CapacityControl::CapacityControl(
-	) : Singleton<CapacityControl>("CapacityControl")
+	) : Singleton<CapacityControl>("CapacityControl"), m_rules(NULL)
 {
 	LoadConfig();
 }
 
+CapacityControl::CapacityControl(
+	const PStringToString & rules
+	) : Singleton<CapacityControl>("CapacityControl"), m_rules(NULL)
+{
+	LoadRules(rules);
+}
+
+CapacityControl::~CapacityControl()
+{
+	PWaitAndSignal lock(m_updateMutex);
+	delete m_rules;
+	m_rules = NULL;
+	DeleteRetiredRules(true);
+	Cleanup(true);
+}
+
 void CapacityControl::LoadConfig()
 {
-	IpCallVolumes ipCallVolumes;
-	H323IdCallVolumes h323IdCallVolumes;
-	CLICallVolumes cliCallVolumes;
+	LoadRules(GkConfig()->GetAllKeyValues("CapacityControl"));
+}
 
-	PConfig* cfg = GkConfig();
-	const PString cfgSec("CapacityControl");
+void CapacityControl::LoadRules(const PStringToString & kv)
+{
+	RuleSet * rules = new RuleSet;
+	IpCallVolumes & ipCallVolumes = rules->m_ipCallVolumes;
+	H323IdCallVolumes & h323IdCallVolumes = rules->m_h323IdCallVolumes;
+	CLICallVolumes & cliCallVolumes = rules->m_cliCallVolumes;
 
 	unsigned ipRules = 0, h323IdRules = 0, cliRules = 0;
 
-	const PStringToString kv = cfg->GetAllKeyValues(cfgSec);
 	for (PINDEX i = 0; i < kv.GetSize(); ++i) {
 		PString key = kv.GetKeyAt(i);
 
@@ -201,57 +411,30 @@ void CapacityControl::LoadConfig()
 	std::stable_sort(h323IdCallVolumes.begin(), h323IdCallVolumes.end(), H323IdRule_greater());
 	std::stable_sort(cliCallVolumes.begin(), cliCallVolumes.end(), CLIRule_greater());
 
-	PWaitAndSignal lock(m_updateMutex);
-
-	// update route entries that have not changed
-	{
-		IpCallVolumes::const_iterator rule = m_ipCallVolumes.begin();
-		while (rule != m_ipCallVolumes.end()) {
-			IpCallVolumes::iterator matchingRule = find(ipCallVolumes.begin(), ipCallVolumes.end(), *rule);
-			if (matchingRule != ipCallVolumes.end() && matchingRule->second == rule->second) {
-				matchingRule->second.m_calls = rule->second.m_calls;
-			}
-			++rule;
-		}
-	}
-
-	{
-		H323IdCallVolumes::const_iterator rule = m_h323IdCallVolumes.begin();
-		while (rule != m_h323IdCallVolumes.end()) {
-			H323IdCallVolumes::iterator matchingRule = find(h323IdCallVolumes.begin(), h323IdCallVolumes.end(), *rule);
-			if (matchingRule != h323IdCallVolumes.end() && matchingRule->second == rule->second) {
-				matchingRule->second.m_calls = rule->second.m_calls;
-			}
-			++rule;
-		}
-	}
+	rules->Compile();
 
-	{
-		CLICallVolumes::const_iterator rule = m_cliCallVolumes.begin();
-		while (rule != m_cliCallVolumes.end()) {
-			CLICallVolumes::iterator matchingRule = find(cliCallVolumes.begin(), cliCallVolumes.end(), *rule);
-			if (matchingRule != cliCallVolumes.end() && matchingRule->second == rule->second) {
-				matchingRule->second.m_calls = rule->second.m_calls;
-			}
-			++rule;
-		}
-	}
+	PWaitAndSignal lock(m_updateMutex);
 
-	m_ipCallVolumes.clear();
-	m_h323IdCallVolumes.clear();
-	m_cliCallVolumes.clear();
+	// keep the call counters of route entries that have not changed
+	RuleSet * oldRules = m_rules;
+	AssignCounters(ipCallVolumes, oldRules ? &oldRules->m_ipCallVolumes : NULL, m_counters);
+	AssignCounters(h323IdCallVolumes, oldRules ? &oldRules->m_h323IdCallVolumes : NULL, m_counters);
+	AssignCounters(cliCallVolumes, oldRules ? &oldRules->m_cliCallVolumes : NULL, m_counters);
 
-	m_ipCallVolumes = ipCallVolumes;
-	m_h323IdCallVolumes = h323IdCallVolumes;
-	m_cliCallVolumes = cliCallVolumes;
+	// lookups may still run on the old rules, keep them for a while
+	AtomicStore(&m_rules, rules);
+	if (oldRules)
+		m_retiredRules.push_back(std::make_pair(PTime(), oldRules));
+	DeleteRetiredRules(false);
+	Cleanup(false);
 
 	PTRACE(5, "CAPCTRL\t" << ipRules << " IP rules loaded");
 	if (PTrace::CanTrace(6)) {
 		ostream & strm = PTrace::Begin(6, __FILE__, __LINE__);
 		strm << "Per IP call volume rules:" << endl;
-		for (unsigned i = 0; i < m_ipCallVolumes.size(); ++i) {
-			strm << "\tsrc " << m_ipCallVolumes[i].first.AsString() << ":" << endl;
-			strm << "\t\t" << m_ipCallVolumes[i].second.AsString() << endl;
+		for (unsigned i = 0; i < ipCallVolumes.size(); ++i) {
+			strm << "\tsrc " << ipCallVolumes[i].first.AsString() << ":" << endl;
+			strm << "\t\t" << ipCallVolumes[i].second.AsString() << endl;
 		}
 		PTrace::End(strm);
 	}
@@ -260,9 +443,9 @@ void CapacityControl::LoadConfig()
 	if (PTrace::CanTrace(6)) {
 		ostream & strm = PTrace::Begin(6, __FILE__, __LINE__);
 		strm << "Per H.323 ID call volume rules:" << endl;
-		for (unsigned i = 0; i < m_h323IdCallVolumes.size(); i++) {
-			strm << "\tsrc " << H323GetAliasAddressString(m_h323IdCallVolumes[i].first) << ":" << endl;
-			strm << "\t\t" << m_h323IdCallVolumes[i].second.AsString() << endl;
+		for (unsigned i = 0; i < h323IdCallVolumes.size(); i++) {
+			strm << "\tsrc " << H323GetAliasAddressString(h323IdCallVolumes[i].first) << ":" << endl;
+			strm << "\t\t" << h323IdCallVolumes[i].second.AsString() << endl;
 		}
 		PTrace::End(strm);
 	}
@@ -271,128 +454,130 @@ void CapacityControl::LoadConfig()
 	if (PTrace::CanTrace(6)) {
 		ostream & strm = PTrace::Begin(6, __FILE__, __LINE__);
 		strm << "Per CLI call volume rules:" << endl;
-		for (unsigned i = 0; i < m_cliCallVolumes.size(); i++) {
-			strm << "\tsrc " << m_cliCallVolumes[i].first << ":" << endl;
-			strm << "\t\t" << m_cliCallVolumes[i].second.AsString() << endl;
+		for (unsigned i = 0; i < cliCallVolumes.size(); i++) {
+			strm << "\tsrc " << cliCallVolumes[i].first << ":" << endl;
+			strm << "\t\t" << cliCallVolumes[i].second.AsString() << endl;
 		}
 		PTrace::End(strm);
 	}
 }
 
+const CapacityControl::RuleSet & CapacityControl::GetRules()
+{
+	return *AtomicLoad(&m_rules);
+}
+
+void CapacityControl::DeleteRetiredRules(bool all)
+{
+	// a lookup takes microseconds, no lookup can still use a rule set after the grace period
+	const PTime now;
+	std::list<std::pair<PTime, RuleSet *> >::iterator r = m_retiredRules.begin();
+	while (r != m_retiredRules.end()) {
+		if (all || (now - r->first).GetSeconds() >= RetiredRulesGracePeriod) {
+			delete r->second;
+			r = m_retiredRules.erase(r);
+		} else
+			++r;
+	}
+}
+
+void CapacityControl::Cleanup(bool all)
+{
+	// counters of removed rules go away when their last call has ended
+	std::set<CallCounter *> used;
+	if (m_rules)
+		m_rules->GetCounters(used);
+	for (std::list<std::pair<PTime, RuleSet *> >::const_iterator r = m_retiredRules.begin(); r != m_retiredRules.end(); ++r)
+		r->second->GetCounters(used);
+
+	std::list<CallCounter *>::iterator c = m_counters.begin();
+	while (c != m_counters.end()) {
+		if (all || (used.find(*c) == used.end() && (*c)->m_calls == 0)) {
+			delete *c;
+			c = m_counters.erase(c);
+		} else
+			++c;
+	}
+}
+
 PString CapacityControl::PrintRules()
 {
 //	std::stringstream strm; // VS2005 version leaks memory!!
 	PStringStream strm;
 
+	PWaitAndSignal lock(m_updateMutex);
+	const RuleSet & rules = *m_rules;
+
 	strm << "Per IP call volume rules:" << endl;
-	for (unsigned i = 0; i < m_ipCallVolumes.size(); ++i) {
-		strm << "  src " << m_ipCallVolumes[i].first.AsString() << ":" << endl;
-		strm << "    " << m_ipCallVolumes[i].second.AsString() << endl;
+	for (unsigned i = 0; i < rules.m_ipCallVolumes.size(); ++i) {
+		strm << "  src " << rules.m_ipCallVolumes[i].first.AsString() << ":" << endl;
+		strm << "    " << rules.m_ipCallVolumes[i].second.AsString() << endl;
 	}
 
 	strm << "Per H.323 ID call volume rules:" << endl;
-	for (unsigned i = 0; i < m_h323IdCallVolumes.size(); i++) {
-		strm << "  src " << H323GetAliasAddressString(m_h323IdCallVolumes[i].first) << ":" << endl;
-		strm << "    " << m_h323IdCallVolumes[i].second.AsString() << endl;
+	for (unsigned i = 0; i < rules.m_h323IdCallVolumes.size(); i++) {
+		strm << "  src " << H323GetAliasAddressString(rules.m_h323IdCallVolumes[i].first) << ":" << endl;
+		strm << "    " << rules.m_h323IdCallVolumes[i].second.AsString() << endl;
 	}
 
 	strm << "Per CLI call volume rules:" << endl;
-	for (unsigned i = 0; i < m_cliCallVolumes.size(); i++) {
-		strm << "  src " << m_cliCallVolumes[i].first << ":" << endl;
-		strm << "    " << m_cliCallVolumes[i].second.AsString() << endl;
+	for (unsigned i = 0; i < rules.m_cliCallVolumes.size(); i++) {
+		strm << "  src " << rules.m_cliCallVolumes[i].first << ":" << endl;
+		strm << "    " << rules.m_cliCallVolumes[i].second.AsString() << endl;
 	}
 
 	return strm;
 }
 
-CapacityControl::IpCallVolumes::iterator CapacityControl::FindByIp(
+const CapacityControl::InboundCallVolume * CapacityControl::FindRule(
+	const RuleSet & rules,
 	const NetworkAddress & srcIp,
-	const PString & calledStationId)
+	const PString & srcAlias,
+	const std::string & srcCli,
+	const PString & calledStationId,
+	PString * ruleName
+	) const
 {
-	unsigned netmaskLen = 0;
-	PINDEX matchLen = P_MAX_INDEX;
-
-	const IpCallVolumes::iterator ipEnd = m_ipCallVolumes.end();
-	IpCallVolumes::iterator bestIpMatch = ipEnd, i = m_ipCallVolumes.begin();
-	while (i != ipEnd) {
-		if (bestIpMatch != ipEnd && i->first.GetNetmaskLen() < netmaskLen)
-			break;
-		if (i->first.IsAny() || srcIp << i->first) {
-			PINDEX offset, len;
-			if (i->second.m_prefix.empty())
-				len = 0;
-			else if (!calledStationId.FindRegEx(
-					PRegularExpression(i->second.m_prefix.c_str(), PRegularExpression::Extended), offset, len))
-				len = P_MAX_INDEX;
-			if (len != P_MAX_INDEX && (matchLen == P_MAX_INDEX || len > matchLen)) {
-				bestIpMatch = i;
-				netmaskLen = i->first.GetNetmaskLen();
-				matchLen = len;
-			}
+	// find longest matching rule by ip/h323id/cli, for IP rules the longest
+	// source network with a matching prefix wins
+	std::vector<const std::vector<unsigned> *> networks;
+	rules.m_ipIndex.FindAllMatches(srcIp.m_address, networks);
+	if (!rules.m_anyIpRules.empty())
+		networks.push_back(&rules.m_anyIpRules);
+	for (unsigned n = 0; n < networks.size(); ++n) {
+		const int best = FindBestPrefix(rules.m_ipCallVolumes, *networks[n], calledStationId);
+		if (best >= 0) {
+			if (ruleName)
+				*ruleName = "IP rule " + rules.m_ipCallVolumes[best].first.AsString();
+			return &rules.m_ipCallVolumes[best].second;
 		}
-		++i;
 	}
 
-	return bestIpMatch;
-}
-
-CapacityControl::H323IdCallVolumes::iterator CapacityControl::FindByH323Id(
-	const PString & h323Id,
-	const PString & calledStationId)
-{
-	PINDEX matchLen = P_MAX_INDEX;
-	const H323IdCallVolumes::iterator h323IdEnd = m_h323IdCallVolumes.end();
-	H323IdCallVolumes::iterator bestH323IdMatch = h323IdEnd, i = m_h323IdCallVolumes.begin();
-	while (i != h323IdEnd) {
-		if (h323Id.IsEmpty())
-			break;
-		PString alias = H323GetAliasAddressString(i->first);
-		if (bestH323IdMatch != h323IdEnd && alias != h323Id)
-			break;
-		if (alias == h323Id) {
-			PINDEX offset, len;
-			if (i->second.m_prefix.empty())
-				len = 0;
-			else if (!calledStationId.FindRegEx(PRegularExpression(i->second.m_prefix.c_str(), PRegularExpression::Extended), offset, len))
-				len = P_MAX_INDEX;
-			if (len != P_MAX_INDEX && (matchLen == P_MAX_INDEX || len > matchLen)) {
-				bestH323IdMatch = i;
-				matchLen = len;
+	if (!srcAlias.IsEmpty()) {
+		std::map<PString, std::vector<unsigned> >::const_iterator i = rules.m_h323IdIndex.find(srcAlias);
+		if (i != rules.m_h323IdIndex.end()) {
+			const int best = FindBestPrefix(rules.m_h323IdCallVolumes, i->second, calledStationId);
+			if (best >= 0) {
+				if (ruleName)
+					*ruleName = "H323.ID rule " + i->first;
+				return &rules.m_h323IdCallVolumes[best].second;
 			}
 		}
-		++i;
 	}
 
-	return bestH323IdMatch;
-}
-
-CapacityControl::CLICallVolumes::iterator CapacityControl::FindByCli(
-	const std::string & cli,
-	const PString & calledStationId)
-{
-	PINDEX matchLen = P_MAX_INDEX;
-	const CLICallVolumes::iterator cliEnd = m_cliCallVolumes.end();
-	CLICallVolumes::iterator bestCliMatch = cliEnd, i = m_cliCallVolumes.begin();
-	while (i != cliEnd) {
-		if (cli.empty())
-			break;
-		if (bestCliMatch != cliEnd && i->first != cli)
-			break;
-		if (i->first == cli) {
-			PINDEX offset, len;
-			if (i->second.m_prefix.empty())
-				len = 0;
-			else if (!calledStationId.FindRegEx(PRegularExpression(i->second.m_prefix.c_str(), PRegularExpression::Extended), offset, len))
-				len = P_MAX_INDEX;
-			if (len != P_MAX_INDEX && (matchLen == P_MAX_INDEX || len > matchLen)) {
-				bestCliMatch = i;
-				matchLen = len;
+	if (!srcCli.empty()) {
+		std::map<std::string, std::vector<unsigned> >::const_iterator i = rules.m_cliIndex.find(srcCli);
+		if (i != rules.m_cliIndex.end()) {
+			const int best = FindBestPrefix(rules.m_cliCallVolumes, i->second, calledStationId);
+			if (best >= 0) {
+				if (ruleName)
+					*ruleName = PString("CLI rule ") + i->first.c_str();
+				return &rules.m_cliCallVolumes[best].second;
 			}
 		}
-		++i;
 	}
 
-	return bestCliMatch;
+	return NULL;
 }
 
 void CapacityControl::LogCall(
@@ -404,73 +589,31 @@ void CapacityControl::LogCall(
 	bool callStart
 	)
 {
+	const unsigned shard = (unsigned)callNumber % CallMapShards;
+
 	if (callStart) {
 		if (callNumber < 1) {
 			PTRACE(1, "CAPCTRL\tInvalid call number used (" << callNumber << ")");
 		}
 
-		// find longest matching rule by ip/h323id/cli
-		IpCallVolumes::iterator bestIpMatch = FindByIp(srcIp, calledStationId);
-		if (bestIpMatch != m_ipCallVolumes.end()) {
+		PString ruleName;
+		const InboundCallVolume * rule = FindRule(GetRules(), srcIp, srcAlias, srcCli, calledStationId,
+			PTrace::CanTrace(5) ? &ruleName : NULL);
+		if (rule) {
 			PTRACE(5, "CAPCTRL\tCall #" << callNumber
-				<< " to " << calledStationId << " matched IP rule " << bestIpMatch->first.AsString()
-				<< "\t" << bestIpMatch->second.AsString());
-			PWaitAndSignal lock(m_updateMutex);
-			bestIpMatch->second.m_calls.insert(callNumber);
-			return;
-		}
-
-		H323IdCallVolumes::iterator bestH323IdMatch = FindByH323Id(srcAlias, calledStationId);
-		if (bestH323IdMatch != m_h323IdCallVolumes.end()) {
-			PTRACE(5, "CAPCTRL\tCall #" << callNumber
-				<< " to " << calledStationId << " matched H323.ID rule " << H323GetAliasAddressString(bestH323IdMatch->first)
-				<< "\t" << bestH323IdMatch->second.AsString());
-			PWaitAndSignal lock(m_updateMutex);
-			bestH323IdMatch->second.m_calls.insert(callNumber);
-			return;
-		}
-
-		CLICallVolumes::iterator bestCliMatch = FindByCli(srcCli, calledStationId);
-		if (bestCliMatch != m_cliCallVolumes.end()) {
-			PTRACE(5, "CAPCTRL\tCall #" << callNumber
-				<< " to " << calledStationId << " matched CLI rule " << bestCliMatch->first
-				<< "\t" << bestCliMatch->second.AsString());
-			PWaitAndSignal lock(m_updateMutex);
-			bestCliMatch->second.m_calls.insert(callNumber);
-			return;
+				<< " to " << calledStationId << " matched " << ruleName
+				<< "\t" << rule->AsString());
+			PWaitAndSignal lock(m_callCountersMutex[shard]);
+			if (m_callCounters[shard].insert(std::make_pair(callNumber, rule->m_counter)).second)
+				AtomicIncrement(&rule->m_counter->m_calls);
 		}
 	} else { // call stop
-		PWaitAndSignal lock(m_updateMutex);
-
 		// find the right counter by GnuGk call number
-		IpCallVolumes::iterator bestIpMatch = m_ipCallVolumes.begin();
-		while (bestIpMatch != m_ipCallVolumes.end()) {
-			std::set<PINDEX>::iterator i = find(bestIpMatch->second.m_calls.begin(), bestIpMatch->second.m_calls.end(), callNumber);
-			if (i != bestIpMatch->second.m_calls.end()) {
-				bestIpMatch->second.m_calls.erase(i);
-				return;
-			}
-			++bestIpMatch;
-		}
-
-		H323IdCallVolumes::iterator bestH323IdMatch = m_h323IdCallVolumes.begin();
-		while (bestH323IdMatch != m_h323IdCallVolumes.end()) {
-			std::set<PINDEX>::iterator i = find(bestH323IdMatch->second.m_calls.begin(), bestH323IdMatch->second.m_calls.end(), callNumber);
-			if (i != bestH323IdMatch->second.m_calls.end()) {
-				bestH323IdMatch->second.m_calls.erase(i);
-				return;
-			}
-			++bestH323IdMatch;
-		}
-
-		CLICallVolumes::iterator bestCliMatch = m_cliCallVolumes.begin();
-		while (bestCliMatch != m_cliCallVolumes.end()) {
-			std::set<PINDEX>::iterator i = find(bestCliMatch->second.m_calls.begin(), bestCliMatch->second.m_calls.end(), callNumber);
-			if (i != bestCliMatch->second.m_calls.end()) {
-				bestCliMatch->second.m_calls.erase(i);
-				return;
-			}
-			++bestCliMatch;
+		PWaitAndSignal lock(m_callCountersMutex[shard]);
+		std::map<PINDEX, CallCounter *>::iterator i = m_callCounters[shard].find(callNumber);
+		if (i != m_callCounters[shard].end()) {
+			AtomicDecrement(&i->second->m_calls);
+			m_callCounters[shard].erase(i);
 		}
 	}
 }
@@ -478,32 +621,18 @@ void CapacityControl::LogCall(
 bool CapacityControl::CheckCall(const NetworkAddress & srcIp, const PString & srcAlias,
                                 const std::string & srcCli, const PString & calledStationId)
 {
-	IpCallVolumes::iterator bestIpMatch = FindByIp(srcIp, calledStationId);
-	if (bestIpMatch != m_ipCallVolumes.end()) {
+	PString ruleName;
+	bool result = true;
+	const InboundCallVolume * rule = FindRule(GetRules(), srcIp, srcAlias, srcCli, calledStationId,
+		PTrace::CanTrace(5) ? &ruleName : NULL);
+	if (rule) {
 		PTRACE(5, "CAPCTRL\tCall from IP " << srcIp.AsString()
-			<< " to " << calledStationId << " matched IP rule " << bestIpMatch->first.AsString()
-			<< "\t" << bestIpMatch->second.AsString());
-		PWaitAndSignal lock(m_updateMutex);
-		return bestIpMatch->second.m_calls.size() < bestIpMatch->second.m_maxVolume;
-	}
-
-	H323IdCallVolumes::iterator bestH323IdMatch = FindByH323Id(srcAlias, calledStationId);
-	if (bestH323IdMatch != m_h323IdCallVolumes.end()) {
-		PTRACE(5, "CAPCTRL\tCall to " << calledStationId << " matched H323.ID rule "
-			<< H323GetAliasAddressString(bestH323IdMatch->first) << "\t" << bestH323IdMatch->second.AsString());
-		PWaitAndSignal lock(m_updateMutex);
-		return bestH323IdMatch->second.m_calls.size() < bestH323IdMatch->second.m_maxVolume;
-	}
-
-	CLICallVolumes::iterator bestCliMatch = FindByCli(srcCli, calledStationId);
-	if (bestCliMatch != m_cliCallVolumes.end()) {
-		PTRACE(5, "CAPCTRL\tCall to " << calledStationId << " matched CLI rule "
-			<< bestCliMatch->first << "\t" << bestCliMatch->second.AsString());
-		PWaitAndSignal lock(m_updateMutex);
-		return bestCliMatch->second.m_calls.size() < bestCliMatch->second.m_maxVolume;
+			<< " to " << calledStationId << " matched " << ruleName
+			<< "\t" << rule->AsString());
+		result = rule->m_counter->m_calls < (long)rule->m_maxVolume;
 	}
 
-	return true;
+	return result;
 }
 
 namespace {
@@ -18,7 +18,8 @@
 
 #include <string>
 #include <vector>
-#include <set>
+#include <list>
+#include <map>
 #include "Toolkit.h"
 
 class CallRec;
@@ -28,6 +29,32 @@ typedef SmartPtr<CallRec> callptr;
 /// Perform per IP/H.323 ID/CLI/prefix inbound call volume accounting/control
 class CapacityControl : public Singleton<CapacityControl> {
 public:
+	/// number of active calls for a rule, kept across config reloads for unchanged rules
+	struct CallCounter {
+		CallCounter() : m_calls(0) { }
+
+		volatile long m_calls; /// active calls, updated atomically
+	};
+
+	/// compiled destination prefix, owned by its rule, copies compile their own
+	class PrefixRegex {
+	public:
+		PrefixRegex() : m_regex(NULL) { }
+		PrefixRegex(const PrefixRegex & other);
+		~PrefixRegex() { delete m_regex; }
+		PrefixRegex & operator=(const PrefixRegex & other);
+
+		/// compile the pattern, plain digit strings are not compiled
+		void Compile(const std::string & pattern);
+
+		/// @return	the compiled pattern or NULL
+		const PRegularExpression * Get() const { return m_regex; }
+
+	private:
+		std::string m_pattern;
+		PRegularExpression * m_regex;
+	};
+
 	/// a single call volume accounting entry
 	struct InboundCallVolume {
 		InboundCallVolume();
@@ -36,9 +63,15 @@ public:
 
 		bool operator==(const InboundCallVolume &) const;
 
+		/** Match the called number against the destination prefix.
+		    @return	length of the match or P_MAX_INDEX if there is no match
+		*/
+		PINDEX MatchPrefix(const PString & calledStationId) const;
+
 		std::string m_prefix; /// destination prefix to match (regex)
+		PrefixRegex m_prefixRegex; /// compiled m_prefix, empty for plain digit strings
 		unsigned m_maxVolume; /// maximum allowed call volume
-		std::set<PINDEX> m_calls; /// active calls
+		CallCounter * m_counter; /// active calls
 	};
 
 	struct InboundIPCallVolume : public InboundCallVolume {
@@ -75,10 +108,16 @@ public:
 
 	/// Create object instance and call LoadConfig()
 	CapacityControl();
+	/// Create object instance with the given rules instead of the config
+	CapacityControl(const PStringToString & rules);
+	virtual ~CapacityControl();
 
 	/// Load/Update settings from the config
 	void LoadConfig();
 
+	/// Load/Update the rules from key/value pairs in [CapacityControl] format
+	void LoadRules(const PStringToString & rules);
+
 	/// @return	a string containing all active rules and their current capacity values
 	PString PrintRules();
 
@@ -108,16 +147,41 @@ private:
 	CapacityControl(const CapacityControl &);
 	CapacityControl & operator=(const CapacityControl &);
 
-	// helper functions
-	IpCallVolumes::iterator FindByIp(const NetworkAddress & srcIp, const PString & calledStationId);
-	H323IdCallVolumes::iterator FindByH323Id(const PString & h323Id, const PString & calledStationId);
-	CLICallVolumes::iterator FindByCli(const std::string & cli, const PString & calledStationId);
+	/// rules with their lookup indexes, replaced as a whole by LoadConfig()
+	class RuleSet;
+
+	/// @return	the rule that applies to the call or NULL
+	const InboundCallVolume * FindRule(
+		const RuleSet & rules,
+		const NetworkAddress & srcIp,
+		const PString & srcAlias,
+		const std::string & srcCli,
+		const PString & calledStationId,
+		PString * ruleName /// set to the rule type and source, if not NULL
+		) const;
+
+	/// @return	the current rule set, it stays valid for RetiredRulesGracePeriod after it has been replaced
+	const RuleSet & GetRules();
+
+	/// delete replaced rule sets after their grace period, all if requested
+	void DeleteRetiredRules(bool all);
+
+	/// delete counters no rule uses any more, all if requested
+	void Cleanup(bool all);
+
+	enum {
+		CallMapShards = 16,
+		RetiredRulesGracePeriod = 60 /// seconds a replaced rule set is kept for running lookups
+	};
 
 private:
-	IpCallVolumes m_ipCallVolumes; /// per-IP inbound routes
-	H323IdCallVolumes m_h323IdCallVolumes; /// per-H.323 ID inbound routes
-	CLICallVolumes m_cliCallVolumes; /// per-CLI inbound routes
-	PMutex m_updateMutex; /// for atomic route read/update operations
+	RuleSet * volatile m_rules; /// current rules, read without locking
+	std::list<std::pair<PTime, RuleSet *> > m_retiredRules; /// replaced rules and when they were replaced
+	std::list<CallCounter *> m_counters; /// all allocated counters
+	/// counter used by each active call, sharded by call number
+	std::map<PINDEX, CallCounter *> m_callCounters[CallMapShards];
+	PMutex m_callCountersMutex[CallMapShards];
+	PMutex m_updateMutex; /// for atomic rule updates
 };
 
 #endif /// CAPCTRL_H
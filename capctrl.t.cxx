@@ -0,0 +1,86 @@
+/*
+ * capctrl.t.cxx
+ *
+ * unit tests for capctrl.cxx
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#include "config.h"
+#include "capctrl.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+class CapCtrlTest : public ::testing::Test {
+protected:
+	CapCtrlTest() {
+		rules.SetAt("ip:10.0.0.0/8", "3");
+		rules.SetAt("ip:10.1.0.0/16", "^49 1");
+		rules.SetAt("ip:*", "^0049 2");
+		rules.SetAt("h323id:gw1", "1");
+		rules.SetAt("cli:12345", "44 1");
+	}
+
+	PStringToString rules;
+};
+
+
+TEST_F(CapCtrlTest, IndexedLookup) {
+	CapacityControl capctrl(rules);
+	// the longest source network with a matching prefix wins
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("10.1.2.3"), "", "", "4930"));
+	capctrl.LogCall(NetworkAddress("10.1.2.3"), "", "", "4930", 1, true);
+	EXPECT_FALSE(capctrl.CheckCall(NetworkAddress("10.1.2.3"), "", "", "4930"));
+	// the /16 prefix doesn't match, so the /8 rule applies
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("10.1.2.3"), "", "", "3330"));
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("10.9.9.9"), "", "", "4930"));
+	// the 'any' rule only covers its prefix
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("192.168.1.1"), "", "", "004930"));
+	// H.323 ID and CLI rules
+	capctrl.LogCall(NetworkAddress("192.168.1.1"), "gw1", "", "123", 2, true);
+	EXPECT_FALSE(capctrl.CheckCall(NetworkAddress("192.168.1.1"), "gw1", "", "123"));
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("192.168.1.1"), "gw2", "", "123"));
+	capctrl.LogCall(NetworkAddress("192.168.1.1"), "", "12345", "4477", 3, true);
+	EXPECT_FALSE(capctrl.CheckCall(NetworkAddress("192.168.1.1"), "", "12345", "4477"));
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("192.168.1.1"), "", "12345", "3377"));
+	// no rule matches
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("192.168.1.1"), "", "", "123"));
+}
+
+TEST_F(CapCtrlTest, CallCounters) {
+	CapacityControl capctrl(rules);
+	capctrl.LogCall(NetworkAddress("10.2.0.1"), "", "", "123", 1, true);
+	capctrl.LogCall(NetworkAddress("10.2.0.2"), "", "", "123", 2, true);
+	// a second start for the same call is not counted
+	capctrl.LogCall(NetworkAddress("10.2.0.2"), "", "", "123", 2, true);
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("10.2.0.3"), "", "", "123"));
+	capctrl.LogCall(NetworkAddress("10.2.0.3"), "", "", "123", 3, true);
+	EXPECT_FALSE(capctrl.CheckCall(NetworkAddress("10.2.0.4"), "", "", "123"));
+	EXPECT_TRUE(capctrl.PrintRules().Find("vol (cur/max): 3/3") != P_MAX_INDEX);
+
+	// unchanged rules keep their counters across a reload
+	capctrl.LoadRules(rules);
+	EXPECT_FALSE(capctrl.CheckCall(NetworkAddress("10.2.0.4"), "", "", "123"));
+	capctrl.LogCall(NetworkAddress("10.2.0.1"), "", "", "123", 1, false);
+	EXPECT_TRUE(capctrl.CheckCall(NetworkAddress("10.2.0.4"), "", "", "123"));
+	// stopping an unknown call changes nothing
+	capctrl.LogCall(NetworkAddress("10.2.0.1"), "", "", "123", 99, false);
+	EXPECT_TRUE(capctrl.PrintRules().Find("vol (cur/max): 2/3") != P_MAX_INDEX);
+
+	// a new limit for the same source and prefix keeps the active calls
+	rules.SetAt("ip:10.0.0.0/8", "5");
+	capctrl.LoadRules(rules);
+	EXPECT_TRUE(capctrl.PrintRules().Find("vol (cur/max): 2/5") != P_MAX_INDEX);
+	capctrl.LogCall(NetworkAddress("10.2.0.2"), "", "", "123", 2, false);
+	capctrl.LogCall(NetworkAddress("10.2.0.3"), "", "", "123", 3, false);
+	EXPECT_TRUE(capctrl.PrintRules().Find("vol (cur/max): 0/5") != P_MAX_INDEX);
+}
+
+}  // namespace
@@ -151,11 +151,111 @@ struct DoubleIpRule_greater : public std::binary_function<CLIRewrite::DoubleIpRu
 		return false;
 	}
 };
+
+/// check if the rule matches the numbers (NULL numbers are not checked)
+bool MatchRule(
+	const CLIRewrite::RewriteRule & rule,
+	const char * cli,
+	const char * dno,
+	const char * cno
+	)
+{
+	if (!rule.m_prefix.empty()) {
+		const char * number = NULL;
+		if (rule.m_matchType == CLIRewrite::RewriteRule::MatchCallerNumber)
+			number = cli;
+		else if (rule.m_matchType == CLIRewrite::RewriteRule::MatchDialedNumber)
+			number = dno;
+		else if (rule.m_matchType == CLIRewrite::RewriteRule::MatchDestinationNumber)
+			number = cno;
+		if (number == NULL)
+			return false;
+		const int matchLen = MatchPrefix(number, rule.m_prefix.c_str());
+		if (matchLen <= 0 || (rule.m_rewriteType == CLIRewrite::RewriteRule::NumberToNumber
+				&& strlen(number) != (unsigned)matchLen))
+			return false;
+	}
+	// a rule has to either hide or rewrite the CLI to be used
+	return rule.m_screeningType != CLIRewrite::RewriteRule::NoScreening || !rule.m_cli.empty();
+}
 } /* namespace */
 
+class CLIRewrite::IpRuleIndex {
+public:
+	IpRuleIndex() : m_anyRule(-1) { }
+
+	/// add a network at the given rule position, rules have to be added in list order
+	void Add(const NetworkAddress & net, unsigned position)
+	{
+		// the first rule for a network wins, like it did with the sorted linear search
+		if (net.IsAny()) {
+			if (m_anyRule < 0)
+				m_anyRule = position;
+		} else if (!m_networks.Find(net))
+			m_networks.Insert(net, position);
+	}
+
+	/// @return	position of the rule with the most specific matching network or -1
+	int Find(const PIPSocket::Address & addr) const
+	{
+		const unsigned * position = m_networks.FindBestMatch(addr);
+		return position ? (int)*position : m_anyRule;
+	}
+
+private:
+	NetworkAddressTree<unsigned> m_networks;
+	int m_anyRule;
+};
+
+class CLIRewrite::RuleIndex {
+public:
+	RuleIndex(const RewriteRules & rules) : m_anyRule(-1)
+	{
+		for (unsigned i = 0; i < rules.size(); ++i) {
+			const RewriteRule & rule = rules[i];
+			// rules that neither hide nor rewrite and negative prefixes never match
+			if (rule.m_screeningType == RewriteRule::NoScreening && rule.m_cli.empty())
+				continue;
+			if (rule.m_prefix.empty()) {
+				if (m_anyRule < 0)
+					m_anyRule = i;
+				continue;
+			}
+			if (rule.m_prefix[0] == '!' || rule.m_matchType < 0 || rule.m_matchType > RewriteRule::MatchCallerNumber)
+				continue;
+			// number to number rules only match the whole number
+			m_numbers[rule.m_matchType].Add(rule.m_prefix.c_str(), i,
+				rule.m_rewriteType == RewriteRule::NumberToNumber);
+		}
+	}
+
+	/// @return	position of the first rule in the list that matches the numbers or -1
+	int Find(const char * cli, const char * dno, const char * cno) const
+	{
+		int best = m_anyRule;
+		if (dno)
+			best = First(best, m_numbers[RewriteRule::MatchDialedNumber].Find(dno));
+		if (cno)
+			best = First(best, m_numbers[RewriteRule::MatchDestinationNumber].Find(cno));
+		if (cli)
+			best = First(best, m_numbers[RewriteRule::MatchCallerNumber].Find(cli));
+		return best;
+	}
+
+private:
+	static int First(int a, int b) { return (b >= 0 && (a < 0 || b < a)) ? b : a; }
+
+	RuleIndex(const RuleIndex &);
+	RuleIndex & operator=(const RuleIndex &);
+
+	PrefixIndex m_numbers[RewriteRule::MatchCallerNumber + 1]; /// one index per match type
+	int m_anyRule; /// first rule without a prefix
+};
+
 CLIRewrite::CLIRewrite()
 	: m_processSourceAddress(true), m_removeH323Id(false),
-	m_CLIRPolicy(RewriteRule::IgnoreCLIR), m_sqlConn(NULL)
+	m_CLIRPolicy(RewriteRule::IgnoreCLIR), m_inboundIndex(NULL), m_outboundIndex(NULL),
+	m_sqlConn(NULL), m_sqlCache(NULL)
 {
 	PConfig * cfg = GkConfig();
 
@@ -483,6 +583,8 @@ CLIRewrite::CLIRewrite()
 		PTrace::End(strm);
 	}
 
+	CompileRules();
+
 	m_processSourceAddress = Toolkit::AsBool(cfg->GetString(CLIRewriteSection, ProcessSourceAddress, "1"));
 	m_removeH323Id = Toolkit::AsBool(cfg->GetString(CLIRewriteSection, RemoveH323Id, "1"));
 	
@@ -538,10 +640,43 @@ CLIRewrite::CLIRewrite()
 			m_sqlConn = NULL;
 			return;
 		}
+		m_sqlCache = new CacheManager(cfg->GetInteger(CLIRewriteSQLSection, "CacheTimeout", 0),
+			cfg->GetInteger(CLIRewriteSQLSection, "CacheMaxEntries", 0), CLIRewriteSQLSection);
 	}
 #endif // HAS_DATABASE
 }
 
+CLIRewrite::~CLIRewrite()
+{
+	delete m_inboundIndex;
+	delete m_outboundIndex;
+	DeleteObjectsInContainer(m_calleeIndexes);
+	DeleteObjectsInMap(m_prefixIndexes);
+	delete m_sqlCache;
+	delete m_sqlConn;
+}
+
+void CLIRewrite::CompileRules()
+{
+	m_inboundIndex = new IpRuleIndex();
+	for (unsigned i = 0; i < m_inboundRules.size(); ++i) {
+		m_inboundIndex->Add(m_inboundRules[i].first, i);
+		m_prefixIndexes[&m_inboundRules[i].second] = new RuleIndex(m_inboundRules[i].second);
+	}
+
+	m_outboundIndex = new IpRuleIndex();
+	for (unsigned i = 0; i < m_outboundRules.size(); ++i) {
+		m_outboundIndex->Add(m_outboundRules[i].first, i);
+		const SingleIpRules & calleeRules = m_outboundRules[i].second;
+		IpRuleIndex * calleeIndex = new IpRuleIndex();
+		for (unsigned j = 0; j < calleeRules.size(); ++j) {
+			calleeIndex->Add(calleeRules[j].first, j);
+			m_prefixIndexes[&calleeRules[j].second] = new RuleIndex(calleeRules[j].second);
+		}
+		m_calleeIndexes.push_back(calleeIndex);
+	}
+}
+
 void CLIRewrite::InRewrite(
 	SetupMsg & msg /// Q.931 Setup message to be rewritten
 	)
@@ -558,18 +693,12 @@ void CLIRewrite::InRewrite(
 		}
 	}
 
-	// find a config file rule that matches caller's IP	
-	SingleIpRules::const_iterator i = m_inboundRules.begin();
-	while (i != m_inboundRules.end())
-		if (i->first.IsAny() || (addr << i->first))
-			break;
-		else
-			++i;
-
-	if (i == m_inboundRules.end())
+	// find a config file rule that matches caller's IP
+	const int i = m_inboundIndex->Find(addr);
+	if (i < 0)
 		return;
 
-	Rewrite(msg, *i, true, NULL);
+	Rewrite(msg, m_inboundRules[i], true, NULL);
 }
 
 void CLIRewrite::OutRewrite(
@@ -583,36 +712,24 @@ void CLIRewrite::OutRewrite(
 
 	// apply [RewriteCLI::SQL] OutboundQuery
 	if (!m_outboundQuery.IsEmpty()) {
-		SingleIpRule * rule = CLIRewrite::RunQuery(m_inboundQuery, msg);
+		SingleIpRule * rule = CLIRewrite::RunQuery(m_outboundQuery, msg);
 		if (rule) {
 			Rewrite(msg, *rule, false, &authData);
 			delete rule;
 		}
 	}
 
-	// find a config file rule that matches caller's IP	
-	DoubleIpRules::const_iterator diprule = m_outboundRules.begin();
-	while (diprule != m_outboundRules.end())
-		if (diprule->first.IsAny() || (addr << diprule->first))
-			break;
-		else
-			++diprule;
-
-	if (diprule == m_outboundRules.end())
+	// find a config file rule that matches caller's IP
+	const int diprule = m_outboundIndex->Find(addr);
+	if (diprule < 0)
 		return;
 
-	// now find a rule that also matches callee's IP	
-	SingleIpRules::const_iterator siprule = diprule->second.begin();
-	while (siprule != diprule->second.end())
-		if (siprule->first.IsAny() || (destAddr << siprule->first))
-			break;
-		else
-			++siprule;
-
-	if (siprule == diprule->second.end())
+	// now find a rule that also matches callee's IP
+	const int siprule = m_calleeIndexes[diprule]->Find(destAddr);
+	if (siprule < 0)
 		return;
 
-	Rewrite(msg, *siprule, false, &authData);
+	Rewrite(msg, m_outboundRules[diprule].second[siprule], false, &authData);
 }
 
 void CLIRewrite::Rewrite(
@@ -657,86 +774,73 @@ void CLIRewrite::Rewrite(
 
 	// find ANI/CLI condition/prefix match
 	PString newcli;
-	RewriteRules::const_iterator rule = ipRule.second.begin();
-	while (rule != ipRule.second.end()) {
-		if (!rule->m_prefix.empty()) {
-			int matchLen = 0;
-			const char *number = NULL;
-			if (rule->m_matchType == RewriteRule::MatchCallerNumber)
-				number = cli;
-			else if (rule->m_matchType == RewriteRule::MatchDialedNumber)
-				number = dno;
-			else if (!inbound && rule->m_matchType == RewriteRule::MatchDestinationNumber)
-				number = cno;
-			if (number != NULL) {
-				matchLen = MatchPrefix(number, rule->m_prefix.c_str());
-				if (matchLen > 0 && rule->m_rewriteType == RewriteRule::NumberToNumber
-						&& strlen(number) != (unsigned)matchLen)
-					matchLen = 0;
-			}
-			if (matchLen <= 0) {
-				++rule;
-				continue;
-			}
-		}
-		if (rule->m_screeningType != RewriteRule::NoScreening)
-			break;
-		if (!rule->m_cli.empty()) {
-			// get the new ANI/CLI
-			newcli = rule->m_cli[rand() % rule->m_cli.size()].c_str();
-			// if this is a number range, choose the new ANI/CLI from the range
-			const PINDEX sepIndex = newcli.Find('-');
-			if (sepIndex != P_MAX_INDEX) {
-				PString lowStr(newcli.Left(sepIndex).Trim());
-				PString highStr(newcli.Mid(sepIndex + 1).Trim());
-				PUInt64 low = lowStr.AsUnsigned64();
-				PUInt64 high = highStr.AsUnsigned64();
-				PUInt64 diff = (low < high) ? (high - low) : (low - high);
-
-				int numLeadingZeros1 = 0;
-				while (numLeadingZeros1 < lowStr.GetLength()
-						&& lowStr[numLeadingZeros1] == '0')
-					++numLeadingZeros1;
-						
-				int numLeadingZeros2 = 0;
-				while (numLeadingZeros2 < highStr.GetLength()
-						&& highStr[numLeadingZeros2] == '0')
-					++numLeadingZeros2;
-				
-				if (diff >= RAND_MAX)
-					diff = PUInt64(rand());
-				else
-					diff = PUInt64(rand() % ((unsigned)diff + 1));
-					
-				diff = (low < high) ? (low + diff) : (high + diff);
-				newcli = PString(diff);
+	const char * const cnoNumber = inbound ? NULL : (const char *)cno;
+	RewriteRules::const_iterator rule = ipRule.second.end();
+	std::map<const RewriteRules *, RuleIndex *>::const_iterator index = m_prefixIndexes.find(&ipRule.second);
+	if (index != m_prefixIndexes.end()) {
+		const int position = index->second->Find(cli, dno, cnoNumber);
+		if (position >= 0)
+			rule = ipRule.second.begin() + position;
+	} else {
+		// rules from a SQL query are not indexed
+		rule = ipRule.second.begin();
+		while (rule != ipRule.second.end() && !MatchRule(*rule, cli, dno, cnoNumber))
+			++rule;
+	}
 
-				if (lowStr.GetLength() == highStr.GetLength() && (numLeadingZeros1 > 0 || numLeadingZeros2 > 0)) {
-					while (newcli.GetLength() < highStr.GetLength())
-						newcli = PString("0") + newcli;
-				}
+	if (rule == ipRule.second.end())
+		return;
 
-				PTRACE(5, "CLIRW\t" << (inbound ? "Inbound" : "Outbound")
-					<< " CLI range rewrite target is '" << newcli << "' selected by the rule "
-					<< rule->AsString()
-					);
-			}
-			if (rule->m_rewriteType == RewriteRule::PrefixToPrefix
-					&& rule->m_matchType == RewriteRule::MatchCallerNumber) {
-				PString unused;
-				newcli = RewriteString(cli, rule->m_prefix.c_str(), newcli, unused);
+	if (rule->m_screeningType == RewriteRule::NoScreening) {
+		// get the new ANI/CLI
+		newcli = rule->m_cli[rand() % rule->m_cli.size()].c_str();
+		// if this is a number range, choose the new ANI/CLI from the range
+		const PINDEX sepIndex = newcli.Find('-');
+		if (sepIndex != P_MAX_INDEX) {
+			PString lowStr(newcli.Left(sepIndex).Trim());
+			PString highStr(newcli.Mid(sepIndex + 1).Trim());
+			PUInt64 low = lowStr.AsUnsigned64();
+			PUInt64 high = highStr.AsUnsigned64();
+			PUInt64 diff = (low < high) ? (high - low) : (low - high);
+
+			int numLeadingZeros1 = 0;
+			while (numLeadingZeros1 < lowStr.GetLength()
+					&& lowStr[numLeadingZeros1] == '0')
+				++numLeadingZeros1;
+					
+			int numLeadingZeros2 = 0;
+			while (numLeadingZeros2 < highStr.GetLength()
+					&& highStr[numLeadingZeros2] == '0')
+				++numLeadingZeros2;
+			
+			if (diff >= RAND_MAX)
+				diff = PUInt64(rand());
+			else
+				diff = PUInt64(rand() % ((unsigned)diff + 1));
+				
+			diff = (low < high) ? (low + diff) : (high + diff);
+			newcli = PString(diff);
+
+			if (lowStr.GetLength() == highStr.GetLength() && (numLeadingZeros1 > 0 || numLeadingZeros2 > 0)) {
+				while (newcli.GetLength() < highStr.GetLength())
+					newcli = PString("0") + newcli;
 			}
 
 			PTRACE(5, "CLIRW\t" << (inbound ? "Inbound" : "Outbound")
-				<< " CLI rewrite to '" << newcli << "' by the rule " << rule->AsString()
+				<< " CLI range rewrite target is '" << newcli << "' selected by the rule "
+				<< rule->AsString()
 				);
-			break;
 		}
-		++rule;
-	}
+		if (rule->m_rewriteType == RewriteRule::PrefixToPrefix
+				&& rule->m_matchType == RewriteRule::MatchCallerNumber) {
+			PString unused;
+			newcli = RewriteString(cli, rule->m_prefix.c_str(), newcli, unused);
+		}
 
-	if (rule == ipRule.second.end())
-		return;
+		PTRACE(5, "CLIRW\t" << (inbound ? "Inbound" : "Outbound")
+			<< " CLI rewrite to '" << newcli << "' by the rule " << rule->AsString()
+			);
+	}
 
 	bool isTerminal = false;	
 	if (authData && authData->m_call) {
@@ -901,43 +1005,51 @@ CLIRewrite::SingleIpRule * CLIRewrite::RunQuery(const PString & query, const Set
 	}
 	params["cli"] = cli;
 
-	GkSQLResult * result = m_sqlConn->ExecuteQuery(query, params, -1);
-	if (result == NULL) {
-		PTRACE(2, CLIRewriteSQLSection << ": query failed - timeout or fatal error");
-		SNMP_TRAP(4, SNMPError, Database, PString(CLIRewriteSQLSection) + " query failed");
-		return NULL;
-	}
+	// the cache key contains all query parameters
+	const PString cacheKey = query + "\n" + params["callerip"] + "\n" + called + "\n" + cli;
+	PString newCLI;
+	if (m_sqlCache == NULL || !m_sqlCache->Retrieve(cacheKey, newCLI)) {
+		GkSQLResult * result = m_sqlConn->ExecuteQuery(query, params, -1);
+		if (result == NULL) {
+			PTRACE(2, CLIRewriteSQLSection << ": query failed - timeout or fatal error");
+			SNMP_TRAP(4, SNMPError, Database, PString(CLIRewriteSQLSection) + " query failed");
+			return NULL;
+		}
+
+		if (!result->IsValid()) {
+			PTRACE(2, CLIRewriteSQLSection << ": query failed (" << result->GetErrorCode()
+				<< ") - " << result->GetErrorMessage());
+			SNMP_TRAP(4, SNMPError, Database, PString(CLIRewriteSQLSection) + " query failed");
+			delete result;
+			return NULL;
+		}
 
-	if (!result->IsValid()) {
-		PTRACE(2, CLIRewriteSQLSection << ": query failed (" << result->GetErrorCode()
-			<< ") - " << result->GetErrorMessage());
-		SNMP_TRAP(4, SNMPError, Database, PString(CLIRewriteSQLSection) + " query failed");
+		if (result->GetNumRows() != 1)
+			PTRACE(3, CLIRewriteSQLSection << ": query returned no rows");
+		else if (result->GetNumFields() < 1)
+			PTRACE(2, CLIRewriteSQLSection << ": bad query - no columns found in the result set");
+		else if (!result->FetchRow(resultRow) || resultRow.empty()) {
+			PTRACE(2, CLIRewriteSQLSection << ": query failed - could not fetch the result row");
+			SNMP_TRAP(4, SNMPError, Database, PString(CLIRewriteSQLSection) + " query failed");
+			delete result;
+			return NULL;
+		} else {
+			newCLI = resultRow[0].first;
+			PTRACE(5, CLIRewriteSQLSection << "\tQuery result : " << newCLI);
+		}
 		delete result;
-		return NULL;
+		// an empty CLI leaves the CLI unchanged, like no rows
+		if (m_sqlCache)
+			m_sqlCache->Save(cacheKey, newCLI);
 	}
-	
-	if (result->GetNumRows() != 1)
-		PTRACE(3, CLIRewriteSQLSection << ": query returned no rows");
-	else if (result->GetNumFields() < 1)
-		PTRACE(2, CLIRewriteSQLSection << ": bad query - no columns found in the result set");
-	else if (!result->FetchRow(resultRow) || resultRow.empty()) {
-		PTRACE(2, CLIRewriteSQLSection << ": query failed - could not fetch the result row");
-		SNMP_TRAP(4, SNMPError, Database, PString(CLIRewriteSQLSection) + " query failed");
-	} else {
-		PString newCLI = resultRow[0].first;
-		PTRACE(5, CLIRewriteSQLSection << "\tQuery result : " << newCLI);
 
+	if (!newCLI.IsEmpty()) {
 		RewriteRules rules;
 		RewriteRule rule;
-		//if ((result->GetNumFields() == 1)
-//		rule.m_manualCLIR = CLIRPassthrough;
-//		rule.m_CLIRPolicy = IgnoreCLIR;
-		rule.m_cli.push_back(newCLI);
+		rule.m_cli.push_back((const char *)newCLI);
 		rules.push_back(rule);
-		delete result;
 		return new SingleIpRule(addr, rules);
 	}
-	delete result;
 #endif // HAS_DATABASE
 	return NULL;
 }
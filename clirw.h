@@ -18,6 +18,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include "Toolkit.h"
 
 struct SetupAuthData;
@@ -26,6 +27,7 @@ template <class> class H225SignalingMsg;
 class H225_Setup_UUIE;
 typedef H225SignalingMsg<H225_Setup_UUIE> SetupMsg;
 class GkSQLConnection;
+class CacheManager;
 
 /// Perform Calling-Party-Number-IE/Setup-UUIE.sourceAddress rewritting
 class CLIRewrite {
@@ -90,6 +92,7 @@ public:
 	typedef std::vector<DoubleIpRule> DoubleIpRules;
 
 	CLIRewrite();
+	~CLIRewrite();
 
 	/// Rewrite CLI before any Setup message processing, like auth & routing
 	void InRewrite(
@@ -106,6 +109,11 @@ public:
 		);
 
 protected:
+	/// longest prefix match index of the networks in a list of IP rules
+	class IpRuleIndex;
+	/// prefix indexes of the numbers in a list of rewrite rules
+	class RuleIndex;
+
 	void Rewrite(
 		SetupMsg &msg, /// Q.931 Setup message to be rewritten
 		const SingleIpRule &ipRule, /// rule to use for rewrite
@@ -113,6 +121,9 @@ protected:
 		SetupAuthData *authData /// additional data for outbound rules
 		) const;
 
+	/// build the lookup indexes after the rules have been loaded
+	void CompileRules();
+
 	// process inbound or outbound SQL queries and return a rule
 	SingleIpRule * RunQuery(const PString & query, const SetupMsg & msg);
 
@@ -122,6 +133,10 @@ protected:
 private:
 	SingleIpRules m_inboundRules; /// a set of inbound CLI/ANI rewrite rules
 	DoubleIpRules m_outboundRules; /// a set of outbound CLI/ANI rewrite rules
+	IpRuleIndex * m_inboundIndex; /// caller networks of m_inboundRules
+	IpRuleIndex * m_outboundIndex; /// caller networks of m_outboundRules
+	std::vector<IpRuleIndex *> m_calleeIndexes; /// callee networks for each of m_outboundRules
+	std::map<const RewriteRules *, RuleIndex *> m_prefixIndexes; /// numbers of each rule list
 	bool m_processSourceAddress; /// true to rewrite numbers in sourceAddress Setup-UUIE
 	bool m_removeH323Id; /// true to put in the sourceAddress Setup-UUIE field only rewritten ANI/CLI
 	int m_CLIRPolicy; /// how to process CLIR
@@ -130,6 +145,7 @@ private:
 	GkSQLConnection * m_sqlConn;
 	PString m_inboundQuery;
 	PString m_outboundQuery;
+	CacheManager * m_sqlCache; /// new CLIs returned by the queries
 };
 
 #endif
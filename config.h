@@ -294,6 +294,11 @@
     #define HAS_DES_ECB 1
 #endif
 
+// HAS_H235_MEDIA_INPLACE is detected by configure, it needs H.235 media support, too
+#if defined(HAS_H235_MEDIA_INPLACE) && !defined(HAS_H235_MEDIA)
+    #undef HAS_H235_MEDIA_INPLACE
+#endif
+
 
 
 //////////////////////////////////////////////////////////////////
@@ -20,7 +20,7 @@
 #include "snmp.h"
 #include "rasinfo.h"
 #include "RasPDU.h"
-#include "gkauth.h"
+#include "ipauth.h"
 
 #ifdef HAS_GEOIP2
 #include <maxminddb.h>
@@ -32,70 +32,25 @@ extern "C" {
 
 /// GeoIP authentication policy
 
-class GeoIPAuth : public GkAuthenticator
+class GeoIPAuth : public IPAuthBase
 {
 public:
-	enum SupportedRasChecks {
-		/// bitmask of RAS checks implemented by this module
-		GeoIPAuthRasChecks = RasInfo<H225_RegistrationRequest>::flag
-			| RasInfo<H225_AdmissionRequest>::flag
-			| RasInfo<H225_GatekeeperRequest>::flag
-			| RasInfo<H225_UnregistrationRequest>::flag
-			| RasInfo<H225_BandwidthRequest>::flag
-			| RasInfo<H225_DisengageRequest>::flag
-			| RasInfo<H225_LocationRequest>::flag
-			| RasInfo<H225_InfoRequest>::flag
-			| RasInfo<H225_ResourcesAvailableIndicate>::flag
-	};
-	enum SupportedMiscChecks {
-		/// bitmask of Misc checks implemented by this module
-        GeoIPAuthMiscChecks = e_Setup
-            | e_SetupUnreg
-            | e_Connect
-            | e_CallProceeding
-            | e_Alerting
-            | e_Information
-            | e_ReleaseComplete
-            | e_Facility
-            | e_Progress
-            | e_Empty
-            | e_Status
-            | e_StatusEnquiry
-            | e_SetupAck
-            | e_Notify
-	};
-
 	GeoIPAuth(
 		const char* name, /// a name for this module (a config section name)
-		unsigned supportedRasChecks = GeoIPAuthRasChecks,
-		unsigned supportedMiscChecks = GeoIPAuthMiscChecks
+		unsigned supportedRasChecks = IPAuthRasChecks,
+		unsigned supportedMiscChecks = IPAuthMiscChecks
 		);
 
 	virtual ~GeoIPAuth();
 
-	/** Authenticate/Authorize RAS or signaling message.
-	    An override from GkAuthenticator.
-
-	    @return
-	    e_fail - authentication rejected the request
-	    e_ok - authentication accepted the request
-	    e_next - authentication is not supported for this request
-	             or cannot be determined (SQL failure, no cryptoTokens, ...)
-	*/
-	virtual int Check(RasPDU<H225_RegistrationRequest> & request, RRQAuthData & authData);
-	virtual int Check(RasPDU<H225_AdmissionRequest> & request, ARQAuthData & authData);
-	virtual int Check(RasPDU<H225_GatekeeperRequest> & grqPdu, unsigned & rejectReason);
-	virtual int Check(RasPDU<H225_UnregistrationRequest> & req, unsigned & rejectReason);
-	virtual int Check(RasPDU<H225_BandwidthRequest> & req, unsigned & rejectReason);
-	virtual int Check(RasPDU<H225_DisengageRequest> & req, unsigned & rejectReason);
-	virtual int Check(RasPDU<H225_LocationRequest> & req, unsigned & rejectReason);
-	virtual int Check(RasPDU<H225_InfoRequest> & req, unsigned & rejectReason);
-	virtual int Check(RasPDU<H225_ResourcesAvailableIndicate> & req, unsigned & rejectReason);
-
-	virtual int Check(SetupMsg & setup, SetupAuthData & authData);
-    virtual int Check(Q931 & msg, Q931AuthData & authData);
-
 protected:
+	/// Overriden from IPAuthBase
+	virtual int CheckAddress(
+		const PIPSocket::Address & addr, /// IP address the request comes from
+		WORD port, /// port number the request comes from
+		const PString & number,
+		bool overTLS);
+
 	/** run the check on the IP
 
 		@return
@@ -103,7 +58,7 @@ protected:
 		e_fail	if authentication failed
 		e_next	go to next policy
 	*/
-	int doGeoCheck(PIPSocket::Address & ip);
+	int doGeoCheck(const PIPSocket::Address & ip);
 
 private:
 	GeoIPAuth();
@@ -120,7 +75,7 @@ protected:
 };
 
 GeoIPAuth::GeoIPAuth(const char * name, unsigned supportedRasChecks, unsigned supportedMiscChecks)
-	: GkAuthenticator(name, supportedRasChecks, supportedMiscChecks)
+	: IPAuthBase(name, supportedRasChecks, supportedMiscChecks)
 {
 	PString database = GkConfig()->GetString("GeoIPAuth", "Database", "geoip.dat");
 #ifdef HAS_GEOIP2
@@ -150,65 +105,12 @@ GeoIPAuth::~GeoIPAuth()
 #endif
 }
 
-int GeoIPAuth::Check(RasPDU<H225_RegistrationRequest> & rrqPdu, RRQAuthData & authData)
-{
-	return doGeoCheck((rrqPdu.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_AdmissionRequest> & request, ARQAuthData & authData)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_GatekeeperRequest> & request, unsigned &)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_UnregistrationRequest> & request, unsigned &)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_BandwidthRequest> & request, unsigned &)
+int GeoIPAuth::CheckAddress(const PIPSocket::Address & addr, WORD /*port*/, const PString & /*number*/, bool /*overTLS*/)
 {
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_DisengageRequest> & request, unsigned &)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_LocationRequest> & request, unsigned &)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_InfoRequest> & request, unsigned &)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(RasPDU<H225_ResourcesAvailableIndicate> & request, unsigned &)
-{
-	return doGeoCheck((request.operator->())->m_peerAddr);
-}
-
-int GeoIPAuth::Check(SetupMsg & setup, SetupAuthData & authData)
-{
-	PIPSocket::Address addr;
-	WORD port = 0;
-	setup.GetPeerAddr(addr, port);
 	return doGeoCheck(addr);
 }
 
-int GeoIPAuth::Check(Q931 & msg, Q931AuthData & authData)
-{
-	return doGeoCheck(authData.m_peerAddr);
-}
-
-int GeoIPAuth::doGeoCheck(PIPSocket::Address & ip)
+int GeoIPAuth::doGeoCheck(const PIPSocket::Address & ip)
 {
 #ifdef HAS_GEOIP2
 #else
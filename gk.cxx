@@ -41,6 +41,8 @@
 #include "gktimer.h"
 #include "gk.h"
 #include "capctrl.h"
+#include "metrics.h"
+#include "regsync.h"
 #include "snmp.h"
 
 #ifdef HAS_LIBSSH
@@ -73,11 +75,14 @@ const char * KnownConfigEntries[][2] = {
 	{ "AlternateGatekeepers::SQL", "Database" },
 	{ "AlternateGatekeepers::SQL", "Driver" },
 	{ "AlternateGatekeepers::SQL", "Host" },
+	{ "AlternateGatekeepers::SQL", "HostRetryInterval" },
 	{ "AlternateGatekeepers::SQL", "Library" },
 	{ "AlternateGatekeepers::SQL", "MinPoolSize" },
 	{ "AlternateGatekeepers::SQL", "Password" },
 	{ "AlternateGatekeepers::SQL", "Query" },
 	{ "AlternateGatekeepers::SQL", "ReadTimeout" },
+	{ "AlternateGatekeepers::SQL", "ReplicaHosts" },
+	{ "AlternateGatekeepers::SQL", "SharedPool" },
 	{ "AlternateGatekeepers::SQL", "Username" },
 #ifdef HAS_LIBRABBITMQ
 	{ "AMQPAcct", "AlertEvent" },
@@ -107,22 +112,28 @@ const char * KnownConfigEntries[][2] = {
 	{ "AssignedAliases::SQL", "Database" },
 	{ "AssignedAliases::SQL", "Driver" },
 	{ "AssignedAliases::SQL", "Host" },
+	{ "AssignedAliases::SQL", "HostRetryInterval" },
 	{ "AssignedAliases::SQL", "Library" },
 	{ "AssignedAliases::SQL", "MinPoolSize" },
 	{ "AssignedAliases::SQL", "Password" },
 	{ "AssignedAliases::SQL", "Query" },
 	{ "AssignedAliases::SQL", "ReadTimeout" },
+	{ "AssignedAliases::SQL", "ReplicaHosts" },
+	{ "AssignedAliases::SQL", "SharedPool" },
 	{ "AssignedAliases::SQL", "Username" },
 	{ "AssignedGatekeepers::SQL", "CacheTimeout" },
 	{ "AssignedGatekeepers::SQL", "ConnectTimeout" },
 	{ "AssignedGatekeepers::SQL", "Database" },
 	{ "AssignedGatekeepers::SQL", "Driver" },
 	{ "AssignedGatekeepers::SQL", "Host" },
+	{ "AssignedGatekeepers::SQL", "HostRetryInterval" },
 	{ "AssignedGatekeepers::SQL", "Library" },
 	{ "AssignedGatekeepers::SQL", "MinPoolSize" },
 	{ "AssignedGatekeepers::SQL", "Password" },
 	{ "AssignedGatekeepers::SQL", "Query" },
 	{ "AssignedGatekeepers::SQL", "ReadTimeout" },
+	{ "AssignedGatekeepers::SQL", "ReplicaHosts" },
+	{ "AssignedGatekeepers::SQL", "SharedPool" },
 	{ "AssignedGatekeepers::SQL", "Username" },
 #ifdef HAS_LANGUAGE
 	{ "AssignedLanguage::SQL", "CacheTimeout" },
@@ -130,11 +141,14 @@ const char * KnownConfigEntries[][2] = {
 	{ "AssignedLanguage::SQL", "Database" },
 	{ "AssignedLanguage::SQL", "Driver" },
 	{ "AssignedLanguage::SQL", "Host" },
+	{ "AssignedLanguage::SQL", "HostRetryInterval" },
 	{ "AssignedLanguage::SQL", "Library" },
 	{ "AssignedLanguage::SQL", "MinPoolSize" },
 	{ "AssignedLanguage::SQL", "Password" },
 	{ "AssignedLanguage::SQL", "Query" },
 	{ "AssignedLanguage::SQL", "ReadTimeout" },
+	{ "AssignedLanguage::SQL", "ReplicaHosts" },
+	{ "AssignedLanguage::SQL", "SharedPool" },
 	{ "AssignedLanguage::SQL", "Username" },
 #endif
 #endif
@@ -268,6 +282,7 @@ const char * KnownConfigEntries[][2] = {
 	{ "Gatekeeper::Main", "MulticastPort" },
 	{ "Gatekeeper::Main", "Name" },
 	{ "Gatekeeper::Main", "NetworkInterfaces" },
+	{ "Gatekeeper::Main", "RasListenerThreads" },
 	{ "Gatekeeper::Main", "RedirectGK" },
 	{ "Gatekeeper::Main", "SendTo" },
 	{ "Gatekeeper::Main", "SkipForwards" },
@@ -327,6 +342,7 @@ const char * KnownConfigEntries[][2] = {
 	{ "GkPresence::SQL", "Database" },
 	{ "GkPresence::SQL", "Driver" },
 	{ "GkPresence::SQL", "Host" },
+	{ "GkPresence::SQL", "HostRetryInterval" },
 	{ "GkPresence::SQL", "IncrementalUpdate" },
 	{ "GkPresence::SQL", "Library" },
 	{ "GkPresence::SQL", "Password" },
@@ -336,6 +352,8 @@ const char * KnownConfigEntries[][2] = {
 	{ "GkPresence::SQL", "QueryList" },
 	{ "GkPresence::SQL", "QueryUpdate" },
 	{ "GkPresence::SQL", "ReadTimeout" },
+	{ "GkPresence::SQL", "ReplicaHosts" },
+	{ "GkPresence::SQL", "SharedPool" },
 	{ "GkPresence::SQL", "UpdateWorkerTimer" },
 	{ "GkPresence::SQL", "Username" },
 #endif
@@ -348,10 +366,13 @@ const char * KnownConfigEntries[][2] = {
 	{ "GkQoSMonitor::SQL", "Database" },
 	{ "GkQoSMonitor::SQL", "Driver" },
 	{ "GkQoSMonitor::SQL", "Host" },
+	{ "GkQoSMonitor::SQL", "HostRetryInterval" },
 	{ "GkQoSMonitor::SQL", "Library" },
 	{ "GkQoSMonitor::SQL", "Password" },
 	{ "GkQoSMonitor::SQL", "Query" },
 	{ "GkQoSMonitor::SQL", "ReadTimeout" },
+	{ "GkQoSMonitor::SQL", "ReplicaHosts" },
+	{ "GkQoSMonitor::SQL", "SharedPool" },
 	{ "GkQoSMonitor::SQL", "Username" },
 #endif
 	{ "GkStatus::Filtering", "Enable" },
@@ -370,6 +391,8 @@ const char * KnownConfigEntries[][2] = {
 	{ "H235", "VerifyRandomNumber" },
 #endif // H323_H235
 #ifdef H323_H350
+	{ "H350PasswordAuth", "CacheMaxEntries" },
+	{ "H350PasswordAuth", "NegativeCacheTimeout" },
 	{ "H350PasswordAuth", "PasswordTimeout" },
 #endif
 #if defined (P_HTTP) || defined (HAS_LIBCURL)
@@ -396,13 +419,17 @@ const char * KnownConfigEntries[][2] = {
 	{ "HttpAcct", "UnregisterBody" },
 	{ "HttpAcct", "UnregisterURL" },
 	{ "HttpPasswordAuth", "Body" },
+	{ "HttpPasswordAuth", "CacheMaxEntries" },
 	{ "HttpPasswordAuth", "DeleteRegex" },
 	{ "HttpPasswordAuth", "ErrorRegex" },
 	{ "HttpPasswordAuth", "Method" },
+	{ "HttpPasswordAuth", "NegativeCacheTimeout" },
 	{ "HttpPasswordAuth", "PasswordTimeout" },
 	{ "HttpPasswordAuth", "ResultRegex" },
 	{ "HttpPasswordAuth", "URL" },
 #endif // P_HTTP
+	{ "IPAuth", "CacheMaxEntries" },
+	{ "IPAuth", "CacheTimeout" },
 #ifdef HAS_LUA
 	{ "LuaAcct", "Script" },
 	{ "LuaAcct", "ScriptFile" },
@@ -411,6 +438,8 @@ const char * KnownConfigEntries[][2] = {
 	{ "LuaAuth", "CallScriptFile" },
 	{ "LuaAuth", "RegistrationScript" },
 	{ "LuaAuth", "RegistrationScriptFile" },
+	{ "LuaPasswordAuth", "CacheMaxEntries" },
+	{ "LuaPasswordAuth", "NegativeCacheTimeout" },
 	{ "LuaPasswordAuth", "PasswordTimeout" },
 	{ "LuaPasswordAuth", "Script" },
 	{ "LuaPasswordAuth", "ScriptFile" },
@@ -423,6 +452,8 @@ const char * KnownConfigEntries[][2] = {
 	{ "LogFile", "Rotate" },
 	{ "LogFile", "RotateDay" },
 	{ "LogFile", "RotateTime" },
+	{ "Metrics", "HttpInterface" },
+	{ "Metrics", "HttpPort" },
 	{ "PortNotifications", "H245PortOpen" },
 	{ "PortNotifications", "H245PortClose" },
 	{ "PortNotifications", "Q931PortOpen" },
@@ -542,20 +573,32 @@ const char * KnownConfigEntries[][2] = {
 	{ "RasSrv::RRQFeatures", "AuthenticatedAliasesOnly" },
 	{ "RasSrv::RRQFeatures", "GatewayAssignAliases" },
 	{ "RasSrv::RRQFeatures", "IRQPollCount" },
+	{ "RasSrv::RRQFeatures", "LightweightRRQFastPath" },
 	{ "RasSrv::RRQFeatures", "OverwriteEPOnSameAddress" },
+	{ "RasSrv::RRQFeatures", "SnapshotFile" },
+	{ "RasSrv::RRQFeatures", "SnapshotInterval" },
 	{ "RasSrv::RRQFeatures", "SupportDynamicIP" },
+	{ "RegistrationSync", "Interface" },
+	{ "RegistrationSync", "KeepAliveInterval" },
+	{ "RegistrationSync", "Peers" },
+	{ "RegistrationSync", "Port" },
+	{ "RegistrationSync", "RetryInterval" },
 #ifdef HAS_DATABASE
+	{ "RewriteCLI::SQL", "CacheMaxEntries" },
 	{ "RewriteCLI::SQL", "CacheTimeout" },
 	{ "RewriteCLI::SQL", "ConnectTimeout" },
 	{ "RewriteCLI::SQL", "Database" },
 	{ "RewriteCLI::SQL", "Driver" },
 	{ "RewriteCLI::SQL", "Host" },
+	{ "RewriteCLI::SQL", "HostRetryInterval" },
 	{ "RewriteCLI::SQL", "InboundQuery" },
 	{ "RewriteCLI::SQL", "Library" },
 	{ "RewriteCLI::SQL", "MinPoolSize" },
 	{ "RewriteCLI::SQL", "OutboundQuery" },
 	{ "RewriteCLI::SQL", "Password" },
 	{ "RewriteCLI::SQL", "ReadTimeout" },
+	{ "RewriteCLI::SQL", "ReplicaHosts" },
+	{ "RewriteCLI::SQL", "SharedPool" },
 	{ "RewriteCLI::SQL", "Username" },
 #endif
 	{ "RewriteSourceAddress", "ForceAliasType" },
@@ -574,6 +617,7 @@ const char * KnownConfigEntries[][2] = {
 	{ "RoutedMode", "AlertingTimeout" },
 	{ "RoutedMode", "AlwaysRewriteSourceCallSignalAddress" },
 	{ "RoutedMode", "AutoProxyIPv4ToIPv6Calls" },
+	{ "RoutedMode", "CallSignalHandlerMaxNumber" },
 	{ "RoutedMode", "CallSignalHandlerNumber" },
 	{ "RoutedMode", "CallSignalPort" },
 	{ "RoutedMode", "CalledTypeOfNumber" },
@@ -658,6 +702,7 @@ const char * KnownConfigEntries[][2] = {
 	{ "RoutedMode", "RequireH235HalfCallMedia" },
 #endif
 	{ "RoutedMode", "RerouteOnFacility" },
+	{ "RoutedMode", "RtpHandlerMaxNumber" },
 	{ "RoutedMode", "RtpHandlerNumber" },
 	{ "RoutedMode", "ScreenCallingPartyNumberIE" },
 	{ "RoutedMode", "ScreenDisplayIE" },
@@ -691,11 +736,14 @@ const char * KnownConfigEntries[][2] = {
 	{ "Routing::Forwarding", "Database" },
 	{ "Routing::Forwarding", "Driver" },
 	{ "Routing::Forwarding", "Host" },
+	{ "Routing::Forwarding", "HostRetryInterval" },
 	{ "Routing::Forwarding", "Library" },
 	{ "Routing::Forwarding", "MinPoolSize" },
 	{ "Routing::Forwarding", "Password" },
 	{ "Routing::Forwarding", "Query" },
 	{ "Routing::Forwarding", "ReadTimeout" },
+	{ "Routing::Forwarding", "ReplicaHosts" },
+	{ "Routing::Forwarding", "SharedPool" },
 	{ "Routing::Forwarding", "Username" },
 #ifdef HAS_LUA
 	{ "Routing::Lua", "Script" },
@@ -706,11 +754,14 @@ const char * KnownConfigEntries[][2] = {
 	{ "Routing::NeighborSql", "Database" },
 	{ "Routing::NeighborSql", "Driver" },
 	{ "Routing::NeighborSql", "Host" },
+	{ "Routing::NeighborSql", "HostRetryInterval" },
 	{ "Routing::NeighborSql", "Library" },
 	{ "Routing::NeighborSql", "MinPoolSize" },
 	{ "Routing::NeighborSql", "Password" },
 	{ "Routing::NeighborSql", "Query" },
 	{ "Routing::NeighborSql", "ReadTimeout" },
+	{ "Routing::NeighborSql", "ReplicaHosts" },
+	{ "Routing::NeighborSql", "SharedPool" },
 	{ "Routing::NeighborSql", "Username" },
 	{ "Routing::RDS", "ResolveLRQ" },
 	{ "Routing::SRV", "ResolveNonLocalLRQ" },
@@ -721,11 +772,14 @@ const char * KnownConfigEntries[][2] = {
 	{ "Routing::Sql", "Driver" },
 	{ "Routing::Sql", "EnableRegexRewrite" },
 	{ "Routing::Sql", "Host" },
+	{ "Routing::Sql", "HostRetryInterval" },
 	{ "Routing::Sql", "Library" },
 	{ "Routing::Sql", "MinPoolSize" },
 	{ "Routing::Sql", "Password" },
 	{ "Routing::Sql", "Query" },
 	{ "Routing::Sql", "ReadTimeout" },
+	{ "Routing::Sql", "ReplicaHosts" },
+	{ "Routing::Sql", "SharedPool" },
 	{ "Routing::Sql", "Username" },
 #endif
 #ifdef HAS_SNMP
@@ -740,11 +794,15 @@ const char * KnownConfigEntries[][2] = {
 #endif
 #ifdef HAS_DATABASE
 	{ "SQLAcct", "AlertQuery" },
+	{ "SQLAcct", "AsyncQueries" },
+	{ "SQLAcct", "AsyncQueueSize" },
+	{ "SQLAcct", "AsyncThreads" },
 	{ "SQLAcct", "CacheTimeout" },
 	{ "SQLAcct", "ConnectTimeout" },
 	{ "SQLAcct", "Database" },
 	{ "SQLAcct", "Driver" },
 	{ "SQLAcct", "Host" },
+	{ "SQLAcct", "HostRetryInterval" },
 	{ "SQLAcct", "Library" },
 	{ "SQLAcct", "MinPoolSize" },
 	{ "SQLAcct", "OffQuery" },
@@ -752,6 +810,8 @@ const char * KnownConfigEntries[][2] = {
 	{ "SQLAcct", "Password" },
 	{ "SQLAcct", "ReadTimeout" },
 	{ "SQLAcct", "RegisterQuery" },
+	{ "SQLAcct", "ReplicaHosts" },
+	{ "SQLAcct", "SharedPool" },
 	{ "SQLAcct", "StartQuery" },
 	{ "SQLAcct", "StartQueryAlt" },
 	{ "SQLAcct", "StopQuery" },
@@ -760,16 +820,21 @@ const char * KnownConfigEntries[][2] = {
 	{ "SQLAcct", "UnregisterQuery" },
 	{ "SQLAcct", "UpdateQuery" },
 	{ "SQLAcct", "Username" },
+	{ "SQLAliasAuth", "CacheMaxEntries" },
 	{ "SQLAliasAuth", "CacheTimeout" },
 	{ "SQLAliasAuth", "ConnectTimeout" },
 	{ "SQLAliasAuth", "Database" },
 	{ "SQLAliasAuth", "Driver" },
 	{ "SQLAliasAuth", "Host" },
+	{ "SQLAliasAuth", "HostRetryInterval" },
 	{ "SQLAliasAuth", "Library" },
 	{ "SQLAliasAuth", "MinPoolSize" },
+	{ "SQLAliasAuth", "NegativeCacheTimeout" },
 	{ "SQLAliasAuth", "Password" },
 	{ "SQLAliasAuth", "Query" },
 	{ "SQLAliasAuth", "ReadTimeout" },
+	{ "SQLAliasAuth", "ReplicaHosts" },
+	{ "SQLAliasAuth", "SharedPool" },
 	{ "SQLAliasAuth", "Table" },
 	{ "SQLAliasAuth", "Username" },
 	{ "SQLAuth", "CacheTimeout" },
@@ -778,12 +843,15 @@ const char * KnownConfigEntries[][2] = {
 	{ "SQLAuth", "Database" },
 	{ "SQLAuth", "Driver" },
 	{ "SQLAuth", "Host" },
+	{ "SQLAuth", "HostRetryInterval" },
 	{ "SQLAuth", "Library" },
 	{ "SQLAuth", "MinPoolSize" },
 	{ "SQLAuth", "NbQuery" },
 	{ "SQLAuth", "Password" },
 	{ "SQLAuth", "ReadTimeout" },
 	{ "SQLAuth", "RegQuery" },
+	{ "SQLAuth", "ReplicaHosts" },
+	{ "SQLAuth", "SharedPool" },
 	{ "SQLAuth", "Username" },
 	{ "SQLConfig", "AssignedAliasQuery" },
 	{ "SQLConfig", "CacheTimeout" },
@@ -793,6 +861,7 @@ const char * KnownConfigEntries[][2] = {
 	{ "SQLConfig", "Driver" },
 	{ "SQLConfig", "GWPrefixesQuery" },
 	{ "SQLConfig", "Host" },
+	{ "SQLConfig", "HostRetryInterval" },
 	{ "SQLConfig", "Library" },
 	{ "SQLConfig", "MinPoolSize" },
 	{ "SQLConfig", "NeighborsQuery" },
@@ -800,19 +869,26 @@ const char * KnownConfigEntries[][2] = {
 	{ "SQLConfig", "Password" },
 	{ "SQLConfig", "PermanentEndpointsQuery" },
 	{ "SQLConfig", "ReadTimeout" },
+	{ "SQLConfig", "ReplicaHosts" },
 	{ "SQLConfig", "RewriteAliasQuery" },
 	{ "SQLConfig", "RewriteE164Query" },
+	{ "SQLConfig", "SharedPool" },
 	{ "SQLConfig", "Username" },
+	{ "SQLPasswordAuth", "CacheMaxEntries" },
 	{ "SQLPasswordAuth", "CacheTimeout" },
 	{ "SQLPasswordAuth", "ConnectTimeout" },
 	{ "SQLPasswordAuth", "Database" },
 	{ "SQLPasswordAuth", "Driver" },
 	{ "SQLPasswordAuth", "Host" },
+	{ "SQLPasswordAuth", "HostRetryInterval" },
 	{ "SQLPasswordAuth", "Library" },
 	{ "SQLPasswordAuth", "MinPoolSize" },
+	{ "SQLPasswordAuth", "NegativeCacheTimeout" },
 	{ "SQLPasswordAuth", "Password" },
 	{ "SQLPasswordAuth", "Query" },
 	{ "SQLPasswordAuth", "ReadTimeout" },
+	{ "SQLPasswordAuth", "ReplicaHosts" },
+	{ "SQLPasswordAuth", "SharedPool" },
 	{ "SQLPasswordAuth", "Username" },
 #endif
 	{ "StatusAcct", "ConnectEvent" },
@@ -965,6 +1041,8 @@ void ShutdownHandler()
 		delete PreliminaryCallTable::Instance();
 	if (CallTable::InstanceExists())
 		delete CallTable::Instance();
+	if (RegistrationSync::InstanceExists())
+		delete RegistrationSync::Instance();
 	if (RegistrationTable::InstanceExists())
 		delete RegistrationTable::Instance();
 	if (RasServer::InstanceExists())
@@ -973,6 +1051,8 @@ void ShutdownHandler()
 		delete MakeCallEndPoint::Instance();
 	if (Toolkit::InstanceExists())
 		delete Toolkit::Instance();
+	if (Metrics::InstanceExists())
+		delete Metrics::Instance();
 #if defined(HAS_SNMP)
 	DeleteSNMPAgent();
 #endif
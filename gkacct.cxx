@@ -30,6 +30,7 @@
 #include "Toolkit.h"
 #include "gktimer.h"
 #include "snmp.h"
+#include "metrics.h"
 #include "gkacct.h"
 
 using std::find;
@@ -70,6 +71,12 @@ GkAcctLogger::GkAcctLogger(const char* moduleName, const char* cfgSecName)
 	if (control.GetSize() > 1)
 		m_enabledEvents = GetEvents(control);
 
+	static const char * const ResultNames[] = { "fail", "next", "ok" };
+	for (int i = 0; i < 3; ++i)
+		m_resultMetrics[i] = Metrics::Instance()->GetCounter("gnugk_acct_events_total",
+			"Accounting events by module and result",
+			PString("module=\"") + moduleName + "\",result=\"" + ResultNames[i] + "\"");
+
 	PTRACE(1, "GKACCT\tCreated module " << moduleName << " with event mask "
 		<< PString(PString::Unsigned, (long)m_enabledEvents, 16));
 }
@@ -79,6 +86,12 @@ GkAcctLogger::~GkAcctLogger()
 	PTRACE(1, "GKACCT\tDestroyed module " << GetName());
 }
 
+void GkAcctLogger::CountResult(int status) const
+{
+	if (status >= Fail && status <= Ok)
+		m_resultMetrics[status - Fail]->Inc();
+}
+
 int GkAcctLogger::GetEvents(const PStringArray & tokens) const
 {
 	int mask = 0;
@@ -925,6 +938,7 @@ bool GkAcctLoggerList::LogAcctEvent(
 			continue;
 
 		status = logger->Log(evt, call);
+		logger->CountResult(status);
 		switch (status)
 		{
 		case GkAcctLogger::Ok:
@@ -994,6 +1008,7 @@ bool GkAcctLoggerList::LogAcctEvent(
 			continue;
 
 		status = logger->Log(evt, ep);
+		logger->CountResult(status);
 		switch (status)
 		{
 		case GkAcctLogger::Ok:
@@ -25,6 +25,8 @@
 /** Module for logging accounting events
 	generated by the gatekeeper.
 */
+class MetricCounter;
+
 class GkAcctLogger : public NamedObject
 {
 public:
@@ -88,6 +90,11 @@ public:
 
 	virtual ~GkAcctLogger();
 
+	/// count the result of a logging operation for the metrics
+	void CountResult(
+		int status /// Ok, Fail or Next
+		) const;
+
 	/** @return
 		Control flag determining processing behavior for this module
 		(optional,sufficient,required).
@@ -262,6 +269,8 @@ private:
 	PConfig* m_config;
 	/// name for the config section with logger settings
 	PString m_configSectionName;
+	/// logging results for the metrics, indexed by status - Fail
+	MetricCounter * m_resultMetrics[3];
 };
 
 /**
@@ -25,6 +25,7 @@
 #include "RasPDU.h"
 #include "sigmsg.h"
 #include "Routing.h"
+#include "metrics.h"
 #include "gkauth.h"
 
 #if H323_H350
@@ -196,6 +197,12 @@ GkAuthenticator::GkAuthenticator(
 		PTRACE(1, "GKAUTH\tNo control flag specified in the config for module '"
 			<< GetName() << '\'');
 
+	static const char * const ResultNames[] = { "fail", "next", "ok" };
+	for (int i = 0; i < 3; ++i)
+		m_resultMetrics[i] = Metrics::Instance()->GetCounter("gnugk_auth_checks_total",
+			"Authentication checks by module and result",
+			PString("module=\"") + name + "\",result=\"" + ResultNames[i] + "\"");
+
 	std::map<PString, unsigned> rasmap;
 	rasmap["GRQ"] = RasInfo<H225_GatekeeperRequest>::flag,
 	rasmap["RRQ"] = RasInfo<H225_RegistrationRequest>::flag,
@@ -293,6 +300,12 @@ GkAuthenticator::~GkAuthenticator()
 	PTRACE(1, "GKAUTH\t" << GetName() << " rule removed");
 }
 
+void GkAuthenticator::CountResult(int status) const
+{
+	if (status >= e_fail && status <= e_ok)
+		m_resultMetrics[status - e_fail]->Inc();
+}
+
 PString GkAuthenticator::StatusAsString(int status) const
 {
 	switch(status)
@@ -885,6 +898,7 @@ bool GkAuthenticatorList::Validate(
 		GkAuthenticator* auth = *i++;
 		if (auth->IsRasCheckEnabled(RasInfo<H225_RegistrationRequest>::flag)) {
 			const int result = auth->Check(request, authData);
+			auth->CountResult(result);
 			if (result == GkAuthenticator::e_ok) {
 				PTRACE(3, "GKAUTH\t" << auth->GetName() << " RRQ check ok");
 				if (auth->GetControlFlag() == GkAuthenticator::e_Sufficient
@@ -913,6 +927,7 @@ bool GkAuthenticatorList::Validate(
 		if (auth->IsRasCheckEnabled(RasInfo<H225_AdmissionRequest>::flag)) {
 			const long oldDurationLimit = authData.m_callDurationLimit;
 			const int result = auth->Check(request, authData);
+			auth->CountResult(result);
 			if (authData.m_callDurationLimit == 0) {
 				PTRACE(3, "GKAUTH\t" << auth->GetName() << " ARQ check failed: "
 					"call duration 0");
@@ -956,6 +971,7 @@ bool GkAuthenticatorList::Validate(
 				&& auth->IsMiscCheckEnabled(GkAuthenticator::e_SetupUnreg))) {
 			const long oldDurationLimit = authData.m_callDurationLimit;
 			const int result = auth->Check(setup, authData);
+			auth->CountResult(result);
 			if (authData.m_callDurationLimit == 0) {
 				PTRACE(3, "GKAUTH\t" << auth->GetName() << " Setup check failed: "
 					"call duration limit 0");
@@ -990,6 +1006,7 @@ bool GkAuthenticatorList::Validate(Q931 & msg, Q931AuthData & authData)
 		GkAuthenticator* auth = *i++;
 		if (auth->IsMiscCheckEnabled(auth->AuthEnum(msg.GetMessageType()))) {
             const int result = auth->Check(msg, authData);
+            auth->CountResult(result);
             if (result == GkAuthenticator::e_ok) {
                 PTRACE(3, "GKAUTH\t" << auth->GetName() << " Q931 check ok");
                 if (auth->GetControlFlag() == GkAuthenticator::e_Sufficient
@@ -1006,27 +1023,100 @@ bool GkAuthenticatorList::Validate(Q931 & msg, Q931AuthData & authData)
 }
 
 // class CacheManager
+
+namespace {
+/// frequently used keys are refreshed ahead of their expiry
+const unsigned RefreshAheadHits = 2;
+}
+
+std::list<CacheManager *> CacheManager::m_caches;
+PMutex CacheManager::m_cachesMutex;
+
+CacheManager::CacheManager(
+	long timeout,
+	unsigned maxEntries,
+	const PString & name
+	) : m_ttl(timeout), m_negativeTtl(0),
+	m_maxShardEntries(maxEntries > 0 ? (maxEntries + NumShards - 1) / NumShards : 0), m_name(name)
+{
+	PWaitAndSignal lock(m_cachesMutex);
+	m_caches.push_back(this);
+}
+
+CacheManager::~CacheManager()
+{
+	PWaitAndSignal lock(m_cachesMutex);
+	m_caches.remove(this);
+}
+
+CacheManager::Shard & CacheManager::GetShard(const PString & key) const
+{
+	// FNV-1a
+	unsigned hash = 2166136261u;
+	for (const char * c = key; *c != 0; ++c)
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	return m_shards[hash % NumShards];
+}
+
+bool CacheManager::IsExpired(const Entry & entry, time_t now) const
+{
+	const long ttl = entry.m_negative ? m_negativeTtl : m_ttl;
+	if (ttl == 0)
+		return true;
+	return ttl > 0 && (now - entry.m_ctime) >= ttl;
+}
+
 bool CacheManager::Retrieve(
 	const PString & key, /// the key to look for
 	PString & value /// filled with the value on return
 	) const
+{
+	const LookupResult result = Lookup(key, value);
+	return result == Hit || result == RefreshAhead;
+}
+
+CacheManager::LookupResult CacheManager::Lookup(
+	const PString & key, /// the key to look for
+	PString & value /// filled with the value on return
+	) const
 {
 	// quick check
-	if (m_ttl == 0)
-		return false;
+	if (m_ttl == 0 && m_negativeTtl == 0)
+		return Miss;
 
-	ReadLock lock(m_rwmutex);
+	Shard & shard = GetShard(key);
+	PWaitAndSignal lock(shard.m_mutex);
 
-	std::map<PString, PString>::const_iterator iter = m_cache.find(key);
-	if (iter == m_cache.end())
-		return false;
-	if (m_ttl >= 0) {
-		std::map<PString, time_t>::const_iterator i = m_ctime.find(key);
-		if (i == m_ctime.end() || (time(NULL) - i->second) >= m_ttl)
-			return false; // cache expired
+	std::map<PString, Entry>::iterator iter = shard.m_entries.find(key);
+	if (iter == shard.m_entries.end()) {
+		++shard.m_misses;
+		return Miss;
 	}
-	value = (const char *)(iter->second);
-	return true;
+	Entry & entry = iter->second;
+	const time_t now = GetTime();
+	if (IsExpired(entry, now)) {
+		shard.m_lru.erase(entry.m_lru);
+		shard.m_entries.erase(iter);
+		++shard.m_misses;
+		return Miss; // cache expired
+	}
+
+	shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, entry.m_lru);
+	++entry.m_hits;
+	if (entry.m_negative) {
+		++shard.m_negativeHits;
+		return NegativeHit;
+	}
+	++shard.m_hits;
+	value = (const char *)(entry.m_value);
+
+	// ask one caller to refresh a frequently used value in the last quarter of its life time
+	if (m_ttl > 0 && !entry.m_refreshing && entry.m_hits >= RefreshAheadHits
+			&& (now - entry.m_ctime) * 4 >= m_ttl * 3) {
+		entry.m_refreshing = true;
+		return RefreshAhead;
+	}
+	return Hit;
 }
 
 void CacheManager::Save(
@@ -1034,13 +1124,77 @@ void CacheManager::Save(
 	const PString & value /// a value to be associated with the key
 	)
 {
-	if (m_ttl != 0) {
-		WriteLock lock(m_rwmutex);
-		m_cache[key] = (const char*)value;
-		m_ctime[key] = time(NULL);
+	Store(key, value, false);
+}
+
+void CacheManager::SaveNegative(
+	const PString & key /// a key to be stored
+	)
+{
+	Store(key, PString::Empty(), true);
+}
+
+void CacheManager::Store(const PString & key, const PString & value, bool negative)
+{
+	if ((negative ? m_negativeTtl : m_ttl) == 0)
+		return;
+
+	Shard & shard = GetShard(key);
+	PWaitAndSignal lock(shard.m_mutex);
+
+	const time_t now = GetTime();
+	std::map<PString, Entry>::iterator iter = shard.m_entries.find(key);
+	if (iter == shard.m_entries.end()) {
+		const PString newKey = (const char *)key;
+		iter = shard.m_entries.insert(std::make_pair(newKey, Entry())).first;
+		shard.m_lru.push_front(newKey);
+	} else
+		shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, iter->second.m_lru);
+
+	Entry & entry = iter->second;
+	entry.m_value = (const char *)value;
+	entry.m_ctime = now;
+	entry.m_hits = 0;
+	entry.m_negative = negative;
+	entry.m_refreshing = false;
+	entry.m_lru = shard.m_lru.begin();
+
+	// drop expired and least recently used keys
+	while (shard.m_entries.size() > 1) {
+		std::map<PString, Entry>::iterator oldest = shard.m_entries.find(shard.m_lru.back());
+		const bool evict = m_maxShardEntries > 0 && shard.m_entries.size() > m_maxShardEntries;
+		if (!evict && !IsExpired(oldest->second, now))
+			break;
+		if (evict)
+			++shard.m_evictions;
+		shard.m_lru.pop_back();
+		shard.m_entries.erase(oldest);
 	}
 }
 
+PString CacheManager::PrintStatistics()
+{
+	PStringStream strm;
+	PWaitAndSignal lock(m_cachesMutex);
+	for (std::list<CacheManager *>::const_iterator i = m_caches.begin(); i != m_caches.end(); ++i) {
+		unsigned long entries = 0, hits = 0, negativeHits = 0, misses = 0, evictions = 0;
+		for (unsigned s = 0; s < NumShards; ++s) {
+			Shard & shard = (*i)->m_shards[s];
+			PWaitAndSignal shardLock(shard.m_mutex);
+			entries += shard.m_entries.size();
+			hits += shard.m_hits;
+			negativeHits += shard.m_negativeHits;
+			misses += shard.m_misses;
+			evictions += shard.m_evictions;
+		}
+		strm << (*i)->m_name << ": entries=" << entries << " hits=" << hits
+			<< " negativeHits=" << negativeHits << " misses=" << misses
+			<< " evictions=" << evictions << "\r\n";
+	}
+	strm << "Number of caches: " << m_caches.size() << "\r\n";
+	return strm;
+}
+
 
 // class SimplePasswordAuth
 SimplePasswordAuth::SimplePasswordAuth(
@@ -1058,7 +1212,9 @@ SimplePasswordAuth::SimplePasswordAuth(
 	if (GkConfig()->HasKey(name, "CheckID")) {
         m_checkID = GkConfig()->GetBoolean(name, "CheckID", true);  // backward compatibility, deprecated
 	}
-	m_cache = new CacheManager(GetConfig()->GetInteger(name, "PasswordTimeout", -1));
+	m_cache = new CacheManager(GetConfig()->GetInteger(name, "PasswordTimeout", -1),
+		GetConfig()->GetInteger(name, "CacheMaxEntries", 0), name);
+	m_cache->SetNegativeTimeout(GetConfig()->GetInteger(name, "NegativeCacheTimeout", 0));
 	m_disabledAlgorithms = GetConfig()->GetString(name, "DisableAlgorithm", "").Tokenise(",;", FALSE);
 
     PFactory<H235Authenticator>::KeyList_T keyList = PFactory<H235Authenticator>::GetKeyList();
@@ -1243,15 +1399,32 @@ bool SimplePasswordAuth::InternalGetPassword(
 {
     params["u"] = id;
 
-	if (m_cache->Retrieve(id, passwd)) {
+	PString newPasswd;
+	switch (m_cache->Lookup(id, passwd)) {
+	case CacheManager::Hit:
 		PTRACE(5, "GKAUTH\t" << GetName() << " cached password found for '" << id << '\'');
 		return true;
+	case CacheManager::NegativeHit:
+		PTRACE(5, "GKAUTH\t" << GetName() << " no password for '" << id << "' (cached)");
+		return false;
+	case CacheManager::RefreshAhead:
+		// refresh the password before it expires, keep using the cached one if that fails
+		PTRACE(5, "GKAUTH\t" << GetName() << " refreshing cached password for '" << id << '\'');
+		if (GetPassword(id, newPasswd, params)) {
+			m_cache->Save(id, newPasswd);
+			passwd = newPasswd;
+		}
+		return true;
+	default:
+		break;
 	}
 	if (GetPassword(id, passwd, params)) {
 		m_cache->Save(id, passwd);
 		return true;
-	} else
+	} else {
+		m_cache->SaveNegative(id);
 		return false;
+	}
 }
 
 int SimplePasswordAuth::CheckTokens(
@@ -1522,7 +1695,9 @@ AliasAuth::AliasAuth(
 	unsigned supportedMiscChecks)
 	: GkAuthenticator(name, supportedRasChecks, supportedMiscChecks), m_cache(NULL)
 {
-	m_cache = new CacheManager(GetConfig()->GetInteger(name, "CacheTimeout", -1));
+	m_cache = new CacheManager(GetConfig()->GetInteger(name, "CacheTimeout", -1),
+		GetConfig()->GetInteger(name, "CacheMaxEntries", 0), name);
+	m_cache->SetNegativeTimeout(GetConfig()->GetInteger(name, "NegativeCacheTimeout", 0));
 }
 
 AliasAuth::~AliasAuth()
@@ -1597,15 +1772,32 @@ bool AliasAuth::InternalGetAuthConditionString(
 	PString & authCond /// filled with the auth condition string on return
 	)
 {
-	if (m_cache->Retrieve(id, authCond)) {
+	PString newAuthCond;
+	switch (m_cache->Lookup(id, authCond)) {
+	case CacheManager::Hit:
 		PTRACE(5, "GKAUTH\t" << GetName() << " cached auth condition string found for '" << id << '\'');
 		return true;
+	case CacheManager::NegativeHit:
+		PTRACE(5, "GKAUTH\t" << GetName() << " no auth condition string for '" << id << "' (cached)");
+		return false;
+	case CacheManager::RefreshAhead:
+		// refresh the auth condition before it expires, keep using the cached one if that fails
+		PTRACE(5, "GKAUTH\t" << GetName() << " refreshing cached auth condition string for '" << id << '\'');
+		if (GetAuthConditionString(id, newAuthCond)) {
+			m_cache->Save(id, newAuthCond);
+			authCond = newAuthCond;
+		}
+		return true;
+	default:
+		break;
 	}
 	if (GetAuthConditionString(id, authCond)) {
 		m_cache->Save(id, authCond);
 		return true;
-	} else
+	} else {
+		m_cache->SaveNegative(id);
 		return false;
+	}
 }
 
 bool AliasAuth::doCheck(
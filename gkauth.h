@@ -52,6 +52,7 @@ typedef H225SignalingMsg<H225_Setup_UUIE> SetupMsg;
 
 class EndpointRec;
 class CallRec;
+class MetricCounter;
 template<class> class SmartPtr;
 typedef SmartPtr<EndpointRec> endptr;
 typedef SmartPtr<CallRec> callptr;
@@ -341,6 +342,10 @@ public:
 
 	virtual ~GkAuthenticator();
 
+	/// count the result of a check for the metrics
+	void CountResult(
+		int status /// e_ok, e_fail or e_next
+		) const;
 
 	/** @return
 	    true if this authenticator provides H.235 compatible security.
@@ -572,18 +577,33 @@ protected:
 	unsigned m_supportedMiscChecks;
 	/// authenticator config
 	PConfig* m_config;
+	/// check results for the metrics, indexed by status - e_fail
+	MetricCounter * m_resultMetrics[3];
 };
 
 /** Cache used by some authenticators to remember key-value associations,
     like username-password. It increases performance, as backend
     does not need to be queried each time.
+    The keys are spread over shards with separate locks and each shard
+    evicts its least recently used keys when the cache is limited in size.
 */
 class CacheManager
 {
 public:
+	/// result of a cache lookup
+	enum LookupResult {
+		Miss, /// not cached or the cache expired
+		Hit, /// the value is valid
+		NegativeHit, /// the key has been cached as not found
+		RefreshAhead /// the value is valid, but it is about to expire and the caller should refresh it
+	};
+
 	CacheManager(
-		long timeout = -1 /// cache timeout - expiry period (seconds)
-		) : m_ttl(timeout) { }
+		long timeout = -1, /// cache timeout - expiry period (seconds)
+		unsigned maxEntries = 0, /// maximum number of cached keys, 0 = no limit
+		const PString & name = "cache" /// name for the statistics
+		);
+	virtual ~CacheManager();
 
 	/** Get a value associated with the key.
 
@@ -596,29 +616,84 @@ public:
 		PString & value /// filled with the value on return
 		) const;
 
+	/** Get a value associated with the key. Only one caller gets RefreshAhead
+	    for frequently used keys, when most of the cache timeout has passed.
+
+	    @return
+	    the result of the lookup, #value# is set for Hit and RefreshAhead
+	*/
+	LookupResult Lookup(
+		const PString & key, /// the key to look for
+		PString & value /// filled with the value on return
+		) const;
+
 	/// Store a key-value association in the cache
 	void Save(
 		const PString & key, /// a key to be stored
 		const PString & value /// a value to be associated with the key
 		);
 
+	/// Remember that the key has no value
+	void SaveNegative(
+		const PString & key /// a key to be stored
+		);
+
 	void SetTimeout(
 		long newTimeout /// new cache expiration timeout
 		) { m_ttl = newTimeout; }
 
+	void SetNegativeTimeout(
+		long newTimeout /// new expiration timeout for keys without a value
+		) { m_negativeTtl = newTimeout; }
+
+	/// @return	hit, miss and eviction counters for all caches
+	static PString PrintStatistics();
+
+protected:
+	/// @return	the current time to check the expiry, can be overridden by tests
+	virtual time_t GetTime() const { return time(NULL); }
+
 private:
 	CacheManager(const CacheManager &);
 	CacheManager & operator=(const CacheManager &);
 
+	struct Entry {
+		PString m_value;
+		time_t m_ctime; /// when the value has been stored
+		unsigned m_hits; /// lookups since the value has been stored
+		bool m_negative; /// the key has no value
+		bool m_refreshing; /// a caller has been asked to refresh the value
+		std::list<PString>::iterator m_lru; /// position in the LRU list
+	};
+
+	struct Shard {
+		Shard() : m_hits(0), m_negativeHits(0), m_misses(0), m_evictions(0) { }
+
+		std::map<PString, Entry> m_entries;
+		std::list<PString> m_lru; /// keys, most recently used first
+		PMutex m_mutex;
+		unsigned long m_hits, m_negativeHits, m_misses, m_evictions;
+	};
+
+	enum { NumShards = 16 };
+
+	Shard & GetShard(const PString & key) const;
+	bool IsExpired(const Entry & entry, time_t now) const;
+	void Store(const PString & key, const PString & value, bool negative);
+
 private:
 	/// cache timeout (seconds), 0 = do not cache, -1 = never expires
 	long m_ttl;
-	/// cached key-value pairs
-	std::map<PString, PString> m_cache;
-	/// timestamps for key-value pair expiration calculation
-	std::map<PString, time_t> m_ctime;
-	/// mutex for multiple read/mutual write access to the cache
-	mutable PReadWriteMutex m_rwmutex;
+	/// cache timeout for keys without a value (seconds), 0 = do not cache
+	long m_negativeTtl;
+	/// maximum number of keys in each shard, 0 = no limit
+	unsigned m_maxShardEntries;
+	PString m_name;
+	mutable Shard m_shards[NumShards];
+
+	/// all caches, for the statistics
+	static std::list<CacheManager *> m_caches;
+	static PMutex m_cachesMutex;
 };
 
 /** A base class for all authenticators that only checks if username-password
@@ -1125,6 +1200,7 @@ public:
 			GkAuthenticator* auth = *i++;
 			if (auth->IsRasCheckEnabled(RasInfo<RAS>::flag)) {
 				const int result = auth->Check(request, rejectReason);
+				auth->CountResult(result);
 				if (result == GkAuthenticator::e_ok) {
 					PTRACE(3, "GKAUTH\t" << auth->GetName() << ' ' << request.GetTagName() << " check ok");
 					if (auth->GetControlFlag() == GkAuthenticator::e_Sufficient
@@ -0,0 +1,120 @@
+/*
+ * gkauth.t.cxx
+ *
+ * unit tests for gkauth.cxx
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#include "config.h"
+#include "gkauth.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+/// cache with a clock the test can move forward
+class ManualClockCache : public CacheManager {
+public:
+	ManualClockCache(long timeout, const PString & name) : CacheManager(timeout, 0, name), m_now(time(NULL)) { }
+
+	void Advance(time_t seconds) { m_now += seconds; }
+
+protected:
+	// override from class CacheManager
+	virtual time_t GetTime() const { return m_now; }
+
+private:
+	time_t m_now;
+};
+
+class CacheManagerTest : public ::testing::Test {
+protected:
+	CacheManagerTest() { }
+
+	/// @return	the statistics line of the named cache
+	PString GetStatistics(const PString & name) {
+		PStringArray lines = CacheManager::PrintStatistics().Lines();
+		for (PINDEX i = 0; i < lines.GetSize(); ++i)
+			if (lines[i].Find(name + ":") == 0)
+				return lines[i];
+		return PString::Empty();
+	}
+
+	PString value;
+};
+
+
+TEST_F(CacheManagerTest, SaveAndRetrieve) {
+	CacheManager cache(-1, 0, "test1");
+	EXPECT_FALSE(cache.Retrieve("key", value));
+	cache.Save("key", "value");
+	EXPECT_TRUE(cache.Retrieve("key", value));
+	EXPECT_STREQ("value", value);
+	cache.Save("key", "other");
+	EXPECT_EQ(CacheManager::Hit, cache.Lookup("key", value));
+	EXPECT_STREQ("other", value);
+	EXPECT_STREQ("test1: entries=1 hits=2 negativeHits=0 misses=1 evictions=0", GetStatistics("test1"));
+}
+
+TEST_F(CacheManagerTest, Expiry) {
+	CacheManager disabled(0, 0, "test2");
+	disabled.Save("key", "value");
+	EXPECT_FALSE(disabled.Retrieve("key", value));
+
+	ManualClockCache cache(2, "test3");
+	cache.Save("key", "value");
+	cache.Advance(1);
+	EXPECT_TRUE(cache.Retrieve("key", value));
+	cache.Advance(1);
+	EXPECT_FALSE(cache.Retrieve("key", value));
+	EXPECT_STREQ("test3: entries=0 hits=1 negativeHits=0 misses=1 evictions=0", GetStatistics("test3"));
+	cache.Save("key", "value");
+	EXPECT_TRUE(cache.Retrieve("key", value));
+}
+
+TEST_F(CacheManagerTest, LRULimit) {
+	CacheManager cache(-1, 32, "test4");
+	cache.Save("key0", "0");
+	// a key that is used all the time is never the least recently used one
+	for (unsigned i = 0; i < 1000; ++i) {
+		cache.Save("other" + PString(PString::Unsigned, i), "x");
+		EXPECT_TRUE(cache.Retrieve("key0", value));
+	}
+	EXPECT_STREQ("0", value);
+	EXPECT_FALSE(cache.Retrieve("other0", value));
+	EXPECT_TRUE(cache.Retrieve("other999", value));
+
+	// the cache never holds more than the limit, the other keys have been evicted
+	PString stats = GetStatistics("test4");
+	EXPECT_EQ(0, stats.Find("test4: entries=32 "));
+	EXPECT_NE(P_MAX_INDEX, stats.Find(" evictions=969"));
+}
+
+TEST_F(CacheManagerTest, NegativeEntries) {
+	ManualClockCache cache(-1, "test5");
+	// negative entries are not stored without a negative timeout
+	cache.SaveNegative("key");
+	EXPECT_EQ(CacheManager::Miss, cache.Lookup("key", value));
+
+	cache.SetNegativeTimeout(1);
+	cache.SaveNegative("key");
+	EXPECT_EQ(CacheManager::NegativeHit, cache.Lookup("key", value));
+	EXPECT_FALSE(cache.Retrieve("key", value));
+	cache.Advance(1);
+	EXPECT_EQ(CacheManager::Miss, cache.Lookup("key", value));
+
+	// a value replaces the negative entry
+	cache.SaveNegative("key");
+	cache.Save("key", "value");
+	EXPECT_EQ(CacheManager::Hit, cache.Lookup("key", value));
+	EXPECT_STREQ("value", value);
+	EXPECT_NE(P_MAX_INDEX, GetStatistics("test5").Find(" negativeHits=2 "));
+}
+
+}  // namespace
@@ -0,0 +1,441 @@
+//////////////////////////////////////////////////////////////////
+//
+// gkcallbench.cxx
+//
+// Signalling load generator and benchmark for the GNU Gatekeeper
+//
+// A calling and an auto-answer endpoint register with a gatekeeper
+// in routed mode and run many simultaneous calls through it:
+// Setup, CallProceeding, Alerting, Connect and ReleaseComplete.
+// Reports the achieved calls per second, post-dial delay
+// percentiles and failures.
+//
+// Copyright (c) 2026, Jan Willamowius
+//
+// This work is published under the GNU Public License version 2 (GPLv2)
+// see file COPYING for details.
+// We also explicitly grant the right to link this code
+// with the OpenH323/H323Plus and OpenSSL library.
+//
+//////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <vector>
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <h323.h>
+
+namespace {
+
+PInt64 Now()
+{
+	return PTime().GetTimestamp();
+}
+
+/// @return	the value of the sorted samples at the given fraction
+unsigned Percentile(const std::vector<unsigned> & samples, double p)
+{
+	if (samples.empty())
+		return 0;
+	size_t i = (size_t)(p * samples.size());
+	return samples[std::min(i, samples.size() - 1)];
+}
+
+/// tokens of calls with the time when the next action is due
+typedef std::list<std::pair<PInt64, PString> > DueList;
+
+} // end of anonymous namespace
+
+
+/// common setup of the calling and the answering endpoint
+class BenchEndPoint : public H323EndPoint
+{
+	PCLASSINFO(BenchEndPoint, H323EndPoint)
+public:
+	BenchEndPoint(const PString & alias, bool fastStart, bool tunneling);
+
+	bool Start(const PIPSocket::Address & iface, WORD port, const PString & gatekeeper);
+
+	// override from H323EndPoint
+	// no media, only the signalling is measured
+	virtual PBoolean OpenAudioChannel(H323Connection &, PBoolean, unsigned, H323AudioCodec &) { return FALSE; }
+};
+
+BenchEndPoint::BenchEndPoint(const PString & alias, bool fastStart, bool tunneling)
+{
+	SetLocalUserName(alias);
+	DisableFastStart(!fastStart);
+	DisableH245Tunneling(!tunneling);
+	AddAllCapabilities(0, 0, "G.711");
+	// not needed for calls on the local host
+#ifdef H323_H46018
+	H46018Enable(PFalse);
+#endif
+#ifdef H323_H46023
+	H46023Enable(PFalse);
+#endif
+}
+
+bool BenchEndPoint::Start(const PIPSocket::Address & iface, WORD port, const PString & gatekeeper)
+{
+	H323ListenerTCP * listener = new H323ListenerTCP(*this, iface, port);
+	if (!StartListener(listener)) {
+		cerr << "Can't open H.323 listener on " << iface << ':' << port << endl;
+		return false;
+	}
+	if (!SetGatekeeper(gatekeeper, new H323TransportUDP(*this, iface))) {
+		cerr << GetLocalUserName() << ": can't register with gatekeeper " << gatekeeper << endl;
+		return false;
+	}
+	return true;
+}
+
+
+/// answers each call with Alerting and after the answer delay with Connect
+class AnswerEndPoint : public BenchEndPoint
+{
+	PCLASSINFO(AnswerEndPoint, BenchEndPoint)
+public:
+	AnswerEndPoint(const PString & alias, bool fastStart, bool tunneling, PInt64 answerDelay)
+		: BenchEndPoint(alias, fastStart, tunneling), m_answerDelay(answerDelay) { }
+
+	// override from H323EndPoint
+	virtual H323Connection::AnswerCallResponse OnAnswerCall(H323Connection & connection,
+		const PString & caller, const H323SignalPDU & setupPDU, H323SignalPDU & connectPDU);
+
+	/// send Connect for the calls that are due, called from the main loop
+	void AnswerCalls(PInt64 now);
+
+private:
+	PInt64 m_answerDelay; /// microseconds
+	PMutex m_mutex;
+	DueList m_answers;
+};
+
+H323Connection::AnswerCallResponse AnswerEndPoint::OnAnswerCall(H323Connection & connection,
+	const PString &, const H323SignalPDU &, H323SignalPDU &)
+{
+	// the connection can't be answered from inside this callback,
+	// the main loop sends the Connect
+	PWaitAndSignal lock(m_mutex);
+	m_answers.push_back(std::make_pair(Now() + m_answerDelay, connection.GetCallToken()));
+	return H323Connection::AnswerCallPending; // send Alerting
+}
+
+void AnswerEndPoint::AnswerCalls(PInt64 now)
+{
+	std::vector<PString> due;
+	{
+		PWaitAndSignal lock(m_mutex);
+		// entries are added in the order they are due
+		while (!m_answers.empty() && m_answers.front().first <= now) {
+			due.push_back(m_answers.front().second);
+			m_answers.pop_front();
+		}
+	}
+	for (size_t i = 0; i < due.size(); ++i) {
+		H323Connection * connection = FindConnectionWithLock(due[i]);
+		if (connection) {
+			connection->AnsweringCall(H323Connection::AnswerCallNow);
+			connection->Unlock();
+		}
+	}
+}
+
+
+class CallerEndPoint;
+
+/// records the progress of an outgoing call
+class CallerConnection : public H323Connection
+{
+	PCLASSINFO(CallerConnection, H323Connection)
+public:
+	CallerConnection(CallerEndPoint & ep, unsigned callReference);
+
+	// overrides from H323Connection
+	virtual PBoolean OnReceivedAlerting(const H323SignalPDU & pdu);
+	virtual PBoolean OnReceivedSignalConnect(const H323SignalPDU & pdu);
+
+	PInt64 m_dialed;
+	PInt64 m_alerted; /// 0 if not received
+	PInt64 m_connected; /// 0 if not received
+
+private:
+	CallerEndPoint & m_ep;
+};
+
+/// places the calls, releases them after the hold time and collects the results
+class CallerEndPoint : public BenchEndPoint
+{
+	PCLASSINFO(CallerEndPoint, BenchEndPoint)
+public:
+	CallerEndPoint(const PString & alias, bool fastStart, bool tunneling, PInt64 holdTime, PInt64 timeout)
+		: BenchEndPoint(alias, fastStart, tunneling), m_holdTime(holdTime), m_timeout(timeout),
+		  m_active(0), m_started(0), m_connected(0), m_failed(0) { }
+
+	// overrides from H323EndPoint
+	virtual H323Connection * CreateConnection(unsigned callReference);
+	virtual void OnConnectionCleared(H323Connection & connection, const PString & token);
+
+	/// @return	true if the call was started
+	bool PlaceCall(const PString & destination);
+	/// called by the connection when the Connect arrives
+	void OnCallConnected(const PString & token);
+	/// release calls after the hold time and clear calls that timed out, called from the main loop
+	void ReleaseCalls(PInt64 now);
+
+	unsigned GetActive() const;
+	unsigned GetFinished() const;
+	unsigned GetFailed() const;
+	void Report(PInt64 elapsed);
+
+private:
+	PInt64 m_holdTime; /// microseconds
+	PInt64 m_timeout; /// microseconds, max. time from dialing to Connect
+
+	mutable PMutex m_mutex;
+	DueList m_releases;
+	DueList m_timeouts;
+	unsigned m_active;
+	unsigned m_started;
+	unsigned m_connected;
+	unsigned m_failed;
+	std::vector<unsigned> m_postDialDelays; /// milliseconds, dialing to Alerting
+	std::vector<unsigned> m_connectDelays; /// milliseconds, dialing to Connect
+	std::map<PString, unsigned> m_failures; /// by call end reason
+};
+
+CallerConnection::CallerConnection(CallerEndPoint & ep, unsigned callReference)
+	: H323Connection(ep, callReference), m_dialed(Now()), m_alerted(0), m_connected(0), m_ep(ep)
+{
+}
+
+PBoolean CallerConnection::OnReceivedAlerting(const H323SignalPDU & pdu)
+{
+	if (m_alerted == 0)
+		m_alerted = Now();
+	return H323Connection::OnReceivedAlerting(pdu);
+}
+
+PBoolean CallerConnection::OnReceivedSignalConnect(const H323SignalPDU & pdu)
+{
+	m_connected = Now();
+	if (!H323Connection::OnReceivedSignalConnect(pdu))
+		return FALSE;
+	m_ep.OnCallConnected(GetCallToken());
+	return TRUE;
+}
+
+H323Connection * CallerEndPoint::CreateConnection(unsigned callReference)
+{
+	return new CallerConnection(*this, callReference);
+}
+
+bool CallerEndPoint::PlaceCall(const PString & destination)
+{
+	{
+		PWaitAndSignal lock(m_mutex);
+		++m_active;
+		++m_started;
+	}
+	PString token;
+	if (MakeCall(destination, token) == NULL) {
+		PWaitAndSignal lock(m_mutex);
+		--m_active;
+		++m_failed;
+		++m_failures["MakeCall failed"];
+		return false;
+	}
+	PWaitAndSignal lock(m_mutex);
+	m_timeouts.push_back(std::make_pair(Now() + m_timeout, token));
+	return true;
+}
+
+void CallerEndPoint::OnCallConnected(const PString & token)
+{
+	PWaitAndSignal lock(m_mutex);
+	m_releases.push_back(std::make_pair(Now() + m_holdTime, token));
+}
+
+void CallerEndPoint::ReleaseCalls(PInt64 now)
+{
+	std::vector<PString> release, expired;
+	{
+		PWaitAndSignal lock(m_mutex);
+		while (!m_releases.empty() && m_releases.front().first <= now) {
+			release.push_back(m_releases.front().second);
+			m_releases.pop_front();
+		}
+		while (!m_timeouts.empty() && m_timeouts.front().first <= now) {
+			expired.push_back(m_timeouts.front().second);
+			m_timeouts.pop_front();
+		}
+	}
+	for (size_t i = 0; i < release.size(); ++i)
+		ClearCall(release[i], H323Connection::EndedByLocalUser);
+	// calls that have been connected or cleared in time are ignored
+	for (size_t i = 0; i < expired.size(); ++i) {
+		H323Connection * connection = FindConnectionWithLock(expired[i]);
+		if (connection) {
+			const bool connected = ((CallerConnection *)connection)->m_connected != 0;
+			connection->Unlock();
+			if (!connected)
+				ClearCall(expired[i], H323Connection::EndedByNoAnswer);
+		}
+	}
+}
+
+void CallerEndPoint::OnConnectionCleared(H323Connection & connection, const PString &)
+{
+	const CallerConnection & call = (const CallerConnection &)connection;
+	PWaitAndSignal lock(m_mutex);
+	--m_active;
+	if (call.m_alerted)
+		m_postDialDelays.push_back((unsigned)((call.m_alerted - call.m_dialed) / 1000));
+	if (call.m_connected) {
+		++m_connected;
+		m_connectDelays.push_back((unsigned)((call.m_connected - call.m_dialed) / 1000));
+	} else {
+		++m_failed;
+		++m_failures[H323Connection::GetCallEndReasonText(connection.GetCallEndReason())];
+	}
+}
+
+unsigned CallerEndPoint::GetActive() const
+{
+	PWaitAndSignal lock(m_mutex);
+	return m_active;
+}
+
+unsigned CallerEndPoint::GetFinished() const
+{
+	PWaitAndSignal lock(m_mutex);
+	return m_connected + m_failed;
+}
+
+unsigned CallerEndPoint::GetFailed() const
+{
+	PWaitAndSignal lock(m_mutex);
+	return m_failed;
+}
+
+void CallerEndPoint::Report(PInt64 elapsed)
+{
+	PWaitAndSignal lock(m_mutex);
+	std::sort(m_postDialDelays.begin(), m_postDialDelays.end());
+	std::sort(m_connectDelays.begin(), m_connectDelays.end());
+	const double seconds = elapsed / 1000000.0;
+	cout << "Calls: " << m_started << "  Connected: " << m_connected << "  Failed: " << m_failed
+		<< "  in " << setprecision(3) << seconds << " s, "
+		<< setprecision(4) << (seconds > 0 ? m_connected / seconds : 0.0) << " calls/s\n\n"
+		<< setw(22) << "" << setw(9) << "Samples"
+		<< setw(10) << "p50(ms)" << setw(10) << "p90(ms)" << setw(10) << "p99(ms)" << setw(10) << "max(ms)" << '\n'
+		<< setw(22) << "Post-dial (Alerting)" << setw(9) << m_postDialDelays.size()
+		<< setw(10) << Percentile(m_postDialDelays, 0.5) << setw(10) << Percentile(m_postDialDelays, 0.9)
+		<< setw(10) << Percentile(m_postDialDelays, 0.99) << setw(10) << Percentile(m_postDialDelays, 1.0) << '\n'
+		<< setw(22) << "Connect" << setw(9) << m_connectDelays.size()
+		<< setw(10) << Percentile(m_connectDelays, 0.5) << setw(10) << Percentile(m_connectDelays, 0.9)
+		<< setw(10) << Percentile(m_connectDelays, 0.99) << setw(10) << Percentile(m_connectDelays, 1.0) << '\n';
+	for (std::map<PString, unsigned>::const_iterator i = m_failures.begin(); i != m_failures.end(); ++i)
+		cout << "  failed " << i->first << ": " << i->second << '\n';
+	cout << endl;
+}
+
+
+class CallBench : public PProcess
+{
+	PCLASSINFO(CallBench, PProcess)
+public:
+	CallBench();
+
+	virtual void Main();
+
+private:
+	void Usage() const;
+};
+
+PCREATE_PROCESS(CallBench)
+
+CallBench::CallBench() : PProcess("GNU", "gkcallbench", 1, 0, ReleaseCode, 0)
+{
+}
+
+void CallBench::Usage() const
+{
+	cout << "Usage: gkcallbench [options]\n"
+		"  -g --gatekeeper host[:port]  gatekeeper in routed mode (default 127.0.0.1)\n"
+		"  -i --interface ip            local IP of the endpoints (default 127.0.0.1)\n"
+		"  -P --port n                  signalling port of the answering endpoint,\n"
+		"                               the calling endpoint uses the next port (default 1730)\n"
+		"  -n --calls n                 number of calls (default 100)\n"
+		"  -C --concurrent n            max. simultaneous calls (default 10)\n"
+		"  -r --rate cps                max. new calls per second, 0 = no limit (default 0)\n"
+		"  -H --hold ms                 time between Connect and release (default 0)\n"
+		"  -a --answer-delay ms         time between Alerting and Connect (default 0)\n"
+		"  -t --timeout ms              max. time from dialing to Connect (default 10000)\n"
+		"  -f --faststart               offer fastStart\n"
+		"  -T --tunneling               use H.245 tunneling\n"
+		"  -d --destination alias       called alias (default the answering endpoint)\n"
+		"  -h --help\n"
+		"The exit code is 1 if any call failed.\n";
+}
+
+void CallBench::Main()
+{
+	PArgList & args = GetArguments();
+	args.Parse("g-gatekeeper:i-interface:P-port:n-calls:C-concurrent:r-rate:H-hold:"
+		"a-answer-delay:t-timeout:f-faststart.T-tunneling.d-destination:h-help.");
+	if (args.HasOption('h')) {
+		Usage();
+		return;
+	}
+
+	const PString gatekeeper = args.GetOptionString('g', "127.0.0.1");
+	const PIPSocket::Address iface(args.GetOptionString('i', "127.0.0.1"));
+	const WORD port = (WORD)args.GetOptionString('P', "1730").AsUnsigned();
+	const unsigned calls = args.GetOptionString('n', "100").AsUnsigned();
+	const unsigned concurrent = std::max(1U, (unsigned)args.GetOptionString('C', "10").AsUnsigned());
+	const unsigned rate = args.GetOptionString('r', "0").AsUnsigned();
+	const PInt64 holdTime = (PInt64)args.GetOptionString('H', "0").AsUnsigned() * 1000;
+	const PInt64 answerDelay = (PInt64)args.GetOptionString('a', "0").AsUnsigned() * 1000;
+	const PInt64 timeout = (PInt64)args.GetOptionString('t', "10000").AsUnsigned() * 1000;
+	const bool fastStart = args.HasOption('f');
+	const bool tunneling = args.HasOption('T');
+
+	const PString answerAlias = "callbench-answer";
+	AnswerEndPoint answer(answerAlias, fastStart, tunneling, answerDelay);
+	CallerEndPoint caller("callbench-caller", fastStart, tunneling, holdTime, timeout);
+	if (!answer.Start(iface, port, gatekeeper) || !caller.Start(iface, (WORD)(port + 1), gatekeeper)) {
+		SetTerminationValue(2);
+		return;
+	}
+	const PString destination = args.GetOptionString('d', answerAlias);
+
+	cout << "Calling " << destination << " through " << gatekeeper
+		<< ", fastStart " << (fastStart ? "on" : "off")
+		<< ", H.245 tunneling " << (tunneling ? "on" : "off") << endl;
+
+	const PInt64 start = Now();
+	unsigned placed = 0;
+	while (caller.GetFinished() < calls) {
+		const PInt64 now = Now();
+		// keep the call rate below the limit by spacing the calls evenly
+		while (placed < calls && caller.GetActive() < concurrent
+				&& (rate == 0 || (now - start) * rate >= (PInt64)placed * 1000000)) {
+			caller.PlaceCall(destination);
+			++placed;
+		}
+		answer.AnswerCalls(now);
+		caller.ReleaseCalls(now);
+		PThread::Sleep(1);
+	}
+	caller.Report(Now() - start);
+
+	caller.ClearAllCalls();
+	answer.ClearAllCalls();
+	caller.RemoveGatekeeper();
+	answer.RemoveGatekeeper();
+	SetTerminationValue(caller.GetFailed() > 0 ? 1 : 0);
+}
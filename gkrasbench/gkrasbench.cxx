@@ -0,0 +1,619 @@
+//////////////////////////////////////////////////////////////////
+//
+// gkrasbench.cxx
+//
+// RAS load generator and benchmark for the GNU Gatekeeper
+//
+// Simulates many endpoints doing GRQ/RRQ/lightweight RRQ/ARQ/DRQ/URQ
+// cycles against a gatekeeper and reports throughput, latency
+// percentiles and rejects for each message type.
+//
+// Copyright (c) 2026, Jan Willamowius
+//
+// This work is published under the GNU Public License version 2 (GPLv2)
+// see file COPYING for details.
+// We also explicitly grant the right to link this code
+// with the OpenH323/H323Plus and OpenSSL library.
+//
+//////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptlib/sockets.h>
+#include <h225.h>
+#include <h323pdu.h>
+#include <transports.h>
+#include <guid.h>
+#include "../rasinfo.h"
+
+namespace {
+
+const char * const H225_ProtocolID = "0.0.8.2250.0.4";
+
+/// endpoints per IP, each gets its own call signal port
+const unsigned PortsPerIP = 64000;
+
+enum BenchStep {
+	StepGRQ,
+	StepRRQ,
+	StepLightweightRRQ,
+	StepARQ,
+	StepDRQ,
+	StepURQ,
+	NumSteps
+};
+
+/// the confirm of a request has the tag + 1, the reject the tag + 2, see RequestInfo in rasinfo.h
+const struct {
+	const char * m_name;
+	unsigned m_tag;
+} StepInfo[NumSteps] = {
+	{ "grq", RasInfo<H225_GatekeeperRequest>::tag },
+	{ "rrq", RasInfo<H225_RegistrationRequest>::tag },
+	{ "lrrq", RasInfo<H225_RegistrationRequest>::tag },
+	{ "arq", RasInfo<H225_AdmissionRequest>::tag },
+	{ "drq", RasInfo<H225_DisengageRequest>::tag },
+	{ "urq", RasInfo<H225_UnregistrationRequest>::tag }
+};
+
+/// results for one message type
+struct StepStats {
+	StepStats() : m_sent(0), m_confirmed(0), m_rejected(0), m_timeouts(0), m_skipped(0) { }
+
+	/// @return	latency in microseconds, the latencies must be sorted
+	unsigned Percentile(double p) const
+	{
+		if (m_latencies.empty())
+			return 0;
+		size_t i = (size_t)(p * m_latencies.size());
+		return m_latencies[std::min(i, m_latencies.size() - 1)];
+	}
+
+	unsigned m_sent;
+	unsigned m_confirmed;
+	unsigned m_rejected;
+	unsigned m_timeouts;
+	unsigned m_skipped; /// not sent, eg. ARQ of an unregistered endpoint
+	std::vector<unsigned> m_latencies; /// microseconds, confirms and rejects
+	std::map<PString, unsigned> m_rejectReasons;
+};
+
+struct BenchEndpoint {
+	BenchEndpoint() : m_next(0), m_cycle(0), m_callRef(0), m_registered(false), m_inCall(false) { }
+
+	PString m_alias;
+	H225_TransportAddress m_callSignalAddress;
+	H225_EndpointIdentifier m_endpointId;
+	size_t m_next; /// index into the sequence of steps
+	unsigned m_cycle;
+	unsigned m_callRef;
+	H225_ConferenceIdentifier m_conferenceId;
+	H225_CallIdentifier m_callId;
+	bool m_registered;
+	bool m_inCall;
+};
+
+/// a request waiting for an answer
+struct PendingRequest {
+	unsigned m_endpoint;
+	BenchStep m_step;
+	PInt64 m_sent; /// microseconds
+	PInt64 m_deadline; /// microseconds, extended by RequestInProgress
+};
+
+template<class RAS> unsigned GetSeqNum(const H225_RasMessage & ras)
+{
+	const RAS & msg = ras;
+	return msg.m_requestSeqNum;
+}
+
+/// @return	the sequence number of an answer, 0 if the message isn't an answer
+unsigned GetReplySeqNum(const H225_RasMessage & ras)
+{
+	switch (ras.GetTag()) {
+		case H225_RasMessage::e_gatekeeperConfirm: return GetSeqNum<H225_GatekeeperConfirm>(ras);
+		case H225_RasMessage::e_gatekeeperReject: return GetSeqNum<H225_GatekeeperReject>(ras);
+		case H225_RasMessage::e_registrationConfirm: return GetSeqNum<H225_RegistrationConfirm>(ras);
+		case H225_RasMessage::e_registrationReject: return GetSeqNum<H225_RegistrationReject>(ras);
+		case H225_RasMessage::e_admissionConfirm: return GetSeqNum<H225_AdmissionConfirm>(ras);
+		case H225_RasMessage::e_admissionReject: return GetSeqNum<H225_AdmissionReject>(ras);
+		case H225_RasMessage::e_disengageConfirm: return GetSeqNum<H225_DisengageConfirm>(ras);
+		case H225_RasMessage::e_disengageReject: return GetSeqNum<H225_DisengageReject>(ras);
+		case H225_RasMessage::e_unregistrationConfirm: return GetSeqNum<H225_UnregistrationConfirm>(ras);
+		case H225_RasMessage::e_unregistrationReject: return GetSeqNum<H225_UnregistrationReject>(ras);
+		case H225_RasMessage::e_requestInProgress: return GetSeqNum<H225_RequestInProgress>(ras);
+		case H225_RasMessage::e_unknownMessageResponse: return GetSeqNum<H225_UnknownMessageResponse>(ras);
+		default: return 0;
+	}
+}
+
+PString GetRejectReason(const H225_RasMessage & ras)
+{
+	switch (ras.GetTag()) {
+		case H225_RasMessage::e_gatekeeperReject:
+			return ((const H225_GatekeeperReject &)ras).m_rejectReason.GetTagName();
+		case H225_RasMessage::e_registrationReject:
+			return ((const H225_RegistrationReject &)ras).m_rejectReason.GetTagName();
+		case H225_RasMessage::e_admissionReject:
+			return ((const H225_AdmissionReject &)ras).m_rejectReason.GetTagName();
+		case H225_RasMessage::e_disengageReject:
+			return ((const H225_DisengageReject &)ras).m_rejectReason.GetTagName();
+		case H225_RasMessage::e_unregistrationReject:
+			return ((const H225_UnregistrationReject &)ras).m_rejectReason.GetTagName();
+		default:
+			return ras.GetTagName();
+	}
+}
+
+H225_TransportAddress SocketToH225TransportAddr(const PIPSocket::Address & ip, WORD port)
+{
+	H225_TransportAddress addr;
+	H323TransportAddress(ip, port).SetPDU(addr);
+	return addr;
+}
+
+PInt64 Now()
+{
+	return PTime().GetTimestamp();
+}
+
+} // end of anonymous namespace
+
+
+class RasBench : public PProcess
+{
+	PCLASSINFO(RasBench, PProcess)
+public:
+	RasBench();
+
+	virtual void Main();
+
+private:
+	bool Setup();
+	void Usage() const;
+	void Run();
+	void SendNext(unsigned index);
+	bool CanSend(const BenchEndpoint & ep, BenchStep step) const;
+	void BuildRequest(BenchEndpoint & ep, BenchStep step, unsigned seqNum, H225_RasMessage & ras);
+	void OnReply(const BYTE * buf, PINDEX len);
+	void OnAnswer(BenchEndpoint & ep, BenchStep step, const H225_RasMessage & ras, bool confirmed);
+	void ExpireRequests(PInt64 now);
+	void Report(PInt64 elapsed);
+
+	PUDPSocket m_socket;
+	PIPSocket::Address m_gkIP;
+	WORD m_gkPort;
+	H225_TransportAddress m_rasAddress;
+	H225_VendorIdentifier m_vendor;
+
+	std::vector<BenchEndpoint> m_endpoints;
+	std::vector<BenchStep> m_sequence;
+	unsigned m_cycles;
+	unsigned m_window;
+	PInt64 m_timeout; /// microseconds
+	unsigned m_timeToLive;
+	PString m_destination; /// fixed ARQ destination, empty = next endpoint
+
+	std::deque<unsigned> m_ready; /// endpoints that can send their next request
+	std::map<unsigned, PendingRequest> m_pending; /// by sequence number
+	unsigned m_seqNum;
+	StepStats m_stats[NumSteps];
+	unsigned m_unexpected;
+};
+
+PCREATE_PROCESS(RasBench)
+
+RasBench::RasBench() : PProcess("GNU", "gkrasbench", 1, 0, ReleaseCode, 0),
+	m_gkPort(1719), m_cycles(1), m_window(100), m_timeout(2000000), m_timeToLive(600),
+	m_seqNum(0), m_unexpected(0)
+{
+}
+
+void RasBench::Usage() const
+{
+	cout << "Usage: gkrasbench [options]\n"
+		"  -g --gatekeeper host[:port]  gatekeeper to test (default 127.0.0.1:1719)\n"
+		"  -i --interface ip            local IP to send from (default 127.0.0.1)\n"
+		"  -n --endpoints n             number of simulated endpoints (default 1000)\n"
+		"  -c --cycles n                message cycles per endpoint (default 1)\n"
+		"  -m --messages list           messages of a cycle (default grq,rrq,lrrq,arq,drq,urq)\n"
+		"  -k --keepalives n            lightweight RRQs for each lrrq in the list (default 1)\n"
+		"  -w --window n                max. outstanding requests (default 100)\n"
+		"  -t --timeout ms              request timeout (default 2000)\n"
+		"  -p --prefix alias            alias prefix of the endpoints (default bench)\n"
+		"  -d --destination alias       ARQ destination (default the next endpoint)\n"
+		"  -l --ttl seconds             registration time to live (default 600)\n"
+		"  -h --help\n"
+		"The exit code is 1 if any request timed out.\n";
+}
+
+bool RasBench::Setup()
+{
+	PArgList & args = GetArguments();
+	args.Parse("g-gatekeeper:i-interface:n-endpoints:c-cycles:m-messages:k-keepalives:"
+		"w-window:t-timeout:p-prefix:d-destination:l-ttl:h-help.");
+	if (args.HasOption('h')) {
+		Usage();
+		return false;
+	}
+
+	const PString gk = args.GetOptionString('g', "127.0.0.1");
+	const PINDEX colon = gk.FindLast(':');
+	if (colon != P_MAX_INDEX && gk.Find(']') == P_MAX_INDEX && gk.Find(':') == colon) {
+		m_gkPort = (WORD)gk.Mid(colon + 1).AsUnsigned();
+		m_gkIP = PIPSocket::Address(gk.Left(colon));
+	} else
+		m_gkIP = PIPSocket::Address(gk);
+	if (!m_gkIP.IsValid() && !PIPSocket::GetHostAddress(gk.Left(colon), m_gkIP)) {
+		cerr << "Invalid gatekeeper address " << gk << endl;
+		return false;
+	}
+
+	const unsigned numEndpoints = args.GetOptionString('n', "1000").AsUnsigned();
+	m_cycles = std::max(1U, (unsigned)args.GetOptionString('c', "1").AsUnsigned());
+	m_window = std::min(60000U, std::max(1U, (unsigned)args.GetOptionString('w', "100").AsUnsigned()));
+	m_timeout = (PInt64)args.GetOptionString('t', "2000").AsUnsigned() * 1000;
+	m_timeToLive = args.GetOptionString('l', "600").AsUnsigned();
+	m_destination = args.GetOptionString('d');
+	const PString prefix = args.GetOptionString('p', "bench");
+	const unsigned keepAlives = args.GetOptionString('k', "1").AsUnsigned();
+
+	const PStringArray messages = args.GetOptionString('m', "grq,rrq,lrrq,arq,drq,urq").ToLower().Tokenise(",", FALSE);
+	for (PINDEX i = 0; i < messages.GetSize(); ++i) {
+		int step = 0;
+		while (step < NumSteps && messages[i] != StepInfo[step].m_name)
+			++step;
+		if (step == NumSteps) {
+			cerr << "Unknown message " << messages[i] << endl;
+			return false;
+		}
+		for (unsigned k = 0; k < ((step == StepLightweightRRQ) ? keepAlives : 1); ++k)
+			m_sequence.push_back((BenchStep)step);
+	}
+	if (numEndpoints == 0 || m_sequence.empty()) {
+		Usage();
+		return false;
+	}
+
+	const PIPSocket::Address localIP(args.GetOptionString('i', "127.0.0.1"));
+	if (!m_socket.Listen(localIP, 0, 0)) {
+		cerr << "Can't open RAS socket on " << localIP << ": " << m_socket.GetErrorText() << endl;
+		return false;
+	}
+	// the answers to a full window must fit into the receive buffer
+	m_socket.SetOption(SO_RCVBUF, 4 * 1024 * 1024);
+	m_socket.SetReadTimeout(PTimeInterval(10));
+	m_socket.SetSendAddress(m_gkIP, m_gkPort);
+	PIPSocket::Address rasIP;
+	WORD rasPort = 0;
+	m_socket.GetLocalAddress(rasIP, rasPort);
+	m_rasAddress = SocketToH225TransportAddr(rasIP, rasPort);
+
+	if (numEndpoints > PortsPerIP && !rasIP.IsLoopback()) {
+		cerr << "More than " << PortsPerIP << " endpoints need a loopback interface" << endl;
+		return false;
+	}
+
+	m_vendor.m_vendor.m_t35CountryCode = 9; // Australia
+	m_vendor.m_vendor.m_manufacturerCode = 61;
+	m_vendor.IncludeOptionalField(H225_VendorIdentifier::e_productId);
+	m_vendor.m_productId = PString("gkrasbench");
+
+	// the gatekeeper only compares the call signal addresses,
+	// on loopback each block of endpoints uses the next IP
+	m_endpoints.resize(numEndpoints);
+	for (unsigned i = 0; i < numEndpoints; ++i) {
+		BenchEndpoint & ep = m_endpoints[i];
+		ep.m_alias = prefix + PString(PString::Unsigned, i);
+		PIPSocket::Address ip = rasIP;
+		if (i >= PortsPerIP)
+			ip = PIPSocket::Address(127, 0, (BYTE)((i / PortsPerIP) >> 8), (BYTE)(i / PortsPerIP + 1));
+		ep.m_callSignalAddress = SocketToH225TransportAddr(ip, (WORD)(1024 + i % PortsPerIP));
+		m_ready.push_back(i);
+	}
+	return true;
+}
+
+bool RasBench::CanSend(const BenchEndpoint & ep, BenchStep step) const
+{
+	switch (step) {
+		case StepLightweightRRQ:
+		case StepARQ:
+		case StepURQ:
+			return ep.m_registered;
+		case StepDRQ:
+			return ep.m_registered && ep.m_inCall;
+		default:
+			return true;
+	}
+}
+
+void RasBench::BuildRequest(BenchEndpoint & ep, BenchStep step, unsigned seqNum, H225_RasMessage & ras)
+{
+	ras.SetTag(StepInfo[step].m_tag);
+	switch (step) {
+		case StepGRQ: {
+			H225_GatekeeperRequest & grq = ras;
+			grq.m_requestSeqNum = seqNum;
+			grq.m_protocolIdentifier.SetValue(H225_ProtocolID);
+			grq.m_rasAddress = m_rasAddress;
+			grq.m_endpointType.IncludeOptionalField(H225_EndpointType::e_terminal);
+			grq.IncludeOptionalField(H225_GatekeeperRequest::e_endpointAlias);
+			grq.m_endpointAlias.SetSize(1);
+			H323SetAliasAddress(ep.m_alias, grq.m_endpointAlias[0]);
+			break;
+		}
+		case StepRRQ:
+		case StepLightweightRRQ: {
+			H225_RegistrationRequest & rrq = ras;
+			rrq.m_requestSeqNum = seqNum;
+			rrq.m_protocolIdentifier.SetValue(H225_ProtocolID);
+			rrq.m_discoveryComplete = (std::find(m_sequence.begin(), m_sequence.end(), StepGRQ) != m_sequence.end());
+			rrq.m_callSignalAddress.SetSize(1);
+			rrq.m_callSignalAddress[0] = ep.m_callSignalAddress;
+			rrq.m_rasAddress.SetSize(1);
+			rrq.m_rasAddress[0] = m_rasAddress;
+			rrq.m_terminalType.IncludeOptionalField(H225_EndpointType::e_terminal);
+			rrq.m_endpointVendor = m_vendor;
+			if (m_timeToLive > 0) {
+				rrq.IncludeOptionalField(H225_RegistrationRequest::e_timeToLive);
+				rrq.m_timeToLive = m_timeToLive;
+			}
+			rrq.IncludeOptionalField(H225_RegistrationRequest::e_keepAlive);
+			if (step == StepLightweightRRQ) {
+				rrq.m_keepAlive = TRUE;
+				rrq.IncludeOptionalField(H225_RegistrationRequest::e_endpointIdentifier);
+				rrq.m_endpointIdentifier = ep.m_endpointId;
+			} else {
+				rrq.m_keepAlive = FALSE;
+				rrq.IncludeOptionalField(H225_RegistrationRequest::e_terminalAlias);
+				rrq.m_terminalAlias.SetSize(1);
+				H323SetAliasAddress(ep.m_alias, rrq.m_terminalAlias[0]);
+			}
+			break;
+		}
+		case StepARQ: {
+			ep.m_callRef = (ep.m_callRef + 1) & 0x7fff;
+			ep.m_conferenceId = OpalGloballyUniqueID();
+			ep.m_callId.m_guid = OpalGloballyUniqueID();
+			H225_AdmissionRequest & arq = ras;
+			arq.m_requestSeqNum = seqNum;
+			arq.m_callType.SetTag(H225_CallType::e_pointToPoint);
+			arq.IncludeOptionalField(H225_AdmissionRequest::e_callModel);
+			arq.m_callModel.SetTag(H225_CallModel::e_direct);
+			arq.m_endpointIdentifier = ep.m_endpointId;
+			arq.IncludeOptionalField(H225_AdmissionRequest::e_destinationInfo);
+			arq.m_destinationInfo.SetSize(1);
+			const unsigned index = &ep - &m_endpoints[0];
+			H323SetAliasAddress(m_destination.IsEmpty() ? m_endpoints[(index + 1) % m_endpoints.size()].m_alias : m_destination,
+				arq.m_destinationInfo[0]);
+			arq.m_srcInfo.SetSize(1);
+			H323SetAliasAddress(ep.m_alias, arq.m_srcInfo[0]);
+			arq.IncludeOptionalField(H225_AdmissionRequest::e_srcCallSignalAddress);
+			arq.m_srcCallSignalAddress = ep.m_callSignalAddress;
+			arq.m_bandWidth = 1280;
+			arq.m_callReferenceValue = ep.m_callRef;
+			arq.m_conferenceID = ep.m_conferenceId;
+			arq.m_answerCall = FALSE;
+			arq.IncludeOptionalField(H225_AdmissionRequest::e_callIdentifier);
+			arq.m_callIdentifier = ep.m_callId;
+			break;
+		}
+		case StepDRQ: {
+			H225_DisengageRequest & drq = ras;
+			drq.m_requestSeqNum = seqNum;
+			drq.m_endpointIdentifier = ep.m_endpointId;
+			drq.m_conferenceID = ep.m_conferenceId;
+			drq.m_callReferenceValue = ep.m_callRef;
+			drq.m_disengageReason.SetTag(H225_DisengageReason::e_normalDrop);
+			drq.IncludeOptionalField(H225_DisengageRequest::e_callIdentifier);
+			drq.m_callIdentifier = ep.m_callId;
+			drq.IncludeOptionalField(H225_DisengageRequest::e_answeredCall);
+			drq.m_answeredCall = FALSE;
+			break;
+		}
+		case StepURQ: {
+			H225_UnregistrationRequest & urq = ras;
+			urq.m_requestSeqNum = seqNum;
+			urq.m_callSignalAddress.SetSize(1);
+			urq.m_callSignalAddress[0] = ep.m_callSignalAddress;
+			urq.IncludeOptionalField(H225_UnregistrationRequest::e_endpointIdentifier);
+			urq.m_endpointIdentifier = ep.m_endpointId;
+			urq.IncludeOptionalField(H225_UnregistrationRequest::e_endpointAlias);
+			urq.m_endpointAlias.SetSize(1);
+			H323SetAliasAddress(ep.m_alias, urq.m_endpointAlias[0]);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+void RasBench::SendNext(unsigned index)
+{
+	BenchEndpoint & ep = m_endpoints[index];
+	BenchStep step;
+	for (;;) {
+		if (ep.m_next >= m_sequence.size()) {
+			if (++ep.m_cycle >= m_cycles)
+				return; // done
+			ep.m_next = 0;
+		}
+		step = m_sequence[ep.m_next];
+		if (CanSend(ep, step))
+			break;
+		++m_stats[step].m_skipped;
+		++ep.m_next;
+	}
+
+	// sequence numbers of outstanding requests must be unique
+	do {
+		m_seqNum = (m_seqNum % 65535) + 1;
+	} while (m_pending.find(m_seqNum) != m_pending.end());
+
+	H225_RasMessage ras;
+	BuildRequest(ep, step, m_seqNum, ras);
+	PPER_Stream strm;
+	ras.Encode(strm);
+	strm.CompleteEncoding();
+
+	PendingRequest & request = m_pending[m_seqNum];
+	request.m_endpoint = index;
+	request.m_step = step;
+	request.m_sent = Now();
+	request.m_deadline = request.m_sent + m_timeout;
+	++m_stats[step].m_sent;
+	// a lost datagram shows up as timeout
+	m_socket.Write(strm.GetPointer(), strm.GetSize());
+}
+
+void RasBench::OnReply(const BYTE * buf, PINDEX len)
+{
+	const PInt64 now = Now();
+	H225_RasMessage ras;
+	PPER_Stream strm(buf, len);
+	if (!ras.Decode(strm)) {
+		++m_unexpected;
+		return;
+	}
+	std::map<unsigned, PendingRequest>::iterator i = m_pending.find(GetReplySeqNum(ras));
+	if (i == m_pending.end()) {
+		// late answer after a timeout or a request from the gatekeeper, eg. IRQ
+		++m_unexpected;
+		return;
+	}
+	PendingRequest & request = i->second;
+	if (ras.GetTag() == H225_RasMessage::e_requestInProgress) {
+		const H225_RequestInProgress & rip = ras;
+		request.m_deadline = now + (PInt64)rip.m_delay * 1000 + m_timeout;
+		return;
+	}
+
+	const BenchStep step = request.m_step;
+	const unsigned index = request.m_endpoint;
+	StepStats & stats = m_stats[step];
+	stats.m_latencies.push_back((unsigned)(now - request.m_sent));
+	if (ras.GetTag() == StepInfo[step].m_tag + 1) {
+		++stats.m_confirmed;
+		OnAnswer(m_endpoints[index], step, ras, true);
+	} else {
+		++stats.m_rejected;
+		++stats.m_rejectReasons[GetRejectReason(ras)];
+		OnAnswer(m_endpoints[index], step, ras, false);
+	}
+	m_pending.erase(i);
+	m_ready.push_back(index);
+}
+
+void RasBench::OnAnswer(BenchEndpoint & ep, BenchStep step, const H225_RasMessage & ras, bool confirmed)
+{
+	++ep.m_next;
+	switch (step) {
+		case StepRRQ:
+			if (confirmed) {
+				const H225_RegistrationConfirm & rcf = ras;
+				ep.m_endpointId = rcf.m_endpointIdentifier;
+				ep.m_registered = true;
+			}
+			break;
+		case StepARQ:
+			ep.m_inCall = confirmed;
+			break;
+		case StepDRQ:
+			ep.m_inCall = false;
+			break;
+		case StepURQ:
+			if (confirmed)
+				ep.m_registered = ep.m_inCall = false;
+			break;
+		default:
+			break;
+	}
+}
+
+void RasBench::ExpireRequests(PInt64 now)
+{
+	std::map<unsigned, PendingRequest>::iterator i = m_pending.begin();
+	while (i != m_pending.end()) {
+		if (i->second.m_deadline <= now) {
+			++m_stats[i->second.m_step].m_timeouts;
+			// the endpoint continues with its next request, a timed out ARQ leaves no call
+			BenchEndpoint & ep = m_endpoints[i->second.m_endpoint];
+			++ep.m_next;
+			if (i->second.m_step == StepARQ)
+				ep.m_inCall = false;
+			m_ready.push_back(i->second.m_endpoint);
+			m_pending.erase(i++);
+		} else
+			++i;
+	}
+}
+
+void RasBench::Run()
+{
+	const PInt64 start = Now();
+	PInt64 lastExpiry = start;
+	BYTE buf[8192];
+	while (!m_ready.empty() || !m_pending.empty()) {
+		while (m_pending.size() < m_window && !m_ready.empty()) {
+			const unsigned index = m_ready.front();
+			m_ready.pop_front();
+			SendNext(index);
+		}
+		PIPSocket::Address fromIP;
+		WORD fromPort = 0;
+		if (m_socket.ReadFrom(buf, sizeof(buf), fromIP, fromPort))
+			OnReply(buf, m_socket.GetLastReadCount());
+		const PInt64 now = Now();
+		if (now - lastExpiry >= 100000) {
+			ExpireRequests(now);
+			lastExpiry = now;
+		}
+	}
+	Report(Now() - start);
+}
+
+void RasBench::Report(PInt64 elapsed)
+{
+	unsigned answered = 0, timeouts = 0;
+	cout << "Endpoints: " << m_endpoints.size() << "  Cycles: " << m_cycles
+		<< "  Window: " << m_window << "\n\n"
+		<< setw(6) << "Type" << setw(9) << "Sent" << setw(9) << "Confirm" << setw(9) << "Reject"
+		<< setw(9) << "Timeout" << setw(9) << "Skipped"
+		<< setw(10) << "p50(us)" << setw(10) << "p90(us)" << setw(10) << "p99(us)" << setw(10) << "max(us)" << '\n';
+	for (int step = 0; step < NumSteps; ++step) {
+		StepStats & stats = m_stats[step];
+		if (stats.m_sent == 0 && stats.m_skipped == 0)
+			continue;
+		std::sort(stats.m_latencies.begin(), stats.m_latencies.end());
+		answered += stats.m_confirmed + stats.m_rejected;
+		timeouts += stats.m_timeouts;
+		cout << setw(6) << PString(StepInfo[step].m_name).ToUpper()
+			<< setw(9) << stats.m_sent << setw(9) << stats.m_confirmed << setw(9) << stats.m_rejected
+			<< setw(9) << stats.m_timeouts << setw(9) << stats.m_skipped
+			<< setw(10) << stats.Percentile(0.5) << setw(10) << stats.Percentile(0.9)
+			<< setw(10) << stats.Percentile(0.99) << setw(10) << stats.Percentile(1.0) << '\n';
+		for (std::map<PString, unsigned>::const_iterator r = stats.m_rejectReasons.begin(); r != stats.m_rejectReasons.end(); ++r)
+			cout << "         reject " << r->first << ": " << r->second << '\n';
+	}
+	const double seconds = elapsed / 1000000.0;
+	cout << "\nAnswered: " << answered << " in " << setprecision(3) << seconds << " s, "
+		<< (unsigned)(seconds > 0 ? answered / seconds : 0) << " requests/s";
+	if (m_unexpected > 0)
+		cout << ", " << m_unexpected << " unexpected messages";
+	cout << endl;
+	SetTerminationValue(timeouts > 0 ? 1 : 0);
+}
+
+void RasBench::Main()
+{
+	if (!Setup()) {
+		SetTerminationValue(2);
+		return;
+	}
+	Run();
+}
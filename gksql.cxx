@@ -17,6 +17,8 @@
 #include <ptlib/sockets.h>
 #include "stl_supp.h"
 #include "Toolkit.h"
+#include "job.h"
+#include "metrics.h"
 #include "gksql.h"
 
 using std::max;
@@ -26,10 +28,211 @@ namespace {
     const int GKSQL_DEFAULT_CONNECT_TIMEOUT = 10; // in seconds
     const int GKSQL_DEFAULT_READ_TIMEOUT = 60; // in seconds
     const long GKSQL_CLEANUP_TIMEOUT = 5000; // in milliseconds !
+    const long GKSQL_DRAIN_TIMEOUT = 10000; // in milliseconds, for queued async queries on shutdown
+    const int GKSQL_DEFAULT_ASYNC_QUEUE_SIZE = 10000;
     const int GKSQL_DEFAULT_MIN_POOL_SIZE = 1;
     const int GKSQL_DEFAULT_MAX_POOL_SIZE = 1;
+    const int GKSQL_DEFAULT_HOST_RETRY_INTERVAL = 30; // in seconds
+    // upper limits (ms) of the histogram buckets, the last bucket is open
+    const unsigned GKSQL_HISTOGRAM_LIMITS[GkSQLConnection::HistogramBuckets - 1] = { 1, 5, 10, 50, 100, 500, 1000 };
+
+unsigned HistogramBucket(PInt64 ms)
+{
+	unsigned i = 0;
+	while (i < GkSQLConnection::HistogramBuckets - 1 && ms >= GKSQL_HISTOGRAM_LIMITS[i])
+		++i;
+	return i;
 }
 
+} // end of anonymous namespace
+
+/// database host with its health state
+struct GkSQLConnection::Host {
+	Host(const PString & name, bool replica)
+		: m_name(name), m_port(0), m_replica(replica), m_up(true), m_retryTime(0),
+		m_connections(0), m_busy(0) { }
+
+	/// host[:port] as configured
+	PString m_name;
+	/// host name or IP and port to connect to
+	PString m_host;
+	WORD m_port;
+	/// read-only replica, used for SELECT queries only
+	bool m_replica;
+	/// false after a failed connect or query
+	bool m_up;
+	/// when to try a failed host again
+	PTime m_retryTime;
+	/// connections to this host in the pool
+	unsigned m_connections;
+	/// connections to this host busy with query execution
+	unsigned m_busy;
+};
+
+/// SQL connections to one database, used by one or more GkSQLConnection objects
+struct GkSQLConnection::Pool {
+	/// a query waiting for an idle connection
+	struct Waiter {
+		Waiter(SQLConnPtr * connptr, bool readOnly, const GkSQLConnection * owner)
+			: m_connptr(connptr), m_readOnly(readOnly), m_owner(owner) { }
+
+		SQLConnPtr * m_connptr;
+		bool m_readOnly;
+		const GkSQLConnection * m_owner;
+	};
+	typedef std::list<SQLConnPtr>::iterator iterator;
+	typedef std::list<Waiter>::iterator witerator;
+
+	Pool(const PString & key, const std::vector<Host> & hosts)
+		: m_key(key), m_hosts(hosts), m_minPoolSize(0), m_maxPoolSize(0),
+		m_users(0), m_nextId(0), m_connected(false), m_growing(false)
+	{
+		memset(m_waitTime, 0, sizeof(m_waitTime));
+		memset(m_execTime, 0, sizeof(m_execTime));
+	}
+
+	/// remove the request from the list of waiting requests
+	void RemoveWaiter(SQLConnPtr * connptr)
+	{
+		for (witerator i = m_waitingRequests.begin(); i != m_waitingRequests.end(); ++i)
+			if (i->m_connptr == connptr) {
+				m_waitingRequests.erase(i);
+				break;
+			}
+	}
+
+	/// remove all requests of an object from the list of waiting requests
+	void RemoveWaiters(const GkSQLConnection * owner)
+	{
+		witerator i = m_waitingRequests.begin();
+		while (i != m_waitingRequests.end())
+			if (i->m_owner == owner)
+				m_waitingRequests.erase(i++);
+			else
+				++i;
+	}
+
+	/// move a busy connection back to the idle list
+	void MakeIdle(SQLConnPtr connptr)
+	{
+		m_busyConnections.remove(connptr);
+		--m_hosts[connptr->m_hostIndex].m_busy;
+		m_idleConnections.push_back(connptr);
+	}
+
+	/// close a busy connection
+	void DeleteBusy(SQLConnPtr connptr)
+	{
+		m_busyConnections.remove(connptr);
+		--m_hosts[connptr->m_hostIndex].m_busy;
+		--m_hosts[connptr->m_hostIndex].m_connections;
+		delete connptr;
+	}
+
+	/// add a new connection to the idle list or mark the host as failed
+	void ConnectResult(unsigned hostIndex, SQLConnPtr connptr, unsigned retryInterval)
+	{
+		Host & host = m_hosts[hostIndex];
+		if (connptr) {
+			connptr->m_hostIndex = hostIndex;
+			++host.m_connections;
+			host.m_up = true;
+			m_idleConnections.push_back(connptr);
+		} else {
+			host.m_up = false;
+			host.m_retryTime = PTime() + PTimeInterval(0, retryInterval);
+		}
+	}
+
+	/// key in the shared pool list, empty for private pools
+	PString m_key;
+	/// primary hosts followed by read-only replicas
+	std::vector<Host> m_hosts;
+	/// number of connections to the primary hosts and to the replicas
+	int m_minPoolSize;
+	int m_maxPoolSize;
+	/// objects using this pool
+	unsigned m_users;
+	/// next connection identifier
+	int m_nextId;
+	/// list of idle SQL connections
+	std::list<SQLConnPtr> m_idleConnections;
+	/// list of connections busy with query execution
+	std::list<SQLConnPtr> m_busyConnections;
+	/// FIFO queue of queries waiting to be executed when there is no idle connections
+	std::list<Waiter> m_waitingRequests;
+	/// mutual access to the lists and host states
+	PTimedMutex m_connectionsMutex;
+	/// signalled when a connections moves from the busy to the idle list
+	PSyncPoint m_connectionAvailable;
+	/// remain false while connection to the database not yet established
+	/// reset to false on disconnect or error during operation -> reconnect
+	bool m_connected;
+	/// a connection is being added by CheckHosts
+	bool m_growing;
+	/// queries by time waited for a connection
+	unsigned m_waitTime[HistogramBuckets];
+	/// queries by execution time
+	unsigned m_execTime[HistogramBuckets];
+};
+
+/// query queued by ExecuteQueryAsync
+struct GkSQLConnection::AsyncQuery {
+	AsyncQuery(const char* queryStr, QueryCallback* callback, long timeout, const PString & key)
+		: m_query(queryStr), m_hasParams(false), m_namedParams(false),
+		m_callback(callback), m_timeout(timeout), m_key(key) { }
+
+	PString m_query;
+	/// true if the query has parameters, either in m_params or m_paramMap
+	bool m_hasParams;
+	/// true for %{Name} parameters from m_paramMap
+	bool m_namedParams;
+	PStringArray m_params;
+	std::map<PString, PString> m_paramMap;
+	QueryCallback* m_callback;
+	long m_timeout;
+	/// queries with the same key are executed in order
+	PString m_key;
+};
+
+/// checks the hosts and tops up the pool, so queries don't wait for connects
+class GkSQLConnection::HostMonitor : public RegularJob {
+public:
+	HostMonitor(GkSQLConnection * conn) : m_conn(conn)
+	{
+		SetName("SQLHostMonitor");
+		Execute();
+	}
+
+	// override from RegularJob
+	virtual void Exec()
+	{
+		Wait(PTimeInterval(0, max(m_conn->m_hostRetryInterval, 1u)));
+		while (IsRunning() && m_conn->CheckHosts())
+			;
+	}
+
+	// override from RegularJob
+	virtual void Stop()
+	{
+		PWaitAndSignal lock(m_deletionPreventer);
+		RegularJob::Stop();
+	}
+
+protected:
+	// override from RegularJob
+	virtual void OnStop()
+	{
+		m_conn->m_hostMonitorStopped.Signal();
+	}
+
+private:
+	GkSQLConnection * m_conn;
+};
+
+std::map<PString, GkSQLConnection::Pool *> GkSQLConnection::m_sharedPools;
+PMutex GkSQLConnection::m_sharedPoolsMutex;
+
 
 GkSQLResult::~GkSQLResult()
 {
@@ -41,15 +244,24 @@ GkSQLConnection::GkSQLConnection(
 	: NamedObject(name), m_port(0),
 	m_connectTimeout(GKSQL_DEFAULT_CONNECT_TIMEOUT),
 	m_readTimeout(GKSQL_DEFAULT_READ_TIMEOUT),
+	m_pool(NULL),
 	m_minPoolSize(GKSQL_DEFAULT_MIN_POOL_SIZE),
 	m_maxPoolSize(GKSQL_DEFAULT_MAX_POOL_SIZE),
-	m_destroying(false), m_connected(false)
+	m_hostRetryInterval(GKSQL_DEFAULT_HOST_RETRY_INTERVAL),
+	m_activeQueries(0), m_destroying(false), m_hostMonitor(NULL),
+	m_maxAsyncThreads(GKSQL_DEFAULT_MIN_POOL_SIZE),
+	m_maxAsyncQueries(GKSQL_DEFAULT_ASYNC_QUEUE_SIZE), m_asyncThreads(0)
 {
+	m_asyncQueueMetric = Metrics::Instance()->GetGauge("gnugk_sql_async_queries",
+		"SQL queries waiting for a database thread", PString("connection=\"") + GetName() + "\"");
 }
 
 GkSQLConnection* GkSQLConnection::Create( const char * driverName, const char * connectionName)
 {
-	return Factory<GkSQLConnection>::Create(driverName, connectionName);
+	GkSQLConnection * conn = Factory<GkSQLConnection>::Create(driverName, connectionName);
+	if (conn)
+		conn->m_driverName = driverName;
+	return conn;
 }
 
 bool GkSQLConnection::Initialize(
@@ -58,16 +270,31 @@ bool GkSQLConnection::Initialize(
 	/// name of the config section with SQL settings
 	const char * cfgSectionName)
 {
-	PWaitAndSignal lock(m_connectionsMutex);
-
 	if (!(cfg && cfgSectionName)) {
 		PTRACE(1, GetName() << "\tInitialize failed: NULL config or config section not specified!");
 		SNMP_TRAP(4, SNMPError, Database, GetName() + " creation failed");
 		return false;
 	}
 
+	const PString hostList = cfg->GetString(cfgSectionName, "Host", "localhost");
+	const PString replicaList = cfg->GetString(cfgSectionName, "ReplicaHosts", "");
+	std::vector<Host> hosts;
+	PStringArray names = hostList.Tokenise(", \t", FALSE);
+	for (PINDEX i = 0; i < names.GetSize(); ++i)
+		hosts.push_back(Host(names[i], false));
+	names = replicaList.Tokenise(", \t", FALSE);
+	for (PINDEX i = 0; i < names.GetSize(); ++i)
+		hosts.push_back(Host(names[i], true));
+	for (unsigned i = 0; i < hosts.size(); ++i)
+		GetHostAndPort(hosts[i].m_name, hosts[i].m_host, hosts[i].m_port);
+
 	m_library = cfg->GetString(cfgSectionName, "Library", "");
-	GetHostAndPort(cfg->GetString(cfgSectionName, "Host", "localhost"), m_host, m_port);
+	m_host = PString::Empty();
+	m_port = 0;
+	if (!hosts.empty() && !hosts.front().m_replica) {
+		m_host = hosts.front().m_host;
+		m_port = hosts.front().m_port;
+	}
 	m_database = cfg->GetString(cfgSectionName, "Database", "");
 	m_username = cfg->GetString(cfgSectionName, "Username", "");
 	m_password = Toolkit::Instance()->ReadPassword(cfgSectionName, "Password");
@@ -78,6 +305,9 @@ bool GkSQLConnection::Initialize(
 	m_maxPoolSize = cfg->GetInteger(cfgSectionName, "MaxPoolSize", m_minPoolSize);
 	if (m_maxPoolSize >= 0)
 		m_maxPoolSize = max(m_minPoolSize, m_maxPoolSize);
+	m_hostRetryInterval = cfg->GetInteger(cfgSectionName, "HostRetryInterval", GKSQL_DEFAULT_HOST_RETRY_INTERVAL);
+	m_maxAsyncThreads = max(cfg->GetInteger(cfgSectionName, "AsyncThreads", max(m_minPoolSize, 1)), 1);
+	m_maxAsyncQueries = max(cfg->GetInteger(cfgSectionName, "AsyncQueueSize", GKSQL_DEFAULT_ASYNC_QUEUE_SIZE), 0);
 
 	if (m_host.IsEmpty() || m_database.IsEmpty()) {
 		PTRACE(1, GetName() << "\tInitialize failed: database name or host not specified!");
@@ -85,99 +315,357 @@ bool GkSQLConnection::Initialize(
 		return false;
 	}
 
-	return Connect();
+	PString key;
+	if (Toolkit::AsBool(cfg->GetString(cfgSectionName, "SharedPool", "0"))) {
+		// only modules with the same connection settings share their connections
+		if (IsPoolShareable())
+			key = m_driverName + '\n' + m_username + '\n' + m_password + '\n' + hostList + '\n' + replicaList
+				+ '\n' + m_database + '\n' + m_library + '\n' + PString(PString::Unsigned, m_connectTimeout)
+				+ '\n' + PString(PString::Unsigned, m_readTimeout);
+		else
+			PTRACE(2, GetName() << "\tThe " << m_driverName << " driver can not share its connection pool");
+	}
+	AttachPool(key, hosts);
+
+	const bool connected = Connect();
+	if (m_hostMonitor == NULL)
+		m_hostMonitor = new HostMonitor(this);
+	return connected;
 }
 
-bool GkSQLConnection::Connect()
+void GkSQLConnection::AttachPool(const PString & key, const std::vector<Host> & hosts)
 {
-	PWaitAndSignal lock(m_connectionsMutex);
+	DetachPool();
 
-	for (PINDEX i = m_idleConnections.size(); i < m_minPoolSize; ++i) {
-		SQLConnPtr connptr = CreateNewConnection(i);
-		if (connptr != NULL)
-			m_idleConnections.push_back(connptr);
+	PWaitAndSignal lock(m_sharedPoolsMutex);
+
+	if (!key.IsEmpty()) {
+		std::map<PString, Pool *>::iterator i = m_sharedPools.find(key);
+		if (i != m_sharedPools.end()) {
+			m_pool = i->second;
+			PTRACE(3, GetName() << "\tSharing the connection pool with " << m_pool->m_users << " other module(s)");
+		}
+	}
+	if (m_pool == NULL) {
+		m_pool = new Pool(key, hosts);
+		if (!key.IsEmpty())
+			m_sharedPools[key] = m_pool;
 	}
 
-	if (m_idleConnections.empty() && m_minPoolSize) {
+	PWaitAndSignal poolLock(m_pool->m_connectionsMutex);
+	++m_pool->m_users;
+	// a shared pool is as large as its largest user needs
+	m_pool->m_minPoolSize = max(m_pool->m_minPoolSize, m_minPoolSize);
+	if (m_maxPoolSize < 0 || m_pool->m_maxPoolSize < 0)
+		m_pool->m_maxPoolSize = -1;
+	else
+		m_pool->m_maxPoolSize = max(m_pool->m_maxPoolSize, m_maxPoolSize);
+}
+
+void GkSQLConnection::DetachPool()
+{
+	if (m_pool == NULL)
+		return;
+
+	PWaitAndSignal lock(m_sharedPoolsMutex);
+
+	Pool * pool = m_pool;
+	m_pool = NULL;
+	{
+		PWaitAndSignal poolLock(pool->m_connectionsMutex);
+		if (--pool->m_users > 0)
+			return;
+	}
+
+	if (!pool->m_key.IsEmpty())
+		m_sharedPools.erase(pool->m_key);
+
+	// close connections from the idle list and leave any on the busy list
+	// busy list should be empty at this moment
+	{
+		PWaitAndSignal poolLock(pool->m_connectionsMutex);
+
+		pool->m_waitingRequests.clear();
+		Pool::iterator iter = pool->m_idleConnections.begin();
+		Pool::iterator end = pool->m_idleConnections.end();
+
+		while (iter != end) {
+			PTRACE(5, GetName() << "\tDatabase connection (id " << (*iter)->m_id << ") closed");
+			delete *iter++;
+		}
+
+		pool->m_idleConnections.clear();
+	}
+
+	PTRACE(5, GetName() << "\tConnection pool cleanup finished");
+	if (!pool->m_busyConnections.empty()) {
+		PTRACE(1, GetName() << "\tConnection cleanup finished with " << pool->m_busyConnections.size() << " active connections");
+		return;
+	}
+	delete pool;
+}
+
+GkSQLConnection::SQLConnPtr GkSQLConnection::ConnectToHost(int id, unsigned hostIndex)
+{
+	PWaitAndSignal lock(m_hostMutex);
+
+	// the drivers connect to m_host and m_port, the host list is never changed
+	m_host = m_pool->m_hosts[hostIndex].m_host;
+	m_port = m_pool->m_hosts[hostIndex].m_port;
+	return CreateNewConnection(id);
+}
+
+int GkSQLConnection::AddConnections(bool replicas)
+{
+	std::vector<Host> & hosts = m_pool->m_hosts;
+	std::vector<bool> failed(hosts.size(), false);
+	const PTime now;
+	int connections = 0;
+	bool anyUsable = false;
+
+	for (unsigned i = 0; i < hosts.size(); ++i)
+		if (hosts[i].m_replica == replicas) {
+			connections += hosts[i].m_connections;
+			if (hosts[i].m_up || hosts[i].m_retryTime <= now)
+				anyUsable = true;
+		}
+
+	while (connections < m_pool->m_minPoolSize) {
+		// spread the connections over the working hosts,
+		// if no host is known to work, try all of them
+		int best = -1;
+		for (unsigned i = 0; i < hosts.size(); ++i) {
+			const Host & host = hosts[i];
+			if (host.m_replica != replicas || failed[i])
+				continue;
+			if (anyUsable && !host.m_up && host.m_retryTime > now)
+				continue;
+			if (best < 0 || host.m_connections < hosts[best].m_connections)
+				best = i;
+		}
+		if (best < 0)
+			break;
+
+		SQLConnPtr connptr = ConnectToHost(m_pool->m_nextId++, best);
+		if (connptr == NULL) {
+			failed[best] = true;
+			PTRACE(2, GetName() << "\tDatabase host " << hosts[best].m_name << " failed, retry in " << m_hostRetryInterval << 's');
+		} else
+			++connections;
+		m_pool->ConnectResult(best, connptr, m_hostRetryInterval);
+	}
+
+	return connections;
+}
+
+bool GkSQLConnection::Connect()
+{
+	PWaitAndSignal lock(m_pool->m_connectionsMutex);
+
+	const int connections = AddConnections(false);
+	AddConnections(true);
+
+	if (connections == 0 && m_pool->m_minPoolSize) {
 		PTRACE(1, GetName() << "\tDatabase connection failed: "
-			<< m_username << '@' << m_host << '[' << m_database << ']');
+			<< m_username << '@' << m_pool->m_hosts.front().m_name << '[' << m_database << ']');
 		SNMP_TRAP(4, SNMPError, Database, GetName() + " connection failed");
 		return false;
 	} else {
 		PTRACE(3, GetName() << "\tDatabase connection pool created: "
-			<< m_username << '@' << m_host << '[' << m_database << ']');
+			<< m_username << '@' << m_pool->m_hosts.front().m_name << '[' << m_database << ']');
 		PTRACE(5, GetName() << "\tConnection pool: "
-			<< m_idleConnections.size() << " SQL connections created, "
-			<< (m_minPoolSize - m_idleConnections.size()) << " failed");
-		m_connected = true;
+			<< m_pool->m_idleConnections.size() + m_pool->m_busyConnections.size()
+			<< " SQL connections to " << m_pool->m_hosts.size() << " host(s)");
+		m_pool->m_connected = true;
 		return true;
 	}
 }
 
 void GkSQLConnection::Disconnect()
 {
-	PWaitAndSignal lock(m_connectionsMutex);
+	if (m_pool == NULL)
+		return;
+
+	PWaitAndSignal lock(m_pool->m_connectionsMutex);
 
 	// disconnect/delete all connections
 	PTRACE(3, GetName() << "\tDisconnecting all SQL connections in pool");
-	for(iterator Iter = m_idleConnections.begin(); Iter != m_idleConnections.end(); ++Iter) {
+	for (Pool::iterator Iter = m_pool->m_idleConnections.begin(); Iter != m_pool->m_idleConnections.end(); ++Iter) {
+		--m_pool->m_hosts[(*Iter)->m_hostIndex].m_connections;
 		delete *Iter;
 	}
-	m_idleConnections.clear();
-	m_connected = false;
+	m_pool->m_idleConnections.clear();
+	m_pool->m_connected = false;
+}
+
+bool GkSQLConnection::CheckHosts()
+{
+	int hostIndex = -1;
+	int id = 0;
+	{
+		PWaitAndSignal lock(m_pool->m_connectionsMutex);
+
+		// after a connection error the next query reconnects the whole pool
+		if (m_pool->m_growing || !m_pool->m_connected)
+			return false;
+
+		std::vector<Host> & hosts = m_pool->m_hosts;
+		int connections[2] = { 0, 0 };
+		for (unsigned i = 0; i < hosts.size(); ++i)
+			connections[hosts[i].m_replica ? 1 : 0] += hosts[i].m_connections;
+
+		// top up the pool after failures, failed hosts are used again after their retry interval
+		const PTime now;
+		for (unsigned i = 0; i < hosts.size(); ++i) {
+			const Host & host = hosts[i];
+			if (connections[host.m_replica ? 1 : 0] >= m_pool->m_minPoolSize)
+				continue;
+			if (!host.m_up && host.m_retryTime > now)
+				continue;
+			if (hostIndex < 0 || host.m_connections < hosts[hostIndex].m_connections)
+				hostIndex = i;
+		}
+		if (hostIndex < 0)
+			return false;
+
+		// make sure no other query waits for this host while we try it
+		if (!hosts[hostIndex].m_up)
+			hosts[hostIndex].m_retryTime = now + PTimeInterval(0, m_hostRetryInterval);
+		m_pool->m_growing = true;
+		id = m_pool->m_nextId++;
+	}
+
+	SQLConnPtr connptr = ConnectToHost(id, hostIndex);
+
+	{
+		PWaitAndSignal lock(m_pool->m_connectionsMutex);
+		if (connptr)
+			PTRACE(3, GetName() << "\tAdded a connection to database host " << m_pool->m_hosts[hostIndex].m_name);
+		else
+			PTRACE(2, GetName() << "\tDatabase host " << m_pool->m_hosts[hostIndex].m_name << " failed, retry in " << m_hostRetryInterval << 's');
+		m_pool->ConnectResult(hostIndex, connptr, m_hostRetryInterval);
+		m_pool->m_growing = false;
+	}
+
+	if (connptr)
+		m_pool->m_connectionAvailable.Signal();
+	return connptr != NULL;
+}
+
+void GkSQLConnection::StopBackgroundJobs()
+{
+	// give the database threads some time to execute the queued queries,
+	// eg. the call stop events sent when the calls are cleared on shutdown
+	const PTime drainStart;
+	while (true) {
+		{
+			PWaitAndSignal lock(m_asyncMutex);
+			if ((m_asyncQueries.empty() && m_asyncThreads == 0) || m_destroying)
+				break;
+		}
+		if ((PTime() - drainStart).GetMilliSeconds() >= GKSQL_DRAIN_TIMEOUT)
+			break;
+		PThread::Sleep(100);
+	}
+
+	if (m_hostMonitor) {
+		m_hostMonitor->Stop();
+		m_hostMonitorStopped.Wait();
+		m_hostMonitor = NULL;
+	}
+
+	// cancel async queries that have not been started yet
+	std::list<AsyncQuery *> cancelled;
+	bool running = false;
+	{
+		PWaitAndSignal lock(m_asyncMutex);
+		m_destroying = true;
+		cancelled.swap(m_asyncQueries);
+		m_asyncQueueMetric->Dec(cancelled.size());
+		running = m_asyncThreads > 0;
+	}
+	if (!cancelled.empty())
+		PTRACE(1, GetName() << "\tCancelling " << cancelled.size() << " queued queries");
+	for (std::list<AsyncQuery *>::iterator i = cancelled.begin(); i != cancelled.end(); ++i) {
+		(*i)->m_callback->OnQueryCancelled();
+		delete *i;
+	}
+
+	// wait for the database threads to finish their current query
+	if (running) {
+		if (m_pool)
+			m_pool->m_connectionAvailable.Signal();
+		m_asyncThreadsDone.Wait();
+	}
 }
 
 GkSQLConnection::~GkSQLConnection()
 {
+	StopBackgroundJobs();
+
+	if (m_pool == NULL)
+		return;
+
 	const PTime timeStart;
 
-	m_destroying = true;
 	// wakeup any waiting threads
-	m_connectionAvailable.Signal();
+	m_pool->m_connectionAvailable.Signal();
 
-	// wait for still active connections (should not happen, but...)
+	// wait for still active queries (should not happen, but...)
 	do {
 		{
-			PWaitAndSignal lock(m_connectionsMutex);
-			m_waitingRequests.clear();
-			if (m_busyConnections.empty())
+			PWaitAndSignal lock(m_pool->m_connectionsMutex);
+			m_pool->RemoveWaiters(this);
+			if (m_activeQueries == 0)
 				break;
 			else
-				PTRACE(2, GetName() << "\tActive connections (" << m_busyConnections.size() << ") during cleanup - sleeping 250ms");
+				PTRACE(2, GetName() << "\tActive connections (" << m_activeQueries << ") during cleanup - sleeping 250ms");
 		}
 		PThread::Sleep(250);
 	} while ((PTime()-timeStart).GetMilliSeconds() < GKSQL_CLEANUP_TIMEOUT);
 
-	// close connections from the idle list and leave any on the busy list
-	// busy list should be empty at this moment
-	PWaitAndSignal lock(m_connectionsMutex);
+	DetachPool();
+}
 
-	m_waitingRequests.clear();
-	iterator iter = m_idleConnections.begin();
-	iterator end = m_idleConnections.end();
+GkSQLConnection::SQLConnPtr GkSQLConnection::TakeIdleConnection(bool readOnly)
+{
+	std::list<SQLConnPtr> & idle = m_pool->m_idleConnections;
+	Pool::iterator best = idle.end();
+	unsigned bestRank = 0, bestBusy = 0;
 
-	while (iter != end) {
-		PTRACE(5, GetName() << "\tDatabase connection (id " << (*iter)->m_id << ") closed");
-		delete *iter++;
+	// read-only queries prefer replicas, then take the host with the fewest
+	// outstanding queries
+	for (Pool::iterator i = idle.begin(); i != idle.end(); ++i) {
+		const Host & host = m_pool->m_hosts[(*i)->m_hostIndex];
+		if (host.m_replica && !readOnly)
+			continue;
+		const unsigned rank = (readOnly && !host.m_replica) ? 1 : 0;
+		if (best == idle.end() || rank < bestRank || (rank == bestRank && host.m_busy < bestBusy)) {
+			best = i;
+			bestRank = rank;
+			bestBusy = host.m_busy;
+		}
 	}
+	if (best == idle.end())
+		return NULL;
 
-	m_idleConnections.clear();
-
-	PTRACE(5, GetName() << "\tConnection pool cleanup finished");
-	if (!m_busyConnections.empty()) {
-		PTRACE(1, GetName() << "\tConnection cleanup finished with " << m_busyConnections.size() << " active connections");
-	}
+	SQLConnPtr connptr = *best;
+	idle.erase(best);
+	m_pool->m_busyConnections.push_front(connptr);
+	++m_pool->m_hosts[connptr->m_hostIndex].m_busy;
+	return connptr;
 }
 
 bool GkSQLConnection::AcquireSQLConnection(
 	SQLConnPtr & connptr,
-	long timeout
+	long timeout,
+	bool readOnly
 	)
 {
-	if (m_destroying)
+	if (m_destroying || m_pool == NULL)
 		return false;
 
-	if (!m_connected) {
+	if (!m_pool->m_connected) {
 		PTRACE(2, GetName() << "\tAttempting to reconnect to the database");
 		Disconnect();
 		if (!Connect()) {
@@ -194,43 +682,43 @@ bool GkSQLConnection::AcquireSQLConnection(
 	// wait for an idle connection or timeout
 	do {
 		if (!waiting) {
-			PWaitAndSignal lock(m_connectionsMutex);
+			PWaitAndSignal lock(m_pool->m_connectionsMutex);
 
 			if (m_destroying)
 				break;
 
 			// grab an idle connection if available or add itself
 			// to the list of waiting requests
-			if (!m_idleConnections.empty()) {
-				connptr = m_idleConnections.front();
-				m_idleConnections.pop_front();
-				m_busyConnections.push_front(connptr);
-			} else {
-				m_waitingRequests.push_back(&connptr);
+			connptr = TakeIdleConnection(readOnly);
+			if (connptr == NULL) {
+				m_pool->m_waitingRequests.push_back(Pool::Waiter(&connptr, readOnly, this));
 				waiting = true;
 			}
 		}
 
 		if (connptr == NULL && timeout != 0 && !m_destroying)
-			m_connectionAvailable.Wait(min(250L, timeout));
+			m_pool->m_connectionAvailable.Wait(min(250L, timeout));
 
 		if (connptr == NULL && timeout >= 0)
 			if ((PTime()-timeStart).GetMilliSeconds() >= timeout)
 				break;
 	} while (connptr == NULL && !m_destroying);
 
+	PWaitAndSignal lock(m_pool->m_connectionsMutex);
+	m_pool->RemoveWaiter(&connptr);
+
 	if (connptr == NULL || m_destroying) {
-		PWaitAndSignal lock(m_connectionsMutex);
-		m_waitingRequests.remove(&connptr);
 		if (connptr) {
-			m_idleConnections.push_back(connptr);
-			m_busyConnections.remove(connptr);
+			m_pool->MakeIdle(connptr);
+			connptr = NULL;
 		}
 		PTRACE(2, GetName() << "\tQuery timed out waiting for idle connection");
 		return false;
 	}
 
-	return connptr != NULL;
+	++m_activeQueries;
+	++m_pool->m_waitTime[HistogramBucket((PTime() - timeStart).GetMilliSeconds())];
+	return true;
 }
 
 void GkSQLConnection::ReleaseSQLConnection(
@@ -243,32 +731,33 @@ void GkSQLConnection::ReleaseSQLConnection(
 
 	// mark the connection as idle or give it to the first waiting request
 	{
-		PWaitAndSignal lock(m_connectionsMutex);
+		PWaitAndSignal lock(m_pool->m_connectionsMutex);
 
 		// remove itself from the list of waiting requests
-		m_waitingRequests.remove(&connptr);
+		m_pool->RemoveWaiter(&connptr);
+		if (m_activeQueries > 0)
+			--m_activeQueries;
 
-		witerator iter = m_waitingRequests.begin();
-		witerator end = m_waitingRequests.end();
+		const bool replica = m_pool->m_hosts[connptr->m_hostIndex].m_replica;
+		Pool::witerator iter = m_pool->m_waitingRequests.begin();
+		Pool::witerator end = m_pool->m_waitingRequests.end();
 
-		// find a waiting requests that has not been given a connection yet
+		// find a waiting request that has not been given a connection yet
+		// and may use a connection to this host
 		while (iter != end) {
-			// check if SQLConnPtr* is not NULL and if SQLConnPtr is empty (NULL)
-			if (*iter && *(*iter) == NULL)
+			if (*(iter->m_connptr) == NULL && (iter->m_readOnly || !replica))
 				break;
 			++iter;
 		}
 		if (iter != end && !m_destroying && !deleteFromPool) {
 			// do not remove itself from the list of busy connections
 			// just move the connection to the waiting request
-			*(*iter) = connptr;
+			*(iter->m_connptr) = connptr;
+		} else if (deleteFromPool) {
+			m_pool->DeleteBusy(connptr);
 		} else {
 			// move the connection to the list of idle connections
-			m_busyConnections.remove(connptr);
-			if (deleteFromPool)
-				delete connptr;
-			else
-				m_idleConnections.push_back(connptr);
+			m_pool->MakeIdle(connptr);
 		}
 
 		connptr = NULL;
@@ -276,7 +765,43 @@ void GkSQLConnection::ReleaseSQLConnection(
 
 	// wake up any threads waiting for an idle connection
 	if (!deleteFromPool)
-		m_connectionAvailable.Signal();
+		m_pool->m_connectionAvailable.Signal();
+}
+
+GkSQLResult* GkSQLConnection::RunQuery(
+	SQLConnPtr & connptr,
+	const PString & queryStr,
+	long timeout)
+{
+	PTRACE(5, GetName() << "\tExecuting query: " << queryStr);
+	const PTime execStart;
+	GkSQLResult * result = ExecuteQuery(connptr, queryStr, timeout);
+	const PInt64 execTime = (PTime() - execStart).GetMilliSeconds();
+
+	bool connected;
+	{
+		PWaitAndSignal lock(m_pool->m_connectionsMutex);
+		++m_pool->m_execTime[HistogramBucket(execTime)];
+		connected = m_pool->m_connected;
+		// drivers disconnect the pool when a query fails because of a connection error
+		if (!connected && (result == NULL || !result->IsValid())) {
+			Host & host = m_pool->m_hosts[connptr->m_hostIndex];
+			if (host.m_up)
+				PTRACE(2, GetName() << "\tDatabase host " << host.m_name << " failed, retry in " << m_hostRetryInterval << 's');
+			host.m_up = false;
+			host.m_retryTime = PTime() + PTimeInterval(0, m_hostRetryInterval);
+		}
+	}
+
+	ReleaseSQLConnection(connptr, !connected);
+	return result;
+}
+
+bool GkSQLConnection::IsReadOnlyQuery(const char* queryStr)
+{
+	const PCaselessString query = PString(queryStr).LeftTrim();
+	return (query.Left(6) *= "SELECT") && !isalnum((unsigned char)query[6]) && query[6] != '_'
+		&& query.Find("FOR UPDATE") == P_MAX_INDEX;
 }
 
 GkSQLResult* GkSQLConnection::ExecuteQuery(
@@ -286,18 +811,11 @@ GkSQLResult* GkSQLConnection::ExecuteQuery(
 {
 	SQLConnPtr connptr;
 
-	if (AcquireSQLConnection(connptr, timeout)) {
-		GkSQLResult* result = NULL;
-		if (queryParams) {
-			const PString finalQueryStr = ReplaceQueryParams(connptr, queryStr, *queryParams);
-			PTRACE(5, GetName() << "\tExecuting query: " << finalQueryStr);
-			result = ExecuteQuery(connptr, finalQueryStr, timeout);
-		} else {
-			PTRACE(5, GetName() << "\tExecuting query: " << queryStr);
-			result = ExecuteQuery(connptr, queryStr, timeout);
-		}
-		ReleaseSQLConnection(connptr, !m_connected);
-		return result;
+	if (AcquireSQLConnection(connptr, timeout, IsReadOnlyQuery(queryStr))) {
+		if (queryParams)
+			return RunQuery(connptr, ReplaceQueryParams(connptr, queryStr, *queryParams), timeout);
+		else
+			return RunQuery(connptr, queryStr, timeout);
 	} else {
 		PTRACE(2, GetName() << "\tQuery failed - no idle connection in the pool");
 		SNMP_TRAP(5, SNMPError, Database, GetName() + " query failed");
@@ -313,18 +831,11 @@ GkSQLResult* GkSQLConnection::ExecuteQuery(
 {
 	SQLConnPtr connptr;
 
-	if (AcquireSQLConnection(connptr, timeout)) {
-		GkSQLResult * result = NULL;
-		if (queryParams.empty()) {
-			PTRACE(5, GetName() << "\tExecuting query: " << queryStr);
-			result = ExecuteQuery(connptr, queryStr, timeout);
-		} else {
-			const PString finalQueryStr = ReplaceQueryParams(connptr, queryStr, queryParams);
-			PTRACE(5, GetName() << "\tExecuting query: " << finalQueryStr);
-			result = ExecuteQuery(connptr, finalQueryStr, timeout);
-		}
-		ReleaseSQLConnection(connptr, !m_connected);
-		return result;
+	if (AcquireSQLConnection(connptr, timeout, IsReadOnlyQuery(queryStr))) {
+		if (queryParams.empty())
+			return RunQuery(connptr, queryStr, timeout);
+		else
+			return RunQuery(connptr, ReplaceQueryParams(connptr, queryStr, queryParams), timeout);
 	} else {
 		PTRACE(2, GetName() << "\tQuery failed - no idle connection in the pool");
 		SNMP_TRAP(5, SNMPError, Database, GetName() + " query failed");
@@ -332,6 +843,121 @@ GkSQLResult* GkSQLConnection::ExecuteQuery(
 	}
 }
 
+bool GkSQLConnection::ExecuteQueryAsync(
+	const char* queryStr,
+	const PStringArray* queryParams,
+	QueryCallback* callback,
+	long timeout,
+	const PString & key
+	)
+{
+	AsyncQuery * query = new AsyncQuery(queryStr, callback, timeout, key);
+	if (queryParams) {
+		query->m_hasParams = true;
+		query->m_params = *queryParams;
+	}
+	return QueueAsyncQuery(query);
+}
+
+bool GkSQLConnection::ExecuteQueryAsync(
+	const char* queryStr,
+	const std::map<PString, PString>& queryParams,
+	QueryCallback* callback,
+	long timeout,
+	const PString & key
+	)
+{
+	AsyncQuery * query = new AsyncQuery(queryStr, callback, timeout, key);
+	query->m_hasParams = !queryParams.empty();
+	query->m_namedParams = true;
+	query->m_paramMap = queryParams;
+	return QueueAsyncQuery(query);
+}
+
+bool GkSQLConnection::QueueAsyncQuery(AsyncQuery* query)
+{
+	bool startThread = false;
+	{
+		PWaitAndSignal lock(m_asyncMutex);
+
+		if (m_destroying || m_pool == NULL || query->m_callback == NULL) {
+			PTRACE(2, GetName() << "\tQuery failed - can not queue the query");
+			delete query;
+			return false;
+		}
+		if (m_maxAsyncQueries > 0 && m_asyncQueries.size() >= m_maxAsyncQueries) {
+			PTRACE(2, GetName() << "\tQuery not queued - " << m_asyncQueries.size() << " queries waiting");
+			delete query;
+			return false;
+		}
+
+		m_asyncQueries.push_back(query);
+		m_asyncQueueMetric->Inc();
+		if (m_asyncThreads < m_maxAsyncThreads) {
+			++m_asyncThreads;
+			startThread = true;
+		}
+	}
+
+	if (startThread)
+		CreateJob(this, &GkSQLConnection::ProcessAsyncQueries, "SQLAsync");
+	return true;
+}
+
+void GkSQLConnection::ProcessAsyncQueries()
+{
+	while (true) {
+		AsyncQuery * query = NULL;
+		bool stopped = false;
+		{
+			PWaitAndSignal lock(m_asyncMutex);
+			if (!m_destroying)
+				query = TakeAsyncQuery();
+			// queries whose key is busy are left to the thread executing that key
+			if (query == NULL)
+				stopped = --m_asyncThreads == 0 && m_destroying;
+		}
+		if (query == NULL) {
+			// StopBackgroundJobs waits for the last thread,
+			// the object may be gone once this has been signalled
+			if (stopped)
+				m_asyncThreadsDone.Signal();
+			return;
+		}
+
+		GkSQLResult * result = NULL;
+		if (query->m_namedParams)
+			result = ExecuteQuery(query->m_query, query->m_paramMap, query->m_timeout);
+		else
+			result = ExecuteQuery(query->m_query, query->m_hasParams ? &query->m_params : NULL, query->m_timeout);
+		// the query didn't get a connection, because the object is being deleted
+		if (result == NULL && m_destroying)
+			query->m_callback->OnQueryCancelled();
+		else
+			query->m_callback->OnQueryDone(result);
+
+		if (!query->m_key.IsEmpty()) {
+			PWaitAndSignal lock(m_asyncMutex);
+			m_asyncKeys.erase(query->m_key);
+		}
+		delete query;
+	}
+}
+
+GkSQLConnection::AsyncQuery * GkSQLConnection::TakeAsyncQuery()
+{
+	// the first query of a key is always before the others in the list
+	for (std::list<AsyncQuery *>::iterator i = m_asyncQueries.begin(); i != m_asyncQueries.end(); ++i) {
+		AsyncQuery * query = *i;
+		if (query->m_key.IsEmpty() || m_asyncKeys.insert(query->m_key).second) {
+			m_asyncQueries.erase(i);
+			m_asyncQueueMetric->Dec();
+			return query;
+		}
+	}
+	return NULL;
+}
+
 PString GkSQLConnection::ReplaceQueryParams(
 	/// SQL connection to get escape parameters from
 	GkSQLConnection::SQLConnPtr conn,
@@ -452,14 +1078,55 @@ void GkSQLConnection::GetInfo(
 	Info &info /// filled with SQL connection state information upon return
 	)
 {
-	PWaitAndSignal lock(m_connectionsMutex);
-
-	info.m_connected = m_connected;
+	info.m_connected = false;
 	info.m_minPoolSize = m_minPoolSize;
 	info.m_maxPoolSize = m_maxPoolSize;
-	info.m_idleConnections = m_idleConnections.size();
-	info.m_busyConnections = m_busyConnections.size();
-	info.m_waitingRequests = m_waitingRequests.size();
+	info.m_idleConnections = info.m_busyConnections = info.m_waitingRequests = 0;
+	info.m_poolUsers = 0;
+	{
+		PWaitAndSignal lock(m_asyncMutex);
+		info.m_queuedAsyncQueries = m_asyncQueries.size();
+	}
+	info.m_hosts = PString::Empty();
+	memset(info.m_waitTime, 0, sizeof(info.m_waitTime));
+	memset(info.m_execTime, 0, sizeof(info.m_execTime));
+	if (m_pool == NULL)
+		return;
+
+	PWaitAndSignal lock(m_pool->m_connectionsMutex);
+
+	info.m_connected = m_pool->m_connected;
+	info.m_minPoolSize = m_pool->m_minPoolSize;
+	info.m_maxPoolSize = m_pool->m_maxPoolSize;
+	info.m_idleConnections = m_pool->m_idleConnections.size();
+	info.m_busyConnections = m_pool->m_busyConnections.size();
+	info.m_waitingRequests = m_pool->m_waitingRequests.size();
+	info.m_poolUsers = m_pool->m_users;
+	for (unsigned i = 0; i < m_pool->m_hosts.size(); ++i) {
+		const Host & host = m_pool->m_hosts[i];
+		if (i > 0)
+			info.m_hosts += ", ";
+		info.m_hosts += host.m_name + (host.m_replica ? " (replica, " : " (")
+			+ (host.m_up ? "up, " : "down, ") + PString(host.m_busy) + "/"
+			+ PString(host.m_connections) + " busy)";
+	}
+	memcpy(info.m_waitTime, m_pool->m_waitTime, sizeof(info.m_waitTime));
+	memcpy(info.m_execTime, m_pool->m_execTime, sizeof(info.m_execTime));
+}
+
+PString GkSQLConnection::PrintHistogram(const unsigned histogram[HistogramBuckets])
+{
+	PString result;
+	for (unsigned i = 0; i < HistogramBuckets; ++i) {
+		if (i > 0)
+			result += ' ';
+		if (i < HistogramBuckets - 1)
+			result += "<" + PString(GKSQL_HISTOGRAM_LIMITS[i]) + "ms:";
+		else
+			result += ">=" + PString(GKSQL_HISTOGRAM_LIMITS[i - 1]) + "ms:";
+		result += PString(histogram[i]);
+	}
+	return result;
 }
 
 GkSQLConnection::SQLConnWrapper::~SQLConnWrapper()
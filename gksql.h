@@ -18,6 +18,7 @@
 
 #include <list>
 #include <map>
+#include <set>
 #include <vector>
 #include "h323util.h"
 #include "snmp.h"
@@ -25,6 +26,8 @@
 #include "factory.h"
 #include "config.h"
 
+class MetricGauge;
+
 /** Abstract base class that encapsulates SQL query result.
     Backend specific operations are performed by derived classes.
 */
@@ -104,12 +107,19 @@ protected:
     Can provide a single SQL connection or maintain a pool of SQL connections.
     Thread safe.
 
+    The pool can spread its connections over several database hosts and
+    read-only replicas, and can be shared by all modules using the same
+    database (SharedPool=1).
+
     NOTE: Currently it implements only fixed SQL connections pool size,
     so only minPoolSize parameter is examined.
 */
 class GkSQLConnection : public NamedObject
 {
 public:
+	/// number of buckets in the wait/execution time histograms
+	enum { HistogramBuckets = 8 };
+
 	struct Info {
 		bool m_connected;
 		unsigned m_idleConnections;
@@ -117,6 +127,35 @@ public:
 		unsigned m_waitingRequests;
 		int m_minPoolSize;
 		int m_maxPoolSize;
+		/// number of modules using this pool (> 1 for shared pools)
+		unsigned m_poolUsers;
+		/// state of each database host
+		PString m_hosts;
+		/// number of queries by time waited for a connection
+		unsigned m_waitTime[HistogramBuckets];
+		/// number of queries by execution time
+		unsigned m_execTime[HistogramBuckets];
+		/// queries from ExecuteQueryAsync waiting for a database thread
+		unsigned m_queuedAsyncQueries;
+	};
+
+	/// Receives the result of a query started with ExecuteQueryAsync
+	class QueryCallback
+	{
+	public:
+		virtual ~QueryCallback() {}
+
+		/// Called from a database thread when the query is done
+		virtual void OnQueryDone(
+			/// query result as returned by ExecuteQuery (NULL on timeout),
+			/// to be deleted by the callee
+			GkSQLResult* result
+			) = 0;
+
+		/** Called instead of OnQueryDone when the query has not been executed,
+		    because the connection object is deleted.
+		*/
+		virtual void OnQueryCancelled() = 0;
 	};
 
 	GkSQLConnection(
@@ -196,11 +235,60 @@ public:
 		long timeout = -1
 		);
 
+	/** Queue the query for execution by a database thread and return
+	    immediately. The result is passed to the callback, which is called
+	    from the database thread. At most AsyncThreads queries of this object
+	    are executed at the same time, the others are queued. Queries with
+	    the same key are executed one after another in the order they have been
+	    queued.
+
+	    @return
+	    False if the query could not be queued (the queue is full or the
+	    object is being deleted), the callback is not called then.
+	*/
+	bool ExecuteQueryAsync(
+		/// query to be executed
+		const char* queryStr,
+		/// query parameters (%1, %2, ... notation), NULL if the query
+		/// does not take any parameters
+		const PStringArray* queryParams,
+		/// receives the result, has to be valid until it has been called
+		QueryCallback* callback,
+		/// time (ms) to wait for an idle connection, -1 means infinite
+		long timeout = -1,
+		/// queries with the same key are not executed in parallel, empty = no order
+		const PString & key = PString::Empty()
+		);
+
+	/** Queue the query for execution by a database thread and return
+	    immediately, see above.
+
+	    @return
+	    False if the query could not be queued, the callback is not called then.
+	*/
+	bool ExecuteQueryAsync(
+		/// query to be executed
+		const char* queryStr,
+		/// query parameters (name => value associations)
+		const std::map<PString, PString>& queryParams,
+		/// receives the result, has to be valid until it has been called
+		QueryCallback* callback,
+		/// time (ms) to wait for an idle connection, -1 means infinite
+		long timeout = -1,
+		/// queries with the same key are not executed in parallel, empty = no order
+		const PString & key = PString::Empty()
+		);
+
 	/// Get information about SQL connection state
 	void GetInfo(
 		Info &info /// filled with SQL connection state information upon return
 		);
 
+	/// @return	a histogram from the Info struct in a printable form
+	static PString PrintHistogram(
+		const unsigned histogram[HistogramBuckets]
+		);
+
 protected:
 	/** Generic SQL database connection object - should be extended
 	    by derived classes to include backed specific connection data.
@@ -213,7 +301,7 @@ protected:
 			int id,
 			/// host:port this connection is made to
 			const PString& host
-			) : m_id(id), m_host(host) {}
+			) : m_id(id), m_host(host), m_hostIndex(-1) {}
 
 		virtual ~SQLConnWrapper();
 
@@ -227,6 +315,8 @@ protected:
 		int m_id;
 		/// host:port this connection is made to
 		PString m_host;
+		/// index of the host in the pool, set by the pool
+		int m_hostIndex;
 	};
 	typedef SQLConnWrapper* SQLConnPtr;
 
@@ -255,7 +345,8 @@ protected:
 	*/
 	bool AcquireSQLConnection(
 		SQLConnPtr& connptr, /// variable to hold connection pointer (handle)
-		long timeout /// timeout (ms) to wait for an idle connection
+		long timeout, /// timeout (ms) to wait for an idle connection
+		bool readOnly = false /// true if a connection to a read-only replica will do
 		);
 
 	/** Return previously acquired connection back to the pool. It is important
@@ -327,6 +418,19 @@ protected:
 		const char* str
 		) = 0;
 
+	/** @return
+	    True if connections created by this object can be used by other objects
+	    of the same driver, so the pool can be shared.
+	*/
+	virtual bool IsPoolShareable() const { return true; }
+
+	/** Stop the background jobs of this object and wait until they are done.
+	    Queued async queries are cancelled, the database threads finish their
+	    current query. Has to be called from the destructor of derived classes,
+	    because the jobs use their virtual functions to execute queries.
+	*/
+	void StopBackgroundJobs();
+
 	/// Retrieve hostname (IP or DNS) and optional port number (separated by ':') from the string
 	void GetHostAndPort(
 		/// string to be examined
@@ -349,6 +453,73 @@ private:
 	*/
 	bool Connect();
 
+	/// database host with its health state, defined in gksql.cxx
+	struct Host;
+	/// connection pool, possibly shared by several objects, defined in gksql.cxx
+	struct Pool;
+
+	/// Attach to a shared pool for the key or create a private pool if the key is empty
+	void AttachPool(const PString & key, const std::vector<Host> & hosts);
+
+	/// Detach from the pool and delete it when this was the last user
+	void DetachPool();
+
+	/** Connect to a pool host, m_host and m_port are set to the host.
+	    @return	the new connection or NULL
+	*/
+	SQLConnPtr ConnectToHost(
+		int id, /// unique identifier for this connection
+		unsigned hostIndex /// host in the pool to connect to
+		);
+
+	/** Add connections to the hosts of one kind until the pool has m_minPoolSize
+	    of them. Called with the pool mutex held.
+	    @return	number of connections to hosts of this kind
+	*/
+	int AddConnections(
+		bool replicas /// true to connect to the replicas, false to the primary hosts
+		);
+
+	/** Add a connection when the pool has less than m_minPoolSize connections
+	    to the hosts of one kind, to the least used host that is up or whose
+	    retry interval is over. Runs in the host monitor.
+	    @return	true if a connection has been added
+	*/
+	bool CheckHosts();
+
+	/// checks the hosts and tops up the pool in the background, defined in gksql.cxx
+	class HostMonitor;
+	friend class HostMonitor;
+
+	/// @return	the least loaded idle connection or NULL. Called with the pool mutex held.
+	SQLConnPtr TakeIdleConnection(bool readOnly);
+
+	/// Execute a query on an acquired connection and release the connection
+	GkSQLResult* RunQuery(
+		SQLConnPtr & connptr, /// acquired connection
+		const PString & queryStr, /// final query
+		long timeout /// maximum time (ms) for the query execution
+		);
+
+	/// @return	true if the query only reads data, so it can go to a replica
+	static bool IsReadOnlyQuery(const char* queryStr);
+
+	/// query queued by ExecuteQueryAsync, defined in gksql.cxx
+	struct AsyncQuery;
+
+	/// Add the query to the async queue and start a database thread if needed
+	bool QueueAsyncQuery(AsyncQuery* query);
+
+	/// Execute queued async queries until the queue is empty, runs as a Job
+	void ProcessAsyncQueries();
+
+	/** Take the first queued query whose key isn't being executed by another thread.
+	    m_asyncMutex must be held.
+
+	    @return	the query or NULL if there is none
+	*/
+	AsyncQuery * TakeAsyncQuery();
+
 protected:
 	/** Disconnect connection pool from DB on connection error
 	*/
@@ -372,31 +543,47 @@ protected:
 	unsigned m_readTimeout;
 
 private:
-	/// iterator typedefs for convenience
-	typedef std::list<SQLConnPtr>::iterator iterator;
-	typedef std::list<SQLConnPtr>::const_iterator const_iterator;
-	typedef std::list<SQLConnPtr*>::iterator witerator;
-	typedef std::list<SQLConnPtr*>::const_iterator const_witerator;
-
+	/// driver name this object has been created for
+	PString m_driverName;
+	/// the pool this object executes queries with
+	Pool * m_pool;
 	/// minimum number of SQL connections active
 	int m_minPoolSize;
 	/// maximum number of SQL connections active
 	int m_maxPoolSize;
-	/// list of idle SQL connections
-	std::list<SQLConnPtr> m_idleConnections;
-	/// list of connections busy with query execution
-	std::list<SQLConnPtr> m_busyConnections;
-	/// FIFO queue of queries waiting to be executed when there is no idle connections
-	std::list<SQLConnPtr*> m_waitingRequests;
-	/// mutual access to the lists
-	PTimedMutex m_connectionsMutex;
-	/// signalled when a connections moves from the busy to the idle list
-	PSyncPoint m_connectionAvailable;
+	/// seconds before a failed host is tried again
+	unsigned m_hostRetryInterval;
+	/// queries of this object being executed, protected by the pool mutex
+	unsigned m_activeQueries;
+	/// serialize connection setup, as m_host and m_port are set for each host
+	PMutex m_hostMutex;
 	/// set to true when destructor is being invoked
 	bool m_destroying;
-	/// remain false while connection to the database not yet established
-	/// reset to false on disconnect or error during operation -> reconnect
-	bool m_connected;
+	/// the running host monitor or NULL
+	HostMonitor * m_hostMonitor;
+	/// signalled by the host monitor when it stops
+	PSyncPoint m_hostMonitorStopped;
+	/// queries from ExecuteQueryAsync waiting for a database thread
+	std::list<AsyncQuery *> m_asyncQueries;
+	/// mutual access to m_asyncQueries and m_asyncThreads
+	PMutex m_asyncMutex;
+	/// maximum number of database threads for async queries
+	unsigned m_maxAsyncThreads;
+	/// maximum number of queued async queries, 0 = no limit
+	unsigned m_maxAsyncQueries;
+	/// database threads executing async queries
+	unsigned m_asyncThreads;
+	/// keys of the async queries being executed
+	std::set<PString> m_asyncKeys;
+	/// size of m_asyncQueries for the metrics
+	MetricGauge * m_asyncQueueMetric;
+	/// signalled by the last database thread when the object is being deleted
+	PSyncPoint m_asyncThreadsDone;
+
+	/// shared pools by driver and database
+	static std::map<PString, Pool *> m_sharedPools;
+	/// mutual access to m_sharedPools and the pool user counts
+	static PMutex m_sharedPoolsMutex;
 };
 
 typedef Factory<GkSQLConnection>::Creator1<const char*> SQLCreator1;
@@ -446,6 +446,7 @@ GkIBSQLConnection::GkIBSQLConnection(
 	
 GkIBSQLConnection::~GkIBSQLConnection()
 {
+	StopBackgroundJobs();
 }
 
 GkIBSQLConnection::IBSQLConnWrapper::~IBSQLConnWrapper()
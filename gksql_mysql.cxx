@@ -307,6 +307,7 @@ GkMySQLConnection::GkMySQLConnection(
 
 GkMySQLConnection::~GkMySQLConnection()
 {
+	StopBackgroundJobs();
 }
 
 GkMySQLConnection::MySQLConnWrapper::~MySQLConnWrapper()
@@ -261,6 +261,9 @@ protected:
 		const char* str
 		);
 
+	/// connections depend on the ODBC environment of this object
+	virtual bool IsPoolShareable() const { return false; }
+
 private:
 	GkODBCConnection(const GkODBCConnection &);
 	GkODBCConnection & operator=(const GkODBCConnection &);
@@ -385,6 +388,7 @@ GkODBCConnection::GkODBCConnection(
 
 GkODBCConnection::~GkODBCConnection()
 {
+	StopBackgroundJobs();
 	if (m_env != SQL_NULL_HENV) {
 		(*g_SQLFreeHandle)(SQL_HANDLE_ENV, m_env);
 		m_env = SQL_NULL_HENV;
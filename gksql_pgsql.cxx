@@ -310,6 +310,7 @@ GkPgSQLConnection::GkPgSQLConnection(
 
 GkPgSQLConnection::~GkPgSQLConnection()
 {
+	StopBackgroundJobs();
 }
 
 GkPgSQLConnection::PgSQLConnWrapper::~PgSQLConnWrapper()
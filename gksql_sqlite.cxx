@@ -283,6 +283,7 @@ GkSQLiteConnection::GkSQLiteConnection(
 	
 GkSQLiteConnection::~GkSQLiteConnection()
 {
+	StopBackgroundJobs();
 }
 
 GkSQLiteConnection::GkSQLiteConnWrapper::~GkSQLiteConnWrapper()
@@ -12,6 +12,8 @@
 //////////////////////////////////////////////////////////////////
 
 #include "config.h"
+#include <climits>
+#include <algorithm>
 #include <ptlib.h>
 #include <h323pdu.h>
 #include "gk_const.h"
@@ -875,6 +877,122 @@ int MatchPrefix(
 	return negative ? -j + 1 : j;
 }
 
+namespace {
+
+const unsigned NoPosition = UINT_MAX;
+
+// match a prefix without the '!' handling of MatchPrefix()
+bool MatchPlainPrefix(const char* alias, const char* prefix)
+{
+	for (; *prefix != 0; ++alias, ++prefix)
+		if (*alias == 0 || (*prefix != '.' && *prefix != '%' && *prefix != *alias))
+			return false;
+	return true;
+}
+
+} // end of anonymous namespace
+
+struct PrefixIndex::Node {
+	Node() : m_wildcard(NULL), m_position(NoPosition), m_wholePosition(NoPosition), m_minPosition(NoPosition) { }
+
+	std::map<char, Node *> m_children;
+	Node * m_wildcard; /// child for '.' and '%'
+	unsigned m_position; /// first rule with the prefix ending at this node
+	unsigned m_wholePosition; /// first rule that only matches an alias ending at this node
+	unsigned m_minPosition; /// first rule in this subtree
+};
+
+PrefixIndex::PrefixIndex() : m_root(NULL), m_size(0)
+{
+}
+
+PrefixIndex::~PrefixIndex()
+{
+	Clear();
+}
+
+void PrefixIndex::Clear()
+{
+	DeleteNode(m_root);
+	m_root = NULL;
+	m_negative.clear();
+	m_size = 0;
+}
+
+void PrefixIndex::DeleteNode(Node * node)
+{
+	if (node == NULL)
+		return;
+	for (std::map<char, Node *>::iterator i = node->m_children.begin(); i != node->m_children.end(); ++i)
+		DeleteNode(i->second);
+	DeleteNode(node->m_wildcard);
+	delete node;
+}
+
+void PrefixIndex::Add(const char* prefix, unsigned position, bool wholeAlias)
+{
+	if (prefix == NULL)
+		return;
+	if (prefix[0] == '!') {
+		m_negative.push_back(std::make_pair(position, std::string(prefix + 1)));
+		++m_size;
+		return;
+	}
+	// an empty prefix never matches
+	if (prefix[0] == 0)
+		return;
+
+	if (m_root == NULL)
+		m_root = new Node;
+	Node * node = m_root;
+	node->m_minPosition = std::min(node->m_minPosition, position);
+	for (; *prefix != 0; ++prefix) {
+		Node * & child = (*prefix == '.' || *prefix == '%') ? node->m_wildcard : node->m_children[*prefix];
+		if (child == NULL)
+			child = new Node;
+		node = child;
+		node->m_minPosition = std::min(node->m_minPosition, position);
+	}
+	unsigned & nodePosition = wholeAlias ? node->m_wholePosition : node->m_position;
+	nodePosition = std::min(nodePosition, position);
+	++m_size;
+}
+
+void PrefixIndex::FindNode(const Node * node, const char* alias, unsigned & best)
+{
+	// nothing in this subtree can beat the best match so far
+	if (node == NULL || node->m_minPosition >= best)
+		return;
+	if (node->m_position < best)
+		best = node->m_position;
+	if (*alias == 0) {
+		if (node->m_wholePosition < best)
+			best = node->m_wholePosition;
+		return;
+	}
+	std::map<char, Node *>::const_iterator i = node->m_children.find(*alias);
+	if (i != node->m_children.end())
+		FindNode(i->second, alias + 1, best);
+	FindNode(node->m_wildcard, alias + 1, best);
+}
+
+int PrefixIndex::Find(const char* alias) const
+{
+	if (alias == NULL)
+		alias = "";
+
+	unsigned best = NoPosition;
+	FindNode(m_root, alias, best);
+
+	for (unsigned i = 0; i < m_negative.size() && m_negative[i].first < best; ++i)
+		if (m_negative[i].second.empty() || !MatchPlainPrefix(alias, m_negative[i].second.c_str())) {
+			best = m_negative[i].first;
+			break;
+		}
+
+	return best == NoPosition ? -1 : (int)best;
+}
+
 PString RewriteString(
 	const PString & s,	/// original string to rewrite
 	const char* prefix,	/// prefix string that matched
@@ -1086,3 +1204,15 @@ PString Q931MessageName(unsigned messageType)
     }
 }
 
+unsigned GetRTPHeaderLength(const BYTE * packet, unsigned len)
+{
+	if (len < 12)
+		return 0;
+	unsigned headerLen = 12 + 4 * (packet[0] & 0x0f);	// CSRC count
+	if (packet[0] & 0x10) {	// header extension
+		if (len < headerLen + 4)
+			return 0;
+		headerLen += 4 + 4 * (((unsigned)packet[headerLen + 2] << 8) | packet[headerLen + 3]);
+	}
+	return (headerLen <= len) ? headerLen : 0;
+}
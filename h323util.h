@@ -15,6 +15,9 @@
 #ifndef H323UTIL_H
 #define H323UTIL_H "@(#) $Id$"
 
+#include <string>
+#include <vector>
+#include <map>
 #include <ptlib.h>
 #include <ptlib/sockets.h>
 #include <h245.h>
@@ -232,6 +235,51 @@ int MatchPrefix(
 	const char* prefix
 	);
 
+/** Index of prefixes in the #MatchPrefix# syntax, each with a rule position.
+    A lookup finds the rule with the lowest position that matches the alias
+    in one pass over the alias, instead of calling #MatchPrefix# for every rule.
+*/
+class PrefixIndex {
+public:
+	PrefixIndex();
+	~PrefixIndex();
+
+	/// remove all prefixes
+	void Clear();
+
+	/// add a prefix, positions have to be added in ascending order
+	void Add(
+		const char* prefix, /// prefix to add, can be preceeded with '!'
+		unsigned position, /// rule position returned by #Find#
+		bool wholeAlias = false /// only match an alias of the same length, ignored for '!' prefixes
+		);
+
+	/** Find the first rule that matches the alias, either a normal prefix
+	    that matches or a '!' prefix that doesn't match.
+
+	    @return	the lowest position of a matching rule or -1
+	*/
+	int Find(const char* alias) const;
+
+	/// @return	the number of prefixes in the index
+	unsigned GetSize() const { return m_size; }
+
+private:
+	struct Node;
+
+	static void DeleteNode(Node * node);
+	static void FindNode(const Node * node, const char* alias, unsigned & best);
+
+	/* No copy constructor allowed */
+	PrefixIndex(const PrefixIndex &);
+	/* No operator= allowed */
+	PrefixIndex & operator=(const PrefixIndex &);
+
+	Node * m_root;
+	std::vector<std::pair<unsigned, std::string> > m_negative; /// '!' prefixes without the '!'
+	unsigned m_size;
+};
+
 /** Rewrite the string #s# replacing #prefix# with #value#. The #prefix#
     and #value# strings can contain dots ('.') to copy source characters
     to the destination string. The #prefix# string can also contain percent
@@ -306,6 +354,9 @@ void SetUUIE(Q931 & q931, const H225_H323_UserInformation & uuie);
 // get the name for Q.931 message types
 PString Q931MessageName(unsigned messageType);
 
+// get the length of a RTP header incl. CSRCs and header extension, 0 if the packet is too short
+unsigned GetRTPHeaderLength(const BYTE * packet, unsigned len);
+
 
 class IPAndPortAddress
 {
@@ -391,6 +391,29 @@ TEST_F(H323UtilTest, MatchPrefix) {
 	EXPECT_EQ(0, MatchPrefix("123456789", "1%4"));
 }
 
+TEST_F(H323UtilTest, PrefixIndex) {
+	PrefixIndex index;
+	EXPECT_EQ(-1, index.Find("123456789"));
+	index.Add("1234", 0);
+	index.Add("1.3", 1);
+	index.Add("!12", 2);
+	index.Add("12", 3);
+	index.Add("!", 4);
+	EXPECT_EQ(5u, index.GetSize());
+	EXPECT_EQ(0, index.Find("123456789"));
+	EXPECT_EQ(1, index.Find("193"));
+	EXPECT_EQ(2, index.Find("44"));
+	EXPECT_EQ(3, index.Find("129"));
+	index.Clear();
+	index.Add("!12", 0);
+	EXPECT_EQ(-1, index.Find("129"));
+	index.Clear();
+	index.Add("1.3", 0, true);
+	index.Add("1", 1);
+	EXPECT_EQ(0, index.Find("123"));
+	EXPECT_EQ(1, index.Find("1234"));
+}
+
 TEST_F(H323UtilTest, RewriteString) {
 	PString unused;
 	EXPECT_STREQ("1111497654321", RewriteString("497654321", "49", "111149", unused));
@@ -439,4 +462,20 @@ TEST_F(H323UtilTest, IPAndPortAddress) {
     EXPECT_FALSE(addr1 != addr2);
 }
 
+TEST_F(H323UtilTest, GetRTPHeaderLength) {
+	BYTE packet[40] = { 0 };
+	packet[0] = 0x80;
+	EXPECT_EQ(0u, GetRTPHeaderLength(packet, 11));
+	EXPECT_EQ(12u, GetRTPHeaderLength(packet, 12));
+	// 2 CSRCs
+	packet[0] = 0x82;
+	EXPECT_EQ(20u, GetRTPHeaderLength(packet, 40));
+	EXPECT_EQ(0u, GetRTPHeaderLength(packet, 19));
+	// 2 CSRCs and a header extension of 2 words
+	packet[0] = 0x92;
+	packet[23] = 2;
+	EXPECT_EQ(32u, GetRTPHeaderLength(packet, 40));
+	EXPECT_EQ(0u, GetRTPHeaderLength(packet, 31));
+}
+
 }  // namespace
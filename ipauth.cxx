@@ -84,6 +84,10 @@ private:
 	typedef std::vector<IPAuthEntry> IPAuthList;
 
 	IPAuthList m_authList;
+	// position in m_authList for each network
+	NetworkAddressTree<unsigned> m_authIndex;
+	// position of the entry that matches any address or -1
+	int m_anyEntry;
 };
 
 
@@ -96,10 +100,30 @@ IPAuthBase::IPAuthBase(
 	unsigned supportedMiscChecks
 	) : GkAuthenticator(authName, supportedRasChecks, supportedMiscChecks)
 {
+	m_cache = new CacheManager(GetConfig()->GetInteger(IPAuthSection, "CacheTimeout", 60),
+		GetConfig()->GetInteger(IPAuthSection, "CacheMaxEntries", 100000), PString(authName) + " IP verdicts");
 }
 
 IPAuthBase::~IPAuthBase()
 {
+	delete m_cache;
+}
+
+int IPAuthBase::CheckCachedAddress(
+	const PIPSocket::Address & addr,
+	WORD port,
+	const PString & number,
+	bool overTLS)
+{
+	const PString key = addr.AsString() + ':' + PString(PString::Unsigned, GetPortClass(port))
+		+ (overTLS ? ":tls:" : "::") + number;
+	PString verdict;
+	if (m_cache->Retrieve(key, verdict))
+		return verdict.AsInteger();
+
+	const int result = CheckAddress(addr, port, number, overTLS);
+	m_cache->Save(key, PString(PString::Signed, result));
+	return result;
 }
 
 int IPAuthBase::Check(
@@ -108,7 +132,7 @@ int IPAuthBase::Check(
 	/// authorization data (reject reason, ...)
 	RRQAuthData & /*authData*/)
 {
-	return CheckAddress(rrqPdu->m_peerAddr, rrqPdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(rrqPdu->m_peerAddr, rrqPdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(
@@ -124,42 +148,42 @@ int IPAuthBase::Check(
         number = AsString(arq.m_destinationInfo[0], false);
     }
 
-	return CheckAddress(arqPdu->m_peerAddr, arqPdu->m_peerPort, number);
+	return CheckCachedAddress(arqPdu->m_peerAddr, arqPdu->m_peerPort, number);
 }
 
 int IPAuthBase::Check(RasPDU<H225_GatekeeperRequest> & pdu, unsigned & /* rejectReason */)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(RasPDU<H225_UnregistrationRequest> & pdu, unsigned & /* rejectReason */)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(RasPDU<H225_BandwidthRequest> & pdu, unsigned & /* rejectReason */)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(RasPDU<H225_DisengageRequest> & pdu, unsigned & /*rejectReason*/)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(RasPDU<H225_LocationRequest> & pdu, unsigned & /*rejectReason*/)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(RasPDU<H225_InfoRequest> & pdu, unsigned & /* rejectReason */)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(RasPDU<H225_ResourcesAvailableIndicate> & pdu, unsigned & /* rejectReason */)
 {
-	return CheckAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
+	return CheckCachedAddress(pdu->m_peerAddr, pdu->m_peerPort, PString::Empty());
 }
 
 int IPAuthBase::Check(
@@ -174,7 +198,7 @@ int IPAuthBase::Check(
 	PString number;
 	setup.GetQ931().GetCalledPartyNumber(number);
 
-	return CheckAddress(addr, port, number, authData.m_overTLS);
+	return CheckCachedAddress(addr, port, number, authData.m_overTLS);
 }
 
 int IPAuthBase::Check(
@@ -183,7 +207,7 @@ int IPAuthBase::Check(
 	/// authorization data
 	Q931AuthData & authData)
 {
-	return CheckAddress(authData.m_peerAddr, authData.m_peerPort, PString::Empty());
+	return CheckCachedAddress(authData.m_peerAddr, authData.m_peerPort, PString::Empty());
 }
 
 
@@ -213,7 +237,7 @@ struct IPAuthEntry_greater : public binary_function<FileIPAuth::IPAuthEntry, Fil
 FileIPAuth::FileIPAuth(
 	/// authenticator name from Gatekeeper::Auth section
 	const char * authName
-	) : IPAuthBase(authName)
+	) : IPAuthBase(authName), m_anyEntry(-1)
 {
 	bool dynamicCfg = false;
 	PConfig * cfg = GkConfig();
@@ -266,6 +290,16 @@ FileIPAuth::FileIPAuth(
 
 	std::stable_sort(m_authList.begin(), m_authList.end(), IPAuthEntry_greater());
 
+	// the first entry for a network wins, rejects are sorted first
+	for (unsigned i = 0; i < m_authList.size(); ++i) {
+		if (m_authList[i].first.IsAny()) {
+			if (m_anyEntry < 0)
+				m_anyEntry = i;
+		} else if (!m_authIndex.Find(m_authList[i].first)) {
+			m_authIndex.Insert(m_authList[i].first, i);
+		}
+	}
+
 	PTRACE(m_authList.empty() ? 1 : 5, GetName() << "\t" << m_authList.size() << " entries loaded");
 
 	if (PTrace::CanTrace(6)) {
@@ -296,23 +330,26 @@ int FileIPAuth::CheckAddress(
 	WORD /*port*/, /// port number the request comes from
 	const PString & number, bool overTLS)
 {
-	IPAuthList::const_iterator entry = m_authList.begin();
-	while (entry != m_authList.end()) {
-		if (entry->first.IsAny() || addr << entry->first) {
-			if (entry->second.onlyTLS && !overTLS) {
-				PTRACE(5, GetName() << "\tIP " << addr.AsString() << " rejected (no TLS)");
-				return e_fail;
-			}
-			if (entry->second.auth && !number.IsEmpty()) {
-				int len = entry->second.PrefixMatch(number);
-				PTRACE(5, GetName() << "\tIP " << addr.AsString()
-					<< (len ? " accepted" : " rejected")
-					<< " for Called " << number);
-				return len ? e_ok : e_fail;
-			}
-			return entry->second.auth ? e_ok : e_fail;
+	// the longest matching network wins, the any entry is the last resort
+	const unsigned * index = m_authIndex.FindBestMatch(addr);
+	const IPAuthEntry * entry = NULL;
+	if (index)
+		entry = &m_authList[*index];
+	else if (m_anyEntry >= 0)
+		entry = &m_authList[m_anyEntry];
+	if (entry) {
+		if (entry->second.onlyTLS && !overTLS) {
+			PTRACE(5, GetName() << "\tIP " << addr.AsString() << " rejected (no TLS)");
+			return e_fail;
+		}
+		if (entry->second.auth && !number.IsEmpty()) {
+			int len = entry->second.PrefixMatch(number);
+			PTRACE(5, GetName() << "\tIP " << addr.AsString()
+				<< (len ? " accepted" : " rejected")
+				<< " for Called " << number);
+			return len ? e_ok : e_fail;
 		}
-		++entry;
+		return entry->second.auth ? e_ok : e_fail;
 	}
 	PTRACE(5, GetName() << "\tReturns default for " << addr.AsString() << " => " << StatusAsString(GetDefaultStatus()));
 	return GetDefaultStatus();
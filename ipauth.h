@@ -18,7 +18,16 @@
 
 #include "gkauth.h"
 
-/// Generic IP based authentication
+/// config section with the settings shared by all IP based authenticators
+const char * const IPAuthSection = "IPAuth";
+
+/** Generic IP based authentication
+
+    The verdicts of CheckAddress are cached for each authenticator, keyed by
+    IP, port class, TLS and called number, so the repeated requests from the
+    same endpoint don't run the check again until the verdict expires.
+    The cache is dropped with the authenticator on config reload.
+*/
 class IPAuthBase : public GkAuthenticator {
 public:
 	enum SupportedRasChecks {
@@ -126,12 +135,28 @@ protected:
 		bool overTLS = false
 		) = 0;
 
+	/** @return
+	    the part of the port number the verdict of CheckAddress depends on,
+	    the default ignores the port, so all requests from an IP share one verdict
+	*/
+	virtual WORD GetPortClass(WORD /*port*/) const { return 0; }
+
 private:
+	/// CheckAddress with the verdict cache
+	int CheckCachedAddress(
+		const PIPSocket::Address & addr,
+		WORD port,
+		const PString & number,
+		bool overTLS = false
+		);
+
 	IPAuthBase();
 	/* No copy constructor allowed */
 	IPAuthBase(const IPAuthBase &);
 	/* No operator= allowed */
 	IPAuthBase& operator=(const IPAuthBase &);
+
+	CacheManager * m_cache;
 };
 
 #endif /* #ifndef IPAUTH_H */
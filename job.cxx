@@ -20,6 +20,7 @@
 #include "singleton.h"
 #include "config.h"
 #include "job.h"
+#include "metrics.h"
 #include <list>
 
 // timeout (seconds) for an idle Worker to be deleted
@@ -119,6 +120,9 @@ private:
 	Agent(const Agent &);
 	Agent& operator=(const Agent &);
 
+	/// publish the number of worker threads to the metrics
+	void UpdateMetrics(int numIdleWorkers, int numBusyWorkers);
+
 private:
 	/// mutual access to Worker lists
 	PMutex m_wlistMutex;
@@ -128,6 +132,8 @@ private:
 	std::list<Worker*> m_busyWorkers;
 	/// flag preventing new workers to be registered during Agent destruction
 	volatile bool m_active;
+	MetricGauge * m_idleWorkersMetric;
+	MetricGauge * m_busyWorkersMetric;
 };
 
 
@@ -236,6 +242,10 @@ void Worker::Destroy()
 
 Agent::Agent() : Singleton<Agent>("Agent"), m_active(true)
 {
+	m_idleWorkersMetric = Metrics::Instance()->GetGauge("gnugk_job_workers",
+		"Number of worker threads by state", "state=\"idle\"");
+	m_busyWorkersMetric = Metrics::Instance()->GetGauge("gnugk_job_workers",
+		"Number of worker threads by state", "state=\"busy\"");
 }
 
 Agent::~Agent()
@@ -336,6 +346,7 @@ void Agent::Exec(Job * job)
 
 	PTRACE_IF(5, m_active, "JOB\tWorker threads: " << (numBusyWorkers+numIdleWorkers)
 		<< " total - " << numBusyWorkers << " busy, " << numIdleWorkers << " idle");
+	UpdateMetrics(numIdleWorkers, numBusyWorkers);
 
 	if (destroyWorker) {
 		PTRACE(5, "JOB\tAgent did not accept Job " << (job ? job->GetName() : "<no job>"));
@@ -343,6 +354,14 @@ void Agent::Exec(Job * job)
 	}
 }
 
+void Agent::UpdateMetrics(int numIdleWorkers, int numBusyWorkers)
+{
+	if (numIdleWorkers >= 0 && numBusyWorkers >= 0) {
+		m_idleWorkersMetric->Set(numIdleWorkers);
+		m_busyWorkersMetric->Set(numBusyWorkers);
+	}
+}
+
 void Agent::Remove(Worker* worker)
 {
 	int numIdleWorkers;
@@ -357,6 +376,7 @@ void Agent::Remove(Worker* worker)
 	}
 	PTRACE_IF(5, m_active, "JOB\tWorker threads: " << (numBusyWorkers+numIdleWorkers)
 		<< " total - " << numBusyWorkers << " busy, " << numIdleWorkers << " idle");
+	UpdateMetrics(numIdleWorkers, numBusyWorkers);
 }
 
 void Agent::JobDone(
@@ -376,6 +396,7 @@ void Agent::JobDone(
 	}
 	PTRACE_IF(5, m_active, "JOB\tWorker threads: " << (numBusyWorkers+numIdleWorkers)
 		<< " total - " << numBusyWorkers << " busy, " << numIdleWorkers << " idle");
+	UpdateMetrics(numIdleWorkers, numBusyWorkers);
 }
 
 
@@ -81,50 +81,139 @@ static const luaL_Reg gnugklib[] = {
     {NULL, NULL}
 };
 
-class LuaBase {
+/// a compiled LUA script with a pool of LUA states to run it
+class LuaScript {
 public:
-	LuaBase();
-	virtual ~LuaBase();
+	LuaScript() : m_generation(0) { }
+	~LuaScript();
 
-	void InitLua(lua_State ** lua);
-    void ShutdownLua(lua_State ** lua);
-    bool RunLua(lua_State * lua, const PString & script);
+	/// Set and compile the script, states of a previous script are dropped
+	void SetScript(const PString & script, const PString & name);
 
-	void SetString(lua_State * lua, const char * name, const char * value);
-	PString GetString(lua_State * lua, const char * name) const;
-	void SetNumber(lua_State * lua, const char * name, double value);
-	double GetNumber(lua_State * lua, const char * name) const;
-	void SetBoolean(lua_State * lua, const char * name, bool value);
-	bool GetBoolean(lua_State * lua, const char * name) const;
+	bool IsEmpty() const { return m_script.IsEmpty(); }
+
+	/** Get an idle state or create a new one with the compiled script.
+	    A fresh table for the globals of the run is on the stack (index 1).
+
+	    @return
+	    The state or NULL if the script could not be compiled.
+	*/
+	lua_State * Acquire();
+
+	/// Run the script with the globals table from Acquire()
+	bool Run(lua_State * lua);
+
+	/// Return the state to the pool
+	void Release(lua_State * lua);
+
+private:
+	LuaScript(const LuaScript &);
+	LuaScript & operator=(const LuaScript &);
+
+	/// @return	a new state with the compiled script or NULL
+	lua_State * NewState() const;
+
+	PString m_script;
+	PString m_name;
+	/// incremented when the script is replaced
+	unsigned m_generation;
+	/// idle states of the current script
+	std::list<lua_State *> m_idleStates;
+	/// states in use with the generation of their script
+	std::map<lua_State *, unsigned> m_busyStates;
+	PMutex m_mutex;
 };
 
+// registry key for the compiled script
+#define LUA_GNUGKSCRIPT    "gnugk_script"
+// stack index of the globals table of a script run
+#define LUA_GNUGKGLOBALS   1
 
-LuaBase::LuaBase()
+LuaScript::~LuaScript()
 {
+	PWaitAndSignal lock(m_mutex);
+	for (std::list<lua_State *>::iterator i = m_idleStates.begin(); i != m_idleStates.end(); ++i)
+		lua_close(*i);
+	m_idleStates.clear();
 }
 
-void LuaBase::InitLua(lua_State ** pLua)
+void LuaScript::SetScript(const PString & script, const PString & name)
 {
-	if (pLua && !*pLua) {
-		*pLua = luaL_newstate();
-		luaL_openlibs(*pLua);
-		// register "gnugk" lib
-        luaL_newlib(*pLua, gnugklib);
-        lua_setglobal(*pLua, LUA_GNUGKLIBNAME);
+	PWaitAndSignal lock(m_mutex);
+
+	for (std::list<lua_State *>::iterator i = m_idleStates.begin(); i != m_idleStates.end(); ++i)
+		lua_close(*i);
+	m_idleStates.clear();
+	++m_generation;
+	m_script = script;
+	m_name = name;
+
+	if (m_script.IsEmpty())
+		return;
+
+	// compile now to report errors when the config is loaded
+	lua_State * lua = NewState();
+	if (lua)
+		m_idleStates.push_back(lua);
+}
+
+lua_State * LuaScript::NewState() const
+{
+	lua_State * lua = luaL_newstate();
+	if (lua == NULL)
+		return NULL;
+	luaL_openlibs(lua);
+	// register "gnugk" lib
+	luaL_newlib(lua, gnugklib);
+	lua_setglobal(lua, LUA_GNUGKLIBNAME);
+
+	if (luaL_loadstring(lua, m_script) != 0) {
+		PTRACE(1, m_name << "\tError in LUA script: " << lua_tostring(lua, -1));
+		lua_close(lua);
+		return NULL;
 	}
+	lua_setfield(lua, LUA_REGISTRYINDEX, LUA_GNUGKSCRIPT);
+	return lua;
 }
 
-void LuaBase::ShutdownLua(lua_State ** pLua)
+lua_State * LuaScript::Acquire()
 {
-	if (pLua && *pLua) {
-        lua_close(*pLua);
-        *pLua = NULL;
+	lua_State * lua = NULL;
+	unsigned generation = 0;
+	{
+		PWaitAndSignal lock(m_mutex);
+		generation = m_generation;
+		if (!m_idleStates.empty()) {
+			lua = m_idleStates.front();
+			m_idleStates.pop_front();
+		}
 	}
+	if (lua == NULL) {
+		lua = NewState();
+		if (lua == NULL)
+			return NULL;
+	}
+	{
+		PWaitAndSignal lock(m_mutex);
+		m_busyStates[lua] = generation;
+	}
+
+	// globals set by a run don't leak into the next one,
+	// names not found in the table are looked up in the real globals
+	lua_newtable(lua);
+	lua_newtable(lua);
+	lua_pushglobaltable(lua);
+	lua_setfield(lua, -2, "__index");
+	lua_setmetatable(lua, -2);
+	return lua;
 }
 
-bool LuaBase::RunLua(lua_State * lua, const PString & script)
+bool LuaScript::Run(lua_State * lua)
 {
-	if (luaL_loadstring(lua, script) != 0 || lua_pcall(lua, 0, 0, 0) != 0) {
+	lua_getfield(lua, LUA_REGISTRYINDEX, LUA_GNUGKSCRIPT);
+	lua_pushvalue(lua, LUA_GNUGKGLOBALS);
+	lua_setupvalue(lua, -2, 1);	// _ENV of the script
+	if (lua_pcall(lua, 0, 0, 0) != 0) {
 		PTRACE(1, "LUA\tError in LUA script: " << lua_tostring(lua, -1));
 		lua_pop(lua, 1);
 		return false;
@@ -132,6 +221,67 @@ bool LuaBase::RunLua(lua_State * lua, const PString & script)
 	return true;
 }
 
+void LuaScript::Release(lua_State * lua)
+{
+	if (lua == NULL)
+		return;
+
+	lua_settop(lua, 0);
+
+	PWaitAndSignal lock(m_mutex);
+	std::map<lua_State *, unsigned>::iterator i = m_busyStates.find(lua);
+	const bool current = (i != m_busyStates.end() && i->second == m_generation);
+	if (i != m_busyStates.end())
+		m_busyStates.erase(i);
+	if (current)
+		m_idleStates.push_front(lua);
+	else
+		lua_close(lua);
+}
+
+
+class LuaBase {
+public:
+	LuaBase();
+	virtual ~LuaBase();
+
+	/// Read the script from the config or from the file given in the config
+	PString ReadScript(const PString & section, const PString & scriptKey, const PString & fileKey) const;
+
+	/// access the globals of a script run
+	void SetString(lua_State * lua, const char * name, const char * value);
+	PString GetString(lua_State * lua, const char * name) const;
+	void SetNumber(lua_State * lua, const char * name, double value);
+	double GetNumber(lua_State * lua, const char * name) const;
+	void SetBoolean(lua_State * lua, const char * name, bool value);
+	bool GetBoolean(lua_State * lua, const char * name) const;
+};
+
+
+LuaBase::LuaBase()
+{
+}
+
+PString LuaBase::ReadScript(const PString & section, const PString & scriptKey, const PString & fileKey) const
+{
+	PString script = GkConfig()->GetString(section, scriptKey, "");
+	if (script.IsEmpty()) {
+		PString scriptFile = GkConfig()->GetString(section, fileKey, "");
+		if (!scriptFile.IsEmpty()) {
+			PTextFile f(scriptFile, PFile::ReadOnly);
+			if (!f.IsOpen()) {
+				PTRACE(1, section << "\tCan't read LUA script " << scriptFile);
+			} else {
+				PString line;
+				while (f.ReadLine(line)) {
+					script += (line + "\n");
+				}
+			}
+		}
+	}
+	return script;
+}
+
 LuaBase::~LuaBase()
 {
 }
@@ -140,12 +290,12 @@ void LuaBase::SetString(lua_State * lua, const char * name, const char * value)
 {
     PTRACE(6, "LUA\tSet String " << name << " = " << value);
 	lua_pushstring(lua, value);
-	lua_setglobal(lua, name);
+	lua_setfield(lua, LUA_GNUGKGLOBALS, name);
 }
 
 PString LuaBase::GetString(lua_State * lua, const char * name) const
 {
-	lua_getglobal(lua, name);
+	lua_getfield(lua, LUA_GNUGKGLOBALS, name);
 	PString result = lua_tostring(lua, -1);
 	lua_pop(lua, 1);
 	return result;
@@ -156,12 +306,12 @@ void LuaBase::SetNumber(lua_State * lua, const char * name, double value)
 {
     PTRACE(6, "LUA\tSet Number " << name << " = " << value);
 	lua_pushnumber(lua, value);
-	lua_setglobal(lua, name);
+	lua_setfield(lua, LUA_GNUGKGLOBALS, name);
 }
 
 double LuaBase::GetNumber(lua_State * lua, const char * name) const
 {
-	lua_getglobal(lua, name);
+	lua_getfield(lua, LUA_GNUGKGLOBALS, name);
 	double result = lua_tonumber(lua, -1);
 	lua_pop(lua, 1);
 	return result;
@@ -172,12 +322,12 @@ void LuaBase::SetBoolean(lua_State * lua, const char * name, bool value)
 {
     PTRACE(6, "LUA\tSet Boolean" << name << " = " << value);
 	lua_pushboolean(lua, value);
-	lua_setglobal(lua, name);
+	lua_setfield(lua, LUA_GNUGKGLOBALS, name);
 }
 
 bool LuaBase::GetBoolean(lua_State * lua, const char * name) const
 {
-	lua_getglobal(lua, name);
+	lua_getfield(lua, LUA_GNUGKGLOBALS, name);
 	bool result = lua_toboolean(lua, -1);
 	lua_pop(lua, 1);
 	return result;
@@ -211,7 +361,7 @@ protected:
 
 protected:
 	// script to run
-	PString m_script;
+	LuaScript m_script;
 };
 
 LuaPolicy::LuaPolicy()
@@ -223,21 +373,7 @@ LuaPolicy::LuaPolicy()
 
 void LuaPolicy::LoadConfig(const PString & instance)
 {
-	m_script = GkConfig()->GetString(m_iniSection, "Script", "");
-	if (m_script.IsEmpty()) {
-		PString scriptFile = GkConfig()->GetString(m_iniSection, "ScriptFile", "");
-		if (!scriptFile.IsEmpty()) {
-			PTextFile f(scriptFile, PFile::ReadOnly);
-			if (!f.IsOpen()) {
-				PTRACE(1, "LUA\tCan't read LUA script " << scriptFile);
-			} else {
-				PString line;
-				while (f.ReadLine(line)) {
-					m_script += (line + "\n");
-				}
-			}
-		}
-	}
+	m_script.SetScript(ReadScript(m_iniSection, "Script", "ScriptFile"), m_name);
 
 	if (m_script.IsEmpty()) {
 		PTRACE(2, m_name << "\tmodule creation failed: no LUA script");
@@ -266,8 +402,9 @@ void LuaPolicy::RunPolicy(
 		/* out: */
 		DestinationRoutes & destination)
 {
-	lua_State * lua = NULL;
-    InitLua(&lua);
+	lua_State * lua = m_script.Acquire();
+	if (!lua)
+		return;
 
 	SetString(lua, "source", source);
 	SetString(lua, "calledAlias", calledAlias);
@@ -283,8 +420,8 @@ void LuaPolicy::RunPolicy(
 	SetString(lua, "action", "");
 	SetString(lua, "rejectCode", "");
 
-	if (!RunLua(lua, m_script)) {
-        ShutdownLua(&lua);
+	if (!m_script.Run(lua)) {
+        m_script.Release(lua);
 		return;
 	}
 
@@ -295,7 +432,7 @@ void LuaPolicy::RunPolicy(
 
 	if (action.ToUpper() == "SKIP") {
 		PTRACE(5, m_name << "\tSkipping to next policy");
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return;
 	}
 
@@ -305,7 +442,7 @@ void LuaPolicy::RunPolicy(
 		if (!rejectCode.IsEmpty()) {
 			destination.SetRejectReason(rejectCode.AsInteger());
 		}
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return;
 	}
 
@@ -330,7 +467,7 @@ void LuaPolicy::RunPolicy(
 		destination.AddRoute(route);
 	}
 
-    ShutdownLua(&lua);
+    m_script.Release(lua);
 }
 
 namespace { // anonymous namespace
@@ -450,8 +587,8 @@ private:
 
 protected:
 	// scripts to run
-	PString m_registrationScript;
-	PString m_callScript;
+	LuaScript m_registrationScript;
+	LuaScript m_callScript;
 };
 
 LuaAuth::LuaAuth(
@@ -460,37 +597,8 @@ LuaAuth::LuaAuth(
 	unsigned supportedMiscChecks)
 	: GkAuthenticator(name, supportedRasChecks, supportedMiscChecks)
 {
-	m_registrationScript = GkConfig()->GetString("LuaAuth", "RegistrationScript", "");
-	if (m_registrationScript.IsEmpty()) {
-		PString scriptFile = GkConfig()->GetString("LuaAuth", "RegistrationScriptFile", "");
-		if (!scriptFile.IsEmpty()) {
-			PTextFile f(scriptFile, PFile::ReadOnly);
-			if (!f.IsOpen()) {
-				PTRACE(1, "LuaAuth\tCan't read LUA call script " << scriptFile);
-			} else {
-				PString line;
-				while (f.ReadLine(line)) {
-					m_registrationScript += (line + "\n");
-				}
-			}
-		}
-	}
-
-	m_callScript = GkConfig()->GetString("LuaAuth", "CallScript", "");
-	if (m_callScript.IsEmpty()) {
-		PString scriptFile = GkConfig()->GetString("LuaAuth", "CallScriptFile", "");
-		if (!scriptFile.IsEmpty()) {
-			PTextFile f(scriptFile, PFile::ReadOnly);
-			if (!f.IsOpen()) {
-				PTRACE(1, "LuaAuth\tCan't read LUA call script " << scriptFile);
-			} else {
-				PString line;
-				while (f.ReadLine(line)) {
-					m_callScript += (line + "\n");
-				}
-			}
-		}
-	}
+	m_registrationScript.SetScript(ReadScript("LuaAuth", "RegistrationScript", "RegistrationScriptFile"), "LuaAuth");
+	m_callScript.SetScript(ReadScript("LuaAuth", "CallScript", "CallScriptFile"), "LuaAuth");
 
 	if (m_registrationScript.IsEmpty() && m_callScript.IsEmpty()) {
 		PTRACE(2, "LuaAuth\tno LUA script");
@@ -647,12 +755,11 @@ int LuaAuth::doRegistrationCheck(
 		const PString & message
 		)
 {
-	lua_State * lua = NULL;
-    InitLua(&lua);
+	lua_State * lua = m_registrationScript.Acquire();
 
     if (!lua || m_registrationScript.IsEmpty()) {
 		PTRACE(1, "LuaAuth\tError: LUA not configured");
-        ShutdownLua(&lua);
+        m_registrationScript.Release(lua);
 		return e_fail;
     }
 
@@ -663,8 +770,8 @@ int LuaAuth::doRegistrationCheck(
 	SetString(lua, "message", message);
 	SetString(lua, "result", "FAIL");
 
-	if (!RunLua(lua, m_registrationScript)) {
-        ShutdownLua(&lua);
+	if (!m_registrationScript.Run(lua)) {
+        m_registrationScript.Release(lua);
 		return e_fail;
 	}
 
@@ -676,7 +783,7 @@ int LuaAuth::doRegistrationCheck(
 		resultCode = e_next;
 	}
 
-    ShutdownLua(&lua);
+    m_registrationScript.Release(lua);
     return resultCode;
 }
 
@@ -693,12 +800,11 @@ int LuaAuth::doCallCheck(
 		const PString & vendor
 		)
 {
-	lua_State * lua = NULL;
-    InitLua(&lua);
+	lua_State * lua = m_callScript.Acquire();
 
     if (!lua || m_callScript.IsEmpty()) {
 		PTRACE(1, "LuaAuth\tError: LUA not configured");
-        ShutdownLua(&lua);
+        m_callScript.Release(lua);
 		return e_fail;
     }
 
@@ -714,8 +820,8 @@ int LuaAuth::doCallCheck(
 	SetString(lua, "vendor", vendor);
 	SetString(lua, "result", "FAIL");
 
-	if (!RunLua(lua, m_callScript)) {
-        ShutdownLua(&lua);
+	if (!m_callScript.Run(lua)) {
+        m_callScript.Release(lua);
 		return e_fail;
 	}
 
@@ -727,7 +833,7 @@ int LuaAuth::doCallCheck(
 		resultCode = e_next;
 	}
 
-    ShutdownLua(&lua);
+    m_callScript.Release(lua);
     return resultCode;
 }
 
@@ -768,27 +874,13 @@ private:
 
 protected:
 	// script to run
-	PString m_script;
+	LuaScript m_script;
 };
 
 LuaPasswordAuth::LuaPasswordAuth(const char* authName)
 	: SimplePasswordAuth(authName)
 {
-	m_script = GkConfig()->GetString("LuaPasswordAuth", "Script", "");
-	if (m_script.IsEmpty()) {
-		PString scriptFile = GkConfig()->GetString("LuaPasswordAuth", "ScriptFile", "");
-		if (!scriptFile.IsEmpty()) {
-			PTextFile f(scriptFile, PFile::ReadOnly);
-			if (!f.IsOpen()) {
-				PTRACE(1, "LuaPasswordAuth\tCan't read LUA call script " << scriptFile);
-			} else {
-				PString line;
-				while (f.ReadLine(line)) {
-					m_script += (line + "\n");
-				}
-			}
-		}
-	}
+	m_script.SetScript(ReadScript("LuaPasswordAuth", "Script", "ScriptFile"), "LuaPasswordAuth");
 
 	if (m_script.IsEmpty()) {
 		PTRACE(2, "LuaPasswordAuth\tno LUA script");
@@ -803,12 +895,11 @@ LuaPasswordAuth::~LuaPasswordAuth()
 
 bool LuaPasswordAuth::GetPassword(const PString & alias, PString & password, std::map<PString, PString> & params)
 {
-	lua_State * lua = NULL;
-    InitLua(&lua);
+	lua_State * lua = m_script.Acquire();
 
     if (!lua || m_script.IsEmpty()) {
 		PTRACE(1, "LuaPasswordAuth\tError: LUA not configured");
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return false;
     }
 
@@ -817,13 +908,13 @@ bool LuaPasswordAuth::GetPassword(const PString & alias, PString & password, std
 	SetString(lua, "password", "");
 	// TODO: add other parameters from param
 
-	if (!RunLua(lua, m_script)) {
-        ShutdownLua(&lua);
+	if (!m_script.Run(lua)) {
+        m_script.Release(lua);
 		return false;
 	}
 
 	password = GetString(lua, "password");
-    ShutdownLua(&lua);
+    m_script.Release(lua);
 	return true;
 }
 
@@ -867,7 +958,7 @@ private:
 
 protected:
 	/// script to run
-	PString m_script;
+	LuaScript m_script;
 	/// timestamp formatting string
 	PString m_timestampFormat;
 };
@@ -881,21 +972,7 @@ LuaAcct::LuaAcct(const char* moduleName, const char* cfgSecName)
 	SetSupportedEvents(StatusAcctEvents);
 
 	m_timestampFormat = GkConfig()->GetString("LuaAcct", "TimestampFormat", "");
-	m_script = GkConfig()->GetString("LuaAcct", "Script", "");
-	if (m_script.IsEmpty()) {
-		PString scriptFile = GkConfig()->GetString("LuaAcct", "ScriptFile", "");
-		if (!scriptFile.IsEmpty()) {
-			PTextFile f(scriptFile, PFile::ReadOnly);
-			if (!f.IsOpen()) {
-				PTRACE(1, "LUA\tCan't read LUA script " << scriptFile);
-			} else {
-				PString line;
-				while (f.ReadLine(line)) {
-					m_script += (line + "\n");
-				}
-			}
-		}
-	}
+	m_script.SetScript(ReadScript("LuaAcct", "Script", "ScriptFile"), GetName());
 
 	if (m_script.IsEmpty()) {
 		PTRACE(2, GetName() << "\tmodule creation failed: no LUA script");
@@ -915,18 +992,17 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const callptr & c
 	if ((evt & GetEnabledEvents() & GetSupportedEvents()) == 0)
 		return Next;
 
-	lua_State * lua = NULL;
-    InitLua(&lua);
+	lua_State * lua = m_script.Acquire();
 
     if (!lua || m_script.IsEmpty()) {
 		PTRACE(1, GetName() + "\tError: LUA not configured");
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return Fail;
     }
 
 	if (!call && evt != AcctOn && evt != AcctOff) {
 		PTRACE(1, GetName() << "\tMissing call info for event " << evt);
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return Fail;
 	}
 
@@ -968,7 +1044,7 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const callptr & c
 	SetString(lua, "result", "OK");
 	if (!lua_checkstack(lua, params.size())) {
         PTRACE(1, "LuaAcct\tError: Not enough room on stack");
-        ShutdownLua(&lua);
+        m_script.Release(lua);
         return Fail;
 	}
     for(std::map<PString, PString>::const_iterator it = params.begin(); it != params.end(); ++it) {
@@ -977,8 +1053,8 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const callptr & c
         SetString(lua, varName, PString(it->second));
     }
 
-	if (!RunLua(lua, m_script)) {
-        ShutdownLua(&lua);
+	if (!m_script.Run(lua)) {
+        m_script.Release(lua);
 		return Fail;
 	}
 
@@ -990,7 +1066,7 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const callptr & c
 		resultCode = Next;
 	}
 
-    ShutdownLua(&lua);
+    m_script.Release(lua);
 	return resultCode;
 }
 
@@ -1001,18 +1077,17 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 	if ((evt & GetEnabledEvents() & GetSupportedEvents()) == 0)
 		return Next;
 
-	lua_State * lua = NULL;
-    InitLua(&lua);
+	lua_State * lua = m_script.Acquire();
 
     if (!lua || m_script.IsEmpty()) {
 		PTRACE(1, GetName() + "\tError: LUA not configured");
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return Fail;
     }
 
 	if (!ep) {
 		PTRACE(1, GetName() << "\tMissing endpoint info for event " << evt);
-        ShutdownLua(&lua);
+        m_script.Release(lua);
 		return Fail;
 	}
 
@@ -1035,7 +1110,7 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 	SetString(lua, "result", "OK");
 	if (!lua_checkstack(lua, params.size())) {
         PTRACE(1, "LuaAcct\tError: Not enough room on stack");
-        ShutdownLua(&lua);
+        m_script.Release(lua);
         return Fail;
 	}
     for(std::map<PString, PString>::const_iterator it = params.begin(); it != params.end(); ++it) {
@@ -1044,8 +1119,8 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
         SetString(lua, varName, PString(it->second));
     }
 
-	if (!RunLua(lua, m_script)) {
-        ShutdownLua(&lua);
+	if (!m_script.Run(lua)) {
+        m_script.Release(lua);
 		return Fail;
 	}
 
@@ -1057,7 +1132,7 @@ GkAcctLogger::Status LuaAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 		resultCode = Next;
 	}
 
-    ShutdownLua(&lua);
+    m_script.Release(lua);
 	return resultCode;
 }
 
@@ -0,0 +1,354 @@
+/*
+ * metrics.cxx
+ *
+ * Counters, gauges and histograms for the metrics exporter
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#include "config.h"
+#include <ptlib.h>
+#include <q931.h>
+#include "gk_const.h"
+#include "Toolkit.h"
+#include "RasPDU.h"
+#include "RasTbl.h"
+#include "RasSrv.h"
+#include "metrics.h"
+
+namespace {
+
+#if !defined(__GNUC__) && !defined(_WIN32)
+PMutex MetricMutex;
+#endif
+
+/// Q.931 message types with their own counter, all others are counted as "other"
+const struct {
+	unsigned m_type;
+	const char * m_name;
+} Q931MessageTypes[] = {
+	{ Q931::AlertingMsg, "Alerting" },
+	{ Q931::CallProceedingMsg, "CallProceeding" },
+	{ Q931::ConnectMsg, "Connect" },
+	{ Q931::ConnectAckMsg, "ConnectAck" },
+	{ Q931::ProgressMsg, "Progress" },
+	{ Q931::SetupMsg, "Setup" },
+	{ Q931::SetupAckMsg, "SetupAck" },
+	{ Q931::UserInformationMsg, "UserInformation" },
+	{ Q931::DisconnectMsg, "Disconnect" },
+	{ Q931::ReleaseMsg, "Release" },
+	{ Q931::ReleaseCompleteMsg, "ReleaseComplete" },
+	{ Q931::InformationMsg, "Information" },
+	{ Q931::NotifyMsg, "Notify" },
+	{ Q931::StatusMsg, "Status" },
+	{ Q931::StatusEnquiryMsg, "StatusEnquiry" },
+	{ Q931::FacilityMsg, "Facility" }
+};
+
+/// answer a single HTTP request with the metrics and close the connection
+class MetricsClient : public ServerSocket {
+#ifndef LARGE_FDSET
+	PCLASSINFO ( MetricsClient, ServerSocket )
+#endif
+public:
+	MetricsClient() { SetReadTimeout(5000); SetWriteTimeout(5000); }
+
+	// override from class ServerSocket
+	virtual void Dispatch();
+};
+
+void MetricsClient::Dispatch()
+{
+	// read the request header, the body (if any) is ignored
+	PString request;
+	char buf[1024];
+	while (request.Find("\r\n\r\n") == P_MAX_INDEX && request.Find("\n\n") == P_MAX_INDEX
+			&& request.GetLength() < 8192) {
+		if (!Read(buf, sizeof(buf)) || GetLastReadCount() <= 0)
+			break;
+		request += PString(buf, GetLastReadCount());
+	}
+
+	const PStringArray requestLine = request.Left(request.Find('\n')).Trim().Tokenise(" ", FALSE);
+	PString status = "200 OK";
+	PString body;
+	if (requestLine.GetSize() < 2 || requestLine[0] != "GET") {
+		status = "405 Method Not Allowed";
+	} else if (requestLine[1] == "/metrics" || requestLine[1] == "/") {
+		body = Metrics::Instance()->PrintMetrics();
+	} else {
+		status = "404 Not Found";
+	}
+	PTRACE(5, "METRICS\tRequest from " << GetName() << ": " << status);
+
+	const PString response = "HTTP/1.0 " + status + "\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: " + PString(body.GetLength()) + "\r\n"
+		"Connection: close\r\n\r\n" + body;
+	Write((const char *)response, response.GetLength());
+	Close();
+	delete this;
+}
+
+} // end of anonymous namespace
+
+
+PInt64 MetricValue::Get() const
+{
+#if defined(__GNUC__)
+	return __sync_add_and_fetch(const_cast<volatile PInt64 *>(&m_value), 0);
+#elif defined(_WIN32)
+	return InterlockedCompareExchange64(const_cast<volatile PInt64 *>(&m_value), 0, 0);
+#else
+	PWaitAndSignal lock(MetricMutex);
+	return m_value;
+#endif
+}
+
+void MetricValue::Add(PInt64 n)
+{
+#if defined(__GNUC__)
+	__sync_add_and_fetch(&m_value, n);
+#elif defined(_WIN32)
+	InterlockedExchangeAdd64(&m_value, n);
+#else
+	PWaitAndSignal lock(MetricMutex);
+	m_value += n;
+#endif
+}
+
+void MetricValue::Store(PInt64 n)
+{
+#if defined(__GNUC__)
+	__sync_lock_test_and_set(&m_value, n);
+#elif defined(_WIN32)
+	InterlockedExchange64(&m_value, n);
+#else
+	PWaitAndSignal lock(MetricMutex);
+	m_value = n;
+#endif
+}
+
+void MetricValue::PrintOn(PStringStream & strm, const PString & name, const PString & labels) const
+{
+	strm << name;
+	if (!labels)
+		strm << '{' << labels << '}';
+	strm << ' ' << Get() << '\n';
+}
+
+const long MetricHistogram::BucketLimits[MetricHistogram::NumBuckets - 1] = {
+	1, 5, 10, 50, 100, 500, 1000, 5000
+};
+
+void MetricHistogram::Observe(PInt64 ms)
+{
+	unsigned bucket = 0;
+	while (bucket < NumBuckets - 1 && ms > BucketLimits[bucket])
+		++bucket;
+	m_buckets[bucket].Inc();
+	m_sum.Inc(ms);
+}
+
+void MetricHistogram::PrintOn(PStringStream & strm, const PString & name, const PString & labels) const
+{
+	const PString prefix = labels.IsEmpty() ? PString("{") : ("{" + labels + ",");
+	PInt64 count = 0;
+	for (unsigned i = 0; i < NumBuckets; ++i) {
+		count += m_buckets[i].Get();
+		strm << name << "_bucket" << prefix << "le=\"";
+		if (i < NumBuckets - 1)
+			strm << BucketLimits[i];
+		else
+			strm << "+Inf";
+		strm << "\"} " << count << '\n';
+	}
+	m_sum.PrintOn(strm, name + "_sum", labels);
+	strm << name << "_count";
+	if (!labels)
+		strm << '{' << labels << '}';
+	strm << ' ' << count << '\n';
+}
+
+
+Metrics::Metrics() : Singleton<Metrics>("Metrics"), m_listener(NULL), m_listenPort(0)
+{
+	for (unsigned tag = 0; tag <= MaxRasTag + 1; ++tag) {
+		const PString labels = PString("type=\"") + RasName[tag] + "\"";
+		m_rasMessages.push_back(GetCounter("gnugk_ras_messages_total", "RAS messages received", labels));
+		m_rasProcessing.push_back(GetHistogram("gnugk_ras_processing_milliseconds", "Time to process a RAS request", labels));
+	}
+	m_rasDropped = GetCounter("gnugk_ras_dropped_total", "RAS messages dropped as duplicate, invalid or unexpected");
+
+	MetricCounter * other = GetCounter("gnugk_q931_messages_total", "Q.931 messages received", "type=\"other\"");
+	m_q931Messages.resize(256, other);
+	for (unsigned i = 0; i < PARRAYSIZE(Q931MessageTypes); ++i)
+		m_q931Messages[Q931MessageTypes[i].m_type & 0xff] = GetCounter("gnugk_q931_messages_total",
+			"Q.931 messages received", PString("type=\"") + Q931MessageTypes[i].m_name + "\"");
+
+	m_rtpDropped = GetCounter("gnugk_rtp_dropped_total", "RTP and RTCP packets dropped by the proxy");
+}
+
+Metrics::~Metrics()
+{
+	// the listener belongs to the TCP server
+	PWaitAndSignal lock(m_mutex);
+	for (std::map<PString, Family>::iterator f = m_families.begin(); f != m_families.end(); ++f)
+		for (std::map<PString, Metric *>::iterator m = f->second.m_metrics.begin(); m != f->second.m_metrics.end(); ++m)
+			delete m->second;
+	m_families.clear();
+}
+
+Metric * Metrics::GetMetric(const char * name, const char * help, const PString & labels, MetricType type)
+{
+	PWaitAndSignal lock(m_mutex);
+	std::map<PString, Family>::iterator f = m_families.find(name);
+	if (f == m_families.end()) {
+		f = m_families.insert(std::make_pair(PString(name), Family())).first;
+		f->second.m_help = help;
+		f->second.m_type = type;
+	} else if (f->second.m_type != type) {
+		PTRACE(1, "METRICS\tError: " << name << " is used with different types");
+		return NULL;
+	}
+	Metric * & metric = f->second.m_metrics[labels];
+	if (metric == NULL) {
+		switch (type) {
+		case Counter:
+			metric = new MetricCounter();
+			break;
+		case Gauge:
+			metric = new MetricGauge();
+			break;
+		case Histogram:
+			metric = new MetricHistogram();
+			break;
+		}
+	}
+	return metric;
+}
+
+MetricCounter * Metrics::GetCounter(const char * name, const char * help, const PString & labels)
+{
+	return static_cast<MetricCounter *>(GetMetric(name, help, labels, Counter));
+}
+
+MetricGauge * Metrics::GetGauge(const char * name, const char * help, const PString & labels)
+{
+	return static_cast<MetricGauge *>(GetMetric(name, help, labels, Gauge));
+}
+
+MetricHistogram * Metrics::GetHistogram(const char * name, const char * help, const PString & labels)
+{
+	return static_cast<MetricHistogram *>(GetMetric(name, help, labels, Histogram));
+}
+
+void Metrics::OnRasMessage(unsigned tag)
+{
+	m_rasMessages[(tag <= MaxRasTag) ? tag : MaxRasTag + 1]->Inc();
+}
+
+void Metrics::OnRasProcessed(unsigned tag, PInt64 ms)
+{
+	m_rasProcessing[(tag <= MaxRasTag) ? tag : MaxRasTag + 1]->Observe(ms);
+}
+
+void Metrics::OnQ931Message(unsigned type)
+{
+	m_q931Messages[type & 0xff]->Inc();
+}
+
+PString Metrics::PrintMetrics() const
+{
+	PStringStream strm;
+
+	// table sizes are kept in plain counters, no need to lock the tables
+	strm << "# HELP gnugk_registrations Registered endpoints\n"
+		"# TYPE gnugk_registrations gauge\n"
+		"gnugk_registrations " << RegistrationTable::Instance()->Size() << '\n'
+		<< "# HELP gnugk_calls Current calls\n"
+		"# TYPE gnugk_calls gauge\n"
+		"gnugk_calls " << CallTable::Instance()->Size() << '\n'
+		<< "# HELP gnugk_calls_total Calls since startup\n"
+		"# TYPE gnugk_calls_total counter\n"
+		"gnugk_calls_total " << CallTable::Instance()->TotalCallCount() << '\n'
+		<< "# HELP gnugk_successful_calls_total Connected calls since startup\n"
+		"# TYPE gnugk_successful_calls_total counter\n"
+		"gnugk_successful_calls_total " << CallTable::Instance()->SuccessfulCallCount() << '\n'
+		<< "# HELP gnugk_ras_pending_requests RAS requests waiting for or being processed by a job\n"
+		"# TYPE gnugk_ras_pending_requests gauge\n"
+		"gnugk_ras_pending_requests " << RasServer::Instance()->GetPendingRequests() << '\n';
+
+	// the RTP handlers count their own traffic, so the packet path doesn't share a counter
+	PUInt64 rtpPackets = 0, rtpBytes = 0;
+	if (RasServer::Instance()->GetRtpStatistics(rtpPackets, rtpBytes))
+		strm << "# HELP gnugk_rtp_packets_total RTP and RTCP packets received by the proxy\n"
+			"# TYPE gnugk_rtp_packets_total counter\n"
+			"gnugk_rtp_packets_total " << rtpPackets << '\n'
+			<< "# HELP gnugk_rtp_bytes_total RTP and RTCP bytes received by the proxy\n"
+			"# TYPE gnugk_rtp_bytes_total counter\n"
+			"gnugk_rtp_bytes_total " << rtpBytes << '\n';
+
+	static const char * const TypeNames[] = { "counter", "gauge", "histogram" };
+	PWaitAndSignal lock(m_mutex);
+	for (std::map<PString, Family>::const_iterator f = m_families.begin(); f != m_families.end(); ++f) {
+		strm << "# HELP " << f->first << ' ' << f->second.m_help << '\n'
+			<< "# TYPE " << f->first << ' ' << TypeNames[f->second.m_type] << '\n';
+		for (std::map<PString, Metric *>::const_iterator m = f->second.m_metrics.begin(); m != f->second.m_metrics.end(); ++m)
+			m->second->PrintOn(strm, f->first, m->first);
+	}
+	return strm;
+}
+
+void Metrics::LoadConfig()
+{
+	const WORD port = (WORD)GkConfig()->GetInteger(MetricsSection, "HttpPort", 0);
+	const PIPSocket::Address addr(GkConfig()->GetString(MetricsSection, "HttpInterface", "127.0.0.1"));
+
+	PWaitAndSignal lock(m_mutex);
+	if (m_listener && port == m_listenPort && addr == m_listenAddr)
+		return;
+
+	if (m_listener) {
+		PTRACE(2, "METRICS\tClosing HTTP listener on " << AsString(m_listenAddr, m_listenPort));
+		RasServer::Instance()->CloseListener(m_listener);
+		m_listener = NULL;
+	}
+	m_listenPort = port;
+	m_listenAddr = addr;
+	if (port > 0) {
+		// RasServer deletes the listener if it couldn't be opened
+		MetricsListener * listener = new MetricsListener(addr, port);
+		if (listener->IsOpen()) {
+			PTRACE(2, "METRICS\tHTTP listener on " << AsString(addr, port));
+			m_listener = listener;
+		}
+		RasServer::Instance()->AddListener(listener);
+	}
+}
+
+
+MetricsListener::MetricsListener(const Address & addr, WORD port)
+{
+	const unsigned queueSize = GkConfig()->GetInteger("ListenQueueLength", GK_DEF_LISTEN_QUEUE_LENGTH);
+	if (!Listen(addr, queueSize, port, PSocket::CanReuseAddress)) {
+		PTRACE(1, "METRICS\tCould not open listening socket at " << AsString(addr, port)
+			<< " - error " << GetErrorCode(PSocket::LastGeneralError) << '/'
+			<< GetErrorNumber(PSocket::LastGeneralError) << ": "
+			<< GetErrorText(PSocket::LastGeneralError)
+			);
+		Close();
+	}
+	SetName(AsString(addr, GetPort()) + "(Metrics)");
+}
+
+ServerSocket * MetricsListener::CreateAcceptor() const
+{
+	return new MetricsClient();
+}
@@ -0,0 +1,172 @@
+/*
+ * metrics.h
+ *
+ * Counters, gauges and histograms for the metrics exporter
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H "@(#) $Id$"
+
+#include <map>
+#include <vector>
+#include "singleton.h"
+#include "yasocket.h"
+
+const char * const MetricsSection = "Metrics";
+
+/// base class for all metrics
+class Metric {
+public:
+	virtual ~Metric() { }
+
+	/// print the samples of this metric in the Prometheus text format
+	virtual void PrintOn(
+		PStringStream & strm,
+		const PString & name,
+		const PString & labels /// labels without braces, may be empty
+		) const = 0;
+};
+
+/// a value that is updated atomically, without locking
+class MetricValue : public Metric {
+public:
+	MetricValue() : m_value(0) { }
+
+	PInt64 Get() const;
+
+	// override from class Metric
+	virtual void PrintOn(PStringStream & strm, const PString & name, const PString & labels) const;
+
+protected:
+	void Add(PInt64 n);
+	void Store(PInt64 n);
+
+private:
+	volatile PInt64 m_value;
+};
+
+/// a value that only goes up, eg. the number of received messages
+class MetricCounter : public MetricValue {
+public:
+	void Inc(PInt64 n = 1) { Add(n); }
+};
+
+/// a value that goes up and down, eg. the number of busy threads
+class MetricGauge : public MetricValue {
+public:
+	void Inc(PInt64 n = 1) { Add(n); }
+	void Dec(PInt64 n = 1) { Add(-n); }
+	void Set(PInt64 n) { Store(n); }
+};
+
+/// distribution of durations in milliseconds
+class MetricHistogram : public Metric {
+public:
+	enum { NumBuckets = 9 };
+
+	/// add a sample
+	void Observe(PInt64 ms);
+
+	// override from class Metric
+	virtual void PrintOn(PStringStream & strm, const PString & name, const PString & labels) const;
+
+	/// upper bounds of the buckets, the last bucket has no limit
+	static const long BucketLimits[NumBuckets - 1];
+
+private:
+	MetricCounter m_buckets[NumBuckets]; /// samples in each bucket, not cumulative
+	MetricCounter m_sum; /// sum of all samples
+};
+
+class MetricsListener;
+
+/** Registry of all metrics, printed in the Prometheus text format
+    on the HTTP port configured in the [Metrics] section.
+
+    Metrics are created once and never deleted, so the hot paths keep the
+    pointers and update the values without taking any lock. The registry lock
+    is only held to create metrics and to print them.
+*/
+class Metrics : public Singleton<Metrics> {
+public:
+	Metrics();
+	virtual ~Metrics();
+
+	/** Get a metric or create it on first use.
+
+	    @return	pointer that stays valid until shutdown
+	*/
+	MetricCounter * GetCounter(
+		const char * name, /// metric name, eg. gnugk_ras_messages_total
+		const char * help, /// description for the HELP line
+		const PString & labels = PString::Empty() /// labels like type="RRQ"
+		);
+	MetricGauge * GetGauge(const char * name, const char * help, const PString & labels = PString::Empty());
+	MetricHistogram * GetHistogram(const char * name, const char * help, const PString & labels = PString::Empty());
+
+	/// count a received RAS message
+	void OnRasMessage(unsigned tag);
+	/// record the time it took to process a RAS request
+	void OnRasProcessed(unsigned tag, PInt64 ms);
+	/// count a RAS message that has been dropped (duplicate, invalid or unexpected)
+	void OnRasDropped() { m_rasDropped->Inc(); }
+	/// count a received Q.931 message
+	void OnQ931Message(unsigned type);
+	/// count an RTP or RTCP packet that has not been forwarded
+	void OnRTPDropped() { m_rtpDropped->Inc(); }
+
+	/// @return	all metrics in the Prometheus text format
+	PString PrintMetrics() const;
+
+	/// open, move or close the HTTP listener
+	void LoadConfig();
+
+private:
+	Metrics(const Metrics &);
+	Metrics & operator=(const Metrics &);
+
+	enum MetricType { Counter, Gauge, Histogram };
+
+	struct Family {
+		PString m_help;
+		MetricType m_type;
+		std::map<PString, Metric *> m_metrics; /// by labels
+	};
+
+	Metric * GetMetric(const char * name, const char * help, const PString & labels, MetricType type);
+
+	mutable PMutex m_mutex;
+	std::map<PString, Family> m_families; /// by name
+
+	std::vector<MetricCounter *> m_rasMessages; /// by RAS tag
+	std::vector<MetricHistogram *> m_rasProcessing; /// by RAS tag
+	MetricCounter * m_rasDropped;
+	std::vector<MetricCounter *> m_q931Messages; /// by Q.931 message type
+	MetricCounter * m_rtpDropped;
+
+	MetricsListener * m_listener;
+	PIPSocket::Address m_listenAddr;
+	WORD m_listenPort;
+};
+
+/// accept HTTP connections for the metrics
+class MetricsListener : public TCPListenSocket {
+#ifndef LARGE_FDSET
+	PCLASSINFO ( MetricsListener, TCPListenSocket )
+#endif
+public:
+	MetricsListener(const Address & addr, WORD port);
+
+	// override from class TCPListenSocket
+	virtual ServerSocket *CreateAcceptor() const;
+};
+
+#endif // METRICS_H
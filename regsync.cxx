@@ -0,0 +1,532 @@
+/*
+ * regsync.cxx
+ *
+ * Replication of the registration table between active-active gatekeepers
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#include "config.h"
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <ptlib.h>
+#include <h225.h>
+#include "gk_const.h"
+#include "h323util.h"
+#include "Toolkit.h"
+#include "stl_supp.h"
+#include "RasTbl.h"
+#include "RasSrv.h"
+#include "regsync.h"
+
+namespace {
+
+/// flags in an Update message
+const BYTE UpdateGateway = 0x01;
+
+/// changes queued for a peer before it gets a full update instead
+const size_t MaxQueuedChanges = 100000;
+
+/// send the buffered messages when this size is reached
+const PINDEX MaxBufferedBytes = 64 * 1024;
+
+/// read exactly len bytes
+bool ReadFully(TCPSocket & socket, BYTE * buf, PINDEX len)
+{
+	while (len > 0) {
+		if (!socket.Read(buf, len) || socket.GetLastReadCount() <= 0)
+			return false;
+		buf += socket.GetLastReadCount();
+		len -= socket.GetLastReadCount();
+	}
+	return true;
+}
+
+} // end of anonymous namespace
+
+
+/// sends the local registrations to one peer gatekeeper, reconnects when the connection is lost
+class RegSyncPeer : public RegularJob {
+public:
+	RegSyncPeer(const PIPSocket::Address & ip, WORD port, WORD listenPort, int keepAliveInterval, int retryInterval);
+
+	/// queue a change, dropped if the peer isn't connected (it gets a full update on connect)
+	void Enqueue(int type, const std::string & endpointId);
+
+	// override from class RegularJob
+	virtual void Stop();
+
+private:
+	// override from class RegularJob
+	virtual void Exec();
+	virtual void OnStop();
+
+	bool SendHello();
+	bool SendUpdates(bool idle);
+	bool AppendEndpoint(const endptr & ep);
+	bool AppendMessage(int type, const BYTE * data, PINDEX len);
+	bool Flush();
+
+	PIPSocket::Address m_ip;
+	WORD m_port;
+	WORD m_listenPort; /// sent in the hello, only informational
+	int m_keepAliveInterval;
+	int m_retryInterval;
+	TCPSocket * m_socket;
+	PBYTEArray m_buffer;
+	PINDEX m_bufferLen;
+
+	PMutex m_queueMutex;
+	std::deque<std::pair<int, std::string> > m_queue;
+	bool m_connected;
+	bool m_resync; /// send all endpoints instead of the queued changes
+};
+
+RegSyncPeer::RegSyncPeer(const PIPSocket::Address & ip, WORD port, WORD listenPort, int keepAliveInterval, int retryInterval)
+	: m_ip(ip), m_port(port), m_listenPort(listenPort), m_keepAliveInterval(keepAliveInterval), m_retryInterval(retryInterval),
+	m_socket(NULL), m_bufferLen(0), m_connected(false), m_resync(false)
+{
+	SetName("RegSync " + AsString(ip, port));
+	Execute();
+}
+
+void RegSyncPeer::Enqueue(int type, const std::string & endpointId)
+{
+	{
+		PWaitAndSignal lock(m_queueMutex);
+		if (!m_connected)
+			return;
+		if (m_queue.size() >= MaxQueuedChanges) {
+			if (!m_resync) {
+				PTRACE(2, "RegSync\tToo many changes queued for " << AsString(m_ip, m_port) << ", sending a full update");
+			}
+			m_resync = true;
+			m_queue.clear();
+		} else
+			m_queue.push_back(std::make_pair(type, endpointId));
+	}
+	Signal();
+}
+
+void RegSyncPeer::Stop()
+{
+	PWaitAndSignal lock(m_deletionPreventer);
+	RegularJob::Stop();
+	if (m_socket)
+		m_socket->Close();
+}
+
+void RegSyncPeer::OnStop()
+{
+	RegistrationSync::Instance()->OnPeerStopped();
+}
+
+void RegSyncPeer::Exec()
+{
+	TCPSocket * socket = new TCPSocket();
+	socket->SetPort(m_port);
+	socket->SetWriteTimeout(PTimeInterval(0, m_keepAliveInterval));
+	{
+		PWaitAndSignal lock(m_deletionPreventer);
+		m_socket = socket;
+	}
+
+	if (IsRunning() && socket->Connect(m_ip)) {
+		PTRACE(2, "RegSync\tConnected to " << AsString(m_ip, m_port));
+		{
+			PWaitAndSignal lock(m_queueMutex);
+			m_queue.clear();
+			m_connected = true;
+			m_resync = true;
+		}
+		bool ok = SendHello();
+		bool idle = false;
+		while (ok && IsRunning()) {
+			ok = SendUpdates(idle);
+			if (ok)
+				idle = !Wait(PTimeInterval(0, m_keepAliveInterval));
+		}
+		{
+			PWaitAndSignal lock(m_queueMutex);
+			m_connected = false;
+			m_queue.clear();
+		}
+		m_bufferLen = 0;
+		PTRACE(2, "RegSync\tConnection to " << AsString(m_ip, m_port) << " closed");
+	} else {
+		PTRACE(3, "RegSync\tCan't connect to " << AsString(m_ip, m_port));
+	}
+
+	{
+		PWaitAndSignal lock(m_deletionPreventer);
+		m_socket = NULL;
+	}
+	delete socket;
+
+	if (IsRunning())
+		Wait(PTimeInterval(0, m_retryInterval));
+}
+
+bool RegSyncPeer::SendHello()
+{
+	const PString & name = Toolkit::GKName();
+	PBYTEArray hello(3 + name.GetLength());
+	hello[0] = RegistrationSync::ProtocolVersion;
+	hello[1] = (BYTE)(m_listenPort >> 8);
+	hello[2] = (BYTE)m_listenPort;
+	memcpy(hello.GetPointer() + 3, (const char *)name, name.GetLength());
+	return AppendMessage(RegistrationSync::Hello, hello, hello.GetSize()) && Flush();
+}
+
+bool RegSyncPeer::SendUpdates(bool idle)
+{
+	std::deque<std::pair<int, std::string> > queue;
+	bool resync;
+	{
+		PWaitAndSignal lock(m_queueMutex);
+		queue.swap(m_queue);
+		resync = m_resync;
+		m_resync = false;
+	}
+
+	if (resync) {
+		// the changes queued so far are part of the full update
+		queue.clear();
+		if (!AppendMessage(RegistrationSync::Clear, NULL, 0))
+			return false;
+		std::vector<endptr> endpoints;
+		RegistrationTable::Instance()->GetEndpoints(endpoints);
+		for (std::vector<endptr>::const_iterator i = endpoints.begin(); i != endpoints.end(); ++i)
+			if (!AppendEndpoint(*i))
+				return false;
+		PTRACE(3, "RegSync\tSent " << endpoints.size() << " endpoints to " << AsString(m_ip, m_port));
+	}
+
+	for (std::deque<std::pair<int, std::string> >::const_iterator i = queue.begin(); i != queue.end(); ++i) {
+		if (i->first == RegistrationSync::Remove) {
+			if (!AppendMessage(RegistrationSync::Remove, (const BYTE *)i->second.c_str(), i->second.length()))
+				return false;
+		} else {
+			H225_EndpointIdentifier endpointId;
+			endpointId = PString(i->second.c_str());
+			// not found if the endpoint has been removed meanwhile, a Remove follows
+			endptr ep = RegistrationTable::Instance()->FindByEndpointId(endpointId);
+			if (ep && !AppendEndpoint(ep))
+				return false;
+		}
+	}
+
+	if (idle && m_bufferLen == 0 && !AppendMessage(RegistrationSync::KeepAlive, NULL, 0))
+		return false;
+	return Flush();
+}
+
+bool RegSyncPeer::AppendEndpoint(const endptr & ep)
+{
+	// these endpoints can only be reached through this gatekeeper
+	if (ep->IsPermanent() || ep->IsNATed() || ep->IsTraversalClient() || ep->UsesH46017())
+		return true;
+
+	H225_RasMessage ras;
+	if (!RegistrationTable::BuildRegistrationRequest(ep, ras))
+		return true;
+	PPER_Stream strm;
+	ras.Encode(strm);
+	strm.CompleteEncoding();
+	if (strm.GetSize() >= 0xffff)
+		return true;
+
+	PBYTEArray update(1 + strm.GetSize());
+	update[0] = ep->IsGateway() ? UpdateGateway : 0;
+	memcpy(update.GetPointer() + 1, strm.GetPointer(), strm.GetSize());
+	return AppendMessage(RegistrationSync::Update, update, update.GetSize());
+}
+
+bool RegSyncPeer::AppendMessage(int type, const BYTE * data, PINDEX len)
+{
+	if (m_bufferLen + 3 + len > m_buffer.GetSize())
+		m_buffer.SetSize(2 * (m_bufferLen + 3 + len));
+	BYTE * p = m_buffer.GetPointer() + m_bufferLen;
+	p[0] = (BYTE)type;
+	p[1] = (BYTE)(len >> 8);
+	p[2] = (BYTE)len;
+	if (len > 0)
+		memcpy(p + 3, data, len);
+	m_bufferLen += 3 + len;
+	return (m_bufferLen < MaxBufferedBytes) || Flush();
+}
+
+bool RegSyncPeer::Flush()
+{
+	if (m_bufferLen == 0)
+		return true;
+	const bool ok = m_socket->Write(m_buffer, m_bufferLen);
+	m_bufferLen = 0;
+	return ok;
+}
+
+
+/// receives the registrations of one peer gatekeeper
+class RegSyncClient : public ServerSocket {
+#ifndef LARGE_FDSET
+	PCLASSINFO ( RegSyncClient, ServerSocket )
+#endif
+public:
+	RegSyncClient() { }
+
+	// override from class ServerSocket
+	virtual void Dispatch();
+
+private:
+	void OnUpdate(const PString & peer, const PBYTEArray & payload, PINDEX len);
+};
+
+void RegSyncClient::Dispatch()
+{
+	PIPSocket::Address ip;
+	WORD port = 0;
+	GetPeerAddress(ip, port);
+	RegistrationSync * sync = RegistrationSync::Instance();
+	if (!sync->IsPeer(ip) || !sync->AddClient(this)) {
+		PTRACE(2, "RegSync\tConnection from " << AsString(ip, port) << " rejected");
+		Close();
+		delete this;
+		return;
+	}
+	SetReadTimeout(PTimeInterval(0, 3 * sync->GetKeepAliveInterval()));
+
+	// the endpoints are kept per connection, so a stale connection can't remove
+	// the endpoints received on a new connection from the same peer
+	const PString peer = AsString(ip, port);
+	bool hello = false;
+	BYTE header[3];
+	PBYTEArray payload;
+	while (ReadFully(*this, header, sizeof(header))) {
+		const PINDEX len = (header[1] << 8) | header[2];
+		if (len > 0 && !ReadFully(*this, payload.GetPointer(len), len))
+			break;
+		if (header[0] == RegistrationSync::Hello) {
+			if (len < 3 || payload[0] != RegistrationSync::ProtocolVersion) {
+				PTRACE(1, "RegSync\tUnsupported protocol version from " << peer);
+				break;
+			}
+			hello = true;
+			PTRACE(2, "RegSync\tConnection from " << PString((const char *)(const BYTE *)payload + 3, len - 3)
+				<< " at " << AsString(ip, (WORD)((payload[1] << 8) | payload[2])));
+		} else if (!hello) {
+			PTRACE(1, "RegSync\tNo hello from " << peer);
+			break;
+		} else if (header[0] == RegistrationSync::Clear) {
+			RegistrationTable::Instance()->ClearRemote(peer);
+		} else if (header[0] == RegistrationSync::Update) {
+			OnUpdate(peer, payload, len);
+		} else if (header[0] == RegistrationSync::Remove) {
+			RegistrationTable::Instance()->RemoveRemote(peer, PString((const char *)(const BYTE *)payload, len));
+		}
+		// KeepAlive and unknown messages are ignored
+	}
+
+	PTRACE(2, "RegSync\tConnection from " << peer << " closed");
+	RegistrationTable::Instance()->ClearRemote(peer);
+	Close();
+	// RegistrationSync::Stop waits for this, don't use it or the registration table afterwards
+	sync->RemoveClient(this);
+	delete this;
+}
+
+void RegSyncClient::OnUpdate(const PString & peer, const PBYTEArray & payload, PINDEX len)
+{
+	if (len < 2) {
+		PTRACE(1, "RegSync\tInvalid update from " << peer);
+		return;
+	}
+	H225_RasMessage ras;
+	PPER_Stream strm((const BYTE *)payload + 1, len - 1);
+	if (!ras.Decode(strm) || ras.GetTag() != H225_RasMessage::e_registrationRequest) {
+		PTRACE(1, "RegSync\tInvalid update from " << peer);
+		return;
+	}
+	const H225_RegistrationRequest & rrq = ras;
+	if (!rrq.HasOptionalField(H225_RegistrationRequest::e_endpointIdentifier)
+			|| rrq.m_callSignalAddress.GetSize() < 1) {
+		PTRACE(1, "RegSync\tIncomplete update from " << peer);
+		return;
+	}
+	EndpointRec * ep = (payload[0] & UpdateGateway) ? new GatewayRec(ras) : new EndpointRec(ras);
+	PTRACE(5, "RegSync\tEndpoint " << ep->GetEndpointIdentifier().GetValue() << " updated by " << peer);
+	RegistrationTable::Instance()->UpdateRemote(peer, ep);
+}
+
+
+RegistrationSync::RegistrationSync() : Singleton<RegistrationSync>("RegistrationSync"),
+	m_enabled(false), m_stopped(false), m_keepAliveInterval(10), m_retryInterval(10),
+	m_listener(NULL), m_listenPort(0), m_peerJobs(0)
+{
+}
+
+RegistrationSync::~RegistrationSync()
+{
+	Stop();
+}
+
+void RegistrationSync::OnEndpointUpdated(const EndpointRec * ep)
+{
+	if (m_enabled)
+		Enqueue(Update, ep);
+}
+
+void RegistrationSync::OnEndpointRemoved(const EndpointRec * ep)
+{
+	if (m_enabled)
+		Enqueue(Remove, ep);
+}
+
+void RegistrationSync::Enqueue(MessageType type, const EndpointRec * ep)
+{
+	const std::string endpointId = (const char *)ep->GetEndpointIdentifier().GetValue();
+	PWaitAndSignal lock(m_mutex);
+	for (std::list<RegSyncPeer *>::iterator i = m_peers.begin(); i != m_peers.end(); ++i)
+		(*i)->Enqueue(type, endpointId);
+}
+
+void RegistrationSync::LoadConfig()
+{
+	const WORD port = (WORD)GkConfig()->GetInteger(RegistrationSyncSection, "Port", 0);
+	const PString iface = GkConfig()->GetString(RegistrationSyncSection, "Interface", "");
+	const PIPSocket::Address addr = iface.IsEmpty() ? GNUGK_INADDR_ANY : PIPSocket::Address(iface);
+	const PString peers = GkConfig()->GetString(RegistrationSyncSection, "Peers", "");
+
+	PWaitAndSignal lock(m_mutex);
+	if (m_stopped)
+		return;
+	m_keepAliveInterval = std::max(1, GkConfig()->GetInteger(RegistrationSyncSection, "KeepAliveInterval", 10));
+	m_retryInterval = std::max(1, GkConfig()->GetInteger(RegistrationSyncSection, "RetryInterval", 10));
+
+	if (!(m_listener && port == m_listenPort && addr == m_listenAddr)) {
+		if (m_listener) {
+			PTRACE(2, "RegSync\tClosing listener on " << AsString(m_listenAddr, m_listenPort));
+			RasServer::Instance()->CloseListener(m_listener);
+			m_listener = NULL;
+		}
+		m_listenPort = port;
+		m_listenAddr = addr;
+		if (port > 0) {
+			// RasServer deletes the listener if it couldn't be opened
+			RegSyncListener * listener = new RegSyncListener(addr, port);
+			if (listener->IsOpen()) {
+				PTRACE(2, "RegSync\tListening on " << AsString(addr, port));
+				m_listener = listener;
+			}
+			RasServer::Instance()->AddListener(listener);
+		}
+	}
+
+	// reconnect to all peers when the list changes
+	if (peers != m_peersConfig) {
+		ForEachInContainer(m_peers, mem_vfun(&RegSyncPeer::Stop));
+		m_peers.clear();
+		m_peerIPs.clear();
+		m_peersConfig = peers;
+		const PStringArray peerList = peers.Tokenise(" ,;\t", FALSE);
+		for (PINDEX i = 0; i < peerList.GetSize(); ++i) {
+			PIPSocket::Address peerIP;
+			WORD peerPort = 0;
+			if (!GetTransportAddress(peerList[i], port, peerIP, peerPort) || peerPort == 0) {
+				PTRACE(1, "RegSync\tInvalid peer " << peerList[i]);
+				continue;
+			}
+			m_peerIPs.push_back(peerIP);
+			{
+				PWaitAndSignal jobsLock(m_jobsMutex);
+				++m_peerJobs;
+			}
+			m_peers.push_back(new RegSyncPeer(peerIP, peerPort, m_listenPort, m_keepAliveInterval, m_retryInterval));
+		}
+	}
+	m_enabled = !m_peers.empty();
+}
+
+void RegistrationSync::Stop()
+{
+	{
+		PWaitAndSignal lock(m_mutex);
+		m_stopped = true;
+		m_enabled = false;
+		// the peer jobs delete themselves when stopped
+		ForEachInContainer(m_peers, mem_vfun(&RegSyncPeer::Stop));
+		m_peers.clear();
+		// the clients delete themselves when the connection is closed
+		for (std::list<RegSyncClient *>::iterator i = m_clients.begin(); i != m_clients.end(); ++i)
+			(*i)->Close();
+		if (m_listener && RasServer::InstanceExists())
+			RasServer::Instance()->CloseListener(m_listener);
+		m_listener = NULL;
+	}
+
+	// wait for the jobs, they use this object and the registration table,
+	// which are deleted after shutdown
+	while (true) {
+		{
+			PWaitAndSignal lock(m_mutex);
+			PWaitAndSignal jobsLock(m_jobsMutex);
+			if (m_clients.empty() && m_peerJobs == 0)
+				break;
+		}
+		PThread::Sleep(100);
+	}
+}
+
+void RegistrationSync::OnPeerStopped()
+{
+	PWaitAndSignal jobsLock(m_jobsMutex);
+	if (m_peerJobs > 0)
+		--m_peerJobs;
+}
+
+bool RegistrationSync::IsPeer(const PIPSocket::Address & ip) const
+{
+	PWaitAndSignal lock(m_mutex);
+	return find(m_peerIPs.begin(), m_peerIPs.end(), ip) != m_peerIPs.end();
+}
+
+bool RegistrationSync::AddClient(RegSyncClient * client)
+{
+	PWaitAndSignal lock(m_mutex);
+	if (m_stopped)
+		return false;
+	m_clients.push_back(client);
+	return true;
+}
+
+void RegistrationSync::RemoveClient(RegSyncClient * client)
+{
+	PWaitAndSignal lock(m_mutex);
+	m_clients.remove(client);
+}
+
+
+RegSyncListener::RegSyncListener(const Address & addr, WORD port)
+{
+	const unsigned queueSize = GkConfig()->GetInteger("ListenQueueLength", GK_DEF_LISTEN_QUEUE_LENGTH);
+	if (!Listen(addr, queueSize, port, PSocket::CanReuseAddress)) {
+		PTRACE(1, "RegSync\tCould not open listening socket at " << AsString(addr, port)
+			<< " - error " << GetErrorCode(PSocket::LastGeneralError) << '/'
+			<< GetErrorNumber(PSocket::LastGeneralError) << ": "
+			<< GetErrorText(PSocket::LastGeneralError)
+			);
+		Close();
+	}
+	SetName(AsString(addr, GetPort()) + "(RegSync)");
+}
+
+ServerSocket * RegSyncListener::CreateAcceptor() const
+{
+	return new RegSyncClient();
+}
@@ -0,0 +1,111 @@
+/*
+ * regsync.h
+ *
+ * Replication of the registration table between active-active gatekeepers
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#ifndef REGSYNC_H
+#define REGSYNC_H "@(#) $Id$"
+
+#include <list>
+#include "singleton.h"
+#include "yasocket.h"
+
+const char * const RegistrationSyncSection = "RegistrationSync";
+
+class EndpointRec;
+class RegSyncPeer;
+class RegSyncClient;
+class RegSyncListener;
+
+/** Streams the changes of the registration table to the configured peer
+    gatekeepers and keeps the endpoints received from the peers in the
+    remote index of the registration table, so calls to endpoints that are
+    registered on a peer can be routed without an LRQ.
+
+    Each node only sends its own registrations, remote endpoints are never
+    forwarded. Endpoints that can only be reached through their gatekeeper
+    (NATed, H.460.18 and H.460.17) and permanent endpoints aren't replicated.
+*/
+class RegistrationSync : public Singleton<RegistrationSync> {
+public:
+	/// message types on the replication connection
+	enum MessageType {
+		Hello = 1, /// version, listen port and name of the sending gatekeeper
+		Clear, /// drop all endpoints of the sending gatekeeper, a full update follows
+		Update, /// add or replace an endpoint: flags and PER encoded RRQ
+		Remove, /// remove an endpoint: endpoint ID
+		KeepAlive
+	};
+
+	enum { ProtocolVersion = 1 };
+
+	RegistrationSync();
+	virtual ~RegistrationSync();
+
+	/// called by the registration table with its lock held, only queues the change
+	void OnEndpointUpdated(const EndpointRec * ep);
+	void OnEndpointRemoved(const EndpointRec * ep);
+
+	/// open the listener and connect to the peers
+	void LoadConfig();
+	/// close all connections and wait until the connection jobs have ended, called on shutdown
+	void Stop();
+
+	/// @return	true if connections from this IP are accepted
+	bool IsPeer(const PIPSocket::Address & ip) const;
+	/// keep track of incoming connections, so they can be closed on shutdown
+	bool AddClient(RegSyncClient * client);
+	void RemoveClient(RegSyncClient * client);
+	/// called by a peer job when it ends
+	void OnPeerStopped();
+
+	/// @return	seconds between keep-alive messages
+	int GetKeepAliveInterval() const { return m_keepAliveInterval; }
+
+private:
+	RegistrationSync(const RegistrationSync &);
+	RegistrationSync & operator=(const RegistrationSync &);
+
+	void Enqueue(MessageType type, const EndpointRec * ep);
+
+	mutable PMutex m_mutex;
+	volatile bool m_enabled; /// quick check for the registration table hooks
+	bool m_stopped;
+	std::list<RegSyncPeer *> m_peers;
+	std::list<PIPSocket::Address> m_peerIPs;
+	std::list<RegSyncClient *> m_clients;
+	PString m_peersConfig;
+	int m_keepAliveInterval;
+	int m_retryInterval;
+
+	RegSyncListener * m_listener;
+	PIPSocket::Address m_listenAddr;
+	WORD m_listenPort;
+	/// peer jobs that haven't ended yet, protected by m_jobsMutex,
+	/// a separate mutex because the jobs end with their own lock held
+	unsigned m_peerJobs;
+	PMutex m_jobsMutex;
+};
+
+/// accept replication connections from peer gatekeepers
+class RegSyncListener : public TCPListenSocket {
+#ifndef LARGE_FDSET
+	PCLASSINFO ( RegSyncListener, TCPListenSocket )
+#endif
+public:
+	RegSyncListener(const Address & addr, WORD port);
+
+	// override from class TCPListenSocket
+	virtual ServerSocket *CreateAcceptor() const;
+};
+
+#endif // REGSYNC_H
@@ -0,0 +1,503 @@
+/*
+ * rtpbench.cxx
+ *
+ * RTP relay benchmark for the GNU Gatekeeper
+ *
+ * Creates RTP proxy handlers with N pairs of RTP/RTCP UDPProxySockets,
+ * sends synthetic RTP and RTCP through them over loopback and reports
+ * packets/sec, latency, added jitter and the load of each handler thread.
+ * Links the gatekeeper objects like the unit tests.
+ *
+ * Copyright (c) 2026, Jan Willamowius
+ *
+ * This work is published under the GNU Public License version 2 (GPLv2)
+ * see file COPYING for details.
+ * We also explicitly grant the right to link this code
+ * with the OpenH323/H323Plus and OpenSSL library.
+ *
+ */
+
+#include "config.h"
+#include <algorithm>
+#include <vector>
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptclib/random.h>
+#include <h245.h>
+#include "h323util.h"
+#include "Toolkit.h"
+#include "RasTbl.h"
+#include "ProxyChannel.h"
+#ifdef HAS_H235_MEDIA
+#include "h235/h235crypto.h"
+#endif
+
+// dummies to allow linking without gk.cxx
+const char * KnownConfigEntries[][2] = { };
+void ReloadHandler() { }
+
+namespace {
+
+const unsigned RTPHeaderLength = 12;
+const BYTE RTPPayloadTypePCMU = 0;
+
+enum BenchMode {
+	PlainMode,
+	MultiplexMode, /// H.460.19 multiplexed towards side B
+	H235Mode /// H.235.6 encryption towards side B
+};
+
+DWORD Now32()
+{
+	return (DWORD)PTime().GetTimestamp();
+}
+
+void SetUnicastAddress(H245_UnicastAddress & addr, const PIPSocket::Address & ip, WORD port)
+{
+	addr.SetTag(H245_UnicastAddress::e_iPAddress);
+	H245_UnicastAddress_iPAddress & ipAddr = addr;
+	ipAddr.m_network.SetSize(4);
+	for (PINDEX i = 0; i < 4; ++i)
+		ipAddr.m_network[i] = ip[i];
+	ipAddr.m_tsapIdentifier = port;
+}
+
+/// @return	the value of the sorted samples at the given fraction
+unsigned Percentile(const std::vector<unsigned> & samples, double p)
+{
+	if (samples.empty())
+		return 0;
+	size_t i = (size_t)(p * samples.size());
+	return samples[std::min(i, samples.size() - 1)];
+}
+
+} // end of anonymous namespace
+
+
+#ifdef HAS_H235_MEDIA
+/// encrypts RTP payloads from side A and decrypts those from side B like a H.235.6 media channel
+class H235BenchSocket : public UDPProxySocket {
+#ifndef LARGE_FDSET
+	PCLASSINFO( H235BenchSocket, UDPProxySocket )
+#endif
+public:
+	H235BenchSocket(const PBYTEArray & key, const Address & encryptFromIP, WORD encryptFromPort);
+
+	// override from class UDPProxySocket
+	virtual bool OnReceiveData(void *, PINDEX, Address &, WORD &);
+
+private:
+	H235CryptoEngine m_engine;
+	Address m_encryptFromIP;
+	WORD m_encryptFromPort;
+	PBYTEArray m_cryptoBuffer;
+};
+
+H235BenchSocket::H235BenchSocket(const PBYTEArray & key, const Address & encryptFromIP, WORD encryptFromPort)
+	: UDPProxySocket("RTP", 0), m_engine("2.16.840.1.101.3.4.1.2", key),	// AES-128
+	m_encryptFromIP(encryptFromIP), m_encryptFromPort(encryptFromPort)
+{
+}
+
+bool H235BenchSocket::OnReceiveData(void * data, PINDEX len, Address & fromIP, WORD & fromPort)
+{
+	if (len <= (PINDEX)RTPHeaderLength)
+		return true;
+	BYTE * buffer = (BYTE *)data;
+	BYTE * payload = buffer + RTPHeaderLength;
+	const PINDEX payloadLen = len - RTPHeaderLength;
+	unsigned char ivSequence[6];
+	memcpy(ivSequence, buffer + 2, 6);
+	bool rtpPadding = false;
+	const bool encrypt = (fromIP == m_encryptFromIP && fromPort == m_encryptFromPort);
+#ifdef HAS_H235_MEDIA_INPLACE
+	if (m_cryptoBuffer.GetSize() < payloadLen + 64)
+		m_cryptoBuffer.SetSize(payloadLen + 64);
+	const PINDEX processedLen = encrypt
+		? m_engine.EncryptInPlace(payload, payloadLen, m_cryptoBuffer.GetPointer(), ivSequence, rtpPadding)
+		: m_engine.DecryptInPlace(payload, payloadLen, m_cryptoBuffer.GetPointer(), ivSequence, rtpPadding);
+	const BYTE * processed = m_cryptoBuffer;
+#else
+	const PBYTEArray plain(payload, payloadLen, false);
+	const PBYTEArray processedData = encrypt ? m_engine.Encrypt(plain, ivSequence, rtpPadding)
+		: m_engine.Decrypt(plain, ivSequence, rtpPadding);
+	const PINDEX processedLen = processedData.GetSize();
+	const BYTE * processed = processedData;
+#endif
+	// the packet length can't change here, ciphertext stealing keeps it for payloads >= 16 bytes
+	memcpy(payload, processed, PMIN(processedLen, payloadLen));
+	return true;
+}
+#endif
+
+
+/// the packets received by one side
+struct DirectionStats {
+	DirectionStats() : m_sent(0), m_received(0), m_rtcpSent(0), m_rtcpReceived(0) { }
+
+	/// RFC 3550 interarrival jitter in microseconds
+	struct Session {
+		Session() : m_lastTransit(0), m_jitter(0), m_haveTransit(false) { }
+		int m_lastTransit;
+		double m_jitter;
+		bool m_haveTransit;
+	};
+
+	unsigned m_sent;
+	unsigned m_received;
+	unsigned m_rtcpSent;
+	unsigned m_rtcpReceived;
+	std::vector<unsigned> m_latencies; /// microseconds
+	std::vector<Session> m_sessions;
+};
+
+/// reads the packets arriving at one side
+class BenchReceiver : public PThread {
+	PCLASSINFO(BenchReceiver, PThread)
+public:
+	BenchReceiver(PUDPSocket & socket, DirectionStats & stats, bool isRTCP, bool multiplexed)
+		: PThread(10000, NoAutoDeleteThread, NormalPriority, isRTCP ? "RTCPReceiver" : "RTPReceiver"),
+		  m_socket(socket), m_stats(stats), m_isRTCP(isRTCP), m_multiplexed(multiplexed), m_running(true)
+	{
+		Resume();
+	}
+
+	void Stop() { m_running = false; }
+
+	virtual void Main();
+
+private:
+	PUDPSocket & m_socket;
+	DirectionStats & m_stats;
+	bool m_isRTCP;
+	bool m_multiplexed; /// packets start with a 4 byte multiplex ID
+	volatile bool m_running;
+};
+
+void BenchReceiver::Main()
+{
+	BYTE buffer[DEFAULT_PACKET_BUFFER_SIZE];
+	m_socket.SetReadTimeout(PTimeInterval(100));
+	while (m_running) {
+		if (!m_socket.Read(buffer, sizeof(buffer)))
+			continue;
+		const DWORD now = Now32();
+		PINDEX len = m_socket.GetLastReadCount();
+		const BYTE * packet = buffer;
+		if (m_multiplexed) {
+			if (len < 4)
+				continue;
+			packet += 4;
+			len -= 4;
+		}
+		if (m_isRTCP) {
+			++m_stats.m_rtcpReceived;
+			continue;
+		}
+		if (len < (PINDEX)RTPHeaderLength)
+			continue;
+		const DWORD sentTime = ((DWORD)packet[4] << 24) | ((DWORD)packet[5] << 16) | ((DWORD)packet[6] << 8) | packet[7];
+		const DWORD session = ((DWORD)packet[8] << 24) | ((DWORD)packet[9] << 16) | ((DWORD)packet[10] << 8) | packet[11];
+		if (session >= m_stats.m_sessions.size())
+			continue;
+		++m_stats.m_received;
+		// unsigned arithmetic handles the wrap around of the 32 bit timestamps
+		const int transit = (int)(now - sentTime);
+		m_stats.m_latencies.push_back((unsigned)PMAX(transit, 0));
+		DirectionStats::Session & s = m_stats.m_sessions[session];
+		if (s.m_haveTransit) {
+			const int d = transit - s.m_lastTransit;
+			s.m_jitter += ((d < 0 ? -d : d) - s.m_jitter) / 16;
+		}
+		s.m_lastTransit = transit;
+		s.m_haveTransit = true;
+	}
+}
+
+
+class RTPBench : public PProcess {
+	PCLASSINFO(RTPBench, PProcess)
+public:
+	RTPBench();
+
+	virtual void Main();
+
+private:
+	void Usage() const;
+	bool CreateSessions();
+	void Send(PUDPSocket & from, BYTE * packet, unsigned len, WORD toPort);
+	void Report(DirectionStats & stats, const char * direction, double seconds);
+
+	BenchMode m_mode;
+	unsigned m_numSessions;
+	unsigned m_numHandlers;
+	PIPSocket::Address m_ip;
+	bool m_bidirectional;
+
+	/// the endpoints on both sides share one socket per side for all sessions
+	PUDPSocket m_rtpA, m_rtcpA, m_rtpB, m_rtcpB;
+	/// the socket the proxy sends multiplexed media from
+	PUDPSocket m_multiplexSocket;
+	std::vector<ProxyHandler *> m_handlers;
+	std::vector<WORD> m_proxyPorts; /// RTP port of each session, RTCP uses the one in m_proxyRTCPPorts
+	std::vector<WORD> m_proxyRTCPPorts;
+};
+
+PCREATE_PROCESS(RTPBench)
+
+RTPBench::RTPBench() : PProcess("GNU", "rtpbench", 1, 0, ReleaseCode, 0),
+	m_mode(PlainMode), m_numSessions(100), m_numHandlers(1), m_bidirectional(true)
+{
+}
+
+void RTPBench::Usage() const
+{
+	cout << "Usage: rtpbench [options]\n"
+		"  -n --sessions n       number of RTP/RTCP socket pairs (default 100)\n"
+		"  -H --handlers n       number of RTP proxy handler threads (default 1)\n"
+		"  -r --rate pps         RTP packets per second per session and direction (default 50)\n"
+		"  -s --size bytes       RTP payload size (default 160)\n"
+		"  -d --duration s       test duration (default 10)\n"
+		"  -m --mode mode        plain, multiplex (H.460.19) or h235 (default plain)\n"
+		"  -u --unidirectional   only send from side A to side B\n"
+		"  -i --interface ip     loopback IP to use (default 127.0.0.1)\n"
+		"  -c --config file      gatekeeper config with [Proxy] settings\n"
+		"  -h --help\n"
+		"Without LARGE_FDSET each handler can only poll sockets below FD_SETSIZE.\n";
+}
+
+bool RTPBench::CreateSessions()
+{
+	if (!m_rtpA.Listen(m_ip, 0, 0) || !m_rtcpA.Listen(m_ip, 0, 0)
+		|| !m_rtpB.Listen(m_ip, 0, 0) || !m_rtcpB.Listen(m_ip, 0, 0)
+		|| !m_multiplexSocket.Listen(m_ip, 0, 0)) {
+		cerr << "Can't open endpoint sockets on " << m_ip << endl;
+		return false;
+	}
+	// the receivers must keep up with the traffic of all sessions
+	m_rtpA.SetOption(SO_RCVBUF, 8 * 1024 * 1024);
+	m_rtpB.SetOption(SO_RCVBUF, 8 * 1024 * 1024);
+
+	H245_UnicastAddress rtpA, rtcpA, rtpB, rtcpB;
+	SetUnicastAddress(rtpA, m_ip, m_rtpA.GetPort());
+	SetUnicastAddress(rtcpA, m_ip, m_rtcpA.GetPort());
+	SetUnicastAddress(rtpB, m_ip, m_rtpB.GetPort());
+	SetUnicastAddress(rtcpB, m_ip, m_rtcpB.GetPort());
+
+	PBYTEArray key(16);
+	PRandom::Octets(key.GetPointer(), key.GetSize());
+
+	for (unsigned i = 0; i < m_numHandlers; ++i)
+		m_handlers.push_back(new ProxyHandler(psprintf("RtpBench(%u)", i + 1)));
+
+	callptr noCall;
+	for (unsigned i = 0; i < m_numSessions; ++i) {
+		UDPProxySocket * rtp = NULL;
+#ifdef HAS_H235_MEDIA
+		if (m_mode == H235Mode)
+			rtp = new H235BenchSocket(key, m_ip, m_rtpA.GetPort());
+		else
+#endif
+			rtp = new UDPProxySocket("RTP", 0);
+		UDPProxySocket * rtcp = new UDPProxySocket("RTCP", 0);
+		if (!rtp->Bind(m_ip, 0) || !rtcp->Bind(m_ip, 0)) {
+			cerr << "Can't bind proxy sockets for session " << i << endl;
+			delete rtp;
+			delete rtcp;
+			return false;
+		}
+		rtp->SetForwardDestination(m_ip, m_rtpA.GetPort(), &rtpB, noCall);
+		rtp->SetReverseDestination(m_ip, m_rtpB.GetPort(), &rtpA, noCall);
+		rtcp->SetForwardDestination(m_ip, m_rtcpA.GetPort(), &rtcpB, noCall);
+		rtcp->SetReverseDestination(m_ip, m_rtcpB.GetPort(), &rtcpA, noCall);
+#ifdef HAS_H46018
+		if (m_mode == MultiplexMode) {
+			rtp->SetUsesH46019();
+			rtp->SetMultiplexDestination(IPAndPortAddress(m_ip, m_rtpB.GetPort()), SideB);
+			rtp->SetMultiplexID(2 * i + 1, SideB);
+			rtp->SetMultiplexSocket(m_multiplexSocket.GetHandle(), SideB);
+			rtcp->SetUsesH46019();
+			rtcp->SetMultiplexDestination(IPAndPortAddress(m_ip, m_rtcpB.GetPort()), SideB);
+			rtcp->SetMultiplexID(2 * i + 2, SideB);
+			rtcp->SetMultiplexSocket(m_multiplexSocket.GetHandle(), SideB);
+		}
+#endif
+		m_proxyPorts.push_back(rtp->GetPort());
+		m_proxyRTCPPorts.push_back(rtcp->GetPort());
+		m_handlers[i % m_numHandlers]->Insert(rtp, rtcp);
+	}
+	return true;
+}
+
+void RTPBench::Send(PUDPSocket & from, BYTE * packet, unsigned len, WORD toPort)
+{
+	// lost packets show up in the statistics of the receiver
+	from.WriteTo(packet, len, m_ip, toPort);
+}
+
+void RTPBench::Report(DirectionStats & stats, const char * direction, double seconds)
+{
+	std::sort(stats.m_latencies.begin(), stats.m_latencies.end());
+	double jitter = 0;
+	unsigned sessions = 0;
+	for (size_t i = 0; i < stats.m_sessions.size(); ++i)
+		if (stats.m_sessions[i].m_haveTransit) {
+			jitter += stats.m_sessions[i].m_jitter;
+			++sessions;
+		}
+	cout << setw(6) << direction << setw(10) << stats.m_sent << setw(10) << stats.m_received
+		<< setw(8) << (stats.m_sent - PMIN(stats.m_received, stats.m_sent))
+		<< setw(10) << (unsigned)(seconds > 0 ? stats.m_received / seconds : 0)
+		<< setw(9) << Percentile(stats.m_latencies, 0.5) << setw(9) << Percentile(stats.m_latencies, 0.9)
+		<< setw(9) << Percentile(stats.m_latencies, 0.99) << setw(9) << Percentile(stats.m_latencies, 1.0)
+		<< setw(11) << (unsigned)(sessions ? jitter / sessions : 0)
+		<< setw(7) << stats.m_rtcpSent << '/' << stats.m_rtcpReceived << '\n';
+}
+
+void RTPBench::Main()
+{
+	PArgList & args = GetArguments();
+	args.Parse("n-sessions:H-handlers:r-rate:s-size:d-duration:m-mode:u-unidirectional.i-interface:c-config:h-help.");
+	if (args.HasOption('h')) {
+		Usage();
+		return;
+	}
+	if (args.HasOption('c'))
+		Toolkit::Instance()->SetConfig(PFilePath(args.GetOptionString('c')), "Gatekeeper::Main");
+
+	m_numSessions = std::max(1U, (unsigned)args.GetOptionString('n', "100").AsUnsigned());
+	m_numHandlers = std::max(1U, (unsigned)args.GetOptionString('H', "1").AsUnsigned());
+	const unsigned rate = std::max(1U, (unsigned)args.GetOptionString('r', "50").AsUnsigned());
+	const unsigned payloadSize = std::min((unsigned)DEFAULT_PACKET_BUFFER_SIZE - RTPHeaderLength - 4,
+		(unsigned)args.GetOptionString('s', "160").AsUnsigned());
+	const unsigned duration = std::max(1U, (unsigned)args.GetOptionString('d', "10").AsUnsigned());
+	m_bidirectional = !args.HasOption('u');
+	m_ip = PIPSocket::Address(args.GetOptionString('i', "127.0.0.1"));
+
+	const PCaselessString mode = args.GetOptionString('m', "plain");
+	if (mode == "multiplex") {
+#ifdef HAS_H46018
+		m_mode = MultiplexMode;
+		// side B receives multiplexed media, but doesn't send it
+		m_bidirectional = false;
+#else
+		cerr << "Multiplex mode needs H.460.18 support" << endl;
+		SetTerminationValue(2);
+		return;
+#endif
+	} else if (mode == "h235") {
+#ifdef HAS_H235_MEDIA
+		m_mode = H235Mode;
+#else
+		cerr << "H.235 mode needs H.235 media support" << endl;
+		SetTerminationValue(2);
+		return;
+#endif
+	} else if (mode != "plain") {
+		Usage();
+		SetTerminationValue(2);
+		return;
+	}
+
+	if (!CreateSessions()) {
+		SetTerminationValue(2);
+		return;
+	}
+
+	// side A receives the reverse direction, side B the forward direction
+	DirectionStats forward, reverse;
+	forward.m_sessions.resize(m_numSessions);
+	reverse.m_sessions.resize(m_numSessions);
+	const bool multiplexed = (m_mode == MultiplexMode);
+	BenchReceiver * receivers[4] = {
+		new BenchReceiver(m_rtpB, forward, false, multiplexed),
+		new BenchReceiver(m_rtcpB, forward, true, multiplexed),
+		new BenchReceiver(m_rtpA, reverse, false, false),
+		new BenchReceiver(m_rtcpA, reverse, true, false)
+	};
+
+	cout << "Sessions: " << m_numSessions << "  Handlers: " << m_numHandlers
+		<< "  Mode: " << mode << (m_bidirectional ? "" : " (unidirectional)")
+		<< "  Rate: " << rate << " pps  Payload: " << payloadSize << " bytes" << endl;
+
+	BYTE packet[DEFAULT_PACKET_BUFFER_SIZE];
+	memset(packet, 0, sizeof(packet));
+	// RTCP receiver report without report blocks
+	BYTE rtcp[8] = { 0x80, 201, 0, 1, 0, 0, 0, 0 };
+	const unsigned rtcpInterval = std::max(1U, rate * 5);	// every 5 seconds
+
+	const PTime startTime;
+	for (unsigned h = 0; h < m_numHandlers; ++h)
+		m_handlers[h]->UpdateLoad(startTime);
+	const PInt64 start = startTime.GetTimestamp();
+	const PInt64 interval = 1000000 / rate;
+	const unsigned ticks = duration * rate;
+	for (unsigned tick = 0; tick < ticks; ++tick) {
+		// send one packet per session and direction in each interval
+		const PInt64 due = start + tick * interval;
+		const PInt64 now = PTime().GetTimestamp();
+		if (due > now + 1000)
+			PThread::Sleep((unsigned)((due - now) / 1000));
+		packet[0] = 0x80;
+		packet[1] = RTPPayloadTypePCMU;
+		packet[2] = (BYTE)(tick >> 8);
+		packet[3] = (BYTE)tick;
+		for (unsigned i = 0; i < m_numSessions; ++i) {
+			const DWORD sentTime = Now32();
+			packet[4] = (BYTE)(sentTime >> 24);
+			packet[5] = (BYTE)(sentTime >> 16);
+			packet[6] = (BYTE)(sentTime >> 8);
+			packet[7] = (BYTE)sentTime;
+			packet[8] = (BYTE)(i >> 24);
+			packet[9] = (BYTE)(i >> 16);
+			packet[10] = (BYTE)(i >> 8);
+			packet[11] = (BYTE)i;
+			Send(m_rtpA, packet, RTPHeaderLength + payloadSize, m_proxyPorts[i]);
+			++forward.m_sent;
+			if (m_bidirectional) {
+				Send(m_rtpB, packet, RTPHeaderLength + payloadSize, m_proxyPorts[i]);
+				++reverse.m_sent;
+			}
+			if (tick % rtcpInterval == 0) {
+				memcpy(rtcp + 4, packet + 8, 4);
+				Send(m_rtcpA, rtcp, sizeof(rtcp), m_proxyRTCPPorts[i]);
+				++forward.m_rtcpSent;
+				if (m_bidirectional) {
+					Send(m_rtcpB, rtcp, sizeof(rtcp), m_proxyRTCPPorts[i]);
+					++reverse.m_rtcpSent;
+				}
+			}
+		}
+	}
+	const PTime endTime;
+	for (unsigned h = 0; h < m_numHandlers; ++h)
+		m_handlers[h]->UpdateLoad(endTime);
+	const double seconds = (endTime - startTime).GetMilliSeconds() / 1000.0;
+
+	// let the packets in flight arrive
+	PThread::Sleep(500);
+	for (unsigned r = 0; r < 4; ++r) {
+		receivers[r]->Stop();
+		receivers[r]->WaitForTermination();
+		delete receivers[r];
+	}
+
+	cout << '\n' << setw(6) << "Dir" << setw(10) << "Sent" << setw(10) << "Received" << setw(8) << "Lost"
+		<< setw(10) << "pps" << setw(9) << "p50(us)" << setw(9) << "p90(us)" << setw(9) << "p99(us)"
+		<< setw(9) << "max(us)" << setw(11) << "jitter(us)" << setw(12) << "RTCP" << '\n';
+	Report(forward, "A->B", seconds);
+	if (m_bidirectional)
+		Report(reverse, "B->A", seconds);
+	cout << '\n';
+	for (unsigned h = 0; h < m_numHandlers; ++h)
+		cout << m_handlers[h]->GetName() << ": " << m_handlers[h]->GetPacketsPerSecond() << " pps, "
+			<< m_handlers[h]->GetBusyPercent() << "% busy\n";
+	cout << endl;
+
+	// the handlers delete their sockets and themselves
+	for (unsigned h = 0; h < m_numHandlers; ++h)
+		m_handlers[h]->Stop();
+	PThread::Sleep(200);
+
+	SetTerminationValue(forward.m_received < forward.m_sent || reverse.m_received < reverse.m_sent ? 1 : 0);
+}
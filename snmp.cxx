@@ -18,7 +18,9 @@
 #include "snmp.h"
 #include "gk.h"
 #include "job.h"
+#include "RasSrv.h"
 #include "SoftPBX.h"
+#include "Neighbor.h"
 
 void ReloadHandler();
 
@@ -34,6 +36,209 @@ const char * const SuccessfulCallsOIDStr = "1.3.6.1.4.1.27938.11.1.8";
 const char * const severityOIDStr        = "1.3.6.1.4.1.27938.11.2.1";
 const char * const groupOIDStr           = "1.3.6.1.4.1.27938.11.2.2";
 const char * const displayMsgOIDStr      = "1.3.6.1.4.1.27938.11.2.3";
+const char * const StatusObjectsOIDStr   = "1.3.6.1.4.1.27938.11.1";
+
+namespace {
+// tables below gnugkStatusObjects
+const unsigned GatewayTable = 9;
+const unsigned NeighborTable = 10;
+
+// columns of the gateway table
+enum { GwIndex = 1, GwEndpointId, GwAlias, GwIP, GwActiveCalls, GwTotalCalls };
+// columns of the neighbor table
+enum { NbIndex = 1, NbId, NbGkId, NbIP, NbStatus };
+
+// values of the neighbor status column
+enum { NbActive = 1, NbDisabled = 2 };
+}
+
+
+SNMPCache::SNMPCache() : Singleton<SNMPCache>("SNMPCache"), m_nextGatewayIndex(1)
+{
+	m_statusOID = ToOID(StatusObjectsOIDStr);
+}
+
+SNMPCache::OID SNMPCache::ToOID(const PString & str)
+{
+	OID oid;
+	const PStringArray parts = str.Tokenise(".", FALSE);
+	for (PINDEX i = 0; i < parts.GetSize(); ++i)
+		oid.push_back(parts[i].AsUnsigned());
+	return oid;
+}
+
+PString SNMPCache::AsString(const OID & oid)
+{
+	PString str;
+	for (OID::size_type i = 0; i < oid.size(); ++i) {
+		if (i > 0)
+			str += '.';
+		str += PString(PString::Unsigned, oid[i]);
+	}
+	return str;
+}
+
+SNMPCache::OID SNMPCache::CellOID(unsigned table, unsigned column, unsigned index) const
+{
+	OID oid = m_statusOID;
+	oid.push_back(table);
+	oid.push_back(1);	// table entry
+	oid.push_back(column);
+	oid.push_back(index);
+	return oid;
+}
+
+void SNMPCache::SetCell(unsigned table, unsigned column, unsigned index, char type, unsigned number, const PString & str)
+{
+	Value & value = m_values[CellOID(table, column, index)];
+	value.m_type = type;
+	value.m_number = number;
+	value.m_string = str;
+}
+
+void SNMPCache::RemoveRows(unsigned table, unsigned index)
+{
+	// columns are stored one after another, with all rows for each column
+	std::map<OID, Value>::iterator i = m_values.lower_bound(CellOID(table, 0, 0));
+	const std::map<OID, Value>::iterator end = m_values.lower_bound(CellOID(table + 1, 0, 0));
+	while (i != end) {
+		if (index == 0 || i->first.back() == index)
+			m_values.erase(i++);
+		else
+			++i;
+	}
+}
+
+void SNMPCache::Load()
+{
+	std::vector<endptr> endpoints;
+	RegistrationTable::Instance()->GetEndpoints(endpoints);
+	for (std::vector<endptr>::const_iterator i = endpoints.begin(); i != endpoints.end(); ++i)
+		OnEndpointAdded(i->operator->());
+
+	const Neighbors::NeighborList * neighbors = RasServer::Instance()->GetNeighbors();
+	if (neighbors)
+		OnNeighborsLoaded(*neighbors);
+}
+
+void SNMPCache::OnEndpointAdded(const EndpointRec * ep)
+{
+	if (!ep || !ep->IsGateway())
+		return;
+
+	const H225_ArrayOf_AliasAddress aliases = ep->GetAliases();
+	const PString alias = (aliases.GetSize() > 0) ? ::AsString(aliases[0], false) : PString::Empty();
+	const PString ip = AsDotString(ep->GetCallSignalAddress());
+
+	WriteLock lock(m_lock);
+	std::map<const EndpointRec *, unsigned>::iterator i = m_gateways.find(ep);
+	const unsigned index = (i != m_gateways.end()) ? i->second : m_nextGatewayIndex++;
+	m_gateways[ep] = index;
+	SetCell(GatewayTable, GwIndex, index, 'u', index);
+	SetCell(GatewayTable, GwEndpointId, index, 's', 0, ep->GetEndpointIdentifier().GetValue());
+	SetCell(GatewayTable, GwAlias, index, 's', 0, alias);
+	SetCell(GatewayTable, GwIP, index, 's', 0, ip);
+	SetCell(GatewayTable, GwActiveCalls, index, 'u', ep->GetActiveCalls());
+	SetCell(GatewayTable, GwTotalCalls, index, 'c', ep->GetTotalCalls());
+}
+
+void SNMPCache::OnEndpointUpdated(const EndpointRec * ep)
+{
+	if (ep && ep->IsGateway())
+		OnEndpointAdded(ep); // refreshes the existing row
+	else
+		OnEndpointRemoved(ep);
+}
+
+void SNMPCache::OnEndpointRemoved(const EndpointRec * ep)
+{
+	WriteLock lock(m_lock);
+	std::map<const EndpointRec *, unsigned>::iterator i = m_gateways.find(ep);
+	if (i != m_gateways.end()) {
+		RemoveRows(GatewayTable, i->second);
+		m_gateways.erase(i);
+	}
+}
+
+void SNMPCache::OnEndpointsCleared()
+{
+	WriteLock lock(m_lock);
+	RemoveRows(GatewayTable);
+	m_gateways.clear();
+}
+
+void SNMPCache::OnCallAdded(const EndpointRec * ep)
+{
+	if (!ep || !ep->IsGateway())
+		return;
+
+	WriteLock lock(m_lock);
+	std::map<const EndpointRec *, unsigned>::iterator i = m_gateways.find(ep);
+	if (i != m_gateways.end()) {
+		++m_values[CellOID(GatewayTable, GwActiveCalls, i->second)].m_number;
+		++m_values[CellOID(GatewayTable, GwTotalCalls, i->second)].m_number;
+	}
+}
+
+void SNMPCache::OnCallRemoved(const EndpointRec * ep)
+{
+	if (!ep || !ep->IsGateway())
+		return;
+
+	WriteLock lock(m_lock);
+	std::map<const EndpointRec *, unsigned>::iterator i = m_gateways.find(ep);
+	if (i != m_gateways.end()) {
+		Value & activeCalls = m_values[CellOID(GatewayTable, GwActiveCalls, i->second)];
+		if (activeCalls.m_number > 0)
+			--activeCalls.m_number;
+	}
+}
+
+void SNMPCache::OnNeighborsLoaded(const std::list<Neighbors::Neighbor *> & neighbors)
+{
+	WriteLock lock(m_lock);
+	RemoveRows(NeighborTable);
+	m_neighbors.clear();
+	unsigned index = 1;
+	for (std::list<Neighbors::Neighbor *>::const_iterator i = neighbors.begin(); i != neighbors.end(); ++i, ++index) {
+		const Neighbors::Neighbor * nb = *i;
+		m_neighbors[nb] = index;
+		SetCell(NeighborTable, NbIndex, index, 'u', index);
+		SetCell(NeighborTable, NbId, index, 's', 0, nb->GetId());
+		SetCell(NeighborTable, NbGkId, index, 's', 0, nb->GetGkId());
+		SetCell(NeighborTable, NbIP, index, 's', 0, ::AsString(nb->GetIP(), nb->GetPort()));
+		SetCell(NeighborTable, NbStatus, index, 'u', nb->IsDisabled() ? NbDisabled : NbActive);
+	}
+}
+
+void SNMPCache::OnNeighborStatus(const Neighbors::Neighbor * nb)
+{
+	WriteLock lock(m_lock);
+	std::map<const Neighbors::Neighbor *, unsigned>::iterator i = m_neighbors.find(nb);
+	if (i != m_neighbors.end())
+		SetCell(NeighborTable, NbStatus, i->second, 'u', nb->IsDisabled() ? NbDisabled : NbActive);
+}
+
+bool SNMPCache::Get(const OID & oid, Value & value) const
+{
+	ReadLock lock(m_lock);
+	std::map<OID, Value>::const_iterator i = m_values.find(oid);
+	if (i == m_values.end())
+		return false;
+	value = i->second;
+	return true;
+}
+
+bool SNMPCache::GetNext(OID & oid, Value & value) const
+{
+	ReadLock lock(m_lock);
+	std::map<OID, Value>::const_iterator i = m_values.upper_bound(oid);
+	if (i == m_values.end())
+		return false;
+	oid = i->first;
+	value = i->second;
+	return true;
+}
 
 
 #ifdef HAS_NETSNMP
@@ -57,6 +262,8 @@ static oid SuccessfulCallsOID[] = { 1, 3, 6, 1, 4, 1, 27938, 11, 1, 8 };
 static oid severityOID[]        = { 1, 3, 6, 1, 4, 1, 27938, 11, 2, 1 };
 static oid groupOID[]           = { 1, 3, 6, 1, 4, 1, 27938, 11, 2, 2 };
 static oid displayMsgOID[]      = { 1, 3, 6, 1, 4, 1, 27938, 11, 2, 3 };
+static oid GatewayTableOID[]    = { 1, 3, 6, 1, 4, 1, 27938, 11, 1, 9 };
+static oid NeighborTableOID[]   = { 1, 3, 6, 1, 4, 1, 27938, 11, 1, 10 };
 
 
 void SendNetSNMPTrap(unsigned trapNumber, SNMPLevel severity, SNMPGroup group, const PString & msg)
@@ -221,6 +428,42 @@ int catchall_handler(netsnmp_mib_handler * /* handler */,
 	return SNMPERR_SUCCESS;
 }
 
+static void set_cached_value(netsnmp_variable_list * var, const SNMPCache::Value & value)
+{
+	if (value.m_type == 's')
+		snmp_set_var_typed_value(var, ASN_OCTET_STR, (u_char *)((const char *)value.m_string), value.m_string.GetLength());
+	else
+		snmp_set_var_typed_integer(var, (value.m_type == 'c') ? ASN_COUNTER : ASN_UNSIGNED, value.m_number);
+}
+
+// gateway and neighbor tables, answered from the SNMPCache
+int table_handler(netsnmp_mib_handler * /* handler */,
+							netsnmp_handler_registration * reg,
+							netsnmp_agent_request_info * reqinfo,
+							netsnmp_request_info * requests)
+{
+    for (netsnmp_request_info *request = requests; request; request = request->next) {
+		netsnmp_variable_list * var = request->requestvb;
+		SNMPCache::OID key(var->name, var->name + var->name_length);
+		SNMPCache::Value value;
+		if (reqinfo->mode == MODE_GET) {
+			if (SNMPCache::Instance()->Get(key, value))
+				set_cached_value(var, value);
+			else
+				netsnmp_set_request_error(reqinfo, request, SNMP_NOSUCHINSTANCE);
+		} else if (reqinfo->mode == MODE_GETNEXT) {
+			if (!SNMPCache::Instance()->GetNext(key, value))
+				continue;	// end of the tables, the agent tries the next registration
+			std::vector<oid> next(key.begin(), key.end());
+			if (netsnmp_oid_is_subtree(reg->rootoid, reg->rootoid_len, &next[0], next.size()) != 0)
+				continue;	// past the end of this table
+			snmp_set_var_objid(var, &next[0], next.size());
+			set_cached_value(var, value);
+		}
+	}
+	return SNMPERR_SUCCESS;
+}
+
 } // extern "C"
 
 
@@ -308,6 +551,10 @@ void NetSNMPAgent::Run()
 		netsnmp_create_handler_registration("catchall", tracelevel_handler, TraceLevelOID, OID_LENGTH(TraceLevelOID), HANDLER_CAN_RWRITE));
 	netsnmp_register_scalar(
 		netsnmp_create_handler_registration("catchall", catchall_handler, CatchAllOID, OID_LENGTH(CatchAllOID), HANDLER_CAN_RWRITE));
+	netsnmp_register_handler(
+		netsnmp_create_handler_registration("gateway table", table_handler, GatewayTableOID, OID_LENGTH(GatewayTableOID), HANDLER_CAN_RONLY));
+	netsnmp_register_handler(
+		netsnmp_create_handler_registration("neighbor table", table_handler, NeighborTableOID, OID_LENGTH(NeighborTableOID), HANDLER_CAN_RONLY));
 
 	init_snmp(agent_name);   // reads $HOME/.snmp/gnugk-agent.conf + $HOME/.snmp/agentx.conf
 
@@ -464,6 +711,16 @@ void SetRFC1155Object(PRFC1155_ObjectSyntax & obj, const PString & str)
 	obj = *newObj;
 }
 
+void SetRFC1155Object(PRFC1155_ObjectSyntax & obj, const SNMPCache::Value & value)
+{
+	if (value.m_type == 's')
+		SetRFC1155Object(obj, value.m_string);
+	else if (value.m_type == 'c')
+		SetRFC1155CounterObject(obj, value.m_number);
+	else
+		SetRFC1155Object(obj, value.m_number);
+}
+
 PBoolean PTLibSNMPAgent::MIB_LocalMatch(PSNMP_PDU & answerPDU)
 {
 	PSNMP_VarBindList & vars = answerPDU.m_variable_bindings;
@@ -497,6 +754,13 @@ PBoolean PTLibSNMPAgent::MIB_LocalMatch(PSNMP_PDU & answerPDU)
 				catchAllDest = GkConfig()->GetString("Routing::CatchAll", "CatchAllAlias", "catchall");
 			SetRFC1155Object(vars[i].m_value, catchAllDest);
 			found = true;
+		} else {
+			// gateway and neighbor tables
+			SNMPCache::Value value;
+			if (SNMPCache::Instance()->Get(SNMPCache::ToOID(vars[i].m_name.AsString()), value)) {
+				SetRFC1155Object(vars[i].m_value, value);
+				found = true;
+			}
 		}
 	}
 
@@ -607,6 +871,12 @@ PString WindowsSNMPAgent::HandleRequest(const PString & request)
 				catchAllDest = GkConfig()->GetString("Routing::CatchAll", "CatchAllAlias", "catchall");
 			return "GET_RESPONSE s " + catchAllDest;
 		}
+		// gateway and neighbor tables
+		SNMPCache::Value value;
+		if (SNMPCache::Instance()->Get(SNMPCache::ToOID(token[1]), value)) {
+			return "GET_RESPONSE " + PString(value.m_type) + " "
+				+ ((value.m_type == 's') ? value.m_string : PString(PString::Unsigned, value.m_number));
+		}
 	} else if ((token.GetSize() == 3) && (token[0] == "SET")) {
 		if (token[1] == TraceLevelOIDStr + PString(".0")) {
 			PTrace::SetLevel(token[2].AsUnsigned());
@@ -700,6 +970,8 @@ void SendSNMPTrap(unsigned trapNumber, SNMPLevel severity, SNMPGroup group, cons
 
 void StartSNMPAgent()
 {
+	SNMPCache::Instance()->Load();
+
 	PCaselessString implementation = SelectSNMPImplementation();
 #ifdef HAS_NETSNMP
 	if (implementation == "Net-SNMP") {
@@ -740,6 +1012,9 @@ void StopSNMPAgent()
 
 void DeleteSNMPAgent()
 {
+	if (SNMPCache::InstanceExists()) {
+		delete SNMPCache::Instance();
+	}
 #ifdef HAS_NETSNMP
 	if (NetSNMPAgent::InstanceExists()) {
 		delete NetSNMPAgent::Instance();
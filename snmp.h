@@ -18,7 +18,11 @@
 
 #ifdef HAS_SNMP
 
+#include <list>
+#include <map>
+#include <vector>
 #include "Toolkit.h"
+#include "rwlock.h"
 
 const char * const SNMPSection = "SNMP";
 
@@ -35,9 +39,86 @@ void SendSNMPTrap(unsigned trapNumber, SNMPLevel severity, SNMPGroup group, cons
 
 #define SNMP_TRAP(NO,LEVEL,GROUP,MSG) if (Toolkit::Instance()->IsSNMPEnabled()) { SendSNMPTrap(NO,LEVEL,GROUP,MSG); }
 
+namespace Neighbors { class Neighbor; }
+
+/** Values of the GnuGk MIB tables (gateways and neighbors).
+
+    The values are updated when gateways register and unregister, when calls
+    start and end and when the status of a neighbor changes, so SNMP requests
+    are answered from the cache and never lock the registration or call table.
+    The cache only exists while SNMP is enabled, it is created and loaded
+    when the SNMP agent starts.
+*/
+class SNMPCache : public Singleton<SNMPCache> {
+public:
+	typedef std::vector<unsigned> OID;
+
+	/// a MIB value
+	struct Value {
+		Value() : m_type('u'), m_number(0) { }
+
+		char m_type; /// 's' = string, 'u' = gauge, 'c' = counter
+		PString m_string;
+		unsigned m_number;
+	};
+
+	SNMPCache();
+
+	/// fill the tables from the registration table and the neighbor list
+	void Load();
+
+	/// a gateway has been added to the registration table
+	void OnEndpointAdded(const EndpointRec * ep);
+	/// the aliases, addresses or type of a registered endpoint have changed
+	void OnEndpointUpdated(const EndpointRec * ep);
+	/// a gateway has been removed from the registration table
+	void OnEndpointRemoved(const EndpointRec * ep);
+	/// all endpoints have been removed from the registration table
+	void OnEndpointsCleared();
+	/// a call to or from the endpoint has started
+	void OnCallAdded(const EndpointRec * ep);
+	/// a call to or from the endpoint has ended
+	void OnCallRemoved(const EndpointRec * ep);
+	/// the neighbor configuration has been (re)loaded
+	void OnNeighborsLoaded(const std::list<Neighbors::Neighbor *> & neighbors);
+	/// a neighbor has been enabled or disabled
+	void OnNeighborStatus(const Neighbors::Neighbor * nb);
+
+	/** Get the value for a table cell.
+
+	    @return	true if the OID exists
+	*/
+	bool Get(const OID & oid, Value & value) const;
+
+	/** Get the value for the next table cell, used to walk the tables.
+
+	    @return	true if there is a next OID, #oid# is set to it
+	*/
+	bool GetNext(OID & oid, Value & value) const;
+
+	static OID ToOID(const PString & str);
+	static PString AsString(const OID & oid);
+
+private:
+	OID CellOID(unsigned table, unsigned column, unsigned index) const;
+	void SetCell(unsigned table, unsigned column, unsigned index, char type, unsigned number, const PString & str = PString::Empty());
+	void RemoveRows(unsigned table, unsigned index = 0);
+
+	mutable PReadWriteMutex m_lock;
+	OID m_statusOID;
+	std::map<OID, Value> m_values;
+	std::map<const EndpointRec *, unsigned> m_gateways; /// row index of each gateway
+	std::map<const Neighbors::Neighbor *, unsigned> m_neighbors; /// row index of each neighbor
+	unsigned m_nextGatewayIndex;
+};
+
+// the cache is created by StartSNMPAgent, it isn't maintained without an agent
+#define SNMP_CACHE(EVENT) if (Toolkit::Instance()->IsSNMPEnabled() && SNMPCache::InstanceExists()) { SNMPCache::Instance()->EVENT; }
+
 #else // HAS_SNMP
 
 #define SNMP_TRAP(NO,LEVEL,GROUP,MSG)
+#define SNMP_CACHE(EVENT)
 
 #endif // HAS_SNMP
 
@@ -21,12 +21,44 @@
 
 using std::vector;
 
+/// stores the result of an accounting query executed by a database thread
+class SQLAcct::AsyncQuery : public GkSQLConnection::QueryCallback {
+public:
+	AsyncQuery(
+		SQLAcct * acct,
+		GkAcctLogger::AcctEvent evt,
+		const PString & target,
+		const PString & queryAlt,
+		const std::map<PString, PString> & params
+		) : m_acct(acct), m_evt(evt), m_target(target), m_queryAlt(queryAlt), m_params(params) { }
+
+	virtual void OnQueryDone(GkSQLResult * result)
+	{
+		m_acct->StoreResult(result, m_evt, m_target, m_queryAlt, m_params);
+		delete this;
+	}
+
+	virtual void OnQueryCancelled()
+	{
+		PTRACE(2, "GKACCT\t" << m_acct->GetName() << " dropped accounting "
+			"data (event: " << m_evt << ", " << m_target << "): module is being deleted");
+		delete this;
+	}
+
+private:
+	SQLAcct * m_acct;
+	GkAcctLogger::AcctEvent m_evt;
+	PString m_target;
+	PString m_queryAlt;
+	std::map<PString, PString> m_params;
+};
+
 
 SQLAcct::SQLAcct(
 	const char* moduleName,
 	const char* cfgSecName
 	) : GkAcctLogger(moduleName, cfgSecName),
-	m_sqlConn(NULL)
+	m_sqlConn(NULL), m_asyncQueries(false)
 {
 	SetSupportedEvents(SQLAcctEvents);
 
@@ -139,6 +171,7 @@ SQLAcct::SQLAcct(
 	}
 
 	m_timestampFormat = cfg->GetString(cfgSec, "TimestampFormat", "");
+	m_asyncQueries = Toolkit::AsBool(cfg->GetString(cfgSec, "AsyncQueries", "0"));
 }
 
 SQLAcct::~SQLAcct()
@@ -199,59 +232,10 @@ GkAcctLogger::Status SQLAcct::Log(GkAcctLogger::AcctEvent evt, const callptr & c
     } else {
         SetupAcctParams(params, call, m_timestampFormat);
     }
-	GkSQLResult* result = m_sqlConn->ExecuteQuery(query, params);
-	if (result == NULL) {
-		PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
-			"data (event: " << evt << ", call: " << callNumber << "): timeout or fatal error");
-		SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
-	}
-
-	if (result) {
-		if (result->IsValid()) {
-			if (result->GetNumRows() < 1) {
-				PTRACE(4, "GKACCT\t" << GetName() << " failed to store accounting "
-					"data (event: " << evt << ", call: " << callNumber
-					<< "): no rows have been updated");
-				SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
-				delete result;
-				result = NULL;
-			}
-		} else {
-			PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
-				"data (event: " << evt << ", call: " << callNumber
-				<< "): (" << result->GetErrorCode() << ") " << result->GetErrorMessage());
-			SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
-			delete result;
-			result = NULL;
-		}
-	}
-
-	if (result == NULL && !queryAlt) {
-		result = m_sqlConn->ExecuteQuery(queryAlt, params);
-		if (result == NULL) {
-			PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
-				"data (event: " << evt << ", call: " << callNumber << "): timeout or fatal error");
-			SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
-		} else {
-			if (result->IsValid()) {
-				if (result->GetNumRows() < 1) {
-					PTRACE(4, "GKACCT\t" << GetName() << " failed to store accounting "
-						"data (event: " << evt << ", call: " << callNumber
-						<< "): no rows have been updated");
-					SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
-				}
-			} else {
-				PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
-					"data (event: " << evt << ", call: " << callNumber
-					<< "): (" << result->GetErrorCode() << ") " << result->GetErrorMessage());
-				SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
-			}
-		}
-	}
-
-	const bool succeeded = result != NULL && result->IsValid();
-	delete result;
-	return succeeded ? Ok : Fail;
+	const PString target = "call: " + PString(callNumber);
+	if (m_asyncQueries && evt != AcctOn && evt != AcctOff)
+		return LogAsync(evt, target, query, queryAlt, params);
+	return StoreResult(m_sqlConn->ExecuteQuery(query, params), evt, target, queryAlt, params) ? Ok : Fail;
 }
 
 GkAcctLogger::Status SQLAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep)
@@ -285,10 +269,43 @@ GkAcctLogger::Status SQLAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 
 	std::map<PString, PString> params;
 	SetupAcctEndpointParams(params, ep, m_timestampFormat);
-	GkSQLResult* result = m_sqlConn->ExecuteQuery(query, params);
+	const PString target = "endpoint: " + epid;
+	if (m_asyncQueries)
+		return LogAsync(evt, target, query, PString::Empty(), params);
+	return StoreResult(m_sqlConn->ExecuteQuery(query, params), evt, target, PString::Empty(), params) ? Ok : Fail;
+}
+
+GkAcctLogger::Status SQLAcct::LogAsync(
+	AcctEvent evt,
+	const PString & target,
+	const PString & query,
+	const PString & queryAlt,
+	const std::map<PString, PString> & params
+	)
+{
+	// the events of a call or an endpoint are stored in order
+	AsyncQuery * callback = new AsyncQuery(this, evt, target, queryAlt, params);
+	if (m_sqlConn->ExecuteQueryAsync(query, params, callback, -1, target))
+		return Ok;
+	delete callback;
+
+	// the queue is full, wait for the database instead
+	PTRACE(3, "GKACCT\t" << GetName() << " executing query for event " << evt
+		<< ", " << target << " directly");
+	return StoreResult(m_sqlConn->ExecuteQuery(query, params), evt, target, queryAlt, params) ? Ok : Fail;
+}
+
+bool SQLAcct::StoreResult(
+	GkSQLResult * result,
+	AcctEvent evt,
+	const PString & target,
+	const PString & queryAlt,
+	const std::map<PString, PString> & params
+	)
+{
 	if (result == NULL) {
 		PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
-			"data (event: " << evt << ", endpoint: " << epid << "): timeout or fatal error");
+			"data (event: " << evt << ", " << target << "): timeout or fatal error");
 		SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
 	}
 
@@ -296,7 +313,7 @@ GkAcctLogger::Status SQLAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 		if (result->IsValid()) {
 			if (result->GetNumRows() < 1) {
 				PTRACE(4, "GKACCT\t" << GetName() << " failed to store accounting "
-					"data (event: " << evt << ", endpoint: " << epid
+					"data (event: " << evt << ", " << target
 					<< "): no rows have been updated");
 				SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
 				delete result;
@@ -304,7 +321,7 @@ GkAcctLogger::Status SQLAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 			}
 		} else {
 			PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
-				"data (event: " << evt << ", endpoint: " << epid
+				"data (event: " << evt << ", " << target
 				<< "): (" << result->GetErrorCode() << ") " << result->GetErrorMessage());
 			SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
 			delete result;
@@ -312,9 +329,32 @@ GkAcctLogger::Status SQLAcct::Log(GkAcctLogger::AcctEvent evt, const endptr & ep
 		}
 	}
 
+	if (result == NULL && !queryAlt) {
+		result = m_sqlConn->ExecuteQuery(queryAlt, params);
+		if (result == NULL) {
+			PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
+				"data (event: " << evt << ", " << target << "): timeout or fatal error");
+			SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
+		} else {
+			if (result->IsValid()) {
+				if (result->GetNumRows() < 1) {
+					PTRACE(4, "GKACCT\t" << GetName() << " failed to store accounting "
+						"data (event: " << evt << ", " << target
+						<< "): no rows have been updated");
+					SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
+				}
+			} else {
+				PTRACE(2, "GKACCT\t" << GetName() << " failed to store accounting "
+					"data (event: " << evt << ", " << target
+					<< "): (" << result->GetErrorCode() << ") " << result->GetErrorMessage());
+				SNMP_TRAP(5, SNMPError, Accounting, "Failed to store event");
+			}
+		}
+	}
+
 	const bool succeeded = result != NULL && result->IsValid();
 	delete result;
-	return succeeded ? Ok : Fail;
+	return succeeded;
 }
 
 PString SQLAcct::GetInfo()
@@ -332,6 +372,11 @@ PString SQLAcct::GetInfo()
 		result += "  Idle Connections:            " + PString(info.m_idleConnections) + "\r\n";
 		result += "  Busy Connections::           " + PString(info.m_busyConnections) + "\r\n";
 		result += "  Waiting Requests:            " + PString(info.m_waitingRequests) + "\r\n";
+		result += "  Queued Async Queries:        " + PString(info.m_queuedAsyncQueries) + "\r\n";
+		result += "  Modules Sharing the Pool:    " + PString(info.m_poolUsers) + "\r\n";
+		result += "  Database Hosts:              " + info.m_hosts + "\r\n";
+		result += "  Connection Wait Times:       " + GkSQLConnection::PrintHistogram(info.m_waitTime) + "\r\n";
+		result += "  Query Execution Times:       " + GkSQLConnection::PrintHistogram(info.m_execTime) + "\r\n";
 	}
 
 	result += ";\r\n";
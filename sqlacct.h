@@ -24,6 +24,7 @@
     parameters.
 */
 class GkSQLConnection;
+class GkSQLResult;
 class SQLAcct : public GkAcctLogger
 {
 public:
@@ -72,6 +73,34 @@ private:
 	/* No operator= allowed */
 	SQLAcct& operator=(const SQLAcct&);
 
+	/// Queue the query, the result is checked by a database thread,
+	/// executes the query directly if the queue is full
+	Status LogAsync(
+		AcctEvent evt, /// accounting event to log
+		const PString & target, /// call or endpoint for log messages
+		const PString & query, /// query to execute
+		const PString & queryAlt, /// query to execute if the first one fails
+		const std::map<PString, PString> & params /// query parameters
+		);
+
+	/** Check the query result and execute the alternative query if it failed.
+	    Deletes the result.
+
+		@return
+		true if the accounting data has been stored
+	*/
+	bool StoreResult(
+		GkSQLResult * result, /// query result, NULL on timeout
+		AcctEvent evt, /// accounting event to log
+		const PString & target, /// call or endpoint for log messages
+		const PString & queryAlt, /// query to execute if the first one fails
+		const std::map<PString, PString> & params /// query parameters
+		);
+
+	/// query callback for AsyncQueries=1, defined in sqlacct.cxx
+	class AsyncQuery;
+	friend class AsyncQuery;
+
 private:
 	/// connection to the SQL database
 	GkSQLConnection* m_sqlConn;
@@ -97,6 +126,8 @@ private:
 	PString m_offQuery;
 	/// timestamp formatting string
 	PString m_timestampFormat;
+	/// queue call and endpoint queries instead of waiting for the database
+	bool m_asyncQueries;
 };
 
 #endif /* SQLACCT_H */
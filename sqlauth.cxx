@@ -352,6 +352,11 @@ PString SQLPasswordAuth::GetInfo()
 		result += "  Idle Connections:            " + PString(info.m_idleConnections) + "\r\n";
 		result += "  Busy Connections::           " + PString(info.m_busyConnections) + "\r\n";
 		result += "  Waiting Requests:            " + PString(info.m_waitingRequests) + "\r\n";
+		result += "  Queued Async Queries:        " + PString(info.m_queuedAsyncQueries) + "\r\n";
+		result += "  Modules Sharing the Pool:    " + PString(info.m_poolUsers) + "\r\n";
+		result += "  Database Hosts:              " + info.m_hosts + "\r\n";
+		result += "  Connection Wait Times:       " + GkSQLConnection::PrintHistogram(info.m_waitTime) + "\r\n";
+		result += "  Query Execution Times:       " + GkSQLConnection::PrintHistogram(info.m_execTime) + "\r\n";
 	}
 
 	result += ";\r\n";
@@ -439,6 +444,11 @@ PString SQLAliasAuth::GetInfo()
 		result += "  Idle Connections:            " + PString(info.m_idleConnections) + "\r\n";
 		result += "  Busy Connections::           " + PString(info.m_busyConnections) + "\r\n";
 		result += "  Waiting Requests:            " + PString(info.m_waitingRequests) + "\r\n";
+		result += "  Queued Async Queries:        " + PString(info.m_queuedAsyncQueries) + "\r\n";
+		result += "  Modules Sharing the Pool:    " + PString(info.m_poolUsers) + "\r\n";
+		result += "  Database Hosts:              " + info.m_hosts + "\r\n";
+		result += "  Connection Wait Times:       " + GkSQLConnection::PrintHistogram(info.m_waitTime) + "\r\n";
+		result += "  Query Execution Times:       " + GkSQLConnection::PrintHistogram(info.m_execTime) + "\r\n";
 	}
 
 	result += ";\r\n";
@@ -1043,6 +1053,11 @@ PString SQLAuth::GetInfo()
 		result += "  Idle Connections:            " + PString(info.m_idleConnections) + "\r\n";
 		result += "  Busy Connections::           " + PString(info.m_busyConnections) + "\r\n";
 		result += "  Waiting Requests:            " + PString(info.m_waitingRequests) + "\r\n";
+		result += "  Queued Async Queries:        " + PString(info.m_queuedAsyncQueries) + "\r\n";
+		result += "  Modules Sharing the Pool:    " + PString(info.m_poolUsers) + "\r\n";
+		result += "  Database Hosts:              " + info.m_hosts + "\r\n";
+		result += "  Connection Wait Times:       " + GkSQLConnection::PrintHistogram(info.m_waitTime) + "\r\n";
+		result += "  Query Execution Times:       " + GkSQLConnection::PrintHistogram(info.m_execTime) + "\r\n";
 	}
 
 	result += ";\r\n";
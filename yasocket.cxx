@@ -541,7 +541,7 @@ int YaTCPSocket::os_send(const void * buf, int sz)
 
 
 // class YaUDPSocket
-YaUDPSocket::YaUDPSocket(WORD port, int iAddressFamily)
+YaUDPSocket::YaUDPSocket(WORD port, int iAddressFamily) : m_reusePort(false)
 {
 	memset(&recvaddr, 0, sizeof(recvaddr));
 	((struct sockaddr*)&sendaddr)->sa_family = iAddressFamily;
@@ -572,6 +572,10 @@ bool YaUDPSocket::Listen(const Address & addr, unsigned, WORD pt, PSocket::Reusa
 		return false;
 	if (!SetOption(SO_REUSEADDR, reuse == PSocket::CanReuseAddress ? 1 : 0))
 		return false;
+#ifdef SO_REUSEPORT
+	if (m_reusePort && !SetOption(SO_REUSEPORT, 1))
+		return false;
+#endif
 	return Bind(addr, pt);
 }
 
@@ -129,6 +129,8 @@ public:
 #ifdef hasIPV6
 	bool DualStackListen(const Address & localAddr, WORD port);
 #endif
+	// let several sockets bind the same port (SO_REUSEPORT), must be set before Listen()
+	void SetReusePort(bool reuse) { m_reusePort = reuse; }
 	void GetLastReceiveAddress(Address &, WORD &) const;
 	void SetSendAddress(const Address &, WORD);
 	/// Get the address to use for connectionless Write().
@@ -155,6 +157,7 @@ private:
 #else
 	sockaddr_in recvaddr, sendaddr;
 #endif
+	bool m_reusePort;
 };
 
 class YaSelectList {